@@ -0,0 +1,129 @@
+/* Generated from config.hin via autoheader for cmake; see bootstrap.sh. */
+
+/* Define is you are building for Win32 API */
+/* #undef BGDWIN32 */
+
+/* Whether to support gd image formats */
+#define ENABLE_GD_FORMATS 0
+
+/* Define to 1 if you have the <dirent.h> header file. */
+#define HAVE_DIRENT_H
+
+/* Define to 1 if you have the <dlfcn.h> header file. */
+/* #undef HAVE_DLFCN_H */
+
+/* Define if you have the ft2build.h header. */
+/* #undef HAVE_FT2BUILD_H */
+
+/* Define if you have the iconv() function and it works. */
+/* #undef HAVE_ICONV */
+
+/* Define to 1 if you have the <iconv.h> header file. */
+/* #undef HAVE_ICONV_H */
+
+/* Define if <iconv.h> defines iconv_t. */
+/* #undef HAVE_ICONV_T_DEF */
+
+/* Define to 1 if you have the <inttypes.h> header file. */
+#define HAVE_INTTYPES_H
+
+/* Define if you have fontconfig */
+/* #undef HAVE_LIBFONTCONFIG */
+
+/* Define if you have freetype */
+/* #undef HAVE_LIBFREETYPE */
+
+/* Define if you have liq */
+/* #undef HAVE_LIBIMAGEQUANT */
+
+/* Define if you have jpeg */
+/* #undef HAVE_LIBJPEG */
+
+/* Define to 1 if you have the `m' library (-lm). */
+#define HAVE_LIBM
+
+/* Define if you have png */
+/* #undef HAVE_LIBPNG */
+
+/* Define if you have raqm */
+/* #undef HAVE_LIBRAQM */
+
+/* Define if you have tiff */
+/* #undef HAVE_LIBTIFF */
+
+/* Define if you have webp */
+/* #undef HAVE_LIBWEBP */
+
+/* Define if you have xpm */
+/* #undef HAVE_LIBXPM */
+
+/* Define if you have zlib */
+/* #undef HAVE_LIBZ */
+
+/* Define to 1 if you have the <memory.h> header file. */
+/* #undef HAVE_MEMORY_H */
+
+/* Define if OpenMP is enabled */
+/* #undef HAVE_OPENMP */
+
+/* Define if you have POSIX threads libraries and header files. */
+#define HAVE_PTHREAD
+
+/* Have PTHREAD_PRIO_INHERIT. */
+/* #undef HAVE_PTHREAD_PRIO_INHERIT */
+
+/* Define to 1 if you have the <stdint.h> header file. */
+#define HAVE_STDINT_H
+
+/* Define to 1 if you have the <strings.h> header file. */
+#define HAVE_STRINGS_H
+
+/* Define to 1 if you have the <sys/stat.h> header file. */
+#define HAVE_SYS_STAT_H
+
+/* Define to 1 if you have the <sys/types.h> header file. */
+#define HAVE_SYS_TYPES_H
+
+/* Define to 1 if you have the <unistd.h> header file. */
+#define HAVE_UNISTD_H
+
+/* Define to 1 or 0, depending whether the compiler supports simple visibility
+   declarations. */
+/* #undef HAVE_VISIBILITY */
+
+/* Define as const if the declaration of iconv() needs const. */
+/* #undef ICONV_CONST */
+
+/* Define to the sub-directory where libtool stores uninstalled libraries. */
+/* #undef LT_OBJDIR */
+
+/* Name of package */
+#define PACKAGE
+
+/* Define to the address where bug reports for this package should be sent. */
+/* #undef PACKAGE_BUGREPORT */
+
+/* Define to the full name of this package. */
+#define PACKAGE_NAME
+
+/* Define to the full name and version of this package. */
+/* #undef PACKAGE_STRING */
+
+/* Define to the one symbol short name of this package. */
+/* #undef PACKAGE_TARNAME */
+
+/* Define to the home page for this package. */
+/* #undef PACKAGE_URL */
+
+/* Define to the version of this package. */
+/* #undef PACKAGE_VERSION */
+
+/* Define to necessary symbol if this constant uses a non-standard name on
+   your system. */
+/* #undef PTHREAD_CREATE_JOINABLE */
+
+/* Define to 1 if you have the ANSI C header files. */
+/* #undef STDC_HEADERS */
+
+/* Version number of package */
+/* #undef VERSION */
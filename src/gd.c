@@ -143,10 +143,482 @@ static void gdImageTileApply (gdImagePtr im, int x, int y);
 
 BGD_DECLARE(int) gdImageGetTrueColorPixel (gdImagePtr im, int x, int y);
 
+/* The pixel rows of an image are carved out of a single block, whose
+   start is aligned to a page boundary, and each row is padded to a
+   multiple of GD_ROW_ALIGN bytes. */
+#define GD_PIXEL_BLOCK_ALIGN 4096
+#define GD_ROW_ALIGN 16
+
+static size_t gdRowStride (int sx, size_t pixelSize)
+{
+	return ((size_t) sx * pixelSize + GD_ROW_ALIGN - 1) & ~(size_t) (GD_ROW_ALIGN - 1);
+}
+
+/* Allocates a zeroed block for sy rows of stride bytes */
+static void *gdPixelBlockAlloc (size_t stride, int sy)
+{
+	if (sy != 0 && stride > (SIZE_MAX - GD_PIXEL_BLOCK_ALIGN) / sy) {
+		return NULL;
+	}
+	return gdCalloc (1, stride * sy + GD_PIXEL_BLOCK_ALIGN - 1);
+}
+
+/* The start of the first row in a block from gdPixelBlockAlloc() */
+static unsigned char *gdPixelBlockBase (void *block)
+{
+	return (unsigned char *) (((uintptr_t) block + GD_PIXEL_BLOCK_ALIGN - 1)
+	                          & ~(uintptr_t) (GD_PIXEL_BLOCK_ALIGN - 1));
+}
+
+/* Allocates the (zeroed) palette or truecolor pixel rows of an image of
+   im->sx * im->sy pixels. Returns non-zero on success. */
+int _gdImageAllocRows (gdImagePtr im, int trueColor)
+{
+	const size_t pixelSize = trueColor ? sizeof (int) : sizeof (unsigned char);
+	const size_t stride = gdRowStride (im->sx, pixelSize);
+	unsigned char **rows;
+	unsigned char *base;
+	void *block = NULL;
+	int y;
+
+	if (overflow2(sizeof (unsigned char *), im->sy)) {
+		return 0;
+	}
+	rows = (unsigned char **) gdMalloc (sizeof (unsigned char *) * im->sy);
+	if (!rows) {
+		return 0;
+	}
+
+	block = gdPixelBlockAlloc (stride, im->sy);
+	if (block) {
+		base = gdPixelBlockBase (block);
+		for (y = 0; y < im->sy; y++) {
+			rows[y] = base + y * stride;
+		}
+	} else {
+		/* Not enough contiguous memory; fall back to one allocation per row */
+		for (y = 0; y < im->sy; y++) {
+			rows[y] = (unsigned char *) gdCalloc (im->sx, pixelSize);
+			if (!rows[y]) {
+				while (--y >= 0) {
+					gdFree (rows[y]);
+				}
+				gdFree (rows);
+				return 0;
+			}
+		}
+	}
+
+	if (trueColor) {
+		im->tpixels = (int **) rows;
+		im->tpixelBlock = block;
+	} else {
+		im->pixels = rows;
+		im->pixelBlock = block;
+	}
+	return 1;
+}
+
+/* Storage of pixel rows shared by an image and its clones, which copy a
+   row out of it when they first write to it (see gdImageCloneShared()). It is
+   freed once no image refers to it anymore. */
+typedef struct gdImageRowShareStruct {
+	volatile long refs;
+	int trueColor;
+	int sy;
+	/* the rows are either carved out of one block ... */
+	void *block;
+	/* ... or allocated one by one */
+	void **rows;
+} gdImageRowShare;
+
+static void gdImageRowShareRelease (gdImageRowShare *share)
+{
+	int y;
+
+	if (gdAtomicDecrement (share->refs) != 0) {
+		return;
+	}
+	if (share->block) {
+		gdFree (share->block);
+	} else {
+		for (y = 0; y < share->sy; y++) {
+			gdFree (share->rows[y]);
+		}
+		gdFree (share->rows);
+	}
+	gdFree (share);
+}
+
+/* Frees the palette or truecolor pixel rows of an image, if any. */
+void _gdImageFreeRows (gdImagePtr im, int trueColor)
+{
+	void **rows = trueColor ? (void **) im->tpixels : (void **) im->pixels;
+	void *block = trueColor ? im->tpixelBlock : im->pixelBlock;
+	int y;
+
+	if (im->rowShare && im->rowShare->trueColor == trueColor) {
+		/* rows of our own, if any, were allocated one by one */
+		for (y = 0; y < im->sy; y++) {
+			if (!im->rowShared[y]) {
+				gdFree (rows[y]);
+			}
+		}
+		block = NULL;
+		gdImageRowShareRelease (im->rowShare);
+		gdFree (im->rowShared);
+		im->rowShare = NULL;
+		im->rowShared = NULL;
+		im->rowsShared = 0;
+		gdFree (rows);
+	} else if (rows) {
+		if (trueColor ? im->tpixelsBorrowed : im->pixelsBorrowed) {
+			/* the pixels belong to the caller */
+		} else if (block) {
+			gdFree (block);
+		} else {
+			for (y = 0; y < im->sy; y++) {
+				gdFree (rows[y]);
+			}
+		}
+		gdFree (rows);
+	}
+
+	if (trueColor) {
+		im->tpixels = NULL;
+		im->tpixelBlock = NULL;
+		im->tpixelsBorrowed = 0;
+	} else {
+		im->pixels = NULL;
+		im->pixelBlock = NULL;
+		im->pixelsBorrowed = 0;
+	}
+}
+
+/* Points the palette or truecolor rows of an image into a caller owned
+   buffer. Returns non-zero on success. */
+static int gdImageWrapRows (gdImagePtr im, int trueColor, void *buffer, int stride)
+{
+	const int pixelSize = trueColor ? sizeof (int) : sizeof (unsigned char);
+	unsigned char **rows;
+	int y;
+
+	if (stride < im->sx * pixelSize || stride % pixelSize != 0
+	        || ((uintptr_t) buffer) % pixelSize != 0) {
+		return 0;
+	}
+	rows = (unsigned char **) gdMalloc (sizeof (unsigned char *) * im->sy);
+	if (!rows) {
+		return 0;
+	}
+	for (y = 0; y < im->sy; y++) {
+		rows[y] = (unsigned char *) buffer + (size_t) y * stride;
+	}
+
+	if (trueColor) {
+		im->tpixels = (int **) rows;
+		im->tpixelBlock = buffer;
+		im->tpixelsBorrowed = 1;
+	} else {
+		im->pixels = rows;
+		im->pixelBlock = buffer;
+		im->pixelsBorrowed = 1;
+	}
+	return 1;
+}
+
 /**
  * Group: Creation and Destruction
  */
 
+/* Serializes the changes gdImageShareRows() makes to the source image,
+   which may be cloned by several threads at once */
+gdStaticMutexDeclare(gd_row_share_mutex);
+
+/* Hands the storage of src over to a gdImageRowShare, and copies the
+   rows of a partially written clone out of one, so that all of its rows
+   are shared. The mutex must be held. Returns non-zero on success. */
+static int gdImageShareAll (gdImagePtr src)
+{
+	const int trueColor = src->trueColor;
+	unsigned char **srcRows = trueColor ? (unsigned char **) src->tpixels : src->pixels;
+	gdImageRowShare *share;
+
+	if (src->rowShare && src->rowsShared < src->sy && !gdImageUnshare (src)) {
+		return 0;
+	}
+	if (src->rowShare) {
+		return 1;
+	}
+
+	src->rowShared = (unsigned char *) gdMalloc (src->sy);
+	share = (gdImageRowShare *) gdMalloc (sizeof (gdImageRowShare));
+	if (share) {
+		share->block = trueColor ? src->tpixelBlock : src->pixelBlock;
+		share->rows = NULL;
+		if (!share->block) {
+			share->rows = (void **) gdMalloc (sizeof (void *) * src->sy);
+		}
+	}
+	if (!src->rowShared || !share || (!share->block && !share->rows)) {
+		gdFree (src->rowShared);
+		src->rowShared = NULL;
+		gdFree (share);
+		return 0;
+	}
+	if (share->rows) {
+		memcpy (share->rows, srcRows, sizeof (void *) * src->sy);
+	}
+	share->refs = 1;
+	share->trueColor = trueColor;
+	share->sy = src->sy;
+	memset (src->rowShared, 1, src->sy);
+	src->rowsShared = src->sy;
+	src->rowShare = share;
+	if (trueColor) {
+		src->tpixelBlock = NULL;
+	} else {
+		src->pixelBlock = NULL;
+	}
+	return 1;
+}
+
+/* Lets dst, a new image without pixel rows, share the rows of src. The
+   storage of src is handed over to a gdImageRowShare on the first clone.
+   Returns non-zero on success. */
+static int gdImageShareRows (gdImagePtr src, gdImagePtr dst)
+{
+	const int trueColor = src->trueColor;
+	unsigned char **rows;
+	gdImageRowShare *share = NULL;
+	gdArenaPtr arena;
+
+	if (trueColor ? src->tpixelsBorrowed : src->pixelsBorrowed) {
+		return 0;
+	}
+
+	rows = (unsigned char **) gdMalloc (sizeof (unsigned char *) * src->sy);
+	if (!rows) {
+		return 0;
+	}
+	dst->rowShared = (unsigned char *) gdMalloc (src->sy);
+	if (!dst->rowShared) {
+		gdFree (rows);
+		return 0;
+	}
+
+	gdStaticMutexLock (gd_row_share_mutex);
+	/* what src keeps belongs where src lives, not to an arena bound to
+	   this thread for the clone */
+	arena = gdArenaUse (gdArenaOf (src));
+	if (gdImageShareAll (src)) {
+		share = src->rowShare;
+		gdAtomicIncrement (share->refs);
+		memcpy (rows, trueColor ? (unsigned char **) src->tpixels : src->pixels,
+		        sizeof (unsigned char *) * src->sy);
+	}
+	gdArenaUse (arena);
+	gdStaticMutexUnlock (gd_row_share_mutex);
+	if (!share) {
+		gdFree (dst->rowShared);
+		dst->rowShared = NULL;
+		gdFree (rows);
+		return 0;
+	}
+
+	memset (dst->rowShared, 1, src->sy);
+	dst->rowsShared = src->sy;
+	dst->rowShare = share;
+	if (trueColor) {
+		dst->tpixels = (int **) rows;
+	} else {
+		dst->pixels = rows;
+	}
+	return 1;
+}
+
+/* Copies row y of an image out of the storage it shares with clones, so
+   that it can be written to. Each row is allocated on its own, so that
+   writing to a few rows costs no more than these rows. Returns non-zero
+   on success. */
+int _gdImageUnshareRow (gdImagePtr im, int y)
+{
+	const int trueColor = im->rowShare->trueColor;
+	const size_t pixelSize = trueColor ? sizeof (int) : sizeof (unsigned char);
+	unsigned char **rows = trueColor ? (unsigned char **) im->tpixels : im->pixels;
+	unsigned char *row;
+	gdArenaPtr arena;
+
+	/* the rows belong where the image lives */
+	arena = gdArenaUse (gdArenaOf (im));
+	row = (unsigned char *) gdMalloc (im->sx * pixelSize);
+	gdArenaUse (arena);
+	if (!row) {
+		return 0;
+	}
+	memcpy (row, rows[y], im->sx * pixelSize);
+	rows[y] = row;
+	im->rowShared[y] = 0;
+
+	if (--im->rowsShared == 0) {
+		gdImageRowShareRelease (im->rowShare);
+		gdFree (im->rowShared);
+		im->rowShare = NULL;
+		im->rowShared = NULL;
+	}
+	return 1;
+}
+
+/**
+ * Function: gdImageUnshare
+ *
+ * Gives an image pixel storage of its own
+ *
+ * Images created by <gdImageCloneShared> share their pixel rows with the
+ * original image until they are written to. All drawing functions of
+ * libgd take care of this, but code writing to _im->pixels_ or
+ * _im->tpixels_ directly (for instance through <gdImageTrueColorPixel>)
+ * has to call this function first, for the original as well as for the
+ * clone. For other images, it does nothing.
+ *
+ * Parameters:
+ *   im - The image.
+ *
+ * Returns:
+ *   Non-zero on success, zero if out of memory.
+ */
+BGD_DECLARE(int) gdImageUnshare (gdImagePtr im)
+{
+	int y;
+
+	for (y = 0; im->rowShare && y < im->sy; y++) {
+		if (im->rowShared[y] && !_gdImageUnshareRow (im, y)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* Sets up the state of a new image, apart from its size and pixels */
+static void gdImageInitState (gdImagePtr im, int trueColor)
+{
+	int i;
+
+	im->polyInts = 0;
+	im->polyAllocated = 0;
+	im->brush = 0;
+	im->tile = 0;
+	im->style = 0;
+	im->colorsTotal = 0;
+	im->transparent = (-1);
+	im->interlace = 0;
+	im->thick = 1;
+	im->AA = 0;
+	if (trueColor) {
+		im->trueColor = 1;
+		/* 2.0.2: alpha blending is now on by default, and saving of alpha is
+		   off by default. This allows font antialiasing to work as expected
+		   on the first try in JPEGs -- quite important -- and also allows
+		   for smaller PNGs when saving of alpha channel is not really
+		   desired, which it usually isn't! */
+		im->saveAlphaFlag = 0;
+		im->alphaBlendingFlag = 1;
+	} else {
+		for (i = 0; (i < gdMaxColors); i++) {
+			im->open[i] = 1;
+		};
+		im->trueColor = 0;
+	}
+	im->cx1 = 0;
+	im->cy1 = 0;
+	im->cx2 = im->sx - 1;
+	im->cy2 = im->sy - 1;
+	im->res_x = GD_RESOLUTION;
+	im->res_y = GD_RESOLUTION;
+	im->interpolation = NULL;
+	im->interpolation_id = GD_BILINEAR_FIXED;
+}
+
+/* Brings an image back into the state of a freshly created one of the
+   same size and type, keeping its pixel rows (and polygon scratch
+   buffer) for reuse. The pixels themselves are only cleared if 'clear'
+   is set. Returns non-zero on success. */
+int _gdImageRecycle (gdImagePtr im, int clear)
+{
+	gdImage keep;
+	int y;
+
+	if (im->rowShare) {
+		/* don't reuse rows shared with clones, start afresh */
+		_gdImageFreeRows (im, im->trueColor);
+		if (!_gdImageAllocRows (im, im->trueColor)) {
+			return 0;
+		}
+		clear = 0;
+	}
+	keep = *im;
+	if (im->style) {
+		gdFree (im->style);
+	}
+	_gdImagePaletteIndexFree (im);
+	memset (im, 0, sizeof (gdImage));
+	im->sx = keep.sx;
+	im->sy = keep.sy;
+	im->pixels = keep.pixels;
+	im->pixelBlock = keep.pixelBlock;
+	im->pixelsBorrowed = keep.pixelsBorrowed;
+	im->tpixels = keep.tpixels;
+	im->tpixelBlock = keep.tpixelBlock;
+	im->tpixelsBorrowed = keep.tpixelsBorrowed;
+	gdImageInitState (im, keep.trueColor);
+	im->polyInts = keep.polyInts;
+	im->polyAllocated = keep.polyAllocated;
+
+	if (clear) {
+		for (y = 0; y < im->sy; y++) {
+			if (im->trueColor) {
+				memset (im->tpixels[y], 0, im->sx * sizeof (int));
+			} else {
+				memset (im->pixels[y], 0, im->sx);
+			}
+		}
+	}
+	return 1;
+}
+
+/* Common part of gdImageCreate() and gdImageCreateFromBuffer() */
+static gdImagePtr gdImageCreatePaletteRows (int sx, int sy, unsigned char *buffer, int stride)
+{
+	gdImagePtr im;
+
+	if (overflow2(sx, sy)) {
+		return NULL;
+	}
+
+	if (overflow2(sizeof (unsigned char *), sy)) {
+		return NULL;
+	}
+	if (overflow2(sizeof (unsigned char), sx)) {
+		return NULL;
+	}
+
+	im = (gdImage *) gdCalloc(1, sizeof(gdImage));
+	if (!im) {
+		return NULL;
+	}
+
+	im->sx = sx;
+	im->sy = sy;
+	/* Row-major ever since gd 1.3 */
+	if (buffer ? !gdImageWrapRows(im, 0, buffer, stride) : !_gdImageAllocRows(im, 0)) {
+		gdFree(im);
+		return NULL;
+	}
+
+	gdImageInitState(im, 0);
+	return im;
+}
+
 /*
     Function: gdImageCreate
 
@@ -180,75 +652,78 @@ BGD_DECLARE(int) gdImageGetTrueColorPixel (gdImagePtr im, int x, int y);
  */
 BGD_DECLARE(gdImagePtr) gdImageCreate (int sx, int sy)
 {
-	int i;
-	gdImagePtr im;
+	return gdImageCreatePaletteRows(sx, sy, NULL, 0);
+}
 
-	if (overflow2(sx, sy)) {
+/*
+    Function: gdImageCreateFromBuffer
+
+      Creates a palette-based image whose pixels are stored in a buffer
+      owned by the caller, without copying them.
+
+      The buffer holds _sy_ rows of _sx_ palette indexes each, one byte
+      per pixel, the start of each row being _stride_ bytes after the
+      start of the previous one. The image reads and writes the buffer
+      directly; it must stay valid until the image is destroyed, and
+      <gdImageDestroy> does not free it. The palette itself is empty,
+      as for <gdImageCreate>.
+
+    Parameters:
+
+        sx     - The image width.
+        sy     - The image height.
+        buffer - The pixel data.
+        stride - The number of bytes between the starts of two rows,
+                 at least _sx_.
+
+    Returns:
+
+        A pointer to the new image or NULL if an error occurred.
+
+    See Also:
+
+        <gdImageCreateTrueColorFromBuffer>
+*/
+BGD_DECLARE(gdImagePtr) gdImageCreateFromBuffer (int sx, int sy, unsigned char *buffer, int stride)
+{
+	if (!buffer) {
 		return NULL;
 	}
+	return gdImageCreatePaletteRows(sx, sy, buffer, stride);
+}
 
-	if (overflow2(sizeof (unsigned char *), sy)) {
+/* Common part of gdImageCreateTrueColor() and
+   gdImageCreateTrueColorFromBuffer() */
+static gdImagePtr gdImageCreateTrueColorRows (int sx, int sy, int *buffer, int stride)
+{
+	gdImagePtr im;
+
+	if (overflow2(sx, sy)) {
 		return NULL;
 	}
-	if (overflow2(sizeof (unsigned char), sx)) {
-		return NULL;
+	if (overflow2(sizeof (int *), sy)) {
+		return 0;
 	}
-
-	im = (gdImage *) gdCalloc(1, sizeof(gdImage));
-	if (!im) {
+	if (overflow2(sizeof(int), sx)) {
 		return NULL;
 	}
 
-	/* Row-major ever since gd 1.3 */
-	im->pixels = (unsigned char **) gdMalloc (sizeof (unsigned char *) * sy);
-	if (!im->pixels) {
-		gdFree(im);
-		return NULL;
+	im = (gdImage *) gdMalloc (sizeof (gdImage));
+	if (!im) {
+		return 0;
 	}
+	memset (im, 0, sizeof (gdImage));
 
-	im->polyInts = 0;
-	im->polyAllocated = 0;
-	im->brush = 0;
-	im->tile = 0;
-	im->style = 0;
-	for (i = 0; (i < sy); i++) {
-		/* Row-major ever since gd 1.3 */
-		im->pixels[i] = (unsigned char *) gdCalloc (sx, sizeof (unsigned char));
-		if (!im->pixels[i]) {
-			for (--i ; i >= 0; i--) {
-				gdFree(im->pixels[i]);
-			}
-			gdFree(im->pixels);
-			gdFree(im);
-			return NULL;
-		}
-
-	}
 	im->sx = sx;
 	im->sy = sy;
-	im->colorsTotal = 0;
-	im->transparent = (-1);
-	im->interlace = 0;
-	im->thick = 1;
-	im->AA = 0;
-	for (i = 0; (i < gdMaxColors); i++) {
-		im->open[i] = 1;
-	};
-	im->trueColor = 0;
-	im->tpixels = 0;
-	im->cx1 = 0;
-	im->cy1 = 0;
-	im->cx2 = im->sx - 1;
-	im->cy2 = im->sy - 1;
-	im->res_x = GD_RESOLUTION;
-	im->res_y = GD_RESOLUTION;
-	im->interpolation = NULL;
-	im->interpolation_id = GD_BILINEAR_FIXED;
+	if (buffer ? !gdImageWrapRows(im, 1, buffer, stride) : !_gdImageAllocRows(im, 1)) {
+		gdFree(im);
+		return 0;
+	}
+	gdImageInitState(im, 1);
 	return im;
 }
 
-
-
 /*
     Function: gdImageCreateTrueColor
 
@@ -288,72 +763,60 @@ BGD_DECLARE(gdImagePtr) gdImageCreate (int sx, int sy)
 */
 BGD_DECLARE(gdImagePtr) gdImageCreateTrueColor (int sx, int sy)
 {
-	int i;
-	gdImagePtr im;
+	return gdImageCreateTrueColorRows(sx, sy, NULL, 0);
+}
 
-	if (overflow2(sx, sy)) {
-		return NULL;
-	}
-	if (overflow2(sizeof (int *), sy)) {
-		return 0;
-	}
-	if (overflow2(sizeof(int), sx)) {
-		return NULL;
-	}
+/*
+    Function: gdImageCreateTrueColorFromBuffer
 
-	im = (gdImage *) gdMalloc (sizeof (gdImage));
-	if (!im) {
-		return 0;
-	}
-	memset (im, 0, sizeof (gdImage));
+      Creates a truecolor image whose pixels are stored in a buffer owned
+      by the caller, without copying them.
 
-	im->tpixels = (int **) gdMalloc (sizeof (int *) * sy);
-	if (!im->tpixels) {
-		gdFree(im);
-		return 0;
-	}
-	im->polyInts = 0;
-	im->polyAllocated = 0;
-	im->brush = 0;
-	im->tile = 0;
-	im->style = 0;
-	for (i = 0; (i < sy); i++) {
-		im->tpixels[i] = (int *) gdCalloc (sx, sizeof (int));
-		if (!im->tpixels[i]) {
-			/* 2.0.34 */
-			i--;
-			while (i >= 0) {
-				gdFree(im->tpixels[i]);
-				i--;
-			}
-			gdFree(im->tpixels);
-			gdFree(im);
-			return 0;
-		}
+      The buffer holds _sy_ rows of _sx_ pixels each, every pixel being
+      an int in the format produced by <gdTrueColorAlpha> (native byte
+      order, 7 bit alpha with 0 meaning opaque). The start of each row is
+      _stride_ bytes after the start of the previous one. The image reads
+      and writes the buffer directly; it must stay valid until the image
+      is destroyed, and <gdImageDestroy> does not free it.
+
+      Operations which replace the pixel storage of an image, such as
+      <gdImageTrueColorToPalette>, leave the buffer untouched from then on.
+
+    Parameters:
+
+        sx     - The image width.
+        sy     - The image height.
+        buffer - The pixel data, aligned to an int.
+        stride - The number of bytes between the starts of two rows, a
+                 multiple of sizeof(int) and at least _sx_ * sizeof(int).
+
+    Returns:
+
+        A pointer to the new image or NULL if an error occurred.
+
+    Example:
+      (start code)
+
+      int *frame = ...; // width * height pixels, e.g. an mmap'ed file
+      gdImagePtr im;
+      im = gdImageCreateTrueColorFromBuffer(width, height, frame,
+                                            width * sizeof(int));
+      // ... draw on and encode the frame ...
+      gdImageDestroy(im);
+      // frame still belongs to the caller
+
+      (end code)
+
+    See Also:
+
+        <gdImageCreateTrueColor>, <gdImageCreateFromBuffer>
+*/
+BGD_DECLARE(gdImagePtr) gdImageCreateTrueColorFromBuffer (int sx, int sy, int *buffer, int stride)
+{
+	if (!buffer) {
+		return NULL;
 	}
-	im->sx = sx;
-	im->sy = sy;
-	im->transparent = (-1);
-	im->interlace = 0;
-	im->trueColor = 1;
-	/* 2.0.2: alpha blending is now on by default, and saving of alpha is
-	   off by default. This allows font antialiasing to work as expected
-	   on the first try in JPEGs -- quite important -- and also allows
-	   for smaller PNGs when saving of alpha channel is not really
-	   desired, which it usually isn't! */
-	im->saveAlphaFlag = 0;
-	im->alphaBlendingFlag = 1;
-	im->thick = 1;
-	im->AA = 0;
-	im->cx1 = 0;
-	im->cy1 = 0;
-	im->cx2 = im->sx - 1;
-	im->cy2 = im->sy - 1;
-	im->res_x = GD_RESOLUTION;
-	im->res_y = GD_RESOLUTION;
-	im->interpolation = NULL;
-	im->interpolation_id = GD_BILINEAR_FIXED;
-	return im;
+	return gdImageCreateTrueColorRows(sx, sy, buffer, stride);
 }
 
 /*
@@ -386,26 +849,50 @@ BGD_DECLARE(gdImagePtr) gdImageCreateTrueColor (int sx, int sy)
 
 BGD_DECLARE(void) gdImageDestroy (gdImagePtr im)
 {
-	int i;
-	if (im->pixels) {
-		for (i = 0; (i < im->sy); i++) {
-			gdFree (im->pixels[i]);
-		}
-		gdFree (im->pixels);
-	}
-	if (im->tpixels) {
-		for (i = 0; (i < im->sy); i++) {
-			gdFree (im->tpixels[i]);
-		}
-		gdFree (im->tpixels);
-	}
+	_gdImageFreeRows(im, 0);
+	_gdImageFreeRows(im, 1);
 	if (im->polyInts) {
 		gdFree (im->polyInts);
 	}
-	if (im->style) {
-		gdFree (im->style);
+	if (im->style) {
+		gdFree (im->style);
+	}
+	_gdImagePaletteIndexFree (im);
+	gdFree (im);
+}
+
+/**
+ * Function: gdImageGetStride
+ *
+ * Gets the distance between the rows of an image
+ *
+ * The pixel rows of images created by <gdImageCreate> and
+ * <gdImageCreateTrueColor> are normally stored in a single, page aligned
+ * block of memory, so that the whole image can be processed as one flat
+ * buffer starting at the first row (_im->pixels[0]_ for palette images,
+ * _im->tpixels[0]_ for truecolor images). Rows may be padded, so use the
+ * stride to get from one row to the next. For images wrapping a caller
+ * owned buffer this is the stride the image was created with.
+ *
+ * Parameters:
+ *   im - The image.
+ *
+ * Returns:
+ *   The number of bytes between the starts of two consecutive rows, or 0
+ *   if the rows are not stored contiguously.
+ */
+BGD_DECLARE(int) gdImageGetStride (gdImagePtr im)
+{
+	unsigned char **rows = im->trueColor ? (unsigned char **) im->tpixels : im->pixels;
+	void *block = im->trueColor ? im->tpixelBlock : im->pixelBlock;
+
+	if (!block || im->rowShare) {
+		return 0;
+	}
+	if (im->sy > 1) {
+		return (int) (rows[1] - rows[0]);
 	}
-	gdFree (im);
+	return (int) gdRowStride(im->sx, im->trueColor ? sizeof (int) : sizeof (unsigned char));
 }
 
 /**
@@ -459,191 +946,21 @@ BGD_DECLARE(int) gdImageColorClosest (gdImagePtr im, int r, int g, int b)
  */
 BGD_DECLARE(int) gdImageColorClosestAlpha (gdImagePtr im, int r, int g, int b, int a)
 {
-	int i;
-	long rd, gd, bd, ad;
-	int ct = (-1);
-	int first = 1;
-	long mindist = 0;
 	if (im->trueColor) {
 		return gdTrueColorAlpha (r, g, b, a);
 	}
-	for (i = 0; (i < (im->colorsTotal)); i++) {
-		long dist;
-		if (im->open[i]) {
-			continue;
-		}
-		rd = (im->red[i] - r);
-		gd = (im->green[i] - g);
-		bd = (im->blue[i] - b);
-		/* gd 2.02: whoops, was - b (thanks to David Marwood) */
-		/* gd 2.16: was blue rather than alpha! Geez! Thanks to
-		   Artur Jakub Jerzak */
-		ad = (im->alpha[i] - a);
-		dist = rd * rd + gd * gd + bd * bd + ad * ad;
-		if (first || (dist < mindist)) {
-			mindist = dist;
-			ct = i;
-			first = 0;
-		}
-	}
-	return ct;
-}
-
-/* This code is taken from http://www.acm.org/jgt/papers/SmithLyons96/hwb_rgb.html, an article
- * on colour conversion to/from RBG and HWB colour systems.
- * It has been modified to return the converted value as a * parameter.
- */
-
-#define RETURN_HWB(h, w, b) {HWB->H = h; HWB->W = w; HWB->B = b; return HWB;}
-#define RETURN_RGB(r, g, b) {RGB->R = r; RGB->G = g; RGB->B = b; return RGB;}
-#define HWB_UNDEFINED -1
-#define SETUP_RGB(s, r, g, b) {s.R = r/255.0; s.G = g/255.0; s.B = b/255.0;}
-
-/*
- * Theoretically, hue 0 (pure red) is identical to hue 6 in these transforms. Pure
- * red always maps to 6 in this implementation. Therefore UNDEFINED can be
- * defined as 0 in situations where only unsigned numbers are desired.
- */
-typedef struct {
-	float R, G, B;
-}
-RGBType;
-typedef struct {
-	float H, W, B;
-}
-HWBType;
-
-static HWBType *
-RGB_to_HWB (RGBType RGB, HWBType * HWB)
-{
-
-	/*
-	 * RGB are each on [0, 1]. W and B are returned on [0, 1] and H is
-	 * returned on [0, 6]. Exception: H is returned UNDEFINED if W == 1 - B.
-	 */
-
-	float R = RGB.R, G = RGB.G, B = RGB.B, w, v, b, f;
-	int i;
-
-	w = MIN3 (R, G, B);
-	v = MAX3 (R, G, B);
-	b = 1 - v;
-	if (v == w)
-		RETURN_HWB (HWB_UNDEFINED, w, b);
-	f = (R == w) ? G - B : ((G == w) ? B - R : R - G);
-	i = (R == w) ? 3 : ((G == w) ? 5 : 1);
-	RETURN_HWB (i - f / (v - w), w, b);
-
-}
-
-static float
-HWB_Diff (int r1, int g1, int b1, int r2, int g2, int b2)
-{
-	RGBType RGB1, RGB2;
-	HWBType HWB1, HWB2;
-	float diff;
-
-	SETUP_RGB (RGB1, r1, g1, b1);
-	SETUP_RGB (RGB2, r2, g2, b2);
-
-	RGB_to_HWB (RGB1, &HWB1);
-	RGB_to_HWB (RGB2, &HWB2);
-
-	/*
-	 * I made this bit up; it seems to produce OK results, and it is certainly
-	 * more visually correct than the current RGB metric. (PJW)
-	 */
-
-	if ((HWB1.H == HWB_UNDEFINED) || (HWB2.H == HWB_UNDEFINED)) {
-		diff = 0;			/* Undefined hues always match... */
-	} else {
-		diff = fabs (HWB1.H - HWB2.H);
-		if (diff > 3) {
-			diff = 6 - diff;	/* Remember, it's a colour circle */
-		}
-	}
-
-	diff =
-	    diff * diff + (HWB1.W - HWB2.W) * (HWB1.W - HWB2.W) + (HWB1.B -
-	            HWB2.B) * (HWB1.B -
-	                       HWB2.B);
-
-	return diff;
-}
-
-
-#if 0
-/*
- * This is not actually used, but is here for completeness, in case someone wants to
- * use the HWB stuff for anything else...
- */
-static RGBType *
-HWB_to_RGB (HWBType HWB, RGBType * RGB)
-{
-
-	/*
-	 * H is given on [0, 6] or UNDEFINED. W and B are given on [0, 1].
-	 * RGB are each returned on [0, 1].
-	 */
-
-	float h = HWB.H, w = HWB.W, b = HWB.B, v, n, f;
-	int i;
-
-	v = 1 - b;
-	if (h == HWB_UNDEFINED)
-		RETURN_RGB (v, v, v);
-	i = floor (h);
-	f = h - i;
-	if (i & 1)
-		f = 1 - f;			/* if i is odd */
-	n = w + f * (v - w);		/* linear interpolation between w and v */
-	switch (i) {
-	case 6:
-	case 0:
-		RETURN_RGB (v, n, w);
-	case 1:
-		RETURN_RGB (n, v, w);
-	case 2:
-		RETURN_RGB (w, v, n);
-	case 3:
-		RETURN_RGB (w, n, v);
-	case 4:
-		RETURN_RGB (n, w, v);
-	case 5:
-		RETURN_RGB (v, w, n);
-	}
-
-	return RGB;
-
+	return _gdPaletteClosest (im, r, g, b, a, -1, -1);
 }
-#endif
 
 /*
 	Function: gdImageColorClosestHWB
 */
 BGD_DECLARE(int) gdImageColorClosestHWB (gdImagePtr im, int r, int g, int b)
 {
-	int i;
-	/* long rd, gd, bd; */
-	int ct = (-1);
-	int first = 1;
-	float mindist = 0;
 	if (im->trueColor) {
 		return gdTrueColor (r, g, b);
 	}
-	for (i = 0; (i < (im->colorsTotal)); i++) {
-		float dist;
-		if (im->open[i]) {
-			continue;
-		}
-		dist = HWB_Diff (im->red[i], im->green[i], im->blue[i], r, g, b);
-		if (first || (dist < mindist)) {
-			mindist = dist;
-			ct = i;
-			first = 0;
-		}
-	}
-	return ct;
+	return _gdPaletteClosestHWB (im, r, g, b);
 }
 
 /**
@@ -696,20 +1013,10 @@ BGD_DECLARE(int) gdImageColorExact (gdImagePtr im, int r, int g, int b)
  */
 BGD_DECLARE(int) gdImageColorExactAlpha (gdImagePtr im, int r, int g, int b, int a)
 {
-	int i;
 	if (im->trueColor) {
 		return gdTrueColorAlpha (r, g, b, a);
 	}
-	for (i = 0; (i < (im->colorsTotal)); i++) {
-		if (im->open[i]) {
-			continue;
-		}
-		if ((im->red[i] == r) &&
-		        (im->green[i] == g) && (im->blue[i] == b) && (im->alpha[i] == a)) {
-			return i;
-		}
-	}
-	return -1;
+	return _gdPaletteExact (im, r, g, b, a);
 }
 
 /**
@@ -759,17 +1066,20 @@ BGD_DECLARE(int) gdImageColorAllocate (gdImagePtr im, int r, int g, int b)
  */
 BGD_DECLARE(int) gdImageColorAllocateAlpha (gdImagePtr im, int r, int g, int b, int a)
 {
-	int i;
+	int i, reused;
 	int ct = (-1);
 	if (im->trueColor) {
 		return gdTrueColorAlpha (r, g, b, a);
 	}
-	for (i = 0; (i < (im->colorsTotal)); i++) {
-		if (im->open[i]) {
-			ct = i;
-			break;
+	if (_gdPaletteHasOpen (im)) {
+		for (i = 0; (i < (im->colorsTotal)); i++) {
+			if (im->open[i]) {
+				ct = i;
+				break;
+			}
 		}
 	}
+	reused = ct != (-1);
 	if (ct == (-1)) {
 		ct = im->colorsTotal;
 		if (ct == gdMaxColors) {
@@ -782,6 +1092,7 @@ BGD_DECLARE(int) gdImageColorAllocateAlpha (gdImagePtr im, int r, int g, int b,
 	im->blue[ct] = b;
 	im->alpha[ct] = a;
 	im->open[ct] = 0;
+	_gdPaletteAllocated (im, ct, reused);
 	return ct;
 }
 
@@ -808,45 +1119,46 @@ BGD_DECLARE(int) gdImageColorResolve (gdImagePtr im, int r, int g, int b)
 */
 BGD_DECLARE(int) gdImageColorResolveAlpha (gdImagePtr im, int r, int g, int b, int a)
 {
-	int c;
-	int ct = -1;
+	int c, reused;
 	int op = -1;
-	long rd, gd, bd, ad, dist;
-	long mindist = 4 * 255 * 255;	/* init to max poss dist */
 	if (im->trueColor) {
 		return gdTrueColorAlpha (r, g, b, a);
 	}
 
-	for (c = 0; c < im->colorsTotal; c++) {
-		if (im->open[c]) {
-			op = c;		/* Save open slot */
-			continue;		/* Color not in use */
-		}
-		if (c == im->transparent) {
-			/* don't ever resolve to the color that has
-			 * been designated as the transparent color */
-			continue;
+	if (_gdPaletteHasOpen (im)) {
+		for (c = im->colorsTotal - 1; c >= 0; c--) {
+			if (im->open[c]) {
+				op = c;		/* Save open slot */
+				break;
+			}
 		}
-		rd = (long) (im->red[c] - r);
-		gd = (long) (im->green[c] - g);
-		bd = (long) (im->blue[c] - b);
-		ad = (long) (im->alpha[c] - a);
-		dist = rd * rd + gd * gd + bd * bd + ad * ad;
-		if (dist < mindist) {
-			if (dist == 0) {
-				return c;		/* Return exact match color */
+	}
+	if (op == -1 && im->colorsTotal == gdMaxColors) {
+		/* No room for more colors: return the exact or else the closest
+		 * color, but don't ever resolve to the color that has been
+		 * designated as the transparent color */
+		return _gdPaletteClosest (im, r, g, b, a, im->transparent, 4 * 255 * 255);
+	}
+	c = _gdPaletteExact (im, r, g, b, a);
+	if (c != -1 && c == im->transparent) {
+		/* the transparent color doesn't count, look for a later copy */
+		for (c++; c < im->colorsTotal; c++) {
+			if (!im->open[c] && im->red[c] == r && im->green[c] == g
+			        && im->blue[c] == b && im->alpha[c] == a) {
+				break;
 			}
-			mindist = dist;
-			ct = c;
 		}
+		if (c == im->colorsTotal) {
+			c = -1;
+		}
+	}
+	if (c != -1) {
+		return c;		/* Return exact match color */
 	}
-	/* no exact match.  We now know closest, but first try to allocate exact */
+	/* no exact match, allocate it */
+	reused = op != -1;
 	if (op == -1) {
 		op = im->colorsTotal;
-		if (op == gdMaxColors) {
-			/* No room for more colors */
-			return ct;		/* Return closest available color */
-		}
 		im->colorsTotal++;
 	}
 	im->red[op] = r;
@@ -854,6 +1166,7 @@ BGD_DECLARE(int) gdImageColorResolveAlpha (gdImagePtr im, int r, int g, int b, i
 	im->blue[op] = b;
 	im->alpha[op] = a;
 	im->open[op] = 0;
+	_gdPaletteAllocated (im, op, reused);
 	return op;			/* Return newly allocated color */
 }
 
@@ -878,7 +1191,10 @@ BGD_DECLARE(void) gdImageColorDeallocate (gdImagePtr im, int color)
 		return;
 	}
 	/* Mark it open. */
-	im->open[color] = 1;
+	if (!im->open[color]) {
+		im->open[color] = 1;
+		_gdPaletteDeallocated (im, color);
+	}
 }
 
 /**
@@ -907,6 +1223,7 @@ BGD_DECLARE(void) gdImageColorTransparent (gdImagePtr im, int color)
 			im->alpha[im->transparent] = gdAlphaOpaque;
 		}
 		im->alpha[color] = gdAlphaTransparent;
+		gdImagePaletteChanged (im);
 	}
 	im->transparent = color;
 }
@@ -925,6 +1242,9 @@ BGD_DECLARE(void) gdImagePaletteCopy (gdImagePtr to, gdImagePtr from)
 	if (from->trueColor) {
 		return;
 	}
+	if (!gdImageUnshare (to)) {
+		return;
+	}
 
 	for (i = 0; i < 256; i++) {
 		xlate[i] = -1;
@@ -963,6 +1283,7 @@ BGD_DECLARE(void) gdImagePaletteCopy (gdImagePtr to, gdImagePtr from)
 	};
 
 	to->colorsTotal = from->colorsTotal;
+	gdImagePaletteChanged (to);
 
 }
 
@@ -1165,6 +1486,9 @@ BGD_DECLARE(int) gdImageColorReplaceCallback (gdImagePtr im, gdCallbackImageColo
 /* 2.0.26, TBB: we now have to respect a clipping rectangle, it won't
 	necessarily start at 0. */
 
+/* The differences of end points far apart don't fit into an int, so
+   they are taken as doubles, and the moved end points, which lie
+   between the old ones, are computed as long long. */
 static int
 clip_1d (int *x0, int *y0, int *x1, int *y1, int mindim, int maxdim)
 {
@@ -1173,13 +1497,13 @@ clip_1d (int *x0, int *y0, int *x1, int *y1, int mindim, int maxdim)
 		/* start of line is left of window */
 		if (*x1 < mindim)		/* as is the end, so the line never cuts the window */
 			return 0;
-		m = (*y1 - *y0) / (double) (*x1 - *x0);	/* calculate the slope of the line */
+		m = ((double) *y1 - *y0) / ((double) *x1 - *x0);	/* calculate the slope of the line */
 		/* adjust x0 to be on the left boundary (ie to be zero), and y0 to match */
-		*y0 -= (int)(m * (*x0 - mindim));
+		*y0 = (int) (*y0 - (long long) (m * ((double) *x0 - mindim)));
 		*x0 = mindim;
 		/* now, perhaps, adjust the far end of the line as well */
 		if (*x1 > maxdim) {
-			*y1 += m * (maxdim - *x1);
+			*y1 = (int) (*y1 + m * ((double) maxdim - *x1));
 			*x1 = maxdim;
 		}
 		return 1;
@@ -1189,13 +1513,13 @@ clip_1d (int *x0, int *y0, int *x1, int *y1, int mindim, int maxdim)
 		complement of above */
 		if (*x1 > maxdim)		/* as is the end, so the line misses the window */
 			return 0;
-		m = (*y1 - *y0) / (double) (*x1 - *x0);	/* calculate the slope of the line */
-		*y0 += (int)(m * (maxdim - *x0));	/* adjust so point is on the right
+		m = ((double) *y1 - *y0) / ((double) *x1 - *x0);	/* calculate the slope of the line */
+		*y0 = (int) (*y0 + (long long) (m * ((double) maxdim - *x0)));	/* adjust so point is on the right
 							   boundary */
 		*x0 = maxdim;
 		/* now, perhaps, adjust the end of the line */
 		if (*x1 < mindim) {
-			*y1 -= (int)(m * (*x1 - mindim));
+			*y1 = (int) (*y1 - (long long) (m * ((double) *x1 - mindim)));
 			*x1 = mindim;
 		}
 		return 1;
@@ -1203,15 +1527,15 @@ clip_1d (int *x0, int *y0, int *x1, int *y1, int mindim, int maxdim)
 	/* the final case - the start of the line is inside the window */
 	if (*x1 > maxdim) {
 		/* other end is outside to the right */
-		m = (*y1 - *y0) / (double) (*x1 - *x0);	/* calculate the slope of the line */
-		*y1 += (int)(m * (maxdim - *x1));
+		m = ((double) *y1 - *y0) / ((double) *x1 - *x0);	/* calculate the slope of the line */
+		*y1 = (int) (*y1 + (long long) (m * ((double) maxdim - *x1)));
 		*x1 = maxdim;
 		return 1;
 	}
 	if (*x1 < mindim) {
 		/* other end is outside to the left */
-		m = (*y1 - *y0) / (double) (*x1 - *x0);	/* calculate the slope of the line */
-		*y1 -= (int)(m * (*x1 - mindim));
+		m = ((double) *y1 - *y0) / ((double) *x1 - *x0);	/* calculate the slope of the line */
+		*y1 = (int) (*y1 - (long long) (m * ((double) *x1 - mindim)));
 		*x1 = mindim;
 		return 1;
 	}
@@ -1267,7 +1591,7 @@ BGD_DECLARE(void) gdImageSetPixel (gdImagePtr im, int x, int y, int color)
 		gdImageSetPixel(im, x, y, im->AA_color);
 		break;
 	default:
-		if (gdImageBoundsSafeMacro (im, x, y)) {
+		if (gdImageBoundsSafeMacro (im, x, y) && gdImageRowWritable (im, y)) {
 			if (im->trueColor) {
 				switch (im->alphaBlendingFlag) {
 					default:
@@ -1473,6 +1797,226 @@ BGD_DECLARE(int) gdImageGetTrueColorPixel (gdImagePtr im, int x, int y)
 	}
 }
 
+/* Clips the span of n pixels starting at (*x, y) to the columns x1..x2
+   of the image, and returns the number of pixels left (0 if y is outside
+   y1..y2). *skip receives the number of pixels cut off at the start. */
+static int gdImageClipSpan (int *x, int y, int n, int *skip,
+                            int x1, int y1, int x2, int y2)
+{
+	int end;
+
+	if (n <= 0 || y < y1 || y > y2 || *x > x2 || *x + (n - 1) < x1) {
+		return 0;
+	}
+	end = *x + (n - 1);
+	*skip = 0;
+	if (*x < x1) {
+		*skip = x1 - *x;
+		*x = x1;
+	}
+	if (end > x2) {
+		end = x2;
+	}
+	return end - *x + 1;
+}
+
+/**
+ * Function: gdImageGetSpan
+ *
+ * Gets a span of pixels of a row as stored in the image.
+ *
+ * This is the bulk version of <gdImageGetPixel>: the colors of _n_
+ * pixels starting at (x, y) are stored in _dst_, which receives palette
+ * indexes for palette images and truecolor values otherwise. The span
+ * is clipped to the image; dst[i] always corresponds to pixel (x + i, y),
+ * and elements for pixels outside of the image are left untouched.
+ *
+ * Parameters:
+ *   im  - The image.
+ *   x   - The x-coordinate of the first pixel.
+ *   y   - The y-coordinate.
+ *   n   - The number of pixels.
+ *   dst - The buffer receiving at least _n_ values.
+ *
+ * Returns:
+ *   The number of pixels copied.
+ *
+ * See also:
+ *   - <gdImageGetTrueColorSpan>
+ *   - <gdImagePutSpan>
+ */
+BGD_DECLARE(int) gdImageGetSpan (gdImagePtr im, int x, int y, int n, int *dst)
+{
+	int skip, i, len;
+
+	len = gdImageClipSpan(&x, y, n, &skip, 0, 0, im->sx - 1, im->sy - 1);
+	dst += skip;
+	if (im->trueColor) {
+		memcpy(dst, im->tpixels[y] + x, len * sizeof(int));
+	} else {
+		const unsigned char *row = im->pixels[y] + x;
+		for (i = 0; i < len; i++) {
+			dst[i] = row[i];
+		}
+	}
+	return len;
+}
+
+/**
+ * Function: gdImageGetTrueColorSpan
+ *
+ * Gets a span of pixels of a row always as truecolor values.
+ *
+ * This is the bulk version of <gdImageGetTrueColorPixel>, and otherwise
+ * works like <gdImageGetSpan>.
+ *
+ * Parameters:
+ *   im  - The image.
+ *   x   - The x-coordinate of the first pixel.
+ *   y   - The y-coordinate.
+ *   n   - The number of pixels.
+ *   dst - The buffer receiving at least _n_ values.
+ *
+ * Returns:
+ *   The number of pixels copied.
+ */
+BGD_DECLARE(int) gdImageGetTrueColorSpan (gdImagePtr im, int x, int y, int n, int *dst)
+{
+	int skip, i, len;
+
+	if (im->trueColor) {
+		return gdImageGetSpan(im, x, y, n, dst);
+	}
+	len = gdImageClipSpan(&x, y, n, &skip, 0, 0, im->sx - 1, im->sy - 1);
+	dst += skip;
+	for (i = 0; i < len; i++) {
+		const int p = im->pixels[y][x + i];
+		dst[i] = gdTrueColorAlpha(im->red[p], im->green[p], im->blue[p],
+		                          (im->transparent == p) ? gdAlphaTransparent :
+		                          im->alpha[p]);
+	}
+	return len;
+}
+
+/**
+ * Function: gdImagePutSpan
+ *
+ * Stores a span of pixels of a row as they are.
+ *
+ * The values in _src_, palette indexes for palette images and truecolor
+ * values otherwise, replace the _n_ pixels starting at (x, y), without
+ * any blending, styling or tiling. src[i] always corresponds to pixel
+ * (x + i, y); pixels outside of the clipping rectangle are skipped.
+ *
+ * Parameters:
+ *   im  - The image.
+ *   x   - The x-coordinate of the first pixel.
+ *   y   - The y-coordinate.
+ *   n   - The number of pixels.
+ *   src - The _n_ values.
+ *
+ * Returns:
+ *   The number of pixels stored.
+ *
+ * See also:
+ *   - <gdImageBlendSpan>
+ *   - <gdImageGetSpan>
+ *   - <gdImageSetClip>
+ */
+BGD_DECLARE(int) gdImagePutSpan (gdImagePtr im, int x, int y, int n, const int *src)
+{
+	int skip, i, len;
+
+	len = gdImageClipSpan(&x, y, n, &skip, im->cx1, im->cy1, im->cx2, im->cy2);
+	if (!len || !gdImageRowWritable(im, y)) {
+		return 0;
+	}
+	src += skip;
+	if (im->trueColor) {
+		memcpy(im->tpixels[y] + x, src, len * sizeof(int));
+	} else {
+		unsigned char *row = im->pixels[y] + x;
+		for (i = 0; i < len; i++) {
+			row[i] = (unsigned char) src[i];
+		}
+	}
+	return len;
+}
+
+/**
+ * Function: gdImageBlendSpan
+ *
+ * Draws a span of truecolor pixels onto a row.
+ *
+ * This is the bulk version of <gdImageSetPixel> for plain truecolor
+ * values: each of the _n_ pixels starting at (x, y) is replaced by, or
+ * combined with, the respective value of _src_ according to the effect
+ * set by <gdImageAlphaBlending>. For palette images, the values are
+ * mapped to palette colors by <gdImageColorResolveAlpha>. src[i] always
+ * corresponds to pixel (x + i, y); pixels outside of the clipping
+ * rectangle are skipped. The special colors like <gdStyled> are not
+ * supported.
+ *
+ * Parameters:
+ *   im  - The image.
+ *   x   - The x-coordinate of the first pixel.
+ *   y   - The y-coordinate.
+ *   n   - The number of pixels.
+ *   src - The _n_ truecolor values.
+ *
+ * Returns:
+ *   The number of pixels drawn.
+ *
+ * See also:
+ *   - <gdImagePutSpan>
+ */
+BGD_DECLARE(int) gdImageBlendSpan (gdImagePtr im, int x, int y, int n, const int *src)
+{
+	int skip, i, len;
+
+	len = gdImageClipSpan(&x, y, n, &skip, im->cx1, im->cy1, im->cx2, im->cy2);
+	if (!len || !gdImageRowWritable(im, y)) {
+		return 0;
+	}
+	src += skip;
+	if (im->trueColor) {
+		int *row = im->tpixels[y] + x;
+
+		switch (im->alphaBlendingFlag) {
+			default:
+			case gdEffectReplace:
+				memcpy(row, src, len * sizeof(int));
+				break;
+			case gdEffectAlphaBlend:
+			case gdEffectNormal:
+				_gdAlphaBlendSpan(row, src, len);
+				break;
+			case gdEffectOverlay:
+				_gdLayerOverlaySpan(row, src, len);
+				break;
+			case gdEffectMultiply:
+				_gdLayerMultiplySpan(row, src, len);
+				break;
+		}
+	} else {
+		unsigned char *row = im->pixels[y] + x;
+		/* runs of the same color are common, resolve each run once */
+		int last = 0, index = 0;
+
+		for (i = 0; i < len; i++) {
+			if (i == 0 || src[i] != last) {
+				last = src[i];
+				index = gdImageColorResolveAlpha(im, gdTrueColorGetRed(last),
+				                                 gdTrueColorGetGreen(last),
+				                                 gdTrueColorGetBlue(last),
+				                                 gdTrueColorGetAlpha(last));
+			}
+			row[i] = (unsigned char) index;
+		}
+	}
+	return len;
+}
+
 /**
  * Group: Primitives
  */
@@ -1487,6 +2031,55 @@ BGD_DECLARE(void) gdImageAABlend (gdImagePtr im)
 	(void)im;
 }
 
+/* Sets the pixels x1 to x2 of row y, which have to be inside of the
+   clipping rectangle, to the plain color col, as gdImageSetPixel()
+   does. */
+static void gdImageSetSpan (gdImagePtr im, int y, int x1, int x2, int col)
+{
+	int *row;
+
+	if (!gdImageRowWritable(im, y)) {
+		return;
+	}
+	if (!im->trueColor) {
+		memset(im->pixels[y] + x1, col, x2 - x1 + 1);
+		return;
+	}
+	row = im->tpixels[y] + x1;
+	switch (im->alphaBlendingFlag) {
+		default:
+		case gdEffectReplace:
+			_gdFillSpan(row, col, x2 - x1 + 1);
+			break;
+		case gdEffectAlphaBlend:
+		case gdEffectNormal:
+			_gdAlphaBlendFill(row, col, x2 - x1 + 1);
+			break;
+		case gdEffectOverlay:
+			_gdLayerOverlayFill(row, col, x2 - x1 + 1);
+			break;
+		case gdEffectMultiply:
+			_gdLayerMultiplyFill(row, col, x2 - x1 + 1);
+			break;
+	}
+}
+
+/* Like gdImageSetSpan(), for spans which may reach out of the clipping
+   rectangle */
+static void gdImageClipSetSpan (gdImagePtr im, int y, int x1, int x2, int col)
+{
+	if (y < im->cy1 || y > im->cy2) {
+		return;
+	}
+	/* empty as well for a clipping rectangle with cx1 > cx2 */
+	x1 = MAX(x1, im->cx1);
+	x2 = MIN(x2, im->cx2);
+	if (x1 > x2) {
+		return;
+	}
+	gdImageSetSpan(im, y, x1, x2, col);
+}
+
 static void gdImageAALine (gdImagePtr im, int x1, int y1, int x2, int y2, int col);
 
 static void _gdImageFilledHRectangle (gdImagePtr im, int x1, int y1, int x2, int y2,
@@ -1504,6 +2097,10 @@ static void gdImageHLine(gdImagePtr im, int y, int x1, int x2, int col)
 			x1 = t;
 		}
 
+		if (col >= 0) {
+			gdImageClipSetSpan(im, y, x1, x2, col);
+			return;
+		}
 		for (; x1 <= x2; x1++) {
 			gdImageSetPixel(im, x1, y, col);
 		}
@@ -1523,6 +2120,12 @@ static void gdImageVLine(gdImagePtr im, int x, int y1, int y2, int col)
 			y2 = t;
 		}
 
+		if (col >= 0) {
+			for (y1 = MAX(y1, im->cy1); y1 <= MIN(y2, im->cy2); y1++) {
+				gdImageClipSetSpan(im, y1, x, x, col);
+			}
+			return;
+		}
 		for (; y1 <= y2; y1++) {
 			gdImageSetPixel(im, x, y1, col);
 		}
@@ -1530,6 +2133,66 @@ static void gdImageVLine(gdImagePtr im, int x, int y1, int y2, int col)
 	return;
 }
 
+/* Draws a line one pixel wide in the plain color col, setting the same
+   pixels as gdImageLine() but a run of pixels at a time: the runs on one
+   row of mostly horizontal lines are drawn as a span each. */
+static void gdImageThinLine (gdImagePtr im, int x1, int y1, int x2, int y2, int col)
+{
+	int dx, dy, d, incr1, incr2, x, y, start, step, t;
+
+	if (clip_1d (&x1, &y1, &x2, &y2, im->cx1, im->cx2) == 0)
+		return;
+	if (clip_1d (&y1, &x1, &y2, &x2, im->cy1, im->cy2) == 0)
+		return;
+
+	dx = abs (x2 - x1);
+	dy = abs (y2 - y1);
+
+	if (dy <= dx) {
+		if (x1 > x2) {
+			t = x1; x1 = x2; x2 = t;
+			t = y1; y1 = y2; y2 = t;
+		}
+		step = y2 > y1 ? 1 : -1;
+		d = 2 * dy - dx;
+		incr1 = 2 * dy;
+		incr2 = 2 * (dy - dx);
+		y = y1;
+		start = x1;
+		for (x = x1 + 1; x <= x2; x++) {
+			if (d < 0) {
+				d += incr1;
+			} else {
+				gdImageClipSetSpan(im, y, start, x - 1, col);
+				start = x;
+				y += step;
+				d += incr2;
+			}
+		}
+		gdImageClipSetSpan(im, y, start, x2, col);
+	} else {
+		if (y1 > y2) {
+			t = x1; x1 = x2; x2 = t;
+			t = y1; y1 = y2; y2 = t;
+		}
+		step = x2 > x1 ? 1 : -1;
+		d = 2 * dx - dy;
+		incr1 = 2 * dx;
+		incr2 = 2 * (dx - dy);
+		x = x1;
+		gdImageClipSetSpan(im, y1, x, x, col);
+		for (y = y1 + 1; y <= y2; y++) {
+			if (d < 0) {
+				d += incr1;
+			} else {
+				x += step;
+				d += incr2;
+			}
+			gdImageClipSetSpan(im, y, x, x, col);
+		}
+	}
+}
+
 /*
 	Function: gdImageLine
 
@@ -1551,6 +2214,10 @@ BGD_DECLARE(void) gdImageLine (gdImagePtr im, int x1, int y1, int x2, int y2, in
 		gdImageAALine(im, x1, y1, x2, y2, im->AA_color);
 		return;
 	}
+	if (color >= 0 && im->thick == 1) {
+		gdImageThinLine(im, x1, y1, x2, y2, color);
+		return;
+	}
 	/* 2.0.10: Nick Atty: clip to edges of drawing rectangle, return if no
 	   points need to be drawn. 2.0.26, TBB: clip to edges of clipping
 	   rectangle. We were getting away with this because gdImageSetPixel
@@ -1697,8 +2364,44 @@ BGD_DECLARE(void) gdImageLine (gdImagePtr im, int x1, int y1, int x2, int y2, in
 			}
 		}
 	}
-
+
+}
+
+/**
+ * Function: gdImageLines
+ *
+ * Draws a batch of lines
+ *
+ * Draws the lines from p[2 * i] to p[2 * i + 1] for i from 0 to n - 1,
+ * like as many calls of <gdImageLine> would, but the checks of the color
+ * and the thickness are done once for all lines. Drawing the many short
+ * lines of a chart this way is considerably faster.
+ *
+ * Parameters:
+ *   im    - The image.
+ *   p     - The end points of the lines, two per line.
+ *   n     - The number of lines.
+ *   color - The color.
+ *
+ * See also:
+ *   - <gdImageLine>
+ *   - <gdImageOpenPolygon>
+ */
+BGD_DECLARE(void) gdImageLines (gdImagePtr im, const gdPoint *p, int n, int color)
+{
+	int i;
+
+	if (color < 0 || im->thick != 1) {
+		for (i = 0; i < n; i++, p += 2) {
+			gdImageLine(im, p[0].x, p[0].y, p[1].x, p[1].y, color);
+		}
+		return;
+	}
+	for (i = 0; i < n; i++, p += 2) {
+		gdImageThinLine(im, p[0].x, p[0].y, p[1].x, p[1].y, color);
+	}
 }
+
 static void dashedSet (gdImagePtr im, int x, int y, int color,
 					   int *onP, int *dashStepP, int wid, int vert);
 
@@ -2219,164 +2922,230 @@ BGD_DECLARE(void) gdImageEllipse(gdImagePtr im, int mx, int my, int w, int h, in
 }
 
 
-/*
-	Function: gdImageFilledEllipse
-*/
-BGD_DECLARE(void) gdImageFilledEllipse (gdImagePtr im, int mx, int my, int w, int h, int c)
-{
-	int x=0,mx1=0,mx2=0,my1=0,my2=0;
-	int64_t aq,bq,dx,dy,r,rx,ry,a,b;
-	int i;
-	int old_y2;
-
-	a=w>>1;
-	b=h>>1;
-
-	for (x = mx-a; x <= mx+a; x++) {
-		gdImageSetPixel(im, x, my, c);
-	}
+/* The scan conversion of gdImageFilledEllipse(), producing the spans of
+   an ellipse of size w x h centered on the origin: first the middle row,
+   then the pairs of rows -y and y from the middle outwards. */
+typedef struct {
+	int a, x, x1, x2, y, old_y;
+	int64_t dx, dy, r, rx, ry;
+	int started;
+} gdEllipseScan;
 
-	mx1 = mx-a;
-	my1 = my;
-	mx2 = mx+a;
-	my2 = my;
+static void gdEllipseScanInit (gdEllipseScan *s, int w, int h)
+{
+	int64_t a, b, aq, bq;
 
+	a = w >> 1;
+	b = h >> 1;
 	aq = a * a;
 	bq = b * b;
-	dx = aq << 1;
-	dy = bq << 1;
-	r  = a * bq;
-	rx = r << 1;
-	ry = 0;
-	x = a;
-	old_y2=-2;
-	while (x > 0) {
-		if (r > 0) {
-			my1++;
-			my2--;
-			ry +=dx;
-			r  -=ry;
+	s->a = (int) a;
+	s->dx = aq << 1;
+	s->dy = bq << 1;
+	s->r = a * bq;
+	s->rx = s->r << 1;
+	s->ry = 0;
+	s->x = s->a;
+	s->x1 = -s->a;
+	s->x2 = s->a;
+	s->y = 0;
+	s->old_y = -1;
+	s->started = 0;
+}
+
+/* Gets the next span x1..x2 of row y (and -y). Returns the number of
+   rows it is drawn on, 0 when the ellipse is done. */
+static int gdEllipseScanNext (gdEllipseScan *s, int *y, int *x1, int *x2)
+{
+	if (!s->started) {
+		s->started = 1;
+		if (s->a < 0) {
+			return 0;
 		}
-		if (r <= 0) {
-			x--;
-			mx1++;
-			mx2--;
-			rx -=dy;
-			r  +=rx;
+		*y = 0;
+		*x1 = -s->a;
+		*x2 = s->a;
+		return 1;
+	}
+	while (s->x > 0) {
+		if (s->r > 0) {
+			s->y++;
+			s->ry += s->dx;
+			s->r -= s->ry;
 		}
-
-		if(old_y2!=my2) {
-			for(i=mx1; i<=mx2; i++) {
-				gdImageSetPixel(im,i,my2,c);
-				gdImageSetPixel(im,i,my1,c);
-			}
+		if (s->r <= 0) {
+			s->x--;
+			s->x1++;
+			s->x2--;
+			s->rx -= s->dy;
+			s->r += s->rx;
+		}
+		if (s->y != s->old_y) {
+			s->old_y = s->y;
+			*y = s->y;
+			*x1 = s->x1;
+			*x2 = s->x2;
+			return 2;
 		}
-		old_y2 = my2;
 	}
+	return 0;
 }
 
 /*
-	Function: gdImageFillToBorder
+	Function: gdImageFilledEllipse
 */
-BGD_DECLARE(void) gdImageFillToBorder (gdImagePtr im, int x, int y, int border, int color)
+BGD_DECLARE(void) gdImageFilledEllipse (gdImagePtr im, int mx, int my, int w, int h, int c)
 {
-	int lastBorder;
-	/* Seek left */
-	int leftLimit, rightLimit;
-	int i;
-	int restoreAlphaBleding;
-
-	if (border < 0 || color < 0) {
-		/* Refuse to fill to a non-solid border */
-		return;
-	}
-
-	if (!im->trueColor) {
-		if (color > (im->colorsTotal - 1) || border > (im->colorsTotal - 1)) {
-			return;
+	gdEllipseScan scan;
+	int rows, y, x1, x2, x;
+
+	gdEllipseScanInit(&scan, w, h);
+	while ((rows = gdEllipseScanNext(&scan, &y, &x1, &x2))) {
+		if (c >= 0) {
+			gdImageClipSetSpan(im, my - y, mx + x1, mx + x2, c);
+			if (rows == 2) {
+				gdImageClipSetSpan(im, my + y, mx + x1, mx + x2, c);
+			}
+		} else {
+			for (x = x1; x <= x2; x++) {
+				gdImageSetPixel(im, mx + x, my - y, c);
+				if (rows == 2) {
+					gdImageSetPixel(im, mx + x, my + y, c);
+				}
+			}
 		}
 	}
+}
 
-	leftLimit = (-1);
+typedef struct {
+	int rows, y, x1, x2;
+} gdEllipseSpan;
 
-	restoreAlphaBleding = im->alphaBlendingFlag;
-	im->alphaBlendingFlag = 0;
+/**
+ * Function: gdImageFilledEllipses
+ *
+ * Draws a batch of filled ellipses of the same size
+ *
+ * Draws an ellipse centered on each of the _n_ points, like as many calls
+ * of <gdImageFilledEllipse> would. The outline is scan converted only
+ * once for all of them, so drawing the markers of a scatter chart this
+ * way is considerably faster.
+ *
+ * Parameters:
+ *   im     - The image.
+ *   c      - The centers.
+ *   n      - The number of ellipses.
+ *   w      - The width of the ellipses.
+ *   h      - The height of the ellipses.
+ *   color  - The color.
+ *
+ * See also:
+ *   - <gdImageFilledEllipse>
+ */
+BGD_DECLARE(void) gdImageFilledEllipses (gdImagePtr im, const gdPoint *c, int n, int w, int h, int color)
+{
+	gdEllipseScan scan;
+	gdEllipseSpan *spans = NULL;
+	int count, i, j, y, x1, x2, rows, height;
 
-	if (x >= im->sx) {
-		x = im->sx - 1;
-	} else if (x < 0) {
-		x = 0;
-	}
-	if (y >= im->sy) {
-		y = im->sy - 1;
-	} else if (y < 0) {
-		y = 0;
+	if (n <= 0) {
+		return;
 	}
-
-	for (i = x; (i >= 0); i--) {
-		if (gdImageGetPixel (im, i, y) == border) {
-			break;
+	count = 0;
+	if (color >= 0) {
+		gdEllipseScanInit(&scan, w, h);
+		while (gdEllipseScanNext(&scan, &y, &x1, &x2)) {
+			count++;
+		}
+		if (count == 0) {
+			return;
+		}
+		if (!overflow2(sizeof(gdEllipseSpan), count)) {
+			spans = (gdEllipseSpan *) gdMalloc(sizeof(gdEllipseSpan) * count);
 		}
-		gdImageSetPixel (im, i, y, color);
-		leftLimit = i;
 	}
-	if (leftLimit == (-1)) {
-		im->alphaBlendingFlag = restoreAlphaBleding;
+	if (!spans) {
+		for (i = 0; i < n; i++) {
+			gdImageFilledEllipse(im, c[i].x, c[i].y, w, h, color);
+		}
 		return;
 	}
-	/* Seek right */
-	rightLimit = x;
-	for (i = (x + 1); (i < im->sx); i++) {
-		if (gdImageGetPixel (im, i, y) == border) {
-			break;
-		}
-		gdImageSetPixel (im, i, y, color);
-		rightLimit = i;
+
+	gdEllipseScanInit(&scan, w, h);
+	for (j = 0; j < count; j++) {
+		spans[j].rows = gdEllipseScanNext(&scan, &spans[j].y, &spans[j].x1, &spans[j].x2);
 	}
-	/* Look at lines above and below and start paints */
-	/* Above */
-	if (y > 0) {
-		lastBorder = 1;
-		for (i = leftLimit; (i <= rightLimit); i++) {
-			int c;
-			c = gdImageGetPixel (im, i, y - 1);
-			if (lastBorder) {
-				if ((c != border) && (c != color)) {
-					gdImageFillToBorder (im, i, y - 1, border, color);
-					lastBorder = 0;
-				}
-			} else if ((c == border) || (c == color)) {
-				lastBorder = 1;
-			}
+	/* the spans get narrower and the rows further out */
+	height = spans[count - 1].y;
+	for (i = 0; i < n; i++, c++) {
+		if (c->x + spans[0].x2 < im->cx1 || c->x + spans[0].x1 > im->cx2
+		        || c->y + height < im->cy1 || c->y - height > im->cy2) {
+			continue;
 		}
-	}
-	/* Below */
-	if (y < ((im->sy) - 1)) {
-		lastBorder = 1;
-		for (i = leftLimit; (i <= rightLimit); i++) {
-			int c = gdImageGetPixel (im, i, y + 1);
-			if (lastBorder) {
-				if ((c != border) && (c != color)) {
-					gdImageFillToBorder (im, i, y + 1, border, color);
-					lastBorder = 0;
-				}
-			} else if ((c == border) || (c == color)) {
-				lastBorder = 1;
+		for (j = 0; j < count; j++) {
+			rows = spans[j].rows;
+			gdImageClipSetSpan(im, c->y - spans[j].y, c->x + spans[j].x1, c->x + spans[j].x2, color);
+			if (rows == 2) {
+				gdImageClipSetSpan(im, c->y + spans[j].y, c->x + spans[j].x1, c->x + spans[j].x2, color);
 			}
 		}
 	}
-	im->alphaBlendingFlag = restoreAlphaBleding;
+	gdFree(spans);
 }
 
-/*
- * set the pixel at (x,y) and its 4-connected neighbors
- * with the same pixel value to the new pixel value nc (new color).
- * A 4-connected neighbor:  pixel above, below, left, or right of a pixel.
- * ideas from comp.graphics discussions.
- * For tiled fill, the use of a flag buffer is mandatory. As the tile image can
- * contain the same color as the color to fill. To do not bloat normal filling
- * code I added a 2nd private function.
- */
+/* The flood fills below are scanline fills keeping the segments still to
+   be looked at on a stack that grows as needed, so their memory use
+   follows the outline of the filled region rather than the size of the
+   image. They stay within the clipping rectangle, and write whole runs
+   of pixels at a time where they can. */
+
+/* horizontal segment of scan line y */
+struct seg {
+	int y, xl, xr, dy;
+};
+
+typedef struct {
+	struct seg *segs;
+	int count;
+	int max;
+	/* set when out of memory, which ends the fill */
+	int failed;
+	/* the rows segments may lie in */
+	int y1, y2;
+} gdFillStack;
+
+static void gdFillStackPush (gdFillStack *stack, int y, int xl, int xr, int dy)
+{
+	if (y + dy < stack->y1 || y + dy > stack->y2 || stack->failed) {
+		return;
+	}
+	if (stack->count == stack->max) {
+		const int max = stack->max ? 2 * stack->max : 64;
+		struct seg *segs;
+		if (overflow2(sizeof(struct seg), max)) {
+			stack->failed = 1;
+			return;
+		}
+		segs = (struct seg *) gdRealloc(stack->segs, sizeof(struct seg) * max);
+		if (!segs) {
+			stack->failed = 1;
+			return;
+		}
+		stack->segs = segs;
+		stack->max = max;
+	}
+	stack->segs[stack->count].y = y;
+	stack->segs[stack->count].xl = xl;
+	stack->segs[stack->count].xr = xr;
+	stack->segs[stack->count].dy = dy;
+	stack->count++;
+}
+
+#define FILL_PUSH(Y, XL, XR, DY) gdFillStackPush(&stack, (Y), (XL), (XR), (DY))
+
+#define FILL_POP(Y, XL, XR, DY) \
+	{stack.count--; Y = stack.segs[stack.count].y + (DY = stack.segs[stack.count].dy); \
+	 XL = stack.segs[stack.count].xl; XR = stack.segs[stack.count].xr;}
 
 static int gdImageTileGet (gdImagePtr im, int x, int y)
 {
@@ -2406,218 +3175,296 @@ static int gdImageTileGet (gdImagePtr im, int x, int y)
 	return tileColor;
 }
 
+/* The pixels a fill with a special color such as gdTiled has set, as
+   those may come out in the color being replaced: one bit per pixel, in
+   rows allocated when first written to. */
+typedef struct {
+	unsigned char **rows;
+} gdFillVisited;
 
+#define FILL_VISITED(v, x, y) ((v)->rows[(y)] && ((v)->rows[(y)][(x) >> 3] & (1 << ((x) & 7))))
 
-/* horizontal segment of scan line y */
-struct seg {
-	int y, xl, xr, dy;
-};
+static int gdFillGetPixel (gdImagePtr im, int x, int y)
+{
+	return im->trueColor ? im->tpixels[y][x] : im->pixels[y][x];
+}
 
-/* max depth of stack */
-#define FILL_MAX ((int)(im->sy*im->sx)/4)
-#define FILL_PUSH(Y, XL, XR, DY) \
-	if (sp<stack+FILL_MAX && Y+(DY)>=0 && Y+(DY)<wy2) \
-	{sp->y = Y; sp->xl = XL; sp->xr = XR; sp->dy = DY; sp++;}
+/* Moves from x by step for as long as the pixels in row y are (or, if
+   same is 0, are not) oc and not yet visited, stopping at end. Returns
+   the first x that does not qualify, or end. */
+static int gdFillScan (gdImagePtr im, int x, int y, int end, int step, int oc, int same,
+                       const gdFillVisited *visited)
+{
+	if (visited) {
+		for (; x != end; x += step) {
+			const int fillable = !FILL_VISITED(visited, x, y) && gdFillGetPixel(im, x, y) == oc;
+			if (fillable != same) {
+				break;
+			}
+		}
+	} else if (im->trueColor) {
+		const int *row = im->tpixels[y];
+		for (; x != end && (row[x] == oc) == same; x += step);
+	} else {
+		const unsigned char *row = im->pixels[y];
+		for (; x != end && (row[x] == oc) == same; x += step);
+	}
+	return x;
+}
 
-#define FILL_POP(Y, XL, XR, DY) \
-	{sp--; Y = sp->y+(DY = sp->dy); XL = sp->xl; XR = sp->xr;}
+/* Sets the pixels x1 to x2 of row y to nc, drawing them with
+   gdImageSetPixel() and marking them if visited is set. Returns 0 if out
+   of memory. */
+static int gdFillRun (gdImagePtr im, int x1, int x2, int y, int nc, gdFillVisited *visited)
+{
+	int x;
 
-static void _gdImageFillTiled(gdImagePtr im, int x, int y, int nc);
+	if (visited) {
+		if (!visited->rows[y]) {
+			visited->rows[y] = (unsigned char *) gdCalloc((im->sx + 7) / 8, 1);
+			if (!visited->rows[y]) {
+				return 0;
+			}
+		}
+		for (x = x1; x <= x2; x++) {
+			visited->rows[y][x >> 3] |= 1 << (x & 7);
+			gdImageSetPixel(im, x, y, nc == gdTiled ? gdImageTileGet(im, x, y) : nc);
+		}
+		return 1;
+	}
+	if (!gdImageRowWritable(im, y)) {
+		return 0;
+	}
+	if (im->trueColor) {
+		int *row = im->tpixels[y];
+		for (x = x1; x <= x2; x++) {
+			row[x] = nc;
+		}
+	} else {
+		memset(im->pixels[y] + x1, nc, x2 - x1 + 1);
+	}
+	return 1;
+}
 
 /*
-	Function: gdImageFill
-*/
-BGD_DECLARE(void) gdImageFill(gdImagePtr im, int x, int y, int nc)
+ * set the pixel at (x,y) and its 4-connected neighbors
+ * with the same pixel value to the new pixel value nc (new color).
+ * A 4-connected neighbor:  pixel above, below, left, or right of a pixel.
+ * ideas from comp.graphics discussions.
+ * For tiled fill, the use of a flag buffer is mandatory. As the tile image can
+ * contain the same color as the color to fill. The same goes for the other
+ * special colors, which visited is set for.
+ */
+static void gdImageFloodFill (gdImagePtr im, int x, int y, int oc, int nc, gdFillVisited *visited)
 {
+	const int wx1 = im->cx1, wx2 = im->cx2;
 	int l, x1, x2, dy;
-	int oc;   /* old pixel value */
-	int wx2,wy2;
+	gdFillStack stack;
 
-	int alphablending_bak;
+	stack.segs = NULL;
+	stack.count = stack.max = 0;
+	stack.failed = 0;
+	stack.y1 = im->cy1;
+	stack.y2 = im->cy2;
 
-	/* stack of filled segments */
-	/* struct seg stack[FILL_MAX],*sp = stack; */
-	struct seg *stack;
-	struct seg *sp;
+	/* required! */
+	FILL_PUSH(y, x, x, 1);
+	/* seed segment (popped 1st) */
+	FILL_PUSH(y + 1, x, x, -1);
+	while (stack.count > 0 && !stack.failed) {
+		FILL_POP(y, x1, x2, dy);
 
-	if (!im->trueColor && nc > (im->colorsTotal - 1)) {
-		return;
+		x = gdFillScan(im, x1, y, wx1 - 1, -1, oc, 1, visited);
+		if (x >= x1) {
+			goto skip;
+		}
+		l = x + 1;
+		if (!gdFillRun(im, l, x1, y, nc, visited)) {
+			break;
+		}
+
+		/* leak on left? */
+		if (l < x1) {
+			FILL_PUSH(y, l, x1 - 1, -dy);
+		}
+		x = x1 + 1;
+		do {
+			const int start = x;
+			x = gdFillScan(im, x, y, wx2 + 1, 1, oc, 1, visited);
+			if (x > start && !gdFillRun(im, start, x - 1, y, nc, visited)) {
+				stack.failed = 1;
+				break;
+			}
+			FILL_PUSH(y, l, x - 1, dy);
+			/* leak on right? */
+			if (x > x2 + 1) {
+				FILL_PUSH(y, x2 + 1, x - 1, -dy);
+			}
+skip:
+			x = x + 1 > x2 ? x + 1 : gdFillScan(im, x + 1, y, x2 + 1, 1, oc, 0, visited);
+			l = x;
+		} while (x <= x2);
 	}
 
-	alphablending_bak = im->alphaBlendingFlag;
-	im->alphaBlendingFlag = 0;
+	gdFree(stack.segs);
+}
 
-	if (nc==gdTiled) {
-		_gdImageFillTiled(im,x,y,nc);
-		im->alphaBlendingFlag = alphablending_bak;
-		return;
-	}
+/* A frame of the scan of the rows next to a filled run by
+   gdImageFillToBorder(), starting fills where that finds unfilled pixels
+   in the order the recursive implementation it replaces did. */
+typedef struct {
+	int y, left, right;
+	/* the next pixel to look at, and whether in the row above or below */
+	int i, below;
+	int lastBorder;
+} gdFillToBorderFrame;
 
-	wx2=im->sx;
-	wy2=im->sy;
-	oc = gdImageGetPixel(im, x, y);
-	if (oc==nc || x<0 || x>wx2 || y<0 || y>wy2) {
-		im->alphaBlendingFlag = alphablending_bak;
-		return;
-	}
+/* Fills the run of non border pixels in row y around x with color,
+   pushing the frame to scan the rows next to it. Returns 0 if out of
+   memory. */
+static int gdFillToBorderRun (gdImagePtr im, int x, int y, int border, int color,
+                              gdFillToBorderFrame **frames, int *count, int *max)
+{
+	gdFillToBorderFrame *frame;
+	int left, right;
 
-	/* Do not use the 4 neighbors implementation with
-	* small images
-	*/
-	if (im->sx < 4) {
-		int ix = x, iy = y, c;
-		do {
-			do {
-				c = gdImageGetPixel(im, ix, iy);
-				if (c != oc) {
-					goto done;
-				}
-				gdImageSetPixel(im, ix, iy, nc);
-			} while(ix++ < (im->sx -1));
-			ix = x;
-		} while(iy++ < (im->sy -1));
-		goto done;
+	if (gdFillGetPixel(im, x, y) == border) {
+		return 1;
 	}
+	left = gdFillScan(im, x, y, im->cx1 - 1, -1, border, 0, NULL) + 1;
+	right = gdFillScan(im, x, y, im->cx2 + 1, 1, border, 0, NULL) - 1;
+	if (!gdFillRun(im, left, right, y, color, NULL)) {
+		return 0;
+	}
+
+	if (*count == *max) {
+		const int newMax = *max ? 2 * *max : 64;
+		gdFillToBorderFrame *newFrames;
+		if (overflow2(sizeof(gdFillToBorderFrame), newMax)) {
+			return 0;
+		}
+		newFrames = (gdFillToBorderFrame *) gdRealloc(*frames, sizeof(gdFillToBorderFrame) * newMax);
+		if (!newFrames) {
+			return 0;
+		}
+		*frames = newFrames;
+		*max = newMax;
+	}
+	frame = *frames + (*count)++;
+	frame->y = y;
+	frame->left = left;
+	frame->right = right;
+	frame->i = left;
+	frame->below = 0;
+	frame->lastBorder = 1;
+	return 1;
+}
+
+/*
+	Function: gdImageFillToBorder
+*/
+BGD_DECLARE(void) gdImageFillToBorder (gdImagePtr im, int x, int y, int border, int color)
+{
+	gdFillToBorderFrame *frames = NULL;
+	int count = 0, max = 0;
 
-	if(overflow2(im->sy, im->sx)) {
+	if (border < 0 || color < 0) {
+		/* Refuse to fill to a non-solid border */
 		return;
 	}
 
-	if(overflow2(sizeof(struct seg), ((im->sy * im->sx) / 4))) {
-		return;
+	if (!im->trueColor) {
+		if (color > (im->colorsTotal - 1) || border > (im->colorsTotal - 1)) {
+			return;
+		}
 	}
 
-	stack = (struct seg *)gdMalloc(sizeof(struct seg) * ((int)(im->sy*im->sx)/4));
-	if (!stack) {
+	if (x >= im->sx) {
+		x = im->sx - 1;
+	} else if (x < 0) {
+		x = 0;
+	}
+	if (y >= im->sy) {
+		y = im->sy - 1;
+	} else if (y < 0) {
+		y = 0;
+	}
+	if (x < im->cx1 || x > im->cx2 || y < im->cy1 || y > im->cy2) {
 		return;
 	}
-	sp = stack;
-
-	/* required! */
-	FILL_PUSH(y,x,x,1);
-	/* seed segment (popped 1st) */
-	FILL_PUSH(y+1, x, x, -1);
-	while (sp>stack) {
-		FILL_POP(y, x1, x2, dy);
 
-		for (x=x1; x>=0 && gdImageGetPixel(im,x, y)==oc; x--) {
-			gdImageSetPixel(im,x, y, nc);
-		}
-		if (x>=x1) {
-			goto skip;
-		}
-		l = x+1;
-
-		/* leak on left? */
-		if (l<x1) {
-			FILL_PUSH(y, l, x1-1, -dy);
-		}
-		x = x1+1;
-		do {
-			for (; x<=wx2 && gdImageGetPixel(im,x, y)==oc; x++) {
-				gdImageSetPixel(im, x, y, nc);
+	if (!gdFillToBorderRun(im, x, y, border, color, &frames, &count, &max)) {
+		count = 0;
+	}
+	/* Look at lines above and below and start paints */
+	while (count > 0) {
+		gdFillToBorderFrame *frame = frames + count - 1;
+		const int row = frame->below ? frame->y + 1 : frame->y - 1;
+		int c;
+
+		if (frame->i > frame->right || row < im->cy1 || row > im->cy2) {
+			if (frame->below) {
+				count--;
+			} else {
+				frame->below = 1;
+				frame->i = frame->left;
+				frame->lastBorder = 1;
 			}
-			FILL_PUSH(y, l, x-1, dy);
-			/* leak on right? */
-			if (x>x2+1) {
-				FILL_PUSH(y, x2+1, x-1, -dy);
+			continue;
+		}
+		c = gdFillGetPixel(im, frame->i, row);
+		frame->i++;
+		if (frame->lastBorder) {
+			if ((c != border) && (c != color)) {
+				frame->lastBorder = 0;
+				if (!gdFillToBorderRun(im, frame->i - 1, row, border, color, &frames, &count, &max)) {
+					break;
+				}
 			}
-skip:
-			for (x++; x<=x2 && (gdImageGetPixel(im, x, y)!=oc); x++);
-
-			l = x;
-		} while (x<=x2);
+		} else if ((c == border) || (c == color)) {
+			frame->lastBorder = 1;
+		}
 	}
-
-	gdFree(stack);
-
-done:
-	im->alphaBlendingFlag = alphablending_bak;
+	gdFree(frames);
 }
 
-static void _gdImageFillTiled(gdImagePtr im, int x, int y, int nc)
+/*
+	Function: gdImageFill
+*/
+BGD_DECLARE(void) gdImageFill(gdImagePtr im, int x, int y, int nc)
 {
-	int l, x1, x2, dy;
 	int oc;   /* old pixel value */
-	int wx2,wy2;
-	/* stack of filled segments */
-	struct seg *stack;
-	struct seg *sp;
-	char *pts;
-
-	if (!im->tile) {
-		return;
-	}
-
-	wx2=im->sx;
-	wy2=im->sy;
-
-	if(overflow2(im->sy, im->sx)) {
-		return;
-	}
-
-	if(overflow2(sizeof(struct seg), ((im->sy * im->sx) / 4))) {
-		return;
-	}
+	int alphablending_bak;
 
-	pts = (char *) gdCalloc(im->sy * im->sx, sizeof(char));
-	if (!pts) {
+	if (!im->trueColor && nc > (im->colorsTotal - 1)) {
 		return;
 	}
-
-	stack = (struct seg *)gdMalloc(sizeof(struct seg) * ((int)(im->sy*im->sx)/4));
-	if (!stack) {
-		gdFree(pts);
+	if (x < im->cx1 || x > im->cx2 || y < im->cy1 || y > im->cy2) {
 		return;
 	}
-	sp = stack;
 
-	oc = gdImageGetPixel(im, x, y);
+	alphablending_bak = im->alphaBlendingFlag;
+	im->alphaBlendingFlag = 0;
 
-	/* required! */
-	FILL_PUSH(y,x,x,1);
-	/* seed segment (popped 1st) */
-	FILL_PUSH(y+1, x, x, -1);
-	while (sp>stack) {
-		FILL_POP(y, x1, x2, dy);
-		for (x=x1; x>=0 && (!pts[y + x*wy2] && gdImageGetPixel(im,x,y)==oc); x--) {
-			nc = gdImageTileGet(im,x,y);
-			pts[y + x*wy2]=1;
-			gdImageSetPixel(im,x, y, nc);
-		}
-		if (x>=x1) {
-			goto skip;
-		}
-		l = x+1;
+	oc = gdFillGetPixel(im, x, y);
+	if (nc < 0) {
+		gdFillVisited visited;
 
-		/* leak on left? */
-		if (l<x1) {
-			FILL_PUSH(y, l, x1-1, -dy);
-		}
-		x = x1+1;
-		do {
-			for (; x<wx2 && (!pts[y + x*wy2] && gdImageGetPixel(im,x, y)==oc) ; x++) {
-				if (pts[y + x*wy2]) {
-					/* we should never be here */
-					break;
+		if (nc != gdTiled || im->tile) {
+			visited.rows = (unsigned char **) gdCalloc(im->sy, sizeof(unsigned char *));
+			if (visited.rows) {
+				gdImageFloodFill(im, x, y, oc, nc, &visited);
+				for (y = 0; y < im->sy; y++) {
+					gdFree(visited.rows[y]);
 				}
-				nc = gdImageTileGet(im,x,y);
-				pts[y + x*wy2]=1;
-				gdImageSetPixel(im, x, y, nc);
-			}
-			FILL_PUSH(y, l, x-1, dy);
-			/* leak on right? */
-			if (x>x2+1) {
-				FILL_PUSH(y, x2+1, x-1, -dy);
+				gdFree(visited.rows);
 			}
-skip:
-			for (x++; x<=x2 && (pts[y + x*wy2] || gdImageGetPixel(im,x, y)!=oc); x++);
-			l = x;
-		} while (x<=x2);
+		}
+	} else if (oc != nc) {
+		gdImageFloodFill(im, x, y, oc, nc, NULL);
 	}
 
-	gdFree(pts);
-	gdFree(stack);
+	im->alphaBlendingFlag = alphablending_bak;
 }
 
 /**
@@ -2749,6 +3596,20 @@ static void _gdImageFilledHRectangle (gdImagePtr im, int x1, int y1, int x2, int
 		y2 = gdImageSY(im) - 1;
 	}
 
+	if (color >= 0) {
+		/* plain colors are filled a row at a time */
+		x1 = MAX(x1, im->cx1);
+		x2 = MIN(x2, im->cx2);
+		y1 = MAX(y1, im->cy1);
+		y2 = MIN(y2, im->cy2);
+		if (x1 <= x2) {
+			for (y = y1; y <= y2; y++) {
+				gdImageSetSpan(im, y, x1, x2, color);
+			}
+		}
+		return;
+	}
+
 	for (x = x1; (x <= x2); x++) {
 		for (y = y1; (y <= y2); y++) {
 			gdImageSetPixel (im, x, y, color);
@@ -2794,6 +3655,20 @@ static void _gdImageFilledVRectangle (gdImagePtr im, int x1, int y1, int x2, int
 		y2 = gdImageSY(im) - 1;
 	}
 
+	if (color >= 0) {
+		/* plain colors are filled a row at a time */
+		x1 = MAX(x1, im->cx1);
+		x2 = MIN(x2, im->cx2);
+		y1 = MAX(y1, im->cy1);
+		y2 = MIN(y2, im->cy2);
+		if (x1 <= x2) {
+			for (y = y1; y <= y2; y++) {
+				gdImageSetSpan(im, y, x1, x2, color);
+			}
+		}
+		return;
+	}
+
 	for (y = y1; (y <= y2); y++) {
 		for (x = x1; (x <= x2); x++) {
 			gdImageSetPixel (im, x, y, color);
@@ -2811,35 +3686,93 @@ BGD_DECLARE(void) gdImageFilledRectangle (gdImagePtr im, int x1, int y1, int x2,
 }
 
 /**
- * Group: Cloning and Copying
- */
-
-/**
- * Function: gdImageClone
+ * Function: gdImageFilledRectangles
  *
- * Clones an image
+ * Draws a batch of filled rectangles
  *
- * Creates an exact duplicate of the given image.
+ * Fills each of the _n_ rectangles, like as many calls of
+ * <gdImageFilledRectangle> would; rectangles with a width or height of
+ * zero or less are skipped. For plain colors, the rectangles are clipped
+ * and filled a row at a time, which makes drawing the many bars of a
+ * chart this way considerably faster.
  *
  * Parameters:
- *   src - The source image.
+ *   im    - The image.
+ *   r     - The rectangles.
+ *   n     - The number of rectangles.
+ *   color - The color.
  *
- * Returns:
- *   The cloned image on success, NULL on failure.
+ * See also:
+ *   - <gdImageFilledRectangle>
  */
-BGD_DECLARE(gdImagePtr) gdImageClone (gdImagePtr src) {
-	gdImagePtr dst;
-	register int i, x;
+BGD_DECLARE(void) gdImageFilledRectangles (gdImagePtr im, const gdRect *r, int n, int color)
+{
+	int i, x1, y1, x2, y2, y;
 
-	if (src->trueColor) {
-		dst = gdImageCreateTrueColor(src->sx , src->sy);
-	} else {
-		dst = gdImageCreate(src->sx , src->sy);
+	for (i = 0; i < n; i++, r++) {
+		if (r->width <= 0 || r->height <= 0) {
+			continue;
+		}
+		if (color < 0) {
+			gdImageFilledRectangle(im, r->x, r->y,
+			                       r->x + (r->width - 1), r->y + (r->height - 1), color);
+			continue;
+		}
+		if (r->x > im->cx2 || r->y > im->cy2
+		        || r->x < im->cx1 - (r->width - 1) || r->y < im->cy1 - (r->height - 1)) {
+			continue;
+		}
+		x1 = MAX(r->x, im->cx1);
+		y1 = MAX(r->y, im->cy1);
+		x2 = r->x > im->cx2 - (r->width - 1) ? im->cx2 : r->x + (r->width - 1);
+		y2 = r->y > im->cy2 - (r->height - 1) ? im->cy2 : r->y + (r->height - 1);
+		/* empty for a clipping rectangle with cx1 > cx2 */
+		if (x1 > x2) {
+			continue;
+		}
+		for (y = y1; y <= y2; y++) {
+			gdImageSetSpan(im, y, x1, x2, color);
+		}
 	}
+}
+
+/**
+ * Group: Cloning and Copying
+ */
+
+/* Duplicates src, sharing its pixel rows if share is set */
+static gdImagePtr gdImageDuplicate (gdImagePtr src, int share)
+{
+	gdImagePtr dst;
+	register int i, y;
 
+	dst = (gdImage *) gdCalloc(1, sizeof(gdImage));
 	if (dst == NULL) {
 		return NULL;
 	}
+	dst->sx = src->sx;
+	dst->sy = src->sy;
+	gdImageInitState(dst, src->trueColor);
+
+	if (!share || !gdImageShareRows(src, dst)) {
+		/* copy the pixels of src */
+		gdFree(dst);
+		if (src->trueColor) {
+			dst = gdImageCreateTrueColor(src->sx , src->sy);
+		} else {
+			dst = gdImageCreate(src->sx , src->sy);
+		}
+		if (dst == NULL) {
+			return NULL;
+		}
+		for (y = 0; y < src->sy; y++) {
+			if (src->trueColor) {
+				memcpy(dst->tpixels[y], src->tpixels[y], src->sx * sizeof(int));
+			} else {
+				memcpy(dst->pixels[y], src->pixels[y], src->sx);
+			}
+		}
+	}
 
 	if (src->trueColor == 0) {
 		dst->colorsTotal = src->colorsTotal;
@@ -2850,17 +3783,6 @@ BGD_DECLARE(gdImagePtr) gdImageClone (gdImagePtr src) {
 			dst->alpha[i] = src->alpha[i];
 			dst->open[i]  = src->open[i];
 		}
-		for (i = 0; i < src->sy; i++) {
-			for (x = 0; x < src->sx; x++) {
-				dst->pixels[i][x] = src->pixels[i][x];
-			}
-		}
-	} else {
-		for (i = 0; i < src->sy; i++) {
-			for (x = 0; x < src->sx; x++) {
-				dst->tpixels[i][x] = src->tpixels[i][x];
-			}
-		}
 	}
 
 	dst->interlace   = src->interlace;
@@ -2886,13 +3808,14 @@ BGD_DECLARE(gdImagePtr) gdImageClone (gdImagePtr src) {
 
 	dst->interpolation_id = src->interpolation_id;
 	dst->interpolation    = src->interpolation;
+	dst->threads          = src->threads;
 
 	if (src->brush) {
-		dst->brush = gdImageClone(src->brush);
+		dst->brush = gdImageDuplicate(src->brush, share);
 	}
 
 	if (src->tile) {
-		dst->tile = gdImageClone(src->tile);
+		dst->tile = gdImageDuplicate(src->tile, share);
 	}
 
 	if (src->style) {
@@ -2905,14 +3828,208 @@ BGD_DECLARE(gdImagePtr) gdImageClone (gdImagePtr src) {
 		dst->tileColorMap[i] = src->tileColorMap[i];
 	}
 
-	if (src->polyAllocated > 0) {
-		dst->polyAllocated = src->polyAllocated;
-		for (i = 0; i < src->polyAllocated; i++) {
-			dst->polyInts[i] = src->polyInts[i];
+	/* polyInts is scratch space of the polygon functions, allocated on
+	   demand; there is nothing to copy */
+
+	return dst;
+}
+
+/**
+ * Function: gdImageClone
+ *
+ * Clones an image
+ *
+ * Creates an exact duplicate of the given image.
+ *
+ * Parameters:
+ *   src - The source image.
+ *
+ * Returns:
+ *   The cloned image on success, NULL on failure.
+ *
+ * See also:
+ *   - <gdImageCloneShared>
+ */
+BGD_DECLARE(gdImagePtr) gdImageClone (gdImagePtr src)
+{
+	return gdImageDuplicate(src, 0);
+}
+
+/**
+ * Function: gdImageCloneShared
+ *
+ * Clones an image, sharing its pixels
+ *
+ * Like <gdImageClone>, but the pixels are not copied right away: the
+ * clone shares the pixel rows of the original, and each row is only
+ * copied when either image first writes to it. Cloning is thus cheap,
+ * even for large images of which only a few rows are changed afterwards.
+ *
+ * All drawing functions of libgd take care of the sharing. Code writing
+ * to _im->pixels_ or _im->tpixels_ directly has to call <gdImageUnshare>
+ * first, for the original as well as for the clone; otherwise the write
+ * shows in both.
+ *
+ * Several threads may clone the same image at once, as long as none of
+ * them writes to it. What the original keeps for sharing is allocated
+ * where the original lives, also if the clone is made while an arena is
+ * bound to the thread (see <gdArenaUse>). Such a clone has to be
+ * destroyed before the arena is reset, or the rows it shares with the
+ * original are never freed.
+ *
+ * Parameters:
+ *   src - The source image.
+ *
+ * Returns:
+ *   The cloned image on success, NULL on failure.
+ */
+BGD_DECLARE(gdImagePtr) gdImageCloneShared (gdImagePtr src)
+{
+	return gdImageDuplicate(src, 1);
+}
+
+/* Whether copying the area of src onto dst a span at a time gives the
+   same result as one pixel at a time: the areas may not overlap, and all
+   of the source area has to be readable (gdImageGetPixel() reads pixels
+   outside of the clipping rectangle as 0). */
+static int gdImageCopySpansSafe (gdImagePtr dst, gdImagePtr src, int srcX, int srcY, int w, int h)
+{
+	return dst != src && w > 0 && h > 0
+	       && srcX >= src->cx1 && srcY >= src->cy1
+	       && srcX + w - 1 <= src->cx2 && srcY + h - 1 <= src->cy2;
+}
+
+/* Whether the effect set by gdImageAlphaBlending() replaces pixels */
+#define gdImageEffectReplaces(im) \
+	((im)->alphaBlendingFlag != gdEffectAlphaBlend && (im)->alphaBlendingFlag != gdEffectNormal \
+	 && (im)->alphaBlendingFlag != gdEffectOverlay && (im)->alphaBlendingFlag != gdEffectMultiply)
+
+/* Draws the truecolor pixels of row, x1 to x2, onto row y of dst, except
+   for those equal to key (none if it is -1): with a masked copy if the effect of dst
+   replaces pixels, otherwise by blending the runs of pixels to draw. */
+static void gdImageCopyTrueColorRow (gdImagePtr dst, int y, int x1, int x2, const int *row, int key)
+{
+	int x, end;
+
+	if (gdImageEffectReplaces(dst)) {
+		if (!gdImageRowWritable(dst, y)) {
+			return;
+		}
+		if (key == -1) {
+			memcpy(dst->tpixels[y] + x1, row, (x2 - x1 + 1) * sizeof(int));
+		} else {
+			_gdCopyKeyedSpan(dst->tpixels[y] + x1, row, x2 - x1 + 1, key);
+		}
+		return;
+	}
+	for (x = 0; x <= x2 - x1; x = end) {
+		while (x <= x2 - x1 && row[x] == key) {
+			x++;
+		}
+		for (end = x; end <= x2 - x1 && row[end] != key; end++);
+		if (end > x) {
+			gdImageBlendSpan(dst, x1 + x, y, end - x, row + x);
 		}
 	}
+}
 
-	return dst;
+/* gdImageCopy() a row at a time, for areas gdImageCopySpansSafe() allows.
+   Gives the same result as the per pixel loops, including the order in
+   which colors are allocated in a palette destination. Returns 0 if it
+   can't do the copy, leaving dst untouched. */
+static int gdImageCopyRows (gdImagePtr dst, gdImagePtr src, int dstX, int dstY,
+                            int srcX, int srcY, int w, int h)
+{
+	const int offset = srcX - dstX;
+	int x1, x2, y;
+
+	/* the part of the destination area inside of the clipping rectangle */
+	x1 = MAX(dstX, dst->cx1);
+	x2 = MIN(dstX + w - 1, dst->cx2);
+
+	if (dst->trueColor && src->trueColor) {
+		for (y = MAX(dstY, dst->cy1); y <= MIN(dstY + h - 1, dst->cy2) && x1 <= x2; y++) {
+			gdImageCopyTrueColorRow(dst, y, x1, x2,
+			                        src->tpixels[y - dstY + srcY] + x1 + offset, src->transparent);
+		}
+	} else if (dst->trueColor) {
+		/* palette to truecolor: map each row through a table of the
+		   colors, with a key marking the transparent color */
+		int lut[gdMaxColors];
+		int *row;
+		int i, key = -1;
+
+		if (x1 > x2) {
+			return 1;
+		}
+		row = (int *) gdMalloc(sizeof(int) * (x2 - x1 + 1));
+		if (!row) {
+			return 0;
+		}
+		for (i = 0; i < gdMaxColors; i++) {
+			lut[i] = gdTrueColorAlpha(src->red[i], src->green[i], src->blue[i], src->alpha[i]);
+		}
+		if (src->transparent >= 0 && src->transparent < gdMaxColors) {
+			/* no color has the sign bit set, and -1 would mean no key */
+			key = -2;
+			lut[src->transparent] = key;
+		}
+		for (y = MAX(dstY, dst->cy1); y <= MIN(dstY + h - 1, dst->cy2); y++) {
+			const unsigned char *srcRow = src->pixels[y - dstY + srcY] + x1 + offset;
+			for (i = 0; i <= x2 - x1; i++) {
+				row[i] = lut[srcRow[i]];
+			}
+			gdImageCopyTrueColorRow(dst, y, x1, x2, row, key);
+		}
+		gdFree(row);
+	} else if (!src->trueColor) {
+		/* palette to palette: the colors are resolved in the order the
+		   pixel loop meets them, for all of the area, even where it is
+		   clipped */
+		int colorMap[gdMaxColors];
+		int identity = 1;
+		int i, x;
+
+		for (i = 0; i < gdMaxColors; i++) {
+			colorMap[i] = -1;
+		}
+		for (y = 0; y < h; y++) {
+			const unsigned char *srcRow = src->pixels[srcY + y] + srcX;
+			unsigned char *dstRow;
+			const int toy = dstY + y;
+
+			for (x = 0; x < w; x++) {
+				const int c = srcRow[x];
+				if (c != src->transparent && colorMap[c] == -1) {
+					colorMap[c] = gdImageColorResolveAlpha(dst, src->red[c], src->green[c],
+					                                       src->blue[c], src->alpha[c]);
+					if (colorMap[c] != c) {
+						identity = 0;
+					}
+				}
+			}
+			if (toy < dst->cy1 || toy > dst->cy2 || x1 > x2 || !gdImageRowWritable(dst, toy)) {
+				continue;
+			}
+			srcRow += x1 - dstX;
+			dstRow = dst->pixels[toy] + x1;
+			if (identity && src->transparent < 0) {
+				memcpy(dstRow, srcRow, x2 - x1 + 1);
+			} else if (identity) {
+				_gdCopyKeyedSpan8(dstRow, srcRow, x2 - x1 + 1, src->transparent);
+			} else {
+				for (x = 0; x <= x2 - x1; x++) {
+					if (srcRow[x] != src->transparent) {
+						dstRow[x] = (unsigned char) colorMap[srcRow[x]];
+					}
+				}
+			}
+		}
+	} else {
+		/* truecolor to palette resolves each pixel anyway */
+		return 0;
+	}
+	return 1;
 }
 
 /**
@@ -2943,6 +4060,11 @@ BGD_DECLARE(void) gdImageCopy (gdImagePtr dst, gdImagePtr src, int dstX, int dst
 	int i;
 	int colorMap[gdMaxColors];
 
+	if (gdImageCopySpansSafe(dst, src, srcX, srcY, w, h)
+	        && gdImageCopyRows(dst, src, dstX, dstY, srcX, srcY, w, h)) {
+		return;
+	}
+
 	if (dst->trueColor) {
 		/* 2.0: much easier when the destination is truecolor. */
 		/* 2.0.10: needs a transparent-index check that is still valid if
@@ -3021,6 +4143,61 @@ BGD_DECLARE(void) gdImageCopy (gdImagePtr dst, gdImagePtr src, int dstX, int dst
 	}
 }
 
+/* gdImageCopyMerge() for truecolor images, merging a row at a time and
+   drawing the runs of non transparent pixels as spans. Returns 0 if out
+   of memory. */
+static int gdImageCopyMergeSpans (gdImagePtr dst, gdImagePtr src, int dstX, int dstY,
+                                  int srcX, int srcY, int w, int h, int pct)
+{
+	const int transparent = src->transparent;
+	const int offset = srcX - dstX;
+	int *merged;
+	int x, y, x1, x2, end;
+
+	/* only the part inside of the clipping rectangle of dst is drawn */
+	x1 = MAX(dstX, dst->cx1);
+	x2 = MIN(dstX + w - 1, dst->cx2);
+	if (x1 > x2) {
+		return 1;
+	}
+	merged = (int *) gdMalloc(sizeof(int) * (x2 - x1 + 1));
+	if (!merged) {
+		return 0;
+	}
+	for (y = 0; y < h; y++) {
+		const int toy = dstY + y;
+		const int *row, *dstRow;
+
+		if (toy < dst->cy1 || toy > dst->cy2) {
+			continue;
+		}
+		row = src->tpixels[srcY + y];
+		dstRow = dst->tpixels[toy];
+		for (x = x1; x <= x2; x = end) {
+			while (x <= x2 && row[x + offset] == transparent) {
+				x++;
+			}
+			for (end = x; end <= x2 && row[end + offset] != transparent; end++) {
+				const int c = row[end + offset];
+				const int dc = dstRow[end];
+				/* the same arithmetic as gdImageCopyMerge() */
+				const int ncR = gdTrueColorGetRed(c) * (pct / 100.0)
+				                + gdTrueColorGetRed(dc) * ((100 - pct) / 100.0);
+				const int ncG = gdTrueColorGetGreen(c) * (pct / 100.0)
+				                + gdTrueColorGetGreen(dc) * ((100 - pct) / 100.0);
+				const int ncB = gdTrueColorGetBlue(c) * (pct / 100.0)
+				                + gdTrueColorGetBlue(dc) * ((100 - pct) / 100.0);
+				merged[end - x1] = gdTrueColorAlpha(ncR, ncG, ncB, gdAlphaOpaque);
+			}
+			if (end > x) {
+				gdImageBlendSpan(dst, x, toy, end - x, merged + (x - x1));
+			}
+		}
+	}
+	gdFree(merged);
+	return 1;
+}
+
 /**
  * Function: gdImageCopyMerge
  *
@@ -3055,6 +4232,12 @@ BGD_DECLARE(void) gdImageCopyMerge (gdImagePtr dst, gdImagePtr src, int dstX, in
 	int x, y;
 	int tox, toy;
 	int ncR, ncG, ncB;
+
+	if (dst->trueColor && src->trueColor
+	        && gdImageCopySpansSafe(dst, src, srcX, srcY, w, h)
+	        && gdImageCopyMergeSpans(dst, src, dstX, dstY, srcX, srcY, w, h, pct)) {
+		return;
+	}
 	toy = dstY;
 	for (y = srcY; (y < (srcY + h)); y++) {
 		tox = dstX;
@@ -3419,6 +4602,182 @@ BGD_DECLARE(void) gdImageCopyRotated (gdImagePtr dst,
 	}
 }
 
+/* How much of each source pixel the pixels of a row or column of the
+   destination cover when gdImageCopyResampled() maps srcLen pixels onto
+   dstLen pixels. Destination pixel d covers source pixels first[d] to
+   first[d] + count[d] - 1, and their coverage follows in weight, in units
+   of 1 / dstLen of a source pixel, so the weights of each destination
+   pixel add up to srcLen exactly. */
+typedef struct {
+	int *first;
+	int *count;
+	int *weight;
+} gdCoverageTable;
+
+static int gdCoverageTableInit (gdCoverageTable *table, int dstLen, int srcLen)
+{
+	int d, n = 0;
+
+	/* a destination pixel covers at most one more source pixel than it
+	   shares with its neighbors, so there are fewer than srcLen + dstLen
+	   weights */
+	if (overflow2(dstLen, 2 * sizeof(int)) || srcLen > INT_MAX - dstLen
+	        || overflow2(srcLen + dstLen, sizeof(int))) {
+		return 0;
+	}
+	table->first = (int *) gdMalloc(2 * dstLen * sizeof(int));
+	table->weight = (int *) gdMalloc((srcLen + dstLen) * sizeof(int));
+	if (!table->first || !table->weight) {
+		gdFree(table->first);
+		gdFree(table->weight);
+		return 0;
+	}
+	table->count = table->first + dstLen;
+	for (d = 0; d < dstLen; d++) {
+		const int64_t lo = (int64_t) d * srcLen;
+		const int64_t hi = lo + srcLen;
+		int i = (int) (lo / dstLen);
+
+		table->first[d] = i;
+		table->count[d] = 0;
+		for (; (int64_t) i * dstLen < hi; i++) {
+			const int64_t start = MAX(lo, (int64_t) i * dstLen);
+			const int64_t end = MIN(hi, (int64_t) (i + 1) * dstLen);
+			table->weight[n++] = (int) (end - start);
+			table->count[d]++;
+		}
+	}
+	return 1;
+}
+
+static void gdCoverageTableFree (gdCoverageTable *table)
+{
+	gdFree(table->first);
+	gdFree(table->weight);
+}
+
+/* Averages a row of the source area of gdImageCopyResampled() over the
+   destination columns: the sums of the alpha values, and of the channels
+   weighted by their opacity, with the coverage of the source pixels. */
+static void gdImageResampleRow (const int *row, const gdCoverageTable *cols, int dstW, int64_t *sums)
+{
+	const int *weight = cols->weight;
+	int x, i;
+
+	for (x = 0; x < dstW; x++) {
+		const int *p = row + cols->first[x];
+		int64_t alpha = 0, red = 0, green = 0, blue = 0;
+
+		for (i = 0; i < cols->count[x]; i++) {
+			const int w = *weight++;
+			const int a = gdTrueColorGetAlpha(p[i]);
+			const int64_t opacity = (int64_t) w * (gdAlphaMax - a);
+
+			alpha += w * a;
+			red += opacity * gdTrueColorGetRed(p[i]);
+			green += opacity * gdTrueColorGetGreen(p[i]);
+			blue += opacity * gdTrueColorGetBlue(p[i]);
+		}
+		sums[4 * x] = alpha;
+		sums[4 * x + 1] = red;
+		sums[4 * x + 2] = green;
+		sums[4 * x + 3] = blue;
+	}
+}
+
+/* gdImageCopyResampled() for a truecolor destination and a source area
+   inside of the clipping rectangle of src, as separate passes over the
+   rows and the columns of coverage tables computed once. The weights of
+   a destination pixel are the products of its row and column coverage,
+   and all sums are exact integers, so this gives the box average the
+   per pixel loop approximates in floating point. Returns 0 if out of
+   memory. */
+static int gdImageCopyResampledRows (gdImagePtr dst, gdImagePtr src, int dstX, int dstY,
+                                     int srcX, int srcY, int dstW, int dstH, int srcW, int srcH)
+{
+	gdCoverageTable cols, rows;
+	const int *weight;
+	int64_t *rowSums = NULL, *sums = NULL;
+	int *srcRow = NULL, *out = NULL;
+	const int64_t area = (int64_t) srcW * srcH;
+	int cachedRow = -1;
+	int ok = 0;
+	int x, y, i;
+
+	if (!gdCoverageTableInit(&cols, dstW, srcW)) {
+		return 0;
+	}
+	if (!gdCoverageTableInit(&rows, dstH, srcH)) {
+		gdCoverageTableFree(&cols);
+		return 0;
+	}
+	if (overflow2(4 * sizeof(int64_t), dstW)) {
+		goto done;
+	}
+	rowSums = (int64_t *) gdMalloc(4 * sizeof(int64_t) * dstW);
+	sums = (int64_t *) gdMalloc(4 * sizeof(int64_t) * dstW);
+	out = (int *) gdMalloc(sizeof(int) * dstW);
+	if (!src->trueColor) {
+		srcRow = (int *) gdMalloc(sizeof(int) * srcW);
+	}
+	if (!rowSums || !sums || !out || (!src->trueColor && !srcRow)) {
+		goto done;
+	}
+
+	weight = rows.weight;
+	for (y = 0; y < dstH; y++) {
+		if (dstY + y < dst->cy1 || dstY + y > dst->cy2) {
+			weight += rows.count[y];
+			continue;
+		}
+		memset(sums, 0, 4 * sizeof(int64_t) * dstW);
+		for (i = 0; i < rows.count[y]; i++) {
+			const int64_t w = *weight++;
+			const int sy = rows.first[y] + i;
+
+			/* consecutive destination rows share at most one source
+			   row, the last one averaged */
+			if (sy != cachedRow) {
+				const int *row;
+				if (src->trueColor) {
+					row = src->tpixels[srcY + sy] + srcX;
+				} else {
+					gdImageGetTrueColorSpan(src, srcX, srcY + sy, srcW, srcRow);
+					row = srcRow;
+				}
+				gdImageResampleRow(row, &cols, dstW, rowSums);
+				cachedRow = sy;
+			}
+			for (x = 0; x < 4 * dstW; x++) {
+				sums[x] += w * rowSums[x];
+			}
+		}
+		for (x = 0; x < dstW; x++) {
+			const int64_t *sum = sums + 4 * x;
+			/* the sum of the opacities weighted with the coverage */
+			const int64_t opacity = gdAlphaMax * area - sum[0];
+
+			if (opacity) {
+				out[x] = gdTrueColorAlpha((int) (sum[1] / opacity), (int) (sum[2] / opacity),
+				                          (int) (sum[3] / opacity), (int) (sum[0] / area));
+			} else {
+				out[x] = gdTrueColorAlpha(0, 0, 0, gdAlphaTransparent);
+			}
+		}
+		gdImageBlendSpan(dst, dstX, dstY + y, dstW, out);
+	}
+	ok = 1;
+
+done:
+	gdFree(rowSums);
+	gdFree(sums);
+	gdFree(out);
+	gdFree(srcRow);
+	gdCoverageTableFree(&cols);
+	gdCoverageTableFree(&rows);
+	return ok;
+}
+
 /* When gd 1.x was first created, floating point was to be avoided.
    These days it is often faster than table lookups or integer
    arithmetic. The routine below is shamelessly, gloriously
@@ -3466,6 +4825,13 @@ BGD_DECLARE(void) gdImageCopyResampled (gdImagePtr dst,
 		gdImageCopyResized (dst, src, dstX, dstY, srcX, srcY, dstW, dstH, srcW, srcH);
 		return;
 	}
+	if (dstW <= 0 || dstH <= 0) {
+		return;
+	}
+	if (gdImageCopySpansSafe(dst, src, srcX, srcY, srcW, srcH)
+	        && gdImageCopyResampledRows(dst, src, dstX, dstY, srcX, srcY, dstW, dstH, srcW, srcH)) {
+		return;
+	}
 	for (y = dstY; (y < dstY + dstH); y++) {
 		for (x = dstX; (x < dstX + dstW); x++) {
 			float sy1, sy2, sx1, sx2;
@@ -3561,6 +4927,33 @@ BGD_DECLARE(void) gdImageCopyResampled (gdImagePtr dst,
  * Group: Polygons
  */
 
+/* Draws thick anti-aliased outlines as one stroke, so that the segments
+   are properly joined. Returns 0 if the outline is to be drawn line by
+   line. */
+static int gdImageStrokePolygonAA (gdImagePtr im, gdPointPtr p, int n, int closed, int c)
+{
+	gdPointF *points;
+	int i;
+
+	if (c != gdAntiAliased || im->thick <= 1 || !im->trueColor || n < 2) {
+		return 0;
+	}
+	if (overflow2(sizeof(gdPointF), n)) {
+		return 1;
+	}
+	points = (gdPointF *) gdMalloc(sizeof(gdPointF) * n);
+	if (!points) {
+		return 1;
+	}
+	for (i = 0; i < n; i++) {
+		points[i].x = p[i].x;
+		points[i].y = p[i].y;
+	}
+	_gdImageStrokeAA(im, points, n, closed, im->thick, im->AA_color);
+	gdFree(points);
+	return 1;
+}
+
 /**
  * Function: gdImagePolygon
  *
@@ -3582,7 +4975,9 @@ BGD_DECLARE(void) gdImagePolygon (gdImagePtr im, gdPointPtr p, int n, int c)
 		return;
 	}
 
-
+	if (gdImageStrokePolygonAA(im, p, n, 1, c)) {
+		return;
+	}
 	gdImageLine (im, p->x, p->y, p[n - 1].x, p[n - 1].y, c);
 	gdImageOpenPolygon (im, p, n, c);
 }
@@ -3609,6 +5004,9 @@ BGD_DECLARE(void) gdImageOpenPolygon (gdImagePtr im, gdPointPtr p, int n, int c)
 		return;
 	}
 
+	if (gdImageStrokePolygonAA(im, p, n, 0, c)) {
+		return;
+	}
 
 	lx = p->x;
 	ly = p->y;
@@ -3623,6 +5021,126 @@ BGD_DECLARE(void) gdImageOpenPolygon (gdImagePtr im, gdPointPtr p, int n, int c)
 
 /* THANKS to Kirsten Schulz for the polygon fixes! */
 
+/* gdImageFilledPolygons() fills with an active edge table: the edges are
+   sorted by the row they start on, and only the ones crossing the current
+   row are looked at, stepping their intersection with it incrementally.
+
+   The intersections are the ones the per row computation
+   (int) ((float) ((y - y1) * (x2 - x1)) / (float) (y2 - y1) + 0.5 + x1)
+   of earlier versions gives, which is kept so that Polygon and
+   FilledPolygon for the same set of points have the same footprint. The
+   exact value of that expression is x1 + (2 * num + dy) / (2 * dy), with
+   num = (y - y1) * (x2 - x1) and dy = y2 - y1. While |num| < 2^23 and
+   dy < 2^24 the float division can't round across an integer, so the
+   quotient and remainder of that fraction are stepped instead; longer
+   edges evaluate the expression. */
+
+typedef struct {
+	int y1, y2;
+	int x1, x2;
+	/* whether the edge ends on the bottom row of its polygon, where it
+	   also crosses row y2, at x2 */
+	int bottom;
+	/* whether q and r are stepped */
+	int stepped;
+	/* the intersection with the current row is q, rounded towards zero
+	   by r, the remainder of the division by den */
+	int64_t q, r, den;
+	int64_t stepQ, stepR;
+} gdPolygonEdge;
+
+/* floor(a / b) for b > 0 */
+static int64_t gdFloorDiv (int64_t a, int64_t b)
+{
+	return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+static void gdPolygonEdgeStart (gdPolygonEdge *e, int y)
+{
+	const int64_t dx = e->x2 - e->x1;
+	const int64_t dy = e->y2 - e->y1;
+	int64_t n;
+
+	e->stepped = dy < (1 << 24) && dy * (dx < 0 ? -dx : dx) < (1 << 23);
+	if (!e->stepped) {
+		return;
+	}
+	e->den = 2 * dy;
+	n = 2 * dy * e->x1 + 2 * (y - e->y1) * dx + dy;
+	e->q = gdFloorDiv(n, e->den);
+	e->r = n - e->q * e->den;
+	e->stepQ = gdFloorDiv(2 * dx, e->den);
+	e->stepR = 2 * dx - e->stepQ * e->den;
+}
+
+static int gdPolygonEdgeX (const gdPolygonEdge *e, int y)
+{
+	if (y == e->y2) {
+		return e->x2;
+	}
+	if (e->stepped) {
+		/* (int) truncates towards zero */
+		return (int) (e->q < 0 && e->r ? e->q + 1 : e->q);
+	}
+	return (int) ((float) ((y - e->y1) * (e->x2 - e->x1)) /
+	              (float) (e->y2 - e->y1) + 0.5 + e->x1);
+}
+
+static void gdPolygonEdgeStep (gdPolygonEdge *e)
+{
+	if (e->stepped) {
+		e->q += e->stepQ;
+		e->r += e->stepR;
+		if (e->r >= e->den) {
+			e->r -= e->den;
+			e->q++;
+		}
+	}
+}
+
+/* The topmost and bottommost row of a polygon */
+static void gdPolygonRows (const gdPoint *p, int n, int *miny, int *maxy)
+{
+	int i;
+
+	*miny = *maxy = p[0].y;
+	for (i = 1; i < n; i++) {
+		if (p[i].y < *miny) {
+			*miny = p[i].y;
+		}
+		if (p[i].y > *maxy) {
+			*maxy = p[i].y;
+		}
+	}
+}
+
+static int gdPolygonEdgeCompare (const void *a, const void *b)
+{
+	const gdPolygonEdge *e1 = (const gdPolygonEdge *) a;
+	const gdPolygonEdge *e2 = (const gdPolygonEdge *) b;
+
+	return e1->y1 < e2->y1 ? -1 : e1->y1 > e2->y1;
+}
+
+/* Draws the run of a filled polygon from x1 to x2 (x1 <= x2) of row y,
+   which is inside of the clipping rectangle */
+static void gdImagePolygonSpan (gdImagePtr im, int y, int x1, int x2, int col)
+{
+	/* 2.0.29: back to gdImageLine to prevent segfaults when
+	  performing a pattern fill */
+	if (col < 0 || im->thick > 1) {
+		gdImageLine(im, x1, y, x2, y, col);
+		return;
+	}
+	/* gdImageSetClip() accepts cx1 > cx2, which leaves nothing */
+	x1 = MAX(x1, im->cx1);
+	x2 = MIN(x2, im->cx2);
+	if (x1 > x2) {
+		return;
+	}
+	gdImageSetSpan(im, y, x1, x2, col);
+}
+
 /* The intersection finding technique of this code could be improved  */
 /* by remembering the previous intertersection, and by using the slope. */
 /* That could help to adjust intersections  to produce a nice */
@@ -3645,20 +5163,46 @@ BGD_DECLARE(void) gdImageOpenPolygon (gdImagePtr im, gdPointPtr p, int n, int c)
  *
  * See also:
  *   - <gdImagePolygon>
+ *   - <gdImageFilledPolygons>
  */
 BGD_DECLARE(void) gdImageFilledPolygon (gdImagePtr im, gdPointPtr p, int n, int c)
 {
-	int i;
-	int j;
-	int index;
-	int y;
-	int miny, maxy, pmaxy;
-	int x1, y1;
-	int x2, y2;
-	int ind1, ind2;
+	gdImageFilledPolygons(im, p, &n, 1, c);
+}
+
+/**
+ * Function: gdImageFilledPolygons
+ *
+ * Draws several polygons filled as one shape
+ *
+ * The polygons are filled together using the even-odd fillrule, so
+ * polygons inside of others make holes, and polygons outside of each
+ * other are drawn as if by separate calls of <gdImageFilledPolygon>.
+ * Drawing many polygons of one color this way is considerably faster.
+ *
+ * Parameters:
+ *   im    - The image.
+ *   p     - The vertices of all polygons as array of <gdPoint>s, one
+ *           polygon after the other.
+ *   n     - The number of vertices of each polygon.
+ *   count - The number of polygons.
+ *   c     - The color
+ *
+ * See also:
+ *   - <gdImageFilledPolygon>
+ */
+BGD_DECLARE(void) gdImageFilledPolygons (gdImagePtr im, gdPointPtr p, const int *n, int count, int c)
+{
+	gdPolygonEdge *edges = NULL;
+	gdPolygonEdge **active = NULL;
+	gdPointPtr poly;
+	int total, nedges, nactive, next;
+	int i, j, k;
+	int y, miny, maxy;
 	int ints;
 	int fill_color;
-	if (n <= 0) {
+
+	if (count <= 0) {
 		return;
 	}
 
@@ -3667,18 +5211,31 @@ BGD_DECLARE(void) gdImageFilledPolygon (gdImagePtr im, gdPointPtr p, int n, int
 	} else {
 		fill_color = c;
 	}
-	if (!im->polyAllocated) {
-		if (overflow2(sizeof (int), n)) {
-			return;
+
+	total = 0;
+	for (k = 0; k < count; k++) {
+		if (n[k] > 0) {
+			if (total > INT_MAX - n[k]) {
+				return;
+			}
+			total += n[k];
 		}
-		im->polyInts = (int *) gdMalloc (sizeof (int) * n);
+	}
+	if (total == 0) {
+		return;
+	}
+	if (overflow2(sizeof(gdPolygonEdge), total) || overflow2(sizeof(gdPolygonEdge *), total)) {
+		return;
+	}
+	if (!im->polyAllocated) {
+		im->polyInts = (int *) gdMalloc (sizeof (int) * total);
 		if (!im->polyInts) {
 			return;
 		}
-		im->polyAllocated = n;
+		im->polyAllocated = total;
 	}
-	if (im->polyAllocated < n) {
-		while (im->polyAllocated < n) {
+	if (im->polyAllocated < total) {
+		while (im->polyAllocated < total) {
 			im->polyAllocated *= 2;
 		}
 		if (overflow2(sizeof (int), im->polyAllocated)) {
@@ -3690,30 +5247,63 @@ BGD_DECLARE(void) gdImageFilledPolygon (gdImagePtr im, gdPointPtr p, int n, int
 			return;
 		}
 	}
-	miny = p[0].y;
-	maxy = p[0].y;
-	for (i = 1; (i < n); i++) {
-		if (p[i].y < miny) {
-			miny = p[i].y;
+	edges = (gdPolygonEdge *) gdMalloc(sizeof(gdPolygonEdge) * total);
+	active = (gdPolygonEdge **) gdMalloc(sizeof(gdPolygonEdge *) * total);
+	if (!edges || !active) {
+		goto done;
+	}
+
+	/* the edges of all polygons, except for horizontal ones */
+	nedges = 0;
+	miny = INT_MAX;
+	maxy = INT_MIN;
+	for (k = 0, poly = p; k < count; poly += MAX(n[k], 0), k++) {
+		int pminy, pmaxy;
+
+		if (n[k] <= 0) {
+			continue;
 		}
-		if (p[i].y > maxy) {
-			maxy = p[i].y;
+		gdPolygonRows(poly, n[k], &pminy, &pmaxy);
+		/* necessary special case: horizontal line */
+		if (n[k] > 1 && pminy == pmaxy) {
+			int x1, x2;
+			x1 = x2 = poly[0].x;
+			for (i = 1; (i < n[k]); i++) {
+				if (poly[i].x < x1) {
+					x1 = poly[i].x;
+				} else if (poly[i].x > x2) {
+					x2 = poly[i].x;
+				}
+			}
+			gdImageLine(im, x1, pminy, x2, pminy, c);
+			continue;
 		}
-	}
-	/* necessary special case: horizontal line */
-	if (n > 1 && miny == maxy) {
-		x1 = x2 = p[0].x;
-		for (i = 1; (i < n); i++) {
-			if (p[i].x < x1) {
-				x1 = p[i].x;
-			} else if (p[i].x > x2) {
-				x2 = p[i].x;
+		miny = MIN(miny, pminy);
+		maxy = MAX(maxy, pmaxy);
+		/* Fix in 1.3: count a vertex only once */
+		for (i = 0; i < n[k]; i++) {
+			const gdPoint *a = &poly[i ? i - 1 : n[k] - 1];
+			const gdPoint *b = &poly[i];
+			gdPolygonEdge *e = &edges[nedges];
+
+			if (a->y == b->y) {
+				continue;
+			}
+			if (a->y > b->y) {
+				const gdPoint *t = a;
+				a = b;
+				b = t;
 			}
+			e->y1 = a->y;
+			e->x1 = a->x;
+			e->y2 = b->y;
+			e->x2 = b->x;
+			e->bottom = b->y == pmaxy;
+			nedges++;
 		}
-		gdImageLine(im, x1, miny, x2, miny, c);
-		return;
 	}
-	pmaxy = maxy;
+	qsort(edges, nedges, sizeof(gdPolygonEdge), gdPolygonEdgeCompare);
+
 	/* 2.0.16: Optimization by Ilia Chipitsine -- don't waste time offscreen */
 	/* 2.0.26: clipping rectangle is even better */
 	if (miny < im->cy1) {
@@ -3722,77 +5312,72 @@ BGD_DECLARE(void) gdImageFilledPolygon (gdImagePtr im, gdPointPtr p, int n, int
 	if (maxy > im->cy2) {
 		maxy = im->cy2;
 	}
-	/* Fix in 1.3: count a vertex only once */
-	for (y = miny; (y <= maxy); y++) {
-		ints = 0;
-		for (i = 0; (i < n); i++) {
-			if (!i) {
-				ind1 = n - 1;
-				ind2 = 0;
-			} else {
-				ind1 = i - 1;
-				ind2 = i;
+
+	nactive = 0;
+	next = 0;
+	for (y = miny; y <= maxy; y++) {
+		/* drop the edges above this row, and add the ones starting on
+		   it, or above it on the first row */
+		for (i = 0, j = 0; i < nactive; i++) {
+			gdPolygonEdge *e = active[i];
+			if (y < e->y2 || (y == e->y2 && e->bottom)) {
+				active[j++] = e;
 			}
-			y1 = p[ind1].y;
-			y2 = p[ind2].y;
-			if (y1 < y2) {
-				x1 = p[ind1].x;
-				x2 = p[ind2].x;
-			} else if (y1 > y2) {
-				y2 = p[ind1].y;
-				y1 = p[ind2].y;
-				x2 = p[ind1].x;
-				x1 = p[ind2].x;
-			} else {
-				continue;
+		}
+		nactive = j;
+		for (; next < nedges && edges[next].y1 <= y; next++) {
+			gdPolygonEdge *e = &edges[next];
+			if (y < e->y2 || (y == e->y2 && e->bottom)) {
+				gdPolygonEdgeStart(e, y);
+				active[nactive++] = e;
 			}
+		}
 
-			/* Do the following math as float intermediately, and round to ensure
-			 * that Polygon and FilledPolygon for the same set of points have the
-			 * same footprint. */
+		/* the intersections in ascending order; the ones of the
+		   previous row mostly are, so insertion sort is quick */
+		ints = 0;
+		for (i = 0; i < nactive; i++) {
+			const int x = gdPolygonEdgeX(active[i], y);
+			gdPolygonEdge *e = active[i];
 
-			if ((y >= y1) && (y < y2)) {
-				im->polyInts[ints++] = (int) ((float) ((y - y1) * (x2 - x1)) /
-				                              (float) (y2 - y1) + 0.5 + x1);
-			} else if ((y == pmaxy) && (y == y2)) {
-				im->polyInts[ints++] = x2;
-			}
-		}
-		/*
-		  2.0.26: polygons pretty much always have less than 100 points,
-		  and most of the time they have considerably less. For such trivial
-		  cases, insertion sort is a good choice. Also a good choice for
-		  future implementations that may wish to indirect through a table.
-		*/
-		for (i = 1; (i < ints); i++) {
-			index = im->polyInts[i];
-			j = i;
-			while ((j > 0) && (im->polyInts[j - 1] > index)) {
+			for (j = ints; j > 0 && im->polyInts[j - 1] > x; j--) {
 				im->polyInts[j] = im->polyInts[j - 1];
-				j--;
+				active[j] = active[j - 1];
 			}
-			im->polyInts[j] = index;
+			im->polyInts[j] = x;
+			active[j] = e;
+			ints++;
+			gdPolygonEdgeStep(e);
 		}
 		for (i = 0; (i < (ints-1)); i += 2) {
-			/* 2.0.29: back to gdImageLine to prevent segfaults when
-			  performing a pattern fill */
-			gdImageLine (im, im->polyInts[i], y, im->polyInts[i + 1], y,
-			             fill_color);
+			gdImagePolygonSpan(im, y, im->polyInts[i], im->polyInts[i + 1], fill_color);
 		}
 	}
+
 	/* If we are drawing this AA, then redraw the border with AA lines. */
 	/* This doesn't work as well as I'd like, but it doesn't clash either. */
 	if (c == gdAntiAliased) {
-		gdImagePolygon (im, p, n, c);
+		for (k = 0, poly = p; k < count; poly += MAX(n[k], 0), k++) {
+			int pminy, pmaxy;
+			if (n[k] <= 0) {
+				continue;
+			}
+			gdPolygonRows(poly, n[k], &pminy, &pmaxy);
+			if (n[k] == 1 || pminy != pmaxy) {
+				gdImagePolygon (im, poly, n[k], c);
+			}
+		}
 	}
+
+done:
+	gdFree(edges);
+	gdFree(active);
 }
 
 /**
  * Group: other
  */
 
-static void gdImageSetAAPixelColor(gdImagePtr im, int x, int y, int color, int t);
-
 /**
  * Function: gdImageSetStyle
  *
@@ -3889,6 +5474,11 @@ BGD_DECLARE(void) gdImageSetTile (gdImagePtr im, gdImagePtr tile)
  * anti-aliased drawing (such as <gdImageLine> and <gdImagePolygon>), the actual
  * color to be used can be set with this function.
  *
+ * Lines thicker than a pixel (see <gdImageSetThickness>) are drawn as
+ * anti-aliased strokes, and the outlines drawn by <gdImagePolygon> and
+ * <gdImageOpenPolygon> as one stroke with round joins. The "dont_blend"
+ * color of <gdImageSetAntiAliasedDontBlend> only applies to thin lines.
+ *
  * Example: draw an anti-aliased blue line:
  * | gdImageSetAntiAliased(im, gdTrueColorAlpha(0, 0, gdBlueMax, gdAlphaOpaque));
  * | gdImageLine(im, 10,10, 20,20, gdAntiAliased);
@@ -3948,6 +5538,80 @@ BGD_DECLARE(void) gdImageInterlace (gdImagePtr im, int interlaceArg)
 	im->interlace = interlaceArg;
 }
 
+#define GD_CMP_CHUNK 512
+
+/* The colors of n pixels of row y of im from x on; palette pixels are
+   looked up in rgb and stored in buf */
+static const int *gdImageCompareRow (gdImagePtr im, const int *rgb, int x, int y, int n, int *buf)
+{
+	const unsigned char *row;
+	int i;
+
+	if (im->trueColor) {
+		return im->tpixels[y] + x;
+	}
+	row = im->pixels[y] + x;
+	for (i = 0; i < n; i++) {
+		buf[i] = rgb[row[i]];
+	}
+	return buf;
+}
+
+/* Compares the RGB values of the pixels of the sx * sy rectangles at
+   the origins of im1 and im2; alpha is ignored. Without bounds, stops
+   at the first difference and returns 1 if there is one; otherwise
+   counts the different pixels and sets bounds to the smallest rectangle
+   holding them. */
+static int gdImageCompareColors (gdImagePtr im1, gdImagePtr im2, int sx, int sy, gdRectPtr bounds)
+{
+	int rgb1[gdMaxColors], rgb2[gdMaxColors];
+	int buf1[GD_CMP_CHUNK], buf2[GD_CMP_CHUNK];
+	const int *p1, *p2;
+	int x, y, n, i, first, last;
+	int count = 0, x1 = sx, y1 = sy, x2 = -1, y2 = -1;
+
+	if (!im1->trueColor) {
+		for (i = 0; i < gdMaxColors; i++) {
+			rgb1[i] = (im1->red[i] << 16) | (im1->green[i] << 8) | im1->blue[i];
+		}
+	}
+	if (!im2->trueColor) {
+		for (i = 0; i < gdMaxColors; i++) {
+			rgb2[i] = (im2->red[i] << 16) | (im2->green[i] << 8) | im2->blue[i];
+		}
+	}
+	for (y = 0; y < sy; y++) {
+		for (x = 0; x < sx; x += n) {
+			n = MIN(sx - x, GD_CMP_CHUNK);
+			p1 = gdImageCompareRow(im1, rgb1, x, y, n, buf1);
+			p2 = gdImageCompareRow(im2, rgb2, x, y, n, buf2);
+			first = _gdDiffSpan(p1, p2, n, 0xFFFFFF);
+			if (first == n) {
+				continue;
+			}
+			if (!bounds) {
+				return 1;
+			}
+			count += _gdDiffCount(p1 + first, p2 + first, n - first, 0xFFFFFF, &last);
+			x1 = MIN(x1, x + first);
+			x2 = MAX(x2, x + first + last);
+			y1 = MIN(y1, y);
+			y2 = y;
+		}
+	}
+	if (bounds) {
+		if (count) {
+			bounds->x = x1;
+			bounds->y = y1;
+			bounds->width = x2 - x1 + 1;
+			bounds->height = y2 - y1 + 1;
+		} else {
+			bounds->x = bounds->y = bounds->width = bounds->height = 0;
+		}
+	}
+	return count;
+}
+
 /**
  * Function: gdImageCompare
  *
@@ -3963,8 +5627,6 @@ BGD_DECLARE(void) gdImageInterlace (gdImagePtr im, int interlaceArg)
  */
 BGD_DECLARE(int) gdImageCompare (gdImagePtr im1, gdImagePtr im2)
 {
-	int x, y;
-	int p1, p2;
 	int cmpStatus = 0;
 	int sx, sy;
 
@@ -4000,45 +5662,46 @@ BGD_DECLARE(int) gdImageCompare (gdImagePtr im1, gdImagePtr im2)
 		cmpStatus |= GD_CMP_NUM_COLORS;
 	}
 
-	for (y = 0; (y < sy); y++) {
-		for (x = 0; (x < sx); x++) {
-			p1 =
-			    im1->trueColor ? gdImageTrueColorPixel (im1, x,
-			            y) :
-			    gdImagePalettePixel (im1, x, y);
-			p2 =
-			    im2->trueColor ? gdImageTrueColorPixel (im2, x,
-			            y) :
-			    gdImagePalettePixel (im2, x, y);
-			if (gdImageRed (im1, p1) != gdImageRed (im2, p2)) {
-				cmpStatus |= GD_CMP_COLOR + GD_CMP_IMAGE;
-				break;
-			}
-			if (gdImageGreen (im1, p1) != gdImageGreen (im2, p2)) {
-				cmpStatus |= GD_CMP_COLOR + GD_CMP_IMAGE;
-				break;
-			}
-			if (gdImageBlue (im1, p1) != gdImageBlue (im2, p2)) {
-				cmpStatus |= GD_CMP_COLOR + GD_CMP_IMAGE;
-				break;
-			}
-#if 0
-			/* Soon we'll add alpha channel to palettes */
-			if (gdImageAlpha (im1, p1) != gdImageAlpha (im2, p2)) {
-				cmpStatus |= GD_CMP_COLOR + GD_CMP_IMAGE;
-				break;
-			}
-#endif
-		}
-		if (cmpStatus & GD_CMP_COLOR) {
-			break;
-		};
+	if (gdImageCompareColors (im1, im2, sx, sy, NULL)) {
+		cmpStatus |= GD_CMP_COLOR + GD_CMP_IMAGE;
 	}
 
 	return cmpStatus;
 }
 
 
+/**
+ * Function: gdImageCompareDiff
+ *
+ * Finds the pixels where two images differ
+ *
+ * Like <gdImageCompare>, this compares the red, green and blue values
+ * of the pixels, ignoring alpha, over the area both images cover.
+ * Comparing the frames of an animation or the renderings of a view, it
+ * tells which part has to be updated.
+ *
+ * Parameters:
+ *   im1    - An image.
+ *   im2    - Another image.
+ *   bounds - Where to store the smallest rectangle holding all the
+ *            pixels which differ; all of its members are set to 0 if
+ *            there are none. May be NULL.
+ *
+ * Returns:
+ *   The number of pixels which differ.
+ *
+ * See also:
+ *   - <gdImageCompare>
+ */
+BGD_DECLARE(int) gdImageCompareDiff (gdImagePtr im1, gdImagePtr im2, gdRectPtr bounds)
+{
+	gdRect unused;
+
+	return gdImageCompareColors (im1, im2, MIN(im1->sx, im2->sx), MIN(im1->sy, im2->sy),
+	                             bounds ? bounds : &unused);
+}
+
+
 /* Thanks to Frank Warmerdam for this superior implementation
 	of gdAlphaBlend(), which merges alpha in the
 	destination color much better. */
@@ -4311,19 +5974,15 @@ BGD_DECLARE(void) gdImageSetResolution(gdImagePtr im, const unsigned int res_x,
 #define BLEND_COLOR(a, nc, c, cc) \
 nc = (cc) + (((((c) - (cc)) * (a)) + ((((c) - (cc)) * (a)) >> 8) + 0x80) >> 8);
 
-static void gdImageSetAAPixelColor(gdImagePtr im, int x, int y, int color, int t)
+/* Blends the color over the pixel p, leaving t / 256 of the pixel */
+static void gdImageSetAAPixelColor(gdImagePtr im, int *p, int color, int t)
 {
-	int dr,dg,db,p,r,g,b;
+	int dr,dg,db,r,g,b;
 
-	/* 2.0.34: watch out for out of range calls */
-	if (!gdImageBoundsSafeMacro(im, x, y)) {
-		return;
-	}
-	p = gdImageGetPixel(im,x,y);
 	/* TBB: we have to implement the dont_blend stuff to provide
 	  the full feature set of the old implementation */
-	if ((p == color)
-	        || ((p == im->AA_dont_blend)
+	if ((*p == color)
+	        || ((*p == im->AA_dont_blend)
 	            && (t != 0x00))) {
 		return;
 	}
@@ -4331,23 +5990,60 @@ static void gdImageSetAAPixelColor(gdImagePtr im, int x, int y, int color, int t
 	dg = gdTrueColorGetGreen(color);
 	db = gdTrueColorGetBlue(color);
 
-	r = gdTrueColorGetRed(p);
-	g = gdTrueColorGetGreen(p);
-	b = gdTrueColorGetBlue(p);
+	r = gdTrueColorGetRed(*p);
+	g = gdTrueColorGetGreen(*p);
+	b = gdTrueColorGetBlue(*p);
 
 	BLEND_COLOR(t, dr, r, dr);
 	BLEND_COLOR(t, dg, g, dg);
 	BLEND_COLOR(t, db, b, db);
-	im->tpixels[y][x] = gdTrueColorAlpha(dr, dg, db, gdAlphaOpaque);
+	*p = gdTrueColorAlpha(dr, dg, db, gdAlphaOpaque);
+}
+
+/* Draws the columns x1 to x2 of a mostly horizontal anti-aliased line,
+   on which it runs between row y and row y + 1, with the fraction frac
+   (in 1/65536) of the way to row y + 1 at column x1, increasing by inc
+   per column. */
+static void gdImageAALineRun (gdImagePtr im, int x1, int x2, int y, int64_t frac, int64_t inc,
+                              int col)
+{
+	int x;
+
+	/* clip_1d() may overflow for far away end points */
+	if (x1 < im->cx1) {
+		frac += (int64_t) (im->cx1 - x1) * inc;
+		x1 = im->cx1;
+	}
+	if (x2 > im->cx2) {
+		x2 = im->cx2;
+	}
+	if (x1 > x2) {
+		return;
+	}
+	if (y >= im->cy1 && y <= im->cy2 && gdImageRowWritable(im, y)) {
+		int *row = im->tpixels[y];
+		int64_t f = frac;
+		for (x = x1; x <= x2; x++, f += inc) {
+			gdImageSetAAPixelColor(im, &row[x], col, (int) ((f >> 8) & 0xFF));
+		}
+	}
+	y++;
+	if (y >= im->cy1 && y <= im->cy2 && gdImageRowWritable(im, y)) {
+		int *row = im->tpixels[y];
+		int64_t f = frac;
+		for (x = x1; x <= x2; x++, f += inc) {
+			gdImageSetAAPixelColor(im, &row[x], col, (int) ((~f >> 8) & 0xFF));
+		}
+	}
 }
 
+/* Wu's anti-aliased line in 16.16 fixed point. Lines thicker than a
+   pixel are drawn as an anti-aliased stroke. */
 static void gdImageAALine (gdImagePtr im, int x1, int y1, int x2, int y2, int col)
 {
-	/* keep them as 32bits */
-	long x, y, inc, frac;
-	long dx, dy,tmp;
-	int w, wid, wstart;
-	int thick = im->thick;
+	int64_t inc, frac;
+	int64_t dx, dy;
+	int x, y, tmp;
 
 	if (!im->trueColor) {
 		/* TBB: don't crash when the image is of the wrong type */
@@ -4355,6 +6051,16 @@ static void gdImageAALine (gdImagePtr im, int x1, int y1, int x2, int y2, int co
 		return;
 	}
 
+	if (im->thick > 1 && (x1 != x2 || y1 != y2)) {
+		gdPointF p[2];
+		p[0].x = x1;
+		p[0].y = y1;
+		p[1].x = x2;
+		p[1].y = y2;
+		_gdImageStrokeAA(im, p, 2, 0, im->thick, col);
+		return;
+	}
+
 	/* TBB: use the clipping rectangle */
 	if (clip_1d (&x1, &y1, &x2, &y2, im->cx1, im->cx2) == 0)
 		return;
@@ -4368,19 +6074,6 @@ static void gdImageAALine (gdImagePtr im, int x1, int y1, int x2, int y2, int co
 		/* TBB: allow setting points */
 		gdImageSetPixel(im, x1, y1, col);
 		return;
-	} else {
-		double ag;
-		/* Cast the long to an int to avoid compiler warnings about truncation.
-		 * This isn't a problem as computed dy/dx values came from ints above. */
-		ag = fabs(abs((int)dy) < abs((int)dx) ? cos(atan2(dy, dx)) : sin(atan2(dy, dx)));
-		if (ag != 0) {
-			wid = thick / ag;
-		} else {
-			wid = 1;
-		}
-		if (wid == 0) {
-			wid = 1;
-		}
 	}
 
 	/* Axis aligned lines */
@@ -4392,7 +6085,7 @@ static void gdImageAALine (gdImagePtr im, int x1, int y1, int x2, int y2, int co
 		return;
 	}
 
-	if (abs((int)dx) > abs((int)dy)) {
+	if ((dx < 0 ? -dx : dx) > (dy < 0 ? -dy : dy)) {
 		if (dx < 0) {
 			tmp = x1;
 			x1 = x2;
@@ -4406,21 +6099,29 @@ static void gdImageAALine (gdImagePtr im, int x1, int y1, int x2, int y2, int co
 		y = y1;
 		inc = (dy * 65536) / dx;
 		frac = 0;
-		/* TBB: set the last pixel for consistency (<=) */
-		for (x = x1 ; x <= x2 ; x++) {
-			wstart = y - wid / 2;
-			for (w = wstart; w < wstart + wid; w++) {
-			    gdImageSetAAPixelColor(im, x , w , col , (frac >> 8) & 0xFF);
-			    gdImageSetAAPixelColor(im, x , w + 1 , col, (~frac >> 8) & 0xFF);
-			}
-			frac += inc;
-			if (frac >= 65536) {
-				frac -= 65536;
-				y++;
-			} else if (frac < 0) {
-				frac += 65536;
-				y--;
-			}
+		/* TBB: set the last pixel for consistency (<=); drawn a run of
+		   columns between the same two rows at a time */
+		x = x1;
+		while (x <= x2) {
+			const int start = x;
+			const int64_t runFrac = frac;
+			int next = y;
+
+			do {
+				x++;
+				frac += inc;
+				if (frac >= 65536) {
+					frac -= 65536;
+					next = y + 1;
+					break;
+				} else if (frac < 0) {
+					frac += 65536;
+					next = y - 1;
+					break;
+				}
+			} while (x <= x2);
+			gdImageAALineRun(im, start, x - 1, y, runFrac, inc, col);
+			y = next;
 		}
 	} else {
 		if (dy < 0) {
@@ -4438,10 +6139,15 @@ static void gdImageAALine (gdImagePtr im, int x1, int y1, int x2, int y2, int co
 		frac = 0;
 		/* TBB: set the last pixel for consistency (<=) */
 		for (y = y1 ; y <= y2 ; y++) {
-			wstart = x - wid / 2;
-			for (w = wstart; w < wstart + wid; w++) {
-			    gdImageSetAAPixelColor(im, w , y  , col, (frac >> 8) & 0xFF);
-			    gdImageSetAAPixelColor(im, w + 1, y, col, (~frac >> 8) & 0xFF);
+			/* 2.0.34: watch out for out of range calls */
+			if (x >= im->cx1 - 1 && x <= im->cx2 && gdImageRowWritable(im, y)) {
+				int *row = im->tpixels[y];
+				if (x >= im->cx1) {
+					gdImageSetAAPixelColor(im, &row[x], col, (int) ((frac >> 8) & 0xFF));
+				}
+				if (x + 1 <= im->cx2) {
+					gdImageSetAAPixelColor(im, &row[x + 1], col, (int) ((~frac >> 8) & 0xFF));
+				}
 			}
 			frac += inc;
 			if (frac >= 65536) {
@@ -4456,6 +6162,20 @@ static void gdImageAALine (gdImagePtr im, int x1, int y1, int x2, int y2, int co
 }
 
 
+/* Fills lut with the truecolor values of the palette entries of im, as
+   gdImagePaletteToTrueColor() converts them */
+void _gdImagePaletteLut (gdImagePtr im, int *lut)
+{
+	int c;
+
+	for (c = 0; c < gdMaxColors; c++) {
+		lut[c] = gdTrueColorAlpha(im->red[c], im->green[c], im->blue[c], im->alpha[c]);
+	}
+	if (im->transparent >= 0 && im->transparent < gdMaxColors) {
+		lut[im->transparent] = gdTrueColorAlpha(0, 0, 0, 127);
+	}
+}
+
 /**
  * Function: gdImagePaletteToTrueColor
  *
@@ -4473,7 +6193,6 @@ static void gdImageAALine (gdImagePtr im, int x1, int y1, int x2, int y2, int co
 BGD_DECLARE(int) gdImagePaletteToTrueColor(gdImagePtr src)
 {
 	unsigned int y;
-	unsigned int yy;
 
 	if (src == NULL) {
 		return 0;
@@ -4482,44 +6201,24 @@ BGD_DECLARE(int) gdImagePaletteToTrueColor(gdImagePtr src)
 	if (src->trueColor == 1) {
 		return 1;
 	} else {
-		unsigned int x;
 		const unsigned int sy = gdImageSY(src);
 		const unsigned int sx = gdImageSX(src);
+		int lut[gdMaxColors];
 
-		src->tpixels = (int **) gdMalloc(sizeof(int *) * sy);
-		if (src->tpixels == NULL) {
+		if (!_gdImageAllocRows(src, 1)) {
 			return 0;
 		}
 
+		_gdImagePaletteLut(src, lut);
 		for (y = 0; y < sy; y++) {
-			const unsigned char *src_row = src->pixels[y];
-			int * dst_row;
-
-			/* no need to calloc it, we overwrite all pxl anyway */
-			src->tpixels[y] = (int *) gdMalloc(sx * sizeof(int));
-			if (src->tpixels[y] == NULL) {
-				goto clean_on_error;
-			}
-
-			dst_row = src->tpixels[y];
-			for (x = 0; x < sx; x++) {
-				const unsigned char c = *(src_row + x);
-				if (c == src->transparent) {
-					*(dst_row + x) = gdTrueColorAlpha(0, 0, 0, 127);
-				} else {
-					*(dst_row + x) = gdTrueColorAlpha(src->red[c], src->green[c], src->blue[c], src->alpha[c]);
-				}
-			}
+			_gdLookupSpan(src->tpixels[y], src->pixels[y], sx, lut);
 		}
 	}
 
-	/* free old palette buffer (y is sy) */
-	for (yy = 0; yy < y; yy++) {
-		gdFree(src->pixels[yy]);
-	}
-	gdFree(src->pixels);
+	/* free old palette buffer */
+	_gdImageFreeRows(src, 0);
 	src->trueColor = 1;
-	src->pixels = NULL;
+	_gdImagePaletteIndexFree(src);
 	src->alphaBlendingFlag = 0;
 	src->saveAlphaFlag = 1;
 
@@ -4529,12 +6228,4 @@ BGD_DECLARE(int) gdImagePaletteToTrueColor(gdImagePtr src)
 	}
 
 	return 1;
-
-clean_on_error:
-	/* free new true color buffer (y is not allocated, have failed) */
-	for (yy = 0; yy < y; yy++) {
-		gdFree(src->tpixels[yy]);
-	}
-	gdFree(src->tpixels);
-	return 0;
 }
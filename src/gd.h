@@ -457,6 +457,30 @@ typedef struct gdImageStruct {
 	int paletteQuantizationMaxQuality;
 	gdInterpolationMethod interpolation_id;
 	interpolation_method interpolation;
+
+	/* 2.3.2: contiguous pixel storage. When set, all rows of 'pixels'
+	   (resp. 'tpixels') point into this single block, see
+	   gdImageGetStride(). NULL if the rows were allocated one by one. */
+	void *pixelBlock;
+	void *tpixelBlock;
+	/* 2.3.2: set if the block is owned by the caller, see
+	   gdImageCreateTrueColorFromBuffer(). It is never freed by gd. */
+	int pixelsBorrowed;
+	int tpixelsBorrowed;
+	/* 2.3.2: copy-on-write storage shared with clones, see gdImageCloneShared().
+	   While rowShare is set, rowShared[y] is non-zero as long as row y of
+	   the pixels still lives in the shared storage, and rowsShared counts
+	   such rows. Use gdImageUnshare() before writing to the rows directly. */
+	struct gdImageRowShareStruct *rowShare;
+	unsigned char *rowShared;
+	int rowsShared;
+	/* 2.3.2: lookup structures over the palette, built on demand by the
+	   closest color functions. Direct changes of the palette have to be
+	   announced with gdImagePaletteChanged(). */
+	struct gdPaletteIndexStruct *paletteIndex;
+	/* 2.3.2: threads for the operations reading from the image, 0 for
+	   the default, see gdImageSetThreadCount(). */
+	int threads;
 }
 gdImage;
 
@@ -601,6 +625,19 @@ BGD_DECLARE(gdImagePtr) gdImageCreate (int sx, int sy);
 /* Creates a truecolor image (millions of colors). */
 BGD_DECLARE(gdImagePtr) gdImageCreateTrueColor (int sx, int sy);
 
+/* 2.3.2: images wrapping caller owned pixel buffers, which are not
+   copied and not freed by gdImageDestroy(). */
+BGD_DECLARE(gdImagePtr) gdImageCreateFromBuffer (int sx, int sy, unsigned char *buffer, int stride);
+BGD_DECLARE(gdImagePtr) gdImageCreateTrueColorFromBuffer (int sx, int sy, int *buffer, int stride);
+
+/* 2.3.2: pools recycling the pixel storage of images, see gd_pool.c. */
+typedef struct gdImagePoolStruct *gdImagePoolPtr;
+
+BGD_DECLARE(gdImagePoolPtr) gdImagePoolCreate (int max);
+BGD_DECLARE(void) gdImagePoolDestroy (gdImagePoolPtr pool);
+BGD_DECLARE(gdImagePtr) gdImagePoolGet (gdImagePoolPtr pool, int sx, int sy, int trueColor);
+BGD_DECLARE(void) gdImagePoolPut (gdImagePoolPtr pool, gdImagePtr im);
+
 /* Creates an image from various file types. These functions
    return a palette or truecolor image based on the
    nature of the file being loaded. Truecolor PNG
@@ -609,6 +646,10 @@ BGD_DECLARE(gdImagePtr) gdImageCreateTrueColor (int sx, int sy);
 BGD_DECLARE(gdImagePtr) gdImageCreateFromPng (FILE * fd);
 BGD_DECLARE(gdImagePtr) gdImageCreateFromPngCtx (gdIOCtxPtr in);
 BGD_DECLARE(gdImagePtr) gdImageCreateFromPngPtr (int size, void *data);
+/* 2.3.2: decode into an image from a pool, or into an existing image of
+   the right size and type */
+BGD_DECLARE(gdImagePtr) gdImageCreateFromPngCtxPool (gdIOCtxPtr in, gdImagePoolPtr pool);
+BGD_DECLARE(gdImagePtr) gdImageCreateFromPngCtxInto (gdIOCtxPtr in, gdImagePtr im);
 
 /* These read the first frame only */
 BGD_DECLARE(gdImagePtr) gdImageCreateFromGif (FILE * fd);
@@ -623,6 +664,12 @@ BGD_DECLARE(gdImagePtr) gdImageCreateFromJpegCtx (gdIOCtx * infile);
 BGD_DECLARE(gdImagePtr) gdImageCreateFromJpegCtxEx (gdIOCtx * infile, int ignore_warning);
 BGD_DECLARE(gdImagePtr) gdImageCreateFromJpegPtr (int size, void *data);
 BGD_DECLARE(gdImagePtr) gdImageCreateFromJpegPtrEx (int size, void *data, int ignore_warning);
+BGD_DECLARE(gdImagePtr) gdImageCreateFromJpegCtxPool (gdIOCtx * infile, gdImagePoolPtr pool, int ignore_warning);
+BGD_DECLARE(gdImagePtr) gdImageCreateFromJpegCtxInto (gdIOCtx * infile, gdImagePtr im, int ignore_warning);
+/* 2.3.2: decode at a reduced size */
+BGD_DECLARE(gdImagePtr) gdImageCreateFromJpegScaled (FILE * infile, int width, int height);
+BGD_DECLARE(gdImagePtr) gdImageCreateFromJpegPtrScaled (int size, void *data, int width, int height);
+BGD_DECLARE(gdImagePtr) gdImageCreateFromJpegCtxScaled (gdIOCtx * infile, int width, int height, int ignore_warning);
 BGD_DECLARE(gdImagePtr) gdImageCreateFromWebp (FILE * inFile);
 BGD_DECLARE(gdImagePtr) gdImageCreateFromWebpPtr (int size, void *data);
 BGD_DECLARE(gdImagePtr) gdImageCreateFromWebpCtx (gdIOCtx * infile);
@@ -639,6 +686,7 @@ BGD_DECLARE(gdImagePtr) gdImageCreateFromBmp (FILE * inFile);
 BGD_DECLARE(gdImagePtr) gdImageCreateFromBmpPtr (int size, void *data);
 BGD_DECLARE(gdImagePtr) gdImageCreateFromBmpCtx (gdIOCtxPtr infile);
 BGD_DECLARE(gdImagePtr) gdImageCreateFromFile(const char *filename);
+BGD_DECLARE(gdImagePtr) gdImageCreateFromFileScaled(const char *filename, int width, int height);
 
 
 /*
@@ -700,6 +748,10 @@ BGD_DECLARE(gdImagePtr) gdImageCreateFromXpm (char *filename);
 
 BGD_DECLARE(void) gdImageDestroy (gdImagePtr im);
 
+/* Number of bytes between the starts of two consecutive rows, or 0 if
+   the rows are not stored in one contiguous block. */
+BGD_DECLARE(int) gdImageGetStride (gdImagePtr im);
+
 /* Replaces or blends with the background depending on the
    most recent call to gdImageAlphaBlending and the
    alpha channel value of 'color'; default is to overwrite.
@@ -715,6 +767,12 @@ BGD_DECLARE(void) gdImageSetPixel (gdImagePtr im, int x, int y, int color);
 BGD_DECLARE(int) gdImageGetPixel (gdImagePtr im, int x, int y);
 BGD_DECLARE(int) gdImageGetTrueColorPixel (gdImagePtr im, int x, int y);
 
+/* Bulk access to spans of pixels of a row; see the documentation in gd.c */
+BGD_DECLARE(int) gdImageGetSpan (gdImagePtr im, int x, int y, int n, int *dst);
+BGD_DECLARE(int) gdImageGetTrueColorSpan (gdImagePtr im, int x, int y, int n, int *dst);
+BGD_DECLARE(int) gdImagePutSpan (gdImagePtr im, int x, int y, int n, const int *src);
+BGD_DECLARE(int) gdImageBlendSpan (gdImagePtr im, int x, int y, int n, const int *src);
+
 BGD_DECLARE(void) gdImageAABlend (gdImagePtr im);
 
 BGD_DECLARE(void) gdImageLine (gdImagePtr im, int x1, int y1, int x2, int y2, int color);
@@ -903,6 +961,12 @@ gdRect, *gdRectPtr;
 BGD_DECLARE(void) gdImagePolygon (gdImagePtr im, gdPointPtr p, int n, int c);
 BGD_DECLARE(void) gdImageOpenPolygon (gdImagePtr im, gdPointPtr p, int n, int c);
 BGD_DECLARE(void) gdImageFilledPolygon (gdImagePtr im, gdPointPtr p, int n, int c);
+BGD_DECLARE(void) gdImageFilledPolygons (gdImagePtr im, gdPointPtr p, const int *n, int count, int c);
+BGD_DECLARE(void) gdImageFilledPolygonAA (gdImagePtr im, gdPointFPtr p, int n, int c);
+
+/* Batches of primitives of one color, for charts */
+BGD_DECLARE(void) gdImageLines (gdImagePtr im, const gdPoint *p, int n, int color);
+BGD_DECLARE(void) gdImageFilledRectangles (gdImagePtr im, const gdRect *r, int n, int color);
 
 /* These functions still work with truecolor images,
    for which they never return error. */
@@ -961,6 +1025,7 @@ BGD_DECLARE(int) gdImageColorResolveAlpha (gdImagePtr im, int r, int g, int b, i
 				      (b))
 
 BGD_DECLARE(void) gdImageColorDeallocate (gdImagePtr im, int color);
+BGD_DECLARE(void) gdImagePaletteChanged (gdImagePtr im);
 
 /* Converts a truecolor image to a palette-based image,
    using a high-quality two-pass quantization routine
@@ -1067,6 +1132,27 @@ BGD_DECLARE(int) gdSupportsFileType(const char *filename, int writing);
    functions */
 BGD_DECLARE(void) gdFree (void *m);
 
+/* 2.3.2: replaceable allocator behind gdMalloc()/gdFree() and friends. */
+typedef void *(*gdMallocMethod)(size_t size);
+typedef void *(*gdCallocMethod)(size_t nmemb, size_t size);
+typedef void *(*gdReallocMethod)(void *ptr, size_t size);
+typedef void (*gdFreeMethod)(void *ptr);
+
+BGD_DECLARE(void) gdSetMemoryMethods (gdMallocMethod malloc_method,
+                                      gdCallocMethod calloc_method,
+                                      gdReallocMethod realloc_method,
+                                      gdFreeMethod free_method);
+BGD_DECLARE(void) gdClearMemoryMethods (void);
+
+/* 2.3.2: per-request arenas, see gd_memory.c. */
+typedef struct gdArenaStruct *gdArenaPtr;
+
+BGD_DECLARE(gdArenaPtr) gdArenaCreate (size_t limit);
+BGD_DECLARE(void) gdArenaDestroy (gdArenaPtr arena);
+BGD_DECLARE(void) gdArenaReset (gdArenaPtr arena);
+BGD_DECLARE(gdArenaPtr) gdArenaUse (gdArenaPtr arena);
+BGD_DECLARE(size_t) gdArenaGetUsage (gdArenaPtr arena);
+
 /* Best to free this memory with gdFree(), not free() */
 BGD_DECLARE(void *) gdImageWBMPPtr (gdImagePtr im, int *size, int fg);
 
@@ -1196,6 +1282,13 @@ BGD_DECLARE(void) gdImageArc (gdImagePtr im, int cx, int cy, int w, int h, int s
 BGD_DECLARE(void) gdImageEllipse(gdImagePtr im, int cx, int cy, int w, int h, int color);
 BGD_DECLARE(void) gdImageFilledEllipse (gdImagePtr im, int cx, int cy, int w, int h,
                                         int color);
+BGD_DECLARE(void) gdImageFilledEllipses (gdImagePtr im, const gdPoint *c, int n, int w, int h,
+                                         int color);
+/* Anti-aliased versions of the above, in gd_aa_fill.c */
+BGD_DECLARE(void) gdImageFilledArcAA (gdImagePtr im, double cx, double cy, double w, double h,
+                                      double s, double e, int color, int style);
+BGD_DECLARE(void) gdImageFilledEllipseAA (gdImagePtr im, double cx, double cy, double w, double h,
+                                          int color);
 BGD_DECLARE(void) gdImageFillToBorder (gdImagePtr im, int x, int y, int border,
                                        int color);
 BGD_DECLARE(void) gdImageFill (gdImagePtr im, int x, int y, int color);
@@ -1241,6 +1334,8 @@ BGD_DECLARE(void) gdImageCopyRotated (gdImagePtr dst,
                                       int srcWidth, int srcHeight, int angle);
 
 BGD_DECLARE(gdImagePtr) gdImageClone (gdImagePtr src);
+BGD_DECLARE(gdImagePtr) gdImageCloneShared (gdImagePtr src);
+BGD_DECLARE(int) gdImageUnshare (gdImagePtr im);
 
 BGD_DECLARE(void) gdImageSetBrush (gdImagePtr im, gdImagePtr brush);
 BGD_DECLARE(void) gdImageSetTile (gdImagePtr im, gdImagePtr tile);
@@ -1518,6 +1613,7 @@ BGD_DECLARE(void *) gdDPExtractData (struct gdIOCtx *ctx, int *size);
 
 /* Image comparison definitions */
 BGD_DECLARE(int) gdImageCompare (gdImagePtr im1, gdImagePtr im2);
+BGD_DECLARE(int) gdImageCompareDiff (gdImagePtr im1, gdImagePtr im2, gdRectPtr bounds);
 
 BGD_DECLARE(void) gdImageFlipHorizontal(gdImagePtr im);
 BGD_DECLARE(void) gdImageFlipVertical(gdImagePtr im);
@@ -1558,9 +1654,15 @@ BGD_DECLARE(int) gdImageSetInterpolationMethod(gdImagePtr im, gdInterpolationMet
 BGD_DECLARE(gdInterpolationMethod) gdImageGetInterpolationMethod(gdImagePtr im);
 
 BGD_DECLARE(gdImagePtr) gdImageScale(const gdImagePtr src, const unsigned int new_width, const unsigned int new_height);
+BGD_DECLARE(void) gdScaleCacheSetSize(int size);
 
 BGD_DECLARE(gdImagePtr) gdImageRotateInterpolated(const gdImagePtr src, const float angle, int bgcolor);
 
+/* 2.3.2: worker threads for scaling and transforming, see gd_threads.c. */
+BGD_DECLARE(void) gdSetThreadCount(int threads);
+BGD_DECLARE(int) gdGetThreadCount(void);
+BGD_DECLARE(void) gdImageSetThreadCount(gdImagePtr im, int threads);
+
 typedef enum {
 	GD_AFFINE_TRANSLATE = 0,
 	GD_AFFINE_SCALE,
@@ -1608,6 +1710,7 @@ BGD_DECLARE(int) gdTransformAffineBoundingBox(gdRectPtr src, const double affine
  *
  * See also:
  *   - <gdImageCompare>
+ *   - <gdImageCompareDiff>
  */
 #define GD_CMP_IMAGE		1
 #define GD_CMP_NUM_COLORS	2
@@ -0,0 +1,716 @@
+/**
+ * File: Anti-aliased fills
+ *
+ * Anti-aliased filled polygons, ellipses and arcs.
+ *
+ * The shapes are rendered in one pass by coverage accumulation: each edge
+ * adds the signed area it cuts off of the pixels it crosses to a row
+ * buffer, whose running sum along the row is then the exact fraction of
+ * each pixel covered by the shape. Ellipses and arcs are approximated by
+ * polygons much closer to the exact outline than a pixel.
+ *
+ * Pixel (x, y) is the unit square centered at (x, y), so the outline of a
+ * shape passes through the pixel centers for integer coordinates, just as
+ * for the aliased functions.
+ *
+ * Example:
+ *   (start code)
+ *   gdPointF triangle[3] = {{10.5, 10}, {90, 30.25}, {40.75, 80}};
+ *   im = gdImageCreateTrueColor(100, 100);
+ *   gdImageFilledPolygonAA(im, triangle, 3, gdTrueColor(255, 0, 0));
+ *   gdImageFilledEllipseAA(im, 50, 50, 40.5, 30, gdTrueColorAlpha(0, 0, 255, 64));
+ *   (end code)
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "gd.h"
+#include "gdhelpers.h"
+#include "gd_intern.h"
+
+#ifndef M_PI
+# define M_PI 3.14159265358979323846
+#endif
+
+/* the largest distance of the chords approximating an ellipse from the
+   ellipse, in pixels */
+#define GD_AA_FLATNESS 0.02
+#define GD_AA_MAX_SEGMENTS 65536
+/* larger coordinates are refused, as their differences could overflow */
+#define GD_AA_MAX_COORD 1e15
+
+typedef struct {
+	/* the upper and the lower end, in the coordinates of the row buffer:
+	   pixel (x, y) is the cell [x - x0, x - x0 + 1) x [y, y + 1), x0 being
+	   the first column of the buffer */
+	double x1, y1, x2, y2;
+	/* 1 for edges going down, -1 for edges going up */
+	double dir;
+} gdCoverageEdge;
+
+static int gdCoverageEdgeCompare (const void *a, const void *b)
+{
+	const gdCoverageEdge *e1 = (const gdCoverageEdge *) a;
+	const gdCoverageEdge *e2 = (const gdCoverageEdge *) b;
+
+	return e1->y1 < e2->y1 ? -1 : e1->y1 > e2->y1;
+}
+
+/* Adds the area to the right of a straight piece of an edge within one
+   row, going from x0 to x1 while descending dy (negative when going up),
+   to the cells of acc, whose running sum then gives the coverage of each
+   of the w pixels. Parts left of the buffer count as if on its left
+   border, parts right of it as if on its right border, cell w. lo and hi
+   are widened to the cells changed. */
+static void gdCoverageAddLine (double *acc, int w, double x0, double x1, double dy,
+                               int *lo, int *hi)
+{
+	double xl = MIN(x0, x1), xr = MAX(x0, x1);
+	double scale, xm;
+	int i;
+
+	/* pieces too steep to tell apart from vertical ones are taken as
+	   those, so that the slope can't overflow */
+	if (xr - xl < 1e-9) {
+		xl = (xl + xr) * 0.5;
+		if (xl <= 0.0) {
+			i = 0;
+			acc[0] += dy;
+		} else if (xl >= w) {
+			i = w;
+			acc[w] += dy;
+		} else {
+			i = (int) xl;
+			xm = xl - i;
+			acc[i] += dy * (1.0 - xm);
+			acc[i + 1] += dy * xm;
+		}
+		*lo = MIN(*lo, i);
+		*hi = MAX(*hi, MIN(i + 1, w));
+		return;
+	}
+
+	scale = dy / (xr - xl);
+	if (xl < 0.0) {
+		acc[0] += scale * (MIN(xr, 0.0) - xl);
+		*lo = 0;
+		*hi = MAX(*hi, 0);
+		xl = 0.0;
+	}
+	if (xr > w) {
+		acc[w] += scale * (xr - MAX(xl, (double) w));
+		*lo = MIN(*lo, w);
+		*hi = w;
+		xr = w;
+	}
+	if (!(xl < xr)) {
+		return;
+	}
+	i = (int) xl;
+	*lo = MIN(*lo, i);
+	for (; i < xr; i++) {
+		const double u = MAX(xl, i);
+		const double v = MIN(xr, i + 1.0);
+		const double a = scale * (v - u);
+
+		xm = (u + v) * 0.5 - i;
+		acc[i] += a * (1.0 - xm);
+		acc[i + 1] += a * xm;
+	}
+	*hi = MAX(*hi, i);
+}
+
+/* c with its opacity scaled by a coverage k of 0 to 255 */
+static int gdCoverageScale (int c, int k)
+{
+	const int alpha = gdAlphaMax - ((gdAlphaMax - gdTrueColorGetAlpha(c)) * k + 127) / 255;
+
+	return (c & 0xFFFFFF) | (alpha << 24);
+}
+
+/* src covering k / 255 of a pixel dst, with all channels replaced */
+static int gdCoverageMix (int dst, int src, int k)
+{
+	const int l = 255 - k;
+
+	return gdTrueColorAlpha(
+	           (gdTrueColorGetRed(src) * k + gdTrueColorGetRed(dst) * l + 127) / 255,
+	           (gdTrueColorGetGreen(src) * k + gdTrueColorGetGreen(dst) * l + 127) / 255,
+	           (gdTrueColorGetBlue(src) * k + gdTrueColorGetBlue(dst) * l + 127) / 255,
+	           (gdTrueColorGetAlpha(src) * k + gdTrueColorGetAlpha(dst) * l + 127) / 255);
+}
+
+/* Draws the n pixels from x of row y, which are inside of the clipping
+   rectangle, with the color c covering cov[i] / 255 of pixel x + i. */
+static void gdCoverageSpan (gdImagePtr im, int x, int y, const unsigned char *cov, int n,
+                            int c, int *buf)
+{
+	int i, start;
+
+	if (!gdImageRowWritable(im, y)) {
+		return;
+	}
+	if (!im->trueColor) {
+		/* no partial coverage, the pixels at least half covered are set */
+		for (i = 0; i < n; i++) {
+			if (cov[i] < 128) {
+				continue;
+			}
+			for (start = i; i < n && cov[i] >= 128; i++);
+			memset(im->pixels[y] + x + start, c, i - start);
+		}
+	} else if (im->alphaBlendingFlag == gdEffectReplace) {
+		int *row = im->tpixels[y] + x;
+		for (i = 0; i < n; i++) {
+			if (cov[i] == 255) {
+				row[i] = c;
+			} else if (cov[i]) {
+				row[i] = gdCoverageMix(row[i], c, cov[i]);
+			}
+		}
+	} else {
+		for (i = 0; i < n; i++) {
+			if (!cov[i]) {
+				continue;
+			}
+			for (start = i; i < n && cov[i]; i++) {
+				buf[i] = cov[i] == 255 ? c : gdCoverageScale(c, cov[i]);
+			}
+			gdImageBlendSpan(im, x + start, y, i - start, buf + start);
+		}
+	}
+}
+
+/* Fills count polygons together with the nonzero fill rule, polygon k
+   having the n[k] vertices following the ones of the polygons before it
+   in p */
+static void gdCoverageFill (gdImagePtr im, const gdPointF *p, const int *n, int count, int c)
+{
+	gdCoverageEdge *edges = NULL, **active = NULL;
+	double *acc = NULL;
+	unsigned char *cov = NULL;
+	int *buf = NULL;
+	const gdPointF *poly;
+	double minx, maxx, miny, maxy;
+	int x0, w, total, nedges, nactive, next;
+	int i, j, k, y, ystart, yend;
+
+	if (c == gdAntiAliased) {
+		c = im->AA_color;
+	}
+	if (c < 0 || im->cx1 > im->cx2 || im->cy1 > im->cy2) {
+		return;
+	}
+	total = 0;
+	for (k = 0; k < count; k++) {
+		if (n[k] < 0 || total > INT_MAX - n[k]) {
+			return;
+		}
+		total += n[k];
+	}
+	if (total < 3 || overflow2(sizeof(gdCoverageEdge), total)
+	        || overflow2(sizeof(gdCoverageEdge *), total)) {
+		return;
+	}
+	minx = HUGE_VAL;
+	maxx = -HUGE_VAL;
+	for (i = 0; i < total; i++) {
+		/* also false for NaNs and infinities */
+		if (!(fabs(p[i].x) < GD_AA_MAX_COORD && fabs(p[i].y) < GD_AA_MAX_COORD)) {
+			return;
+		}
+		minx = MIN(minx, p[i].x);
+		maxx = MAX(maxx, p[i].x);
+	}
+
+	/* the row buffer covers the columns of the clipping rectangle the
+	   shape reaches */
+	if (maxx + 0.5 <= im->cx1 || minx + 0.5 >= im->cx2 + 1.0) {
+		return;
+	}
+	x0 = minx + 0.5 > im->cx1 ? (int) floor(minx + 0.5) : im->cx1;
+	w = (maxx + 0.5 < im->cx2 + 1.0 ? (int) ceil(maxx + 0.5) - 1 : im->cx2) - x0 + 1;
+	edges = (gdCoverageEdge *) gdMalloc(sizeof(gdCoverageEdge) * total);
+	active = (gdCoverageEdge **) gdMalloc(sizeof(gdCoverageEdge *) * total);
+	acc = (double *) gdCalloc(w + 2, sizeof(double));
+	cov = (unsigned char *) gdMalloc(w);
+	buf = (int *) gdMalloc(sizeof(int) * w);
+	if (!edges || !active || !acc || !cov || !buf) {
+		goto done;
+	}
+
+	/* the edges, except for horizontal ones, which don't cover anything */
+	nedges = 0;
+	miny = HUGE_VAL;
+	maxy = -HUGE_VAL;
+	for (k = 0, poly = p; k < count; poly += n[k], k++) {
+		for (i = 0; i < n[k]; i++) {
+			const gdPointF *a = &poly[i ? i - 1 : n[k] - 1];
+			const gdPointF *b = &poly[i];
+			gdCoverageEdge *e = &edges[nedges];
+
+			if (a->y == b->y) {
+				continue;
+			}
+			e->dir = 1.0;
+			if (a->y > b->y) {
+				const gdPointF *t = a;
+				a = b;
+				b = t;
+				e->dir = -1.0;
+			}
+			e->x1 = a->x + 0.5 - x0;
+			e->y1 = a->y + 0.5;
+			e->x2 = b->x + 0.5 - x0;
+			e->y2 = b->y + 0.5;
+			miny = MIN(miny, e->y1);
+			maxy = MAX(maxy, e->y2);
+			nedges++;
+		}
+	}
+	if (!nedges || maxy <= im->cy1 || miny >= im->cy2 + 1.0) {
+		goto done;
+	}
+	qsort(edges, nedges, sizeof(gdCoverageEdge), gdCoverageEdgeCompare);
+	ystart = miny > im->cy1 ? (int) floor(miny) : im->cy1;
+	yend = maxy < im->cy2 + 1.0 ? (int) ceil(maxy) - 1 : im->cy2;
+
+	nactive = 0;
+	next = 0;
+	for (y = ystart; y <= yend; y++) {
+		const double top = y, bottom = y + 1.0;
+		int lo = w, hi = -1;
+		double sum;
+
+		/* drop the edges ending above this row, add the ones starting
+		   above its bottom */
+		for (i = 0, j = 0; i < nactive; i++) {
+			if (active[i]->y2 > top) {
+				active[j++] = active[i];
+			}
+		}
+		nactive = j;
+		for (; next < nedges && edges[next].y1 < bottom; next++) {
+			if (edges[next].y2 > top) {
+				active[nactive++] = &edges[next];
+			}
+		}
+
+		for (i = 0; i < nactive; i++) {
+			const gdCoverageEdge *e = active[i];
+			const double ya = MAX(e->y1, top);
+			const double yb = MIN(e->y2, bottom);
+			const double xa = ya == e->y1 ? e->x1 :
+			                  e->x1 + (e->x2 - e->x1) * ((ya - e->y1) / (e->y2 - e->y1));
+			const double xb = yb == e->y2 ? e->x2 :
+			                  e->x1 + (e->x2 - e->x1) * ((yb - e->y1) / (e->y2 - e->y1));
+
+			gdCoverageAddLine(acc, w, xa, xb, (yb - ya) * e->dir, &lo, &hi);
+		}
+		if (hi < 0) {
+			continue;
+		}
+
+		/* the running sum is the winding number weighted by the area,
+		   which is limited to 1; it is back at zero after cell hi */
+		sum = 0.0;
+		for (i = lo; i < MIN(hi + 1, w); i++) {
+			double a;
+			sum += acc[i];
+			a = fabs(sum);
+			cov[i] = a >= 1.0 ? 255 : (unsigned char) (a * 255.0 + 0.5);
+		}
+		gdCoverageSpan(im, x0 + lo, y, cov + lo, MIN(hi + 1, w) - lo, c, buf + lo);
+		for (i = lo; i <= hi + 1; i++) {
+			acc[i] = 0.0;
+		}
+	}
+
+done:
+	gdFree(edges);
+	gdFree(active);
+	gdFree(acc);
+	gdFree(cov);
+	gdFree(buf);
+}
+
+/* The number of segments for an arc of sweep degrees of an ellipse with
+   the diameters w and h */
+static int gdCoverageSegments (double w, double h, double sweep)
+{
+	const double r = MAX(w, h) / 2.0;
+	double n;
+
+	if (r <= GD_AA_FLATNESS) {
+		return 4;
+	}
+	n = ceil(sweep / 360.0 * M_PI / acos(1.0 - GD_AA_FLATNESS / r));
+	return n < 4 ? 4 : (n > GD_AA_MAX_SEGMENTS ? GD_AA_MAX_SEGMENTS : (int) n);
+}
+
+/* Sets p[0] to p[n] to the points at the angles s to e (in degrees) of
+   the ellipse. For n > 1, they are moved out by half the distance of the
+   chords between them from the ellipse, so that the chords lie as much
+   outside of the ellipse as inside and the area comes out right. */
+static void gdCoverageArcPoints (gdPointF *p, int n, double cx, double cy, double w, double h,
+                                 double s, double e)
+{
+	const double f = n > 1 ? 2.0 / (1.0 + cos((e - s) / n * M_PI / 360.0)) : 1.0;
+	int i;
+
+	for (i = 0; i <= n; i++) {
+		const double t = (s + (e - s) * i / n) * M_PI / 180.0;
+		p[i].x = cx + cos(t) * w * f / 2.0;
+		p[i].y = cy + sin(t) * h * f / 2.0;
+	}
+}
+
+/* The polygons making up a stroke: a rectangle for each segment, and a
+   circular wedge on the outer side of each join. They are all oriented the
+   same way, so that the nonzero fill rule gives their union, and the
+   wedges meet the rectangles along common edges, which cancel. */
+typedef struct {
+	gdPointF *points;
+	int npoints, maxPoints;
+	int *counts;
+	int count, maxCount;
+	int failed;
+} gdStrokePolygons;
+
+/* Room for n more points, or NULL if out of memory */
+static gdPointF *gdStrokeReserve (gdStrokePolygons *s, int n)
+{
+	if (s->failed) {
+		return NULL;
+	}
+	if (s->npoints + n > s->maxPoints) {
+		int max = s->maxPoints ? s->maxPoints : 64;
+		gdPointF *points;
+		while (max < s->npoints + n) {
+			if (overflow2(max, 2) || overflow2(sizeof(gdPointF), max * 2)) {
+				s->failed = 1;
+				return NULL;
+			}
+			max *= 2;
+		}
+		points = (gdPointF *) gdRealloc(s->points, sizeof(gdPointF) * max);
+		if (!points) {
+			s->failed = 1;
+			return NULL;
+		}
+		s->points = points;
+		s->maxPoints = max;
+	}
+	if (s->count == s->maxCount) {
+		const int max = s->maxCount ? 2 * s->maxCount : 16;
+		int *counts;
+		if (overflow2(sizeof(int), max)) {
+			s->failed = 1;
+			return NULL;
+		}
+		counts = (int *) gdRealloc(s->counts, sizeof(int) * max);
+		if (!counts) {
+			s->failed = 1;
+			return NULL;
+		}
+		s->counts = counts;
+		s->maxCount = max;
+	}
+	return s->points + s->npoints;
+}
+
+/* Adds the n points just reserved as a polygon, turning it the common
+   way */
+static void gdStrokeAdd (gdStrokePolygons *s, int n)
+{
+	gdPointF *p = s->points + s->npoints;
+	double area = 0.0;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		const gdPointF *a = &p[i ? i - 1 : n - 1];
+		area += a->x * p[i].y - p[i].x * a->y;
+	}
+	if (area < 0.0) {
+		for (i = 0; i < n / 2; i++) {
+			const gdPointF t = p[i];
+			p[i] = p[n - 1 - i];
+			p[n - 1 - i] = t;
+		}
+	}
+	s->npoints += n;
+	s->counts[s->count++] = n;
+}
+
+/* The rectangle of half width hw around the segment from a to b, which
+   is extended by ea before a and eb after b */
+static void gdStrokeSegment (gdStrokePolygons *s, const gdPointF *a, const gdPointF *b,
+                             double hw, double ea, double eb)
+{
+	const double len = sqrt((b->x - a->x) * (b->x - a->x) + (b->y - a->y) * (b->y - a->y));
+	const double dx = (b->x - a->x) / len, dy = (b->y - a->y) / len;
+	const double nx = -dy * hw, ny = dx * hw;
+	gdPointF *p = gdStrokeReserve(s, 4);
+
+	if (!p) {
+		return;
+	}
+	p[0].x = a->x - dx * ea - nx;
+	p[0].y = a->y - dy * ea - ny;
+	p[1].x = b->x + dx * eb - nx;
+	p[1].y = b->y + dy * eb - ny;
+	p[2].x = b->x + dx * eb + nx;
+	p[2].y = b->y + dy * eb + ny;
+	p[3].x = a->x - dx * ea + nx;
+	p[3].y = a->y - dy * ea + ny;
+	gdStrokeAdd(s, 4);
+}
+
+/* The round join at b of the segments from a to b and from b to c */
+static void gdStrokeJoin (gdStrokePolygons *s, const gdPointF *a, const gdPointF *b,
+                          const gdPointF *c, double hw)
+{
+	const double l1 = sqrt((b->x - a->x) * (b->x - a->x) + (b->y - a->y) * (b->y - a->y));
+	const double l2 = sqrt((c->x - b->x) * (c->x - b->x) + (c->y - b->y) * (c->y - b->y));
+	const double d1x = (b->x - a->x) / l1, d1y = (b->y - a->y) / l1;
+	const double d2x = (c->x - b->x) / l2, d2y = (c->y - b->y) / l2;
+	const double cross = d1x * d2y - d1y * d2x;
+	/* the outer side is the one the path turns away from */
+	const double side = cross > 0.0 ? -1.0 : 1.0;
+	double a1, a2, sweep;
+	gdPointF *p;
+	int n;
+
+	if (fabs(cross) < 1e-9 && d1x * d2x + d1y * d2y > 0.0) {
+		return;
+	}
+	a1 = atan2(side * d1x, -side * d1y);
+	a2 = atan2(side * d2x, -side * d2y);
+	sweep = a2 - a1;
+	if (sweep > M_PI) {
+		sweep -= 2 * M_PI;
+	} else if (sweep < -M_PI) {
+		sweep += 2 * M_PI;
+	}
+	/* a turn back could go either way; it has to go round the front */
+	if (cos(a1 + sweep / 2) * (d1x - d2x) + sin(a1 + sweep / 2) * (d1y - d2y) < 0.0) {
+		sweep += sweep > 0.0 ? -2 * M_PI : 2 * M_PI;
+	}
+
+	n = gdCoverageSegments(2 * hw, 2 * hw, fabs(sweep) * 180.0 / M_PI);
+	p = gdStrokeReserve(s, n + 2);
+	if (!p) {
+		return;
+	}
+	p[0] = *b;
+	gdCoverageArcPoints(p + 1, n, b->x, b->y, 2 * hw, 2 * hw,
+	                    a1 * 180.0 / M_PI, (a1 + sweep) * 180.0 / M_PI);
+	gdStrokeAdd(s, n + 2);
+}
+
+void _gdImageStrokeAA (gdImagePtr im, const gdPointF *p, int n, int closed, double width, int c)
+{
+	gdStrokePolygons s;
+	const gdPointF **v;
+	const double hw = width / 2.0;
+	int i, m;
+
+	if (n < 2 || !(width > 0.0) || overflow2(sizeof(gdPointF *), n)) {
+		return;
+	}
+	v = (const gdPointF **) gdMalloc(sizeof(gdPointF *) * n);
+	if (!v) {
+		return;
+	}
+	/* the points without repetitions */
+	m = 0;
+	for (i = 0; i < n; i++) {
+		if (!m || p[i].x != v[m - 1]->x || p[i].y != v[m - 1]->y) {
+			v[m++] = &p[i];
+		}
+	}
+	if (closed && m > 1 && v[0]->x == v[m - 1]->x && v[0]->y == v[m - 1]->y) {
+		m--;
+	}
+	if (m < 3) {
+		closed = 0;
+	}
+	if (m < 2) {
+		gdFree(v);
+		return;
+	}
+
+	memset(&s, 0, sizeof(s));
+	for (i = 0; i < m - 1; i++) {
+		gdStrokeSegment(&s, v[i], v[i + 1], hw,
+		                !closed && i == 0 ? 0.5 : 0.0, !closed && i == m - 2 ? 0.5 : 0.0);
+	}
+	for (i = 1; i < m - 1; i++) {
+		gdStrokeJoin(&s, v[i - 1], v[i], v[i + 1], hw);
+	}
+	if (closed) {
+		gdStrokeSegment(&s, v[m - 1], v[0], hw, 0.0, 0.0);
+		gdStrokeJoin(&s, v[m - 2], v[m - 1], v[0], hw);
+		gdStrokeJoin(&s, v[m - 1], v[0], v[1], hw);
+	}
+	if (!s.failed) {
+		gdCoverageFill(im, s.points, s.counts, s.count, c);
+	}
+	gdFree(s.points);
+	gdFree(s.counts);
+	gdFree(v);
+}
+
+/**
+ * Function: gdImageFilledPolygonAA
+ *
+ * Draws an anti-aliased filled polygon
+ *
+ * Unlike <gdImageFilledPolygon>, the vertices can be anywhere between
+ * pixels, and the pixels on the outline are drawn with their color
+ * weighted by how much of them is inside of the polygon: on truecolor
+ * images the alpha of the color is scaled by the coverage with alpha
+ * blending enabled, and the pixel is mixed with the color otherwise. On
+ * palette images the pixels at least half covered are set.
+ *
+ * The polygon is filled using the nonzero fillrule, so the regions of
+ * self-intersecting polygons that are surrounded more than once are
+ * filled as well. The coverage of the pixels where the outline crosses
+ * itself is only approximated, as the areas on either side of the
+ * crossing partly cancel.
+ *
+ * Parameters:
+ *   im - The image.
+ *   p  - The vertices as array of <gdPointF>s.
+ *   n  - The number of vertices.
+ *   c  - The color, or <gdAntiAliased> for the color set with
+ *        <gdImageSetAntiAliased>; the other special colors aren't
+ *        supported.
+ *
+ * See also:
+ *   - <gdImageFilledPolygon>
+ *   - <gdImageFilledEllipseAA>
+ *   - <gdImageFilledArcAA>
+ */
+BGD_DECLARE(void) gdImageFilledPolygonAA (gdImagePtr im, gdPointFPtr p, int n, int c)
+{
+	gdCoverageFill(im, p, &n, 1, c);
+}
+
+/**
+ * Function: gdImageFilledEllipseAA
+ *
+ * Draws an anti-aliased filled ellipse
+ *
+ * The pixels on the outline are drawn as by <gdImageFilledPolygonAA>.
+ *
+ * Parameters:
+ *   im - The image.
+ *   cx - The x-coordinate of the center.
+ *   cy - The y-coordinate of the center.
+ *   w  - The width of the ellipse.
+ *   h  - The height of the ellipse.
+ *   c  - The color, as for <gdImageFilledPolygonAA>.
+ *
+ * See also:
+ *   - <gdImageFilledEllipse>
+ */
+BGD_DECLARE(void) gdImageFilledEllipseAA (gdImagePtr im, double cx, double cy, double w, double h, int c)
+{
+	gdPointF *p;
+	int n;
+
+	if (!(w > 0.0 && h > 0.0)) {
+		return;
+	}
+	n = gdCoverageSegments(w, h, 360.0);
+	p = (gdPointF *) gdMalloc(sizeof(gdPointF) * (n + 1));
+	if (!p) {
+		return;
+	}
+	gdCoverageArcPoints(p, n, cx, cy, w, h, 0.0, 360.0);
+	gdCoverageFill(im, p, &n, 1, c);
+	gdFree(p);
+}
+
+/**
+ * Function: gdImageFilledArcAA
+ *
+ * Draws an anti-aliased filled partial ellipse
+ *
+ * The shape is the one <gdImageFilledArc> fills, without rounding the
+ * angles and the points on the ellipse to whole numbers. The pixels on
+ * the outline are drawn as by <gdImageFilledPolygonAA>.
+ *
+ * Parameters:
+ *   im    - The image.
+ *   cx    - The x-coordinate of the center.
+ *   cy    - The y-coordinate of the center.
+ *   w     - The width of the ellipse.
+ *   h     - The height of the ellipse.
+ *   s     - The start angle in degrees, where 0 is the rightmost extreme
+ *           and angles grow clockwise.
+ *   e     - The end angle in degrees.
+ *   c     - The color, as for <gdImageFilledPolygonAA>.
+ *   style - gdPie (or gdArc) to fill the slice of the ellipse, or gdChord
+ *           to fill the triangle of the center and the end points of the
+ *           arc. Nothing is drawn with gdNoFill.
+ *
+ * See also:
+ *   - <gdImageFilledArc>
+ */
+BGD_DECLARE(void) gdImageFilledArcAA (gdImagePtr im, double cx, double cy, double w, double h,
+                                      double s, double e, int c, int style)
+{
+	gdPointF *p;
+	int n;
+
+	if (!(w > 0.0 && h > 0.0) || (style & gdNoFill)) {
+		return;
+	}
+	if (!(fabs(s) < HUGE_VAL && fabs(e) < HUGE_VAL)) {
+		return;
+	}
+	s = fmod(s, 360.0);
+	e = fmod(e, 360.0);
+	if (s < 0.0) {
+		s += 360.0;
+	}
+	if (e < 0.0) {
+		e += 360.0;
+	}
+	if (e <= s) {
+		e += 360.0;
+	}
+
+	if (style & gdChord) {
+		gdPointF triangle[3];
+		triangle[0].x = cx;
+		triangle[0].y = cy;
+		gdCoverageArcPoints(triangle + 1, 1, cx, cy, w, h, s, e);
+		n = 3;
+		gdCoverageFill(im, triangle, &n, 1, c);
+		return;
+	}
+	if (e - s == 360.0) {
+		gdImageFilledEllipseAA(im, cx, cy, w, h, c);
+		return;
+	}
+	n = gdCoverageSegments(w, h, e - s);
+	p = (gdPointF *) gdMalloc(sizeof(gdPointF) * (n + 2));
+	if (!p) {
+		return;
+	}
+	p[0].x = cx;
+	p[0].y = cy;
+	gdCoverageArcPoints(p + 1, n, cx, cy, w, h, s, e);
+	n += 2;
+	gdCoverageFill(im, p, &n, 1, c);
+	gdFree(p);
+}
@@ -0,0 +1,313 @@
+/*
+   * gd_blend.c
+   *
+   * Span versions of the compositing functions gdAlphaBlend(),
+   * gdLayerOverlay() and gdLayerMultiply(), of filling with one color,
+   * of copying with a transparent color key, of looking up palette
+   * colors and of comparing. They use the widest SIMD instruction set
+   * the CPU supports, and give the same results as the per pixel
+   * functions.
+   *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gd.h"
+#include "gd_intern.h"
+#include "gd_vec.h"
+
+#ifdef GD_VEC_HAVE_AVX2
+# define GD_VEC_AVX2
+# include "gd_vec.h"
+# include "gd_blend_vec.h"
+# undef GD_VEC_AVX2
+#endif
+
+#ifdef GD_VEC_HAVE_SSE2
+# define GD_VEC_SSE2
+# include "gd_vec.h"
+# include "gd_blend_vec.h"
+# undef GD_VEC_SSE2
+#endif
+
+#ifdef GD_VEC_HAVE_NEON
+# define GD_VEC_NEON
+# include "gd_vec.h"
+# include "gd_blend_vec.h"
+# undef GD_VEC_NEON
+#endif
+
+typedef void (*gdSpanFunc) (int *dst, const int *src, int n);
+typedef void (*gdFillFunc) (int *dst, int color, int n);
+typedef void (*gdKeyedSpanFunc) (int *dst, const int *src, int n, int key);
+typedef void (*gdKeyedSpan8Func) (unsigned char *dst, const unsigned char *src, int n, int key);
+typedef void (*gdLookupSpanFunc) (int *dst, const unsigned char *src, int n, const int *lut);
+typedef int (*gdDiffSpanFunc) (const int *a, const int *b, int n, int mask);
+typedef int (*gdDiffCountFunc) (const int *a, const int *b, int n, int mask, int *last);
+
+typedef struct {
+	gdSpanFunc alphaBlend;
+	gdSpanFunc overlay;
+	gdSpanFunc multiply;
+	gdFillFunc fill;
+	gdFillFunc alphaBlendFill;
+	gdFillFunc overlayFill;
+	gdFillFunc multiplyFill;
+	gdKeyedSpanFunc copyKeyed;
+	gdKeyedSpan8Func copyKeyed8;
+	gdLookupSpanFunc lookup;
+	gdDiffSpanFunc diff;
+	gdDiffCountFunc diffCount;
+} gdBlendKernels;
+
+static void gdAlphaBlendSpanC (int *dst, const int *src, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		dst[i] = gdAlphaBlend(dst[i], src[i]);
+	}
+}
+
+static void gdLayerOverlaySpanC (int *dst, const int *src, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		dst[i] = gdLayerOverlay(dst[i], src[i]);
+	}
+}
+
+static void gdLayerMultiplySpanC (int *dst, const int *src, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		dst[i] = gdLayerMultiply(dst[i], src[i]);
+	}
+}
+
+static void gdFillSpanC (int *dst, int color, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		dst[i] = color;
+	}
+}
+
+static void gdAlphaBlendFillC (int *dst, int color, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		dst[i] = gdAlphaBlend(dst[i], color);
+	}
+}
+
+static void gdLayerOverlayFillC (int *dst, int color, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		dst[i] = gdLayerOverlay(dst[i], color);
+	}
+}
+
+static void gdLayerMultiplyFillC (int *dst, int color, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		dst[i] = gdLayerMultiply(dst[i], color);
+	}
+}
+
+static void gdCopyKeyedSpanC (int *dst, const int *src, int n, int key)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		if (src[i] != key) {
+			dst[i] = src[i];
+		}
+	}
+}
+
+static void gdCopyKeyedSpan8C (unsigned char *dst, const unsigned char *src, int n, int key)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		if (src[i] != key) {
+			dst[i] = src[i];
+		}
+	}
+}
+
+static void gdLookupSpanC (int *dst, const unsigned char *src, int n, const int *lut)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		dst[i] = lut[src[i]];
+	}
+}
+
+static int gdDiffSpanC (const int *a, const int *b, int n, int mask)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		if ((a[i] ^ b[i]) & mask) {
+			break;
+		}
+	}
+	return i;
+}
+
+static int gdDiffCountC (const int *a, const int *b, int n, int mask, int *last)
+{
+	int i, count = 0;
+
+	*last = -1;
+	for (i = 0; i < n; i++) {
+		if ((a[i] ^ b[i]) & mask) {
+			count++;
+			*last = i;
+		}
+	}
+	return count;
+}
+
+static const gdBlendKernels gdBlendKernelsC = {
+	gdAlphaBlendSpanC, gdLayerOverlaySpanC, gdLayerMultiplySpanC,
+	gdFillSpanC, gdAlphaBlendFillC, gdLayerOverlayFillC, gdLayerMultiplyFillC,
+	gdCopyKeyedSpanC, gdCopyKeyedSpan8C, gdLookupSpanC,
+	gdDiffSpanC, gdDiffCountC
+};
+#ifdef GD_VEC_HAVE_AVX2
+static const gdBlendKernels gdBlendKernelsAvx2 = {
+	gdAlphaBlendSpanAvx2, gdLayerOverlaySpanAvx2, gdLayerMultiplySpanAvx2,
+	gdFillSpanAvx2, gdAlphaBlendFillAvx2, gdLayerOverlayFillAvx2, gdLayerMultiplyFillAvx2,
+	gdCopyKeyedSpanAvx2, gdCopyKeyedSpan8Avx2, gdLookupSpanAvx2,
+	gdDiffSpanAvx2, gdDiffCountAvx2
+};
+#endif
+#ifdef GD_VEC_HAVE_SSE2
+static const gdBlendKernels gdBlendKernelsSse2 = {
+	gdAlphaBlendSpanSse2, gdLayerOverlaySpanSse2, gdLayerMultiplySpanSse2,
+	gdFillSpanSse2, gdAlphaBlendFillSse2, gdLayerOverlayFillSse2, gdLayerMultiplyFillSse2,
+	gdCopyKeyedSpanSse2, gdCopyKeyedSpan8Sse2, gdLookupSpanC,
+	gdDiffSpanSse2, gdDiffCountSse2
+};
+#endif
+#ifdef GD_VEC_HAVE_NEON
+static const gdBlendKernels gdBlendKernelsNeon = {
+	gdAlphaBlendSpanNeon, gdLayerOverlaySpanNeon, gdLayerMultiplySpanNeon,
+	gdFillSpanNeon, gdAlphaBlendFillNeon, gdLayerOverlayFillNeon, gdLayerMultiplyFillNeon,
+	gdCopyKeyedSpanNeon, gdCopyKeyedSpan8Neon, gdLookupSpanC,
+	gdDiffSpanNeon, gdDiffCountNeon
+};
+#endif
+
+/* picked on first use; setting it twice in concurrent first calls does
+   no harm */
+static const gdBlendKernels * volatile gdBlendKernelsUsed = NULL;
+
+static const gdBlendKernels *gdBlendKernelsGet (void)
+{
+	const gdBlendKernels *kernels = gdBlendKernelsUsed;
+	int features;
+
+	if (kernels) {
+		return kernels;
+	}
+	features = _gdCpuFeatures();
+	kernels = &gdBlendKernelsC;
+#ifdef GD_VEC_HAVE_NEON
+	if (features & GD_CPU_NEON) {
+		kernels = &gdBlendKernelsNeon;
+	}
+#endif
+#ifdef GD_VEC_HAVE_SSE2
+	if (features & GD_CPU_SSE2) {
+		kernels = &gdBlendKernelsSse2;
+	}
+#endif
+#ifdef GD_VEC_HAVE_AVX2
+	if (features & GD_CPU_AVX2) {
+		kernels = &gdBlendKernelsAvx2;
+	}
+#endif
+	(void) features;
+	gdBlendKernelsUsed = kernels;
+	return kernels;
+}
+
+void _gdAlphaBlendSpan (int *dst, const int *src, int n)
+{
+	gdBlendKernelsGet()->alphaBlend(dst, src, n);
+}
+
+void _gdLayerOverlaySpan (int *dst, const int *src, int n)
+{
+	gdBlendKernelsGet()->overlay(dst, src, n);
+}
+
+void _gdLayerMultiplySpan (int *dst, const int *src, int n)
+{
+	gdBlendKernelsGet()->multiply(dst, src, n);
+}
+
+void _gdFillSpan (int *dst, int color, int n)
+{
+	gdBlendKernelsGet()->fill(dst, color, n);
+}
+
+void _gdAlphaBlendFill (int *dst, int color, int n)
+{
+	/* the cases gdAlphaBlend() doesn't blend are common for fills */
+	if (gdTrueColorGetAlpha(color) == gdAlphaOpaque) {
+		gdBlendKernelsGet()->fill(dst, color, n);
+	} else if (gdTrueColorGetAlpha(color) != gdAlphaTransparent) {
+		gdBlendKernelsGet()->alphaBlendFill(dst, color, n);
+	}
+}
+
+void _gdLayerOverlayFill (int *dst, int color, int n)
+{
+	gdBlendKernelsGet()->overlayFill(dst, color, n);
+}
+
+void _gdLayerMultiplyFill (int *dst, int color, int n)
+{
+	gdBlendKernelsGet()->multiplyFill(dst, color, n);
+}
+
+void _gdCopyKeyedSpan (int *dst, const int *src, int n, int key)
+{
+	gdBlendKernelsGet()->copyKeyed(dst, src, n, key);
+}
+
+void _gdCopyKeyedSpan8 (unsigned char *dst, const unsigned char *src, int n, int key)
+{
+	gdBlendKernelsGet()->copyKeyed8(dst, src, n, key);
+}
+
+void _gdLookupSpan (int *dst, const unsigned char *src, int n, const int *lut)
+{
+	gdBlendKernelsGet()->lookup(dst, src, n, lut);
+}
+
+int _gdDiffSpan (const int *a, const int *b, int n, int mask)
+{
+	return gdBlendKernelsGet()->diff(a, b, n, mask);
+}
+
+int _gdDiffCount (const int *a, const int *b, int n, int mask, int *last)
+{
+	return gdBlendKernelsGet()->diffCount(a, b, n, mask, last);
+}
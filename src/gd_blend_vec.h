@@ -0,0 +1,307 @@
+/* Vectorized compositing and filling kernels, included by gd_blend.c
+   once per instruction set after gd_vec.h (see there). The *Fill
+   versions combine one color into a whole span.
+
+   The blending kernels compute exactly what gdAlphaBlend(),
+   gdLayerOverlay() and gdLayerMultiply() compute. All products involved
+   are below 2^24, so they are exact in single precision floats, and a
+   correctly rounded float quotient of such integers truncates to the
+   same value as the integer division. */
+
+#define GD_BLEND_CHANNEL(v, shift) VEC_AND(VEC_SRL((v), (shift)), VEC_SET1(0xFF))
+#define GD_BLEND_ALPHA(v) VEC_AND(VEC_SRL((v), 24), VEC_SET1(0x7F))
+/* (int) (a * b / c) for non-negative a, b, with c a float */
+#define GD_BLEND_MULDIV(a, b, c) VEC_TOI(VEC_DIVF(VEC_MULF(VEC_TOF(a), VEC_TOF(b)), (c)))
+
+static VEC_TARGET veci VEC_FN(gdAlphaBlendVec) (veci d, veci s)
+{
+	const veci zero = VEC_SET1(0);
+	const veci alphaMax = VEC_SET1(gdAlphaMax);
+	const vecf alphaMaxF = VEC_SET1F((float) gdAlphaMax);
+	const veci srcAlpha = GD_BLEND_ALPHA(s);
+	const veci dstAlpha = GD_BLEND_ALPHA(d);
+	const veci srcWeight = VEC_SUB(alphaMax, srcAlpha);
+	const veci dstWeight = GD_BLEND_MULDIV(VEC_SUB(alphaMax, dstAlpha), srcAlpha, alphaMaxF);
+	/* zero where srcAlpha is gdAlphaTransparent, but those lanes
+	   are replaced below */
+	const vecf totWeight = VEC_TOF(VEC_ADD(srcWeight, dstWeight));
+	const vecf srcWeightF = VEC_TOF(srcWeight);
+	const vecf dstWeightF = VEC_TOF(dstWeight);
+	veci alpha, red, green, blue, res;
+
+	alpha = GD_BLEND_MULDIV(srcAlpha, dstAlpha, alphaMaxF);
+	red = VEC_TOI(VEC_DIVF(VEC_ADDF(VEC_MULF(VEC_TOF(GD_BLEND_CHANNEL(s, 16)), srcWeightF),
+	                                VEC_MULF(VEC_TOF(GD_BLEND_CHANNEL(d, 16)), dstWeightF)),
+	                       totWeight));
+	green = VEC_TOI(VEC_DIVF(VEC_ADDF(VEC_MULF(VEC_TOF(GD_BLEND_CHANNEL(s, 8)), srcWeightF),
+	                                  VEC_MULF(VEC_TOF(GD_BLEND_CHANNEL(d, 8)), dstWeightF)),
+	                         totWeight));
+	blue = VEC_TOI(VEC_DIVF(VEC_ADDF(VEC_MULF(VEC_TOF(GD_BLEND_CHANNEL(s, 0)), srcWeightF),
+	                                 VEC_MULF(VEC_TOF(GD_BLEND_CHANNEL(d, 0)), dstWeightF)),
+	                        totWeight));
+	res = VEC_OR(VEC_OR(VEC_SLL(alpha, 24), VEC_SLL(red, 16)),
+	             VEC_OR(VEC_SLL(green, 8), blue));
+
+	/* the simple cases, in reverse order of precedence */
+	res = VEC_SELECT(VEC_EQ(dstAlpha, alphaMax), s, res);
+	res = VEC_SELECT(VEC_EQ(srcAlpha, alphaMax), d, res);
+	return VEC_SELECT(VEC_EQ(srcAlpha, zero), s, res);
+}
+
+static VEC_TARGET void VEC_FN(gdAlphaBlendSpan) (int *dst, const int *src, int n)
+{
+	int i;
+
+	for (i = 0; i + VEC_WIDTH <= n; i += VEC_WIDTH) {
+		VEC_STORE(dst + i, VEC_FN(gdAlphaBlendVec) (VEC_LOAD(dst + i), VEC_LOAD(src + i)));
+	}
+	for (; i < n; i++) {
+		dst[i] = gdAlphaBlend(dst[i], src[i]);
+	}
+}
+
+static VEC_TARGET void VEC_FN(gdAlphaBlendFill) (int *dst, int color, int n)
+{
+	const veci s = VEC_SET1(color);
+	int i;
+
+	for (i = 0; i + VEC_WIDTH <= n; i += VEC_WIDTH) {
+		VEC_STORE(dst + i, VEC_FN(gdAlphaBlendVec) (VEC_LOAD(dst + i), s));
+	}
+	for (; i < n; i++) {
+		dst[i] = gdAlphaBlend(dst[i], color);
+	}
+}
+
+static VEC_TARGET veci VEC_FN(gdOverlayChannel) (veci s, veci d, vecf maxF)
+{
+	const veci max = VEC_SET1(gdRedMax);
+	const veci d2 = VEC_ADD(d, d);
+	const veci dark = GD_BLEND_MULDIV(d2, s, maxF);
+	const veci light = VEC_SUB(VEC_SUB(VEC_ADD(d2, VEC_ADD(s, s)), dark), max);
+
+	return VEC_SELECT(VEC_GT(d2, max), light, dark);
+}
+
+static VEC_TARGET veci VEC_FN(gdLayerOverlayVec) (veci d, veci s)
+{
+	const veci alphaMax = VEC_SET1(gdAlphaMax);
+	const vecf alphaMaxF = VEC_SET1F((float) gdAlphaMax);
+	const vecf maxF = VEC_SET1F((float) gdRedMax);
+	const veci a1 = VEC_SUB(alphaMax, GD_BLEND_ALPHA(d));
+	const veci a2 = VEC_SUB(alphaMax, GD_BLEND_ALPHA(s));
+	const veci alpha = VEC_SUB(alphaMax, GD_BLEND_MULDIV(a1, a2, alphaMaxF));
+	const veci red = VEC_FN(gdOverlayChannel) (GD_BLEND_CHANNEL(s, 16), GD_BLEND_CHANNEL(d, 16), maxF);
+	const veci green = VEC_FN(gdOverlayChannel) (GD_BLEND_CHANNEL(s, 8), GD_BLEND_CHANNEL(d, 8), maxF);
+	const veci blue = VEC_FN(gdOverlayChannel) (GD_BLEND_CHANNEL(s, 0), GD_BLEND_CHANNEL(d, 0), maxF);
+
+	return VEC_OR(VEC_OR(VEC_SLL(alpha, 24), VEC_SLL(red, 16)),
+	              VEC_OR(VEC_SLL(green, 8), blue));
+}
+
+static VEC_TARGET void VEC_FN(gdLayerOverlaySpan) (int *dst, const int *src, int n)
+{
+	int i;
+
+	for (i = 0; i + VEC_WIDTH <= n; i += VEC_WIDTH) {
+		VEC_STORE(dst + i, VEC_FN(gdLayerOverlayVec) (VEC_LOAD(dst + i), VEC_LOAD(src + i)));
+	}
+	for (; i < n; i++) {
+		dst[i] = gdLayerOverlay(dst[i], src[i]);
+	}
+}
+
+static VEC_TARGET void VEC_FN(gdLayerOverlayFill) (int *dst, int color, int n)
+{
+	const veci s = VEC_SET1(color);
+	int i;
+
+	for (i = 0; i + VEC_WIDTH <= n; i += VEC_WIDTH) {
+		VEC_STORE(dst + i, VEC_FN(gdLayerOverlayVec) (VEC_LOAD(dst + i), s));
+	}
+	for (; i < n; i++) {
+		dst[i] = gdLayerOverlay(dst[i], color);
+	}
+}
+
+/* max - a * (max - c) / gdAlphaMax, the color c with its opacity a applied */
+static VEC_TARGET veci VEC_FN(gdMultiplyWeigh) (veci c, veci a, vecf alphaMaxF)
+{
+	const veci max = VEC_SET1(gdRedMax);
+
+	return VEC_SUB(max, GD_BLEND_MULDIV(a, VEC_SUB(max, c), alphaMaxF));
+}
+
+static VEC_TARGET veci VEC_FN(gdLayerMultiplyVec) (veci d, veci s)
+{
+	const veci alphaMax = VEC_SET1(gdAlphaMax);
+	const vecf alphaMaxF = VEC_SET1F((float) gdAlphaMax);
+	const vecf maxF = VEC_SET1F((float) gdRedMax);
+	const veci srcAlpha = GD_BLEND_ALPHA(s);
+	const veci dstAlpha = GD_BLEND_ALPHA(d);
+	const veci a1 = VEC_SUB(alphaMax, srcAlpha);
+	const veci a2 = VEC_SUB(alphaMax, dstAlpha);
+	const veci alpha = GD_BLEND_MULDIV(srcAlpha, dstAlpha, alphaMaxF);
+	const veci red = GD_BLEND_MULDIV(VEC_FN(gdMultiplyWeigh) (GD_BLEND_CHANNEL(s, 16), a1, alphaMaxF),
+	                                 VEC_FN(gdMultiplyWeigh) (GD_BLEND_CHANNEL(d, 16), a2, alphaMaxF),
+	                                 maxF);
+	const veci green = GD_BLEND_MULDIV(VEC_FN(gdMultiplyWeigh) (GD_BLEND_CHANNEL(s, 8), a1, alphaMaxF),
+	                                   VEC_FN(gdMultiplyWeigh) (GD_BLEND_CHANNEL(d, 8), a2, alphaMaxF),
+	                                   maxF);
+	const veci blue = GD_BLEND_MULDIV(VEC_FN(gdMultiplyWeigh) (GD_BLEND_CHANNEL(s, 0), a1, alphaMaxF),
+	                                  VEC_FN(gdMultiplyWeigh) (GD_BLEND_CHANNEL(d, 0), a2, alphaMaxF),
+	                                  maxF);
+
+	return VEC_OR(VEC_OR(VEC_SLL(alpha, 24), VEC_SLL(red, 16)),
+	              VEC_OR(VEC_SLL(green, 8), blue));
+}
+
+static VEC_TARGET void VEC_FN(gdLayerMultiplySpan) (int *dst, const int *src, int n)
+{
+	int i;
+
+	for (i = 0; i + VEC_WIDTH <= n; i += VEC_WIDTH) {
+		VEC_STORE(dst + i, VEC_FN(gdLayerMultiplyVec) (VEC_LOAD(dst + i), VEC_LOAD(src + i)));
+	}
+	for (; i < n; i++) {
+		dst[i] = gdLayerMultiply(dst[i], src[i]);
+	}
+}
+
+static VEC_TARGET void VEC_FN(gdLayerMultiplyFill) (int *dst, int color, int n)
+{
+	const veci s = VEC_SET1(color);
+	int i;
+
+	for (i = 0; i + VEC_WIDTH <= n; i += VEC_WIDTH) {
+		VEC_STORE(dst + i, VEC_FN(gdLayerMultiplyVec) (VEC_LOAD(dst + i), s));
+	}
+	for (; i < n; i++) {
+		dst[i] = gdLayerMultiply(dst[i], color);
+	}
+}
+
+static VEC_TARGET void VEC_FN(gdFillSpan) (int *dst, int color, int n)
+{
+	const veci c = VEC_SET1(color);
+	int i;
+
+	for (i = 0; i + 2 * VEC_WIDTH <= n; i += 2 * VEC_WIDTH) {
+		VEC_STORE(dst + i, c);
+		VEC_STORE(dst + i + VEC_WIDTH, c);
+	}
+	for (; i < n; i++) {
+		dst[i] = color;
+	}
+}
+
+static VEC_TARGET void VEC_FN(gdCopyKeyedSpan) (int *dst, const int *src, int n, int key)
+{
+	const veci k = VEC_SET1(key);
+	int i;
+
+	for (i = 0; i + VEC_WIDTH <= n; i += VEC_WIDTH) {
+		const veci s = VEC_LOAD(src + i);
+		VEC_STORE(dst + i, VEC_SELECT(VEC_EQ(s, k), VEC_LOAD(dst + i), s));
+	}
+	for (; i < n; i++) {
+		if (src[i] != key) {
+			dst[i] = src[i];
+		}
+	}
+}
+
+static VEC_TARGET void VEC_FN(gdCopyKeyedSpan8) (unsigned char *dst, const unsigned char *src, int n, int key)
+{
+	const veci k = VEC_SET1_8((char) key);
+	int i;
+
+	for (i = 0; i + VEC_WIDTH * 4 <= n; i += VEC_WIDTH * 4) {
+		const veci s = VEC_LOAD(src + i);
+		VEC_STORE(dst + i, VEC_SELECT(VEC_EQ8(s, k), VEC_LOAD(dst + i), s));
+	}
+	for (; i < n; i++) {
+		if (src[i] != key) {
+			dst[i] = src[i];
+		}
+	}
+}
+
+/* Only AVX2 can load from a table per lane; the other instruction sets
+   use the plain C version of this */
+#ifdef GD_VEC_AVX2
+static VEC_TARGET void VEC_FN(gdLookupSpan) (int *dst, const unsigned char *src, int n, const int *lut)
+{
+	int i;
+
+	for (i = 0; i + 2 * VEC_WIDTH <= n; i += 2 * VEC_WIDTH) {
+		const __m256i i0 = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (src + i)));
+		const __m256i i1 = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (src + i + VEC_WIDTH)));
+		VEC_STORE(dst + i, _mm256_i32gather_epi32(lut, i0, 4));
+		VEC_STORE(dst + i + VEC_WIDTH, _mm256_i32gather_epi32(lut, i1, 4));
+	}
+	for (; i < n; i++) {
+		dst[i] = lut[src[i]];
+	}
+}
+#endif
+
+static VEC_TARGET int VEC_FN(gdDiffSpan) (const int *a, const int *b, int n, int mask)
+{
+	const veci m = VEC_SET1(mask);
+	int i;
+
+	for (i = 0; i + 2 * VEC_WIDTH <= n; i += 2 * VEC_WIDTH) {
+		const veci d0 = VEC_XOR(VEC_LOAD(a + i), VEC_LOAD(b + i));
+		const veci d1 = VEC_XOR(VEC_LOAD(a + i + VEC_WIDTH), VEC_LOAD(b + i + VEC_WIDTH));
+		if (VEC_ANY(VEC_AND(VEC_OR(d0, d1), m))) {
+			break;
+		}
+	}
+	for (; i < n; i++) {
+		if ((a[i] ^ b[i]) & mask) {
+			return i;
+		}
+	}
+	return n;
+}
+
+static VEC_TARGET int VEC_FN(gdDiffCount) (const int *a, const int *b, int n, int mask, int *last)
+{
+	const veci m = VEC_SET1(mask), zero = VEC_SET1(0), one = VEC_SET1(1);
+	veci counts = zero;
+	int lanes[VEC_WIDTH];
+	int i, j, count = 0, lastBlock = -1;
+
+	*last = -1;
+	for (i = 0; i + VEC_WIDTH <= n; i += VEC_WIDTH) {
+		const veci d = VEC_AND(VEC_XOR(VEC_LOAD(a + i), VEC_LOAD(b + i)), m);
+		if (VEC_ANY(d)) {
+			/* equal lanes compare to -1 and count 0 */
+			counts = VEC_ADD(counts, VEC_ADD(VEC_EQ(d, zero), one));
+			lastBlock = i;
+		}
+	}
+	VEC_STORE(lanes, counts);
+	for (j = 0; j < VEC_WIDTH; j++) {
+		count += lanes[j];
+	}
+	if (lastBlock >= 0) {
+		for (j = lastBlock; j < lastBlock + VEC_WIDTH; j++) {
+			if ((a[j] ^ b[j]) & mask) {
+				*last = j;
+			}
+		}
+	}
+	for (; i < n; i++) {
+		if ((a[i] ^ b[i]) & mask) {
+			count++;
+			*last = i;
+		}
+	}
+	return count;
+}
+
+#undef GD_BLEND_CHANNEL
+#undef GD_BLEND_ALPHA
+#undef GD_BLEND_MULDIV
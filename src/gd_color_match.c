@@ -57,6 +57,7 @@ BGD_DECLARE(int) gdImageColorMatch (gdImagePtr im1, gdImagePtr im2)
 			bp += 4;
 		}
 	}
+	gdImagePaletteChanged(im2);
 	gdFree(buf);
 	return 0;
 }
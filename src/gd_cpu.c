@@ -0,0 +1,46 @@
+/*
+   * gd_cpu.c
+   *
+   * Runtime detection of the SIMD instruction sets supported by the CPU,
+   * used to pick between the scalar and vectorized kernels.
+   *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gd_intern.h"
+#include "gd_vec.h"
+
+static int gdCpuDetect(void)
+{
+	int features = 0;
+
+#ifdef GD_VEC_HAVE_SSE2
+	features |= GD_CPU_SSE2;
+#endif
+#ifdef GD_VEC_HAVE_AVX2
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		features |= GD_CPU_AVX2;
+	}
+#endif
+#ifdef GD_VEC_HAVE_NEON
+	features |= GD_CPU_NEON;
+#endif
+	return features;
+}
+
+/* Returns the GD_CPU_* flags of the instruction sets that both the
+   compiler and the CPU support. */
+int _gdCpuFeatures(void)
+{
+	/* detecting twice in concurrent first calls does no harm */
+	static volatile int features = -1;
+
+	if (features < 0) {
+		features = gdCpuDetect();
+	}
+	return features;
+}
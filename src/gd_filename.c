@@ -9,10 +9,12 @@
 #include <string.h>
 
 #include "gd.h"
+#include "gd_intern.h"
 
 typedef gdImagePtr (BGD_STDCALL *ReadFn)(FILE *in);
 typedef void (BGD_STDCALL *WriteFn)(gdImagePtr im, FILE *out);
 typedef gdImagePtr (BGD_STDCALL *LoadFn)(char *filename);
+typedef gdImagePtr (BGD_STDCALL *ScaledReadFn)(FILE *in, int width, int height);
 
 #ifdef HAVE_LIBZ
 static void BGD_STDCALL writegd2(gdImagePtr im, FILE *out) {
@@ -42,42 +44,43 @@ static const struct FileType {
     ReadFn reader;
     WriteFn writer;
     LoadFn loader;
+    ScaledReadFn scaledReader;
 } Types[] = {
-    {".gif",    gdImageCreateFromGif,   gdImageGif,     NULL},
-    {".gd",     gdImageCreateFromGd,    gdImageGd,      NULL},
-    {".wbmp",   gdImageCreateFromWBMP,  writewbmp,      NULL},
-    {".bmp",    gdImageCreateFromBmp,   writebmp,       NULL},
+    {".gif",    gdImageCreateFromGif,   gdImageGif,     NULL,   NULL},
+    {".gd",     gdImageCreateFromGd,    gdImageGd,      NULL,   NULL},
+    {".wbmp",   gdImageCreateFromWBMP,  writewbmp,      NULL,   NULL},
+    {".bmp",    gdImageCreateFromBmp,   writebmp,       NULL,   NULL},
 
-    {".xbm",    gdImageCreateFromXbm,   NULL,           NULL},
-    {".tga",    gdImageCreateFromTga,   NULL,           NULL},
+    {".xbm",    gdImageCreateFromXbm,   NULL,           NULL,   NULL},
+    {".tga",    gdImageCreateFromTga,   NULL,           NULL,   NULL},
 
 #ifdef HAVE_LIBPNG
-    {".png",    gdImageCreateFromPng,   gdImagePng,     NULL},
+    {".png",    gdImageCreateFromPng,   gdImagePng,     NULL,   NULL},
 #endif
 
 #ifdef HAVE_LIBJPEG
-    {".jpg",    gdImageCreateFromJpeg,  writejpeg,      NULL},
-    {".jpeg",   gdImageCreateFromJpeg,  writejpeg,      NULL},
+    {".jpg",    gdImageCreateFromJpeg,  writejpeg,      NULL,   gdImageCreateFromJpegScaled},
+    {".jpeg",   gdImageCreateFromJpeg,  writejpeg,      NULL,   gdImageCreateFromJpegScaled},
 #endif
 
 #ifdef HAVE_LIBTIFF
-    {".tiff",   gdImageCreateFromTiff,  gdImageTiff,    NULL},
-    {".tif" ,   gdImageCreateFromTiff,  gdImageTiff,    NULL},
+    {".tiff",   gdImageCreateFromTiff,  gdImageTiff,    NULL,   NULL},
+    {".tif" ,   gdImageCreateFromTiff,  gdImageTiff,    NULL,   NULL},
 #endif
 
 #ifdef HAVE_LIBZ
-    {".gd2",    gdImageCreateFromGd2,   writegd2,       NULL},
+    {".gd2",    gdImageCreateFromGd2,   writegd2,       NULL,   NULL},
 #endif
 
 #ifdef HAVE_LIBWEBP
-    {".webp",   gdImageCreateFromWebp,  gdImageWebp,    NULL},
+    {".webp",   gdImageCreateFromWebp,  gdImageWebp,    NULL,   NULL},
 #endif
 
 #ifdef HAVE_LIBXPM
-    {".xpm",    NULL,                   NULL,           gdImageCreateFromXpm},
+    {".xpm",    NULL,                   NULL,           gdImageCreateFromXpm,   NULL},
 #endif
 
-    {NULL, NULL, NULL}
+    {NULL, NULL, NULL, NULL, NULL}
 };
 
 
@@ -199,6 +202,55 @@ gdImageCreateFromFile(const char *filename) {
 }/* gdImageCreateFromFile*/
 
 
+/*
+  Function: gdImageCreateFromFileScaled
+
+    Read an image file of any supported type, scaled to a given size.
+
+    This works like <gdImageCreateFromFile>, but returns the image
+    scaled to _width_ x _height_. If either is 0, it is computed from
+    the other so that the aspect ratio is kept; if both are, the image
+    is returned at its size.
+
+    JPEG images are mostly reduced while being decoded, see
+    <gdImageCreateFromJpegCtxScaled>, which is much faster than
+    decoding and then scaling them; other types are read and scaled
+    with <gdImageScale>. Images that have to be scaled are returned as
+    truecolor; an image that already has the requested size keeps its
+    type.
+
+  Parameters:
+
+    filename    - the input file name
+    width       - the width of the image to return
+    height      - the height of the image to return
+
+  Returns:
+
+    A pointer to the new image or NULL if an error occurred.
+
+*/
+
+BGD_DECLARE(gdImagePtr)
+gdImageCreateFromFileScaled(const char *filename, int width, int height) {
+    const struct FileType *entry = ftype(filename);
+    FILE *fh;
+    gdImagePtr result;
+
+    if (width <= 0 && height <= 0) return gdImageCreateFromFile(filename);
+    if (!entry || !entry->scaledReader) {
+        result = gdImageCreateFromFile(filename);
+        return result ? _gdImageScaleLoaded(result, width, height) : NULL;
+    }/* if */
+
+    fh = fopen(filename, "rb");
+    if (!fh) return NULL;
+    result = entry->scaledReader(fh, width, height);
+    fclose(fh);
+    return result;
+}/* gdImageCreateFromFileScaled*/
+
+
 
 /*
   Function: gdImageFile
@@ -71,6 +71,79 @@ uchar_clamp(double clr, unsigned char max) {
 
 /* Internal prototypes: */
 
+/* gd.c */
+int _gdImageAllocRows(gdImagePtr im, int trueColor);
+void _gdImagePaletteLut(gdImagePtr im, int *lut);
+void _gdImageFreeRows(gdImagePtr im, int trueColor);
+int _gdImageRecycle(gdImagePtr im, int clear);
+int _gdImageUnshareRow(gdImagePtr im, int y);
+
+/* Makes row y of the pixels of im writable, copying it out of storage
+   shared with clones first if need be. Evaluates to 0 if out of memory. */
+#define gdImageRowWritable(im, y) \
+	(!(im)->rowShared || !(im)->rowShared[(y)] || _gdImageUnshareRow((im), (y)))
+
+/* gd_blend.c: span versions of gdAlphaBlend(), gdLayerOverlay() and
+   gdLayerMultiply(), combining src[i] into dst[i] with bit-identical
+   results. */
+void _gdAlphaBlendSpan(int *dst, const int *src, int n);
+void _gdLayerOverlaySpan(int *dst, const int *src, int n);
+void _gdLayerMultiplySpan(int *dst, const int *src, int n);
+/* Fills dst with color, or combines color into each of its n pixels */
+void _gdFillSpan(int *dst, int color, int n);
+void _gdAlphaBlendFill(int *dst, int color, int n);
+void _gdLayerOverlayFill(int *dst, int color, int n);
+void _gdLayerMultiplyFill(int *dst, int color, int n);
+/* Copies the n pixels of src which are not equal to key to dst */
+void _gdCopyKeyedSpan(int *dst, const int *src, int n, int key);
+void _gdCopyKeyedSpan8(unsigned char *dst, const unsigned char *src, int n, int key);
+/* Sets the n pixels of dst to the entries of lut indexed by src */
+void _gdLookupSpan(int *dst, const unsigned char *src, int n, const int *lut);
+/* The first of the n pixels where a and b differ in the bits of mask, n
+   if there is none */
+int _gdDiffSpan(const int *a, const int *b, int n, int mask);
+/* The number of those pixels; *last is set to the last one, -1 if there
+   is none */
+int _gdDiffCount(const int *a, const int *b, int n, int mask, int *last);
+
+/* gd_interpolation.c: the size and scaling of images decoded with a size
+   requested */
+void _gdScaledSize(int sx, int sy, int *width, int *height);
+gdImagePtr _gdImageScaleLoaded(gdImagePtr im, int width, int height);
+
+/* gd_palette_index.c: searches of the palette, see there. The lookup
+   structures are freed by _gdImagePaletteIndexFree(). */
+int _gdPaletteClosest(gdImagePtr im, int r, int g, int b, int a, int exclude, long limit);
+int _gdPaletteClosestHWB(gdImagePtr im, int r, int g, int b);
+int _gdPaletteExact(gdImagePtr im, int r, int g, int b, int a);
+int _gdPaletteHasOpen(gdImagePtr im);
+void _gdPaletteAllocated(gdImagePtr im, int i, int reused);
+void _gdPaletteDeallocated(gdImagePtr im, int i);
+void _gdImagePaletteIndexFree(gdImagePtr im);
+
+/* gd_aa_fill.c: strokes the path through the n points p, closed if
+   closed is set, with an anti-aliased line of the given width. The
+   segments are joined by round joins, the ends of an open path reach half
+   a pixel beyond its end points. */
+void _gdImageStrokeAA(gdImagePtr im, const gdPointF *p, int n, int closed, double width, int c);
+
+/* gd_cpu.c */
+#define GD_CPU_SSE2 1
+#define GD_CPU_AVX2 2
+#define GD_CPU_NEON 4
+int _gdCpuFeatures(void);
+
+/* gd_pool.c */
+gdImagePtr _gdImagePoolAcquire(gdImagePoolPtr pool, gdImagePtr target,
+                               int sx, int sy, int trueColor, int clear);
+void _gdImagePoolRelease(gdImagePoolPtr pool, gdImagePtr target, gdImagePtr im);
+
+/* gd_threads.c: fn computes the rows start to end - 1, returning 0 on
+   failure */
+typedef int (*gdRowsFunc)(void *arg, int start, int end);
+int _gdImageThreads(gdImagePtr im);
+int _gdParallelRows(int threads, int n, gdRowsFunc fn, void *arg);
+
 /* gd_rotate.c */
 gdImagePtr gdImageRotate90(gdImagePtr src, int ignoretransparent);
 gdImagePtr gdImageRotate180(gdImagePtr src, int ignoretransparent);
@@ -72,6 +72,7 @@ TODO:
 #include "gd.h"
 #include "gdhelpers.h"
 #include "gd_intern.h"
+#include "gd_vec.h"
 
 #ifdef _MSC_VER
 # pragma optimize("t", on)
@@ -120,9 +121,16 @@ typedef long gdFixed;
 /* Divide a fixed by a fixed */
 #define gd_divfx(x,y) (((x) << 8) / (y))
 
+/* The weights are fixed point numbers with this many fractional bits.
+   Each weight is below two and all weights of a pixel add up to less
+   than GD_SCALE_WEIGHT_SUM in magnitude, so that the weighted sums of
+   8 bit channels fit into 32 bits. */
+#define GD_SCALE_WEIGHT_BITS 21
+#define GD_SCALE_WEIGHT_SUM 4.0
+
 typedef struct
 {
-	double *Weights;  /* Normalized weights of neighboring pixels */
+	int *Weights;     /* Normalized weights of neighboring pixels */
 	int Left,Right;   /* Bounds of source pixels window */
 } ContributionType;  /* Contirbution information for a single pixel */
 
@@ -131,6 +139,11 @@ typedef struct
 	ContributionType *ContribRow; /* Row (or column) of contribution weights */
 	unsigned int WindowSize,      /* Filter window size (of affecting source pixels) */
 		     LineLength;      /* Length of line (no. or rows / cols) */
+	/* what the weights were computed for, and the number of users
+	   including the cache, see _gdContributionsGet() */
+	unsigned int SrcLength;
+	interpolation_method Filter;
+	volatile long Refs;
 } LineContribType;
 
 /* Each core filter has its own radius */
@@ -826,12 +839,12 @@ static inline LineContribType * _gdContributionsAlloc(unsigned int line_length,
 {
 	unsigned int u = 0;
 	LineContribType *res;
-	size_t weights_size;
+	int *weights;
 
-	if (overflow2(windows_size, sizeof(double))) {
+	if (overflow2(line_length, sizeof(ContributionType))
+	        || overflow2(line_length, windows_size)
+	        || overflow2(line_length * windows_size, sizeof(int))) {
 		return NULL;
-	} else {
-		weights_size = windows_size * sizeof(double);
 	}
 	res = (LineContribType *) gdMalloc(sizeof(LineContribType));
 	if (!res) {
@@ -839,41 +852,68 @@ static inline LineContribType * _gdContributionsAlloc(unsigned int line_length,
 	}
 	res->WindowSize = windows_size;
 	res->LineLength = line_length;
-	if (overflow2(line_length, sizeof(ContributionType))) {
+	res->ContribRow = (ContributionType *) gdMalloc(line_length * sizeof(ContributionType));
+	if (res->ContribRow == NULL) {
 		gdFree(res);
 		return NULL;
 	}
-	res->ContribRow = (ContributionType *) gdMalloc(line_length * sizeof(ContributionType));
-	if (res->ContribRow == NULL) {
+	/* the weights of all pixels are in one block, owned by the first */
+	weights = (int *) gdMalloc(line_length * windows_size * sizeof(int));
+	if (weights == NULL) {
+		gdFree(res->ContribRow);
 		gdFree(res);
 		return NULL;
 	}
 	for (u = 0 ; u < line_length ; u++) {
-		res->ContribRow[u].Weights = (double *) gdMalloc(weights_size);
-		if (res->ContribRow[u].Weights == NULL) {
-			unsigned int i;
-
-			for (i=0;i<u;i++) {
-				gdFree(res->ContribRow[i].Weights);
-			}
-			gdFree(res->ContribRow);
-			gdFree(res);
-			return NULL;
-		}
+		res->ContribRow[u].Weights = weights + u * windows_size;
 	}
 	return res;
 }
 
 static inline void _gdContributionsFree(LineContribType * p)
 {
-	unsigned int u;
-	for (u = 0; u < p->LineLength; u++)  {
-		gdFree(p->ContribRow[u].Weights);
+	if (p->LineLength) {
+		gdFree(p->ContribRow[0].Weights);
 	}
 	gdFree(p->ContribRow);
 	gdFree(p);
 }
 
+/* Stores the n weights w of a pixel as fixed point numbers. If they are
+   normalized, the rounding error goes to the largest one, so that they
+   add up to exactly one and flat areas stay flat. Weights too large for
+   the fixed point sums are scaled down; they only come from filters
+   whose weights nearly cancel out. */
+static void _gdContributionsFix(ContributionType *contrib, const double *w, int n, int normalized)
+{
+	const int one = 1 << GD_SCALE_WEIGHT_BITS;
+	const int max = 2 * one - 1;
+	int i, sum = 0, largest = 0;
+	double v, scale = 0.0;
+
+	for (i = 0; i < n; i++) {
+		scale += fabs(w[i]);
+	}
+	if (scale > GD_SCALE_WEIGHT_SUM) {
+		scale = GD_SCALE_WEIGHT_SUM / scale;
+		normalized = 0;
+	} else {
+		scale = 1.0;
+	}
+	for (i = 0; i < n; i++) {
+		v = floor(w[i] * scale * one + 0.5);
+		contrib->Weights[i] = (int) CLAMP(v, -max, max);
+		sum += contrib->Weights[i];
+		if (abs(contrib->Weights[i]) > abs(contrib->Weights[largest])) {
+			largest = i;
+		}
+	}
+	if (normalized && n > 0) {
+		v = contrib->Weights[largest] + one - sum;
+		contrib->Weights[largest] = (int) CLAMP(v, -max, max);
+	}
+}
+
 static inline LineContribType *_gdContributionsCalc(unsigned int line_size, unsigned int src_size, double scale_d,  const interpolation_method pFilter)
 {
 	double width_d;
@@ -882,6 +922,7 @@ static inline LineContribType *_gdContributionsCalc(unsigned int line_size, unsi
 	int windows_size;
 	unsigned int u;
 	LineContribType *res;
+	double *weights;
 
 	if (scale_d < 1.0) {
 		width_d = filter_width_d / scale_d;
@@ -895,6 +936,14 @@ static inline LineContribType *_gdContributionsCalc(unsigned int line_size, unsi
 	if (res == NULL) {
 		return NULL;
 	}
+	res->SrcLength = src_size;
+	res->Filter = pFilter;
+	res->Refs = 1;
+	weights = (double *) gdMalloc(windows_size * sizeof(double));
+	if (weights == NULL) {
+		_gdContributionsFree(res);
+		return NULL;
+	}
 	for (u = 0; u < line_size; u++) {
 		const double dCenter = (double)u / scale_d;
 		/* get the significant edge points affecting the pixel */
@@ -916,102 +965,450 @@ static inline LineContribType *_gdContributionsCalc(unsigned int line_size, unsi
 		res->ContribRow[u].Right = iRight;
 
 		for (iSrc = iLeft; iSrc <= iRight; iSrc++) {
-			dTotalWeight += (res->ContribRow[u].Weights[iSrc-iLeft] =  scale_f_d * (*pFilter)(scale_f_d * (dCenter - (double)iSrc)));
+			dTotalWeight += (weights[iSrc-iLeft] =  scale_f_d * (*pFilter)(scale_f_d * (dCenter - (double)iSrc)));
 		}
 
 		if (dTotalWeight < 0.0) {
+			gdFree(weights);
 			_gdContributionsFree(res);
 			return NULL;
 		}
 
 		if (dTotalWeight > 0.0) {
 			for (iSrc = iLeft; iSrc <= iRight; iSrc++) {
-				res->ContribRow[u].Weights[iSrc-iLeft] /= dTotalWeight;
+				weights[iSrc-iLeft] /= dTotalWeight;
 			}
 		}
+		_gdContributionsFix(&res->ContribRow[u], weights, iRight - iLeft + 1, dTotalWeight > 0.0);
 	}
+	gdFree(weights);
 	return res;
 }
 
+/* The weight tables of the last scalings, least recently used first.
+   They are shared by all threads, so that scaling many images to the
+   same few sizes computes them only once. */
+#define GD_SCALE_CACHE_MAX 64
+#define GD_SCALE_CACHE_DEFAULT 16
 
-static inline void
-_gdScaleOneAxis(gdImagePtr pSrc, gdImagePtr dst,
-				unsigned int dst_len, unsigned int row, LineContribType *contrib,
-				gdAxis axis)
+static LineContribType *gd_scale_cache[GD_SCALE_CACHE_MAX];
+static int gd_scale_cache_count = 0;
+static int gd_scale_cache_size = GD_SCALE_CACHE_DEFAULT;
+gdStaticMutexDeclare(gd_scale_cache_mutex);
+
+static void _gdContributionsRelease(LineContribType *p)
 {
-	unsigned int ndx;
+	if (gdAtomicDecrement(p->Refs) == 0) {
+		_gdContributionsFree(p);
+	}
+}
 
-	for (ndx = 0; ndx < dst_len; ndx++) {
-		double r = 0, g = 0, b = 0, a = 0;
-		const int left = contrib->ContribRow[ndx].Left;
-		const int right = contrib->ContribRow[ndx].Right;
-		int *dest = (axis == HORIZONTAL) ?
-			&dst->tpixels[row][ndx] :
-			&dst->tpixels[ndx][row];
+/* Drops the least recently used tables until at most size are left;
+   the cache must be locked */
+static void gdScaleCacheTrim(int size)
+{
+	int i, n = gd_scale_cache_count - size;
 
-		int i;
+	if (n <= 0) {
+		return;
+	}
+	for (i = 0; i < n; i++) {
+		_gdContributionsRelease(gd_scale_cache[i]);
+	}
+	memmove(gd_scale_cache, gd_scale_cache + n, size * sizeof(LineContribType *));
+	gd_scale_cache_count = size;
+}
 
-		/* Accumulate each channel */
-		for (i = left; i <= right; i++) {
-			const int left_channel = i - left;
-			const int srcpx = (axis == HORIZONTAL) ?
-				pSrc->tpixels[row][i] :
-				pSrc->tpixels[i][row];
+/* The weights for scaling src_size pixels to line_size with pFilter,
+   from the cache if possible. To be released with
+   _gdContributionsRelease(). */
+static LineContribType *_gdContributionsGet(unsigned int line_size, unsigned int src_size, const interpolation_method pFilter)
+{
+	LineContribType *res = NULL;
+	gdArenaPtr arena;
+	int i;
 
-			r += contrib->ContribRow[ndx].Weights[left_channel]
-				* (double)(gdTrueColorGetRed(srcpx));
-			g += contrib->ContribRow[ndx].Weights[left_channel]
-				* (double)(gdTrueColorGetGreen(srcpx));
-			b += contrib->ContribRow[ndx].Weights[left_channel]
-				* (double)(gdTrueColorGetBlue(srcpx));
-			a += contrib->ContribRow[ndx].Weights[left_channel]
-				* (double)(gdTrueColorGetAlpha(srcpx));
-		}/* for */
+	gdStaticMutexLock(gd_scale_cache_mutex);
+	for (i = gd_scale_cache_count - 1; i >= 0; i--) {
+		res = gd_scale_cache[i];
+		if (res->LineLength == line_size && res->SrcLength == src_size && res->Filter == pFilter) {
+			gdAtomicIncrement(res->Refs);
+			memmove(gd_scale_cache + i, gd_scale_cache + i + 1,
+			        (gd_scale_cache_count - i - 1) * sizeof(LineContribType *));
+			gd_scale_cache[gd_scale_cache_count - 1] = res;
+			break;
+		}
+		res = NULL;
+	}
+	gdStaticMutexUnlock(gd_scale_cache_mutex);
+	if (res) {
+		return res;
+	}
 
-		*dest = gdTrueColorAlpha(uchar_clamp(r, 0xFF), uchar_clamp(g, 0xFF),
-                                 uchar_clamp(b, 0xFF),
-                                 uchar_clamp(a, 0x7F)); /* alpha is 0..127 */
-	}/* for */
-}/* _gdScaleOneAxis*/
+	/* the table may outlive an arena bound to this thread */
+	arena = gdArenaUse(NULL);
+	res = _gdContributionsCalc(line_size, src_size, (double)line_size / (double)src_size, pFilter);
+	gdArenaUse(arena);
+	if (res == NULL) {
+		return NULL;
+	}
+
+	gdStaticMutexLock(gd_scale_cache_mutex);
+	if (gd_scale_cache_size > 0) {
+		gdScaleCacheTrim(gd_scale_cache_size - 1);
+		gdAtomicIncrement(res->Refs);
+		gd_scale_cache[gd_scale_cache_count++] = res;
+	}
+	gdStaticMutexUnlock(gd_scale_cache_mutex);
+	return res;
+}
+
+/**
+ * Function: gdScaleCacheSetSize
+ *
+ * Sets how many weight tables <gdImageScale> keeps
+ *
+ * The generic interpolation methods scale in two passes, with a table of
+ * the weights of the source pixels for each destination pixel, which
+ * depends only on the lengths and the method. The tables of the last
+ * scalings are kept for the next ones, 16 by default. The cache is shared
+ * by all threads, and this function may be called at any time.
+ *
+ * Parameters:
+ *   size - The number of tables to keep, at most 64. 0 disables the cache
+ *          and frees the tables in it.
+ */
+BGD_DECLARE(void) gdScaleCacheSetSize(int size)
+{
+	gdStaticMutexLock(gd_scale_cache_mutex);
+	gd_scale_cache_size = CLAMP(size, 0, GD_SCALE_CACHE_MAX);
+	gdScaleCacheTrim(gd_scale_cache_size);
+	gdStaticMutexUnlock(gd_scale_cache_mutex);
+}
+
+/* The channel of a weighted sum of pixels, rounded and clamped to 0..max */
+static inline int _gdScaleChannel(int v, int max)
+{
+	if (v < 0) {
+		return 0;
+	}
+	v = (v + (1 << (GD_SCALE_WEIGHT_BITS - 1))) >> GD_SCALE_WEIGHT_BITS;
+	return v > max ? max : v;
+}
+
+/* Pixel x of the weighted sum of the n rows */
+static inline int gdScaleColPixel(int * const *rows, const int *w, int n, int x)
+{
+	int r = 0, g = 0, b = 0, a = 0;
+	int k;
+
+	for (k = 0; k < n; k++) {
+		const int srcpx = rows[k][x];
+
+		r += w[k] * gdTrueColorGetRed(srcpx);
+		g += w[k] * gdTrueColorGetGreen(srcpx);
+		b += w[k] * gdTrueColorGetBlue(srcpx);
+		a += w[k] * gdTrueColorGetAlpha(srcpx);
+	}
+	return gdTrueColorAlpha(_gdScaleChannel(r, 0xFF), _gdScaleChannel(g, 0xFF),
+	                        _gdScaleChannel(b, 0xFF),
+	                        _gdScaleChannel(a, 0x7F)); /* alpha is 0..127 */
+}
+
+/* Scales the row src to the dst_len pixels of dst */
+static void gdScaleRowC(int *dst, const int *src, unsigned int dst_len,
+                        const ContributionType *contrib)
+{
+	unsigned int x;
+
+	for (x = 0; x < dst_len; x++) {
+		int r = 0, g = 0, b = 0, a = 0;
+		const int *p = src + contrib[x].Left;
+		const int *w = contrib[x].Weights;
+		const int n = contrib[x].Right - contrib[x].Left + 1;
+		int k;
+
+		for (k = 0; k < n; k++) {
+			r += w[k] * gdTrueColorGetRed(p[k]);
+			g += w[k] * gdTrueColorGetGreen(p[k]);
+			b += w[k] * gdTrueColorGetBlue(p[k]);
+			a += w[k] * gdTrueColorGetAlpha(p[k]);
+		}
+		dst[x] = gdTrueColorAlpha(_gdScaleChannel(r, 0xFF), _gdScaleChannel(g, 0xFF),
+		                          _gdScaleChannel(b, 0xFF),
+		                          _gdScaleChannel(a, 0x7F));
+	}
+}
+
+/* Sets the len pixels of dst to the weighted sum of the n rows */
+static void gdScaleColC(int *dst, int * const *rows, const int *w, int n, int len)
+{
+	int x;
 
+	for (x = 0; x < len; x++) {
+		dst[x] = gdScaleColPixel(rows, w, n, x);
+	}
+}
+
+#ifdef GD_VEC_HAVE_AVX2
+# define GD_VEC_AVX2
+# include "gd_vec.h"
+# include "gd_scale_vec.h"
+# undef GD_VEC_AVX2
+#endif
 
+#ifdef GD_VEC_HAVE_SSE2
+# define GD_VEC_SSE2
+# include "gd_vec.h"
+# include "gd_scale_vec.h"
+# undef GD_VEC_SSE2
+#endif
+
+#ifdef GD_VEC_HAVE_NEON
+# define GD_VEC_NEON
+# include "gd_vec.h"
+# include "gd_scale_vec.h"
+# undef GD_VEC_NEON
+#endif
+
+typedef struct {
+	void (*row) (int *dst, const int *src, unsigned int dst_len, const ContributionType *contrib);
+	void (*col) (int *dst, int * const *rows, const int *w, int n, int len);
+} gdScaleKernels;
+
+static const gdScaleKernels gdScaleKernelsC = { gdScaleRowC, gdScaleColC };
+#ifdef GD_VEC_HAVE_AVX2
+static const gdScaleKernels gdScaleKernelsAvx2 = { gdScaleRowAvx2, gdScaleColAvx2 };
+#endif
+#ifdef GD_VEC_HAVE_SSE2
+static const gdScaleKernels gdScaleKernelsSse2 = { gdScaleRowSse2, gdScaleColSse2 };
+#endif
+#ifdef GD_VEC_HAVE_NEON
+static const gdScaleKernels gdScaleKernelsNeon = { gdScaleRowNeon, gdScaleColNeon };
+#endif
+
+/* picked on first use, like the kernels of gd_blend.c */
+static const gdScaleKernels * volatile gdScaleKernelsUsed = NULL;
+
+static const gdScaleKernels *gdScaleKernelsGet(void)
+{
+	const gdScaleKernels *kernels = gdScaleKernelsUsed;
+	int features;
+
+	if (kernels) {
+		return kernels;
+	}
+	features = _gdCpuFeatures();
+	kernels = &gdScaleKernelsC;
+#ifdef GD_VEC_HAVE_NEON
+	if (features & GD_CPU_NEON) {
+		kernels = &gdScaleKernelsNeon;
+	}
+#endif
+#ifdef GD_VEC_HAVE_SSE2
+	if (features & GD_CPU_SSE2) {
+		kernels = &gdScaleKernelsSse2;
+	}
+#endif
+#ifdef GD_VEC_HAVE_AVX2
+	if (features & GD_CPU_AVX2) {
+		kernels = &gdScaleKernelsAvx2;
+	}
+#endif
+	(void) features;
+	gdScaleKernelsUsed = kernels;
+	return kernels;
+}
+
+typedef struct {
+	gdImagePtr src, dst;
+	unsigned int src_len, dst_len, num_lines;
+	const int *lut;
+	const LineContribType *contrib;
+	const gdScaleKernels *kernels;
+} gdScalePassArgs;
+
+/* The horizontal pass, for the rows start to end - 1. Palette sources
+   are looked up a row at a time into a line buffer. */
+static int _gdScaleRows(void *arg, int start, int end)
+{
+	const gdScalePassArgs *p = (const gdScalePassArgs *) arg;
+	int *line = NULL;
+	int y;
+
+	if (p->lut) {
+		line = overflow2(p->src_len, sizeof(int)) ? NULL : (int *) gdMalloc(p->src_len * sizeof(int));
+		if (line == NULL) {
+			return 0;
+		}
+	}
+	for (y = start; y < end; y++) {
+		const int *src = line ? line : p->src->tpixels[y];
+
+		if (line) {
+			_gdLookupSpan(line, p->src->pixels[y], p->src_len, p->lut);
+		}
+		p->kernels->row(p->dst->tpixels[y], src, p->dst_len, p->contrib->ContribRow);
+	}
+	if (line) {
+		gdFree(line);
+	}
+	return 1;
+}
+
+/* The vertical pass, for the rows start to end - 1 of the destination,
+   which are each computed from left to right. Palette sources are read
+   pixel by pixel through the lut. */
+static int _gdScaleCols(void *arg, int start, int end)
+{
+	const gdScalePassArgs *p = (const gdScalePassArgs *) arg;
+	int y;
+
+	for (y = start; y < end; y++) {
+		const ContributionType *c = &p->contrib->ContribRow[y];
+		const int n = c->Right - c->Left + 1;
+		unsigned int x;
+		int k;
+
+		if (!p->lut) {
+			p->kernels->col(p->dst->tpixels[y], p->src->tpixels + c->Left, c->Weights, n, p->num_lines);
+			continue;
+		}
+		for (x = 0; x < p->num_lines; x++) {
+			int r = 0, g = 0, b = 0, a = 0;
+
+			for (k = 0; k < n; k++) {
+				const int srcpx = p->lut[p->src->pixels[c->Left + k][x]];
+
+				r += c->Weights[k] * gdTrueColorGetRed(srcpx);
+				g += c->Weights[k] * gdTrueColorGetGreen(srcpx);
+				b += c->Weights[k] * gdTrueColorGetBlue(srcpx);
+				a += c->Weights[k] * gdTrueColorGetAlpha(srcpx);
+			}
+			p->dst->tpixels[y][x] = gdTrueColorAlpha(_gdScaleChannel(r, 0xFF), _gdScaleChannel(g, 0xFF),
+			                                         _gdScaleChannel(b, 0xFF),
+			                                         _gdScaleChannel(a, 0x7F));
+		}
+	}
+	return 1;
+}
+
+/* Palette sources are read through lut. The rows of the destination are
+   split between threads. */
 static inline int
 _gdScalePass(const gdImagePtr pSrc, const unsigned int src_len,
              const gdImagePtr pDst, const unsigned int dst_len,
              const unsigned int num_lines,
-             const gdAxis axis)
+             const gdAxis axis, const int *lut, int threads)
 {
-	unsigned int line_ndx;
+	gdScalePassArgs args;
 	LineContribType * contrib;
+	int res;
 
     /* Same dim, just copy it. */
     assert(dst_len != src_len); // TODO: caller should handle this.
 
-	contrib = _gdContributionsCalc(dst_len, src_len,
-                                   (double)dst_len / (double)src_len,
-                                   pSrc->interpolation);
+	contrib = _gdContributionsGet(dst_len, src_len, pSrc->interpolation);
 	if (contrib == NULL) {
 		return 0;
 	}
-
-	/* Scale each line */
-    for (line_ndx = 0; line_ndx < num_lines; line_ndx++) {
-        _gdScaleOneAxis(pSrc, pDst, dst_len, line_ndx, contrib, axis);
+	args.src = pSrc;
+	args.dst = pDst;
+	args.src_len = src_len;
+	args.dst_len = dst_len;
+	args.num_lines = num_lines;
+	args.lut = lut;
+	args.contrib = contrib;
+	args.kernels = gdScaleKernelsGet();
+	if (axis == HORIZONTAL) {
+		res = _gdParallelRows(threads, num_lines, _gdScaleRows, &args);
+	} else {
+		res = _gdParallelRows(threads, dst_len, _gdScaleCols, &args);
 	}
-	_gdContributionsFree (contrib);
-    return 1;
+	_gdContributionsRelease (contrib);
+    return res;
 }/* _gdScalePass*/
 
 
+typedef struct {
+	gdImagePtr src, dst;
+	const int *lut;
+	const LineContribType *hcontrib, *vcontrib;
+	const gdScaleKernels *kernels;
+} gdScaleWindowArgs;
+
+/* Both passes, for the rows start to end - 1 of the destination. The
+   horizontally scaled rows are kept in a ring of as many rows as a
+   destination row has taps, row y in slot y % size, so that the
+   vertical pass reads them while they are still in the cache. */
+static int _gdScaleWindowRows(void *arg, int start, int end)
+{
+	const gdScaleWindowArgs *p = (const gdScaleWindowArgs *) arg;
+	const int width = gdImageSX(p->dst);
+	const int size = p->vcontrib->WindowSize;
+	int *ring, *line = NULL, *held;
+	int **rows;
+	int y, k;
+
+	if (overflow2(size, width) || overflow2(size * width, sizeof(int))) {
+		return 0;
+	}
+	ring = (int *) gdMalloc(size * width * sizeof(int));
+	held = (int *) gdMalloc(size * sizeof(int));
+	rows = (int **) gdMalloc(size * sizeof(int *));
+	if (p->lut) {
+		line = overflow2(gdImageSX(p->src), sizeof(int)) ? NULL : (int *) gdMalloc(gdImageSX(p->src) * sizeof(int));
+	}
+	if (!ring || !held || !rows || (p->lut && !line)) {
+		gdFree(ring);
+		gdFree(held);
+		gdFree(rows);
+		gdFree(line);
+		return 0;
+	}
+	for (k = 0; k < size; k++) {
+		held[k] = -1;
+	}
+
+	for (y = start; y < end; y++) {
+		const ContributionType *c = &p->vcontrib->ContribRow[y];
+		const int n = c->Right - c->Left + 1;
+
+		for (k = 0; k < n; k++) {
+			const int row = c->Left + k;
+			const int slot = row % size;
+
+			rows[k] = ring + slot * width;
+			if (held[slot] != row) {
+				if (line) {
+					_gdLookupSpan(line, p->src->pixels[row], gdImageSX(p->src), p->lut);
+				}
+				p->kernels->row(rows[k], line ? line : p->src->tpixels[row], width, p->hcontrib->ContribRow);
+				held[slot] = row;
+			}
+		}
+		p->kernels->col(p->dst->tpixels[y], rows, c->Weights, n, width);
+	}
+
+	gdFree(ring);
+	gdFree(held);
+	gdFree(rows);
+	gdFree(line);
+	return 1;
+}
+
 static gdImagePtr
 gdImageScaleTwoPass(const gdImagePtr src, const unsigned int new_width,
                     const unsigned int new_height)
 {
     const unsigned int src_width = src->sx;
     const unsigned int src_height = src->sy;
-	gdImagePtr tmp_im = NULL;
+	LineContribType *hcontrib, *vcontrib;
 	gdImagePtr dst = NULL;
 	int scale_pass_res;
+	int lut[gdMaxColors];
+	const int *src_lut = NULL;
+	const int threads = _gdImageThreads(src);
 
 	assert(src != NULL);
 
@@ -1020,52 +1417,63 @@ gdImageScaleTwoPass(const gdImagePtr src, const unsigned int new_width,
         return gdImageClone(src);
     }/* if */
 
-	/* Convert to truecolor if it isn't; this code requires it. */
+	/* Read palette pixels through their truecolor values, leaving the
+	   source as it is. */
 	if (!src->trueColor) {
-		gdImagePaletteToTrueColor(src);
+		_gdImagePaletteLut(src, lut);
+		src_lut = lut;
 	}/* if */
 
-    /* Scale horizontally unless sizes are the same. */
-    if (src_width == new_width) {
-        tmp_im = src;
-    } else {
-        tmp_im = gdImageCreateTrueColor(new_width, src_height);
-        if (tmp_im == NULL) {
+    /* Scale in one direction only. */
+    if (src_height == new_height || src_width == new_width) {
+        dst = gdImageCreateTrueColor(new_width, new_height);
+        if (dst == NULL) {
             return NULL;
         }
-        gdImageSetInterpolationMethod(tmp_im, src->interpolation_id);
-
-		scale_pass_res = _gdScalePass(src, src_width, tmp_im, new_width, src_height, HORIZONTAL);
-		if (scale_pass_res != 1) {
-			gdImageDestroy(tmp_im);
-			return NULL;
-		}
-    }/* if .. else*/
-
-    /* If vertical sizes match, we're done. */
-    if (src_height == new_height) {
-        assert(tmp_im != src);
-        return tmp_im;
+        gdImageSetInterpolationMethod(dst, src->interpolation_id);
+        if (src_height == new_height) {
+            scale_pass_res = _gdScalePass(src, src_width, dst, new_width, src_height, HORIZONTAL, src_lut,
+                                          threads);
+        } else {
+            scale_pass_res = _gdScalePass(src, src_height, dst, new_height, new_width, VERTICAL, src_lut,
+                                          threads);
+        }
+        if (scale_pass_res != 1) {
+            gdImageDestroy(dst);
+            return NULL;
+        }
+        return dst;
     }/* if */
 
-    /* Otherwise, we need to scale vertically. */
+    /* Otherwise, do both passes together, without an intermediate
+       image of the full height. */
+	hcontrib = _gdContributionsGet(new_width, src_width, src->interpolation);
+	vcontrib = _gdContributionsGet(new_height, src_height, src->interpolation);
 	dst = gdImageCreateTrueColor(new_width, new_height);
-	if (dst != NULL) {
-        gdImageSetInterpolationMethod(dst, src->interpolation_id);
-        scale_pass_res = _gdScalePass(tmp_im, src_height, dst, new_height, new_width, VERTICAL);
-		if (scale_pass_res != 1) {
+	if (hcontrib && vcontrib && dst) {
+		gdScaleWindowArgs args;
+
+		gdImageSetInterpolationMethod(dst, src->interpolation_id);
+		args.src = src;
+		args.dst = dst;
+		args.lut = src_lut;
+		args.hcontrib = hcontrib;
+		args.vcontrib = vcontrib;
+		args.kernels = gdScaleKernelsGet();
+		if (!_gdParallelRows(threads, new_height, _gdScaleWindowRows, &args)) {
 			gdImageDestroy(dst);
-			if (src != tmp_im) {
-				gdImageDestroy(tmp_im);
-			}
-			return NULL;
-	   }
-    }/* if */
-
-
-	if (src != tmp_im) {
-        gdImageDestroy(tmp_im);
-    }/* if */
+			dst = NULL;
+		}
+	} else if (dst) {
+		gdImageDestroy(dst);
+		dst = NULL;
+	}
+	if (hcontrib) {
+		_gdContributionsRelease(hcontrib);
+	}
+	if (vcontrib) {
+		_gdContributionsRelease(vcontrib);
+	}
 
 	return dst;
 }/* gdImageScaleTwoPass*/
@@ -1666,6 +2074,45 @@ BGD_DECLARE(gdImagePtr) gdImageScale(const gdImagePtr src, const unsigned int ne
 	return im_scaled;
 }
 
+/* Fills in the width or height, whichever is not positive, so that an
+   image of sx * sy keeps its aspect ratio; the original size if both
+   are not */
+void _gdScaledSize(int sx, int sy, int *width, int *height)
+{
+	if (*width <= 0 && *height <= 0) {
+		*width = sx;
+		*height = sy;
+	} else if (*width <= 0) {
+		*width = MAX(1, (int) ((double) sx * *height / sy + 0.5));
+	} else if (*height <= 0) {
+		*height = MAX(1, (int) ((double) sy * *width / sx + 0.5));
+	}
+}
+
+/* Scales a just decoded image to width * height, as for _gdScaledSize(),
+   destroying it. The result is truecolor and has the settings of a
+   freshly decoded image. */
+gdImagePtr _gdImageScaleLoaded(gdImagePtr im, int width, int height)
+{
+	gdImagePtr res;
+
+	_gdScaledSize(gdImageSX(im), gdImageSY(im), &width, &height);
+	if (gdImageSX(im) == width && gdImageSY(im) == height) {
+		return im;
+	}
+	/* averages all the pixels for any reduction */
+	gdImageSetInterpolationMethod(im, GD_TRIANGLE);
+	res = gdImageScale(im, width, height);
+	if (res) {
+		res->interpolation = NULL;
+		res->interpolation_id = GD_BILINEAR_FIXED;
+		res->res_x = im->res_x;
+		res->res_y = im->res_y;
+	}
+	gdImageDestroy(im);
+	return res;
+}
+
 static int gdRotatedImageSize(gdImagePtr src, const float angle, gdRectPtr bbox)
 {
     gdRect src_area;
@@ -1738,20 +2185,48 @@ gdImageRotateNearestNeighbour(gdImagePtr src, const float degrees,
 	return dst;
 }
 
+typedef struct {
+	gdImagePtr src, dst;
+	gdFixed f_H, f_W, f_cos, f_sin;
+	int bgColor;
+} gdRotateArgs;
+
+static int gdImageRotateGenericRows(void *arg, int start, int end)
+{
+	const gdRotateArgs *p = (const gdRotateArgs *) arg;
+	const int src_w = gdImageSX(p->src);
+	const int src_h = gdImageSY(p->src);
+	const int new_width = gdImageSX(p->dst);
+	const int new_height = gdImageSY(p->dst);
+	int i;
+
+	for (i = start; i < end; i++) {
+		int j;
+		for (j = 0; j < new_width; j++) {
+			gdFixed f_i = gd_itofx(i - new_height / 2);
+			gdFixed f_j = gd_itofx(j - new_width  / 2);
+			gdFixed f_m = gd_mulfx(f_j,p->f_sin) + gd_mulfx(f_i,p->f_cos) + p->f_H;
+			gdFixed f_n = gd_mulfx(f_j,p->f_cos) - gd_mulfx(f_i,p->f_sin)  + p->f_W;
+			long m = gd_fxtoi(f_m);
+			long n = gd_fxtoi(f_n);
+
+			if (m < -1 || n < -1 || m >= src_h || n >= src_w ) {
+				p->dst->tpixels[i][j] = p->bgColor;
+			} else {
+				p->dst->tpixels[i][j] = getPixelInterpolated(p->src, gd_fxtod(f_n), gd_fxtod(f_m), p->bgColor);
+			}
+		}
+	}
+	return 1;
+}
+
 static gdImagePtr
 gdImageRotateGeneric(gdImagePtr src, const float degrees, const int bgColor)
 {
 	float _angle = ((float) (-degrees / 180.0f) * (float)M_PI);
 	const int src_w  = gdImageSX(src);
 	const int src_h = gdImageSY(src);
-	const gdFixed f_H = gd_itofx(src_h/2);
-	const gdFixed f_W = gd_itofx(src_w/2);
-	const gdFixed f_cos = gd_ftofx(cos(-_angle));
-	const gdFixed f_sin = gd_ftofx(sin(-_angle));
-
-	unsigned int dst_offset_x;
-	unsigned int dst_offset_y = 0;
-	unsigned int i;
+	gdRotateArgs args;
 	gdImagePtr dst;
 	int new_width, new_height;
 	gdRect bbox;
@@ -1774,25 +2249,14 @@ gdImageRotateGeneric(gdImagePtr src, const float degrees, const int bgColor)
 	}
 	dst->saveAlphaFlag = 1;
 
-	for (i = 0; i < new_height; i++) {
-		unsigned int j;
-		dst_offset_x = 0;
-		for (j = 0; j < new_width; j++) {
-			gdFixed f_i = gd_itofx((int)i - (int)new_height / 2);
-			gdFixed f_j = gd_itofx((int)j - (int)new_width  / 2);
-			gdFixed f_m = gd_mulfx(f_j,f_sin) + gd_mulfx(f_i,f_cos) + f_H;
-			gdFixed f_n = gd_mulfx(f_j,f_cos) - gd_mulfx(f_i,f_sin)  + f_W;
-			long m = gd_fxtoi(f_m);
-			long n = gd_fxtoi(f_n);
-
-			if (m < -1 || n < -1 || m >= src_h || n >= src_w ) {
-				dst->tpixels[dst_offset_y][dst_offset_x++] = bgColor;
-			} else {
-				dst->tpixels[dst_offset_y][dst_offset_x++] = getPixelInterpolated(src, gd_fxtod(f_n), gd_fxtod(f_m), bgColor);
-			}
-		}
-		dst_offset_y++;
-	}
+	args.src = src;
+	args.dst = dst;
+	args.f_H = gd_itofx(src_h/2);
+	args.f_W = gd_itofx(src_w/2);
+	args.f_cos = gd_ftofx(cos(-_angle));
+	args.f_sin = gd_ftofx(sin(-_angle));
+	args.bgColor = bgColor;
+	_gdParallelRows(_gdImageThreads(src), new_height, gdImageRotateGenericRows, &args);
 	return dst;
 }
 
@@ -2015,9 +2479,87 @@ static int getPixelRgbInterpolated(gdImagePtr im, const int tcolor)
 	im->blue[ct] = b;
 	im->alpha[ct] = a;
 	im->open[ct] = 0;
+	gdImagePaletteChanged(im);
 
 	return ct;
 }
+typedef struct {
+	gdImagePtr dst, src;
+	int dst_x, dst_y;
+	int bbox_x, bbox_y, end_x;
+	int src_offset_x, src_offset_y;
+	int c1x, c1y, c2x, c2y;
+	double inv[6];
+} gdAffineArgs;
+
+/* The rows bbox_y + start to bbox_y + end - 1 of gdTransformAffineCopy() */
+static int gdTransformAffineRows(void *arg, int start, int end)
+{
+	const gdAffineArgs *p = (const gdAffineArgs *) arg;
+	const gdImagePtr dst = p->dst;
+	const gdImagePtr src = p->src;
+	const int dst_x = p->dst_x, dst_y = p->dst_y;
+	const int src_offset_x = p->src_offset_x, src_offset_y = p->src_offset_y;
+	register int x, y;
+	gdPointF pt, src_pt;
+
+	if (dst->alphaBlendingFlag) {
+		for (y = p->bbox_y + start; y < p->bbox_y + end; y++) {
+			pt.y = y + 0.5;
+			for (x = p->bbox_x; x <= p->end_x; x++) {
+				pt.x = x + 0.5;
+				gdAffineApplyToPointF(&src_pt, &pt, p->inv);
+				if (floor(src_offset_x + src_pt.x) < p->c1x
+					|| floor(src_offset_x + src_pt.x) > p->c2x
+					|| floor(src_offset_y + src_pt.y) < p->c1y
+					|| floor(src_offset_y + src_pt.y) > p->c2y) {
+					continue;
+				}
+				gdImageSetPixel(dst, dst_x + x, dst_y + y, getPixelInterpolated(src, (int)(src_offset_x + src_pt.x), (int)(src_offset_y + src_pt.y), 0));
+			}
+		}
+	} else {
+		for (y = p->bbox_y + start; y < p->bbox_y + end; y++) {
+			unsigned char *dst_p = NULL;
+			int *tdst_p = NULL;
+
+			pt.y = y + 0.5;
+			if ((dst_y + y) < 0 || ((dst_y + y) > gdImageSY(dst) -1)) {
+				continue;
+			}
+			if (!gdImageRowWritable(dst, dst_y + y)) {
+				return 0;
+			}
+			if (dst->trueColor) {
+				tdst_p = dst->tpixels[dst_y + y] + dst_x;
+			} else {
+				dst_p = dst->pixels[dst_y + y] + dst_x;
+			}
+
+			for (x = p->bbox_x; x <= p->end_x; x++) {
+				pt.x = x + 0.5;
+				gdAffineApplyToPointF(&src_pt, &pt, p->inv);
+
+				if ((dst_x + x) < 0 || (dst_x + x) > (gdImageSX(dst) - 1)) {
+					break;
+				}
+				if (floor(src_offset_x + src_pt.x) < p->c1x
+					|| floor(src_offset_x + src_pt.x) > p->c2x
+					|| floor(src_offset_y + src_pt.y) < p->c1y
+					|| floor(src_offset_y + src_pt.y) > p->c2y) {
+					continue;
+				}
+				if (dst->trueColor) {
+					*(tdst_p + dst_x + x) = getPixelInterpolated(src, (int)(src_offset_x + src_pt.x), (int)(src_offset_y + src_pt.y), -1);
+				} else {
+					*(dst_p + dst_x + x) = getPixelRgbInterpolated(dst, getPixelInterpolated(src, (int)(src_offset_x + src_pt.x), (int)(src_offset_y + src_pt.y), -1));
+				}
+			}
+		}
+	}
+	return 1;
+}
+
 /**
  * Function: gdTransformAffineCopy
  *  Applies an affine transformation to a region and copy the result
@@ -2042,11 +2584,12 @@ BGD_DECLARE(int) gdTransformAffineCopy(gdImagePtr dst,
 	int c1x,c1y,c2x,c2y;
 	int backclip = 0;
 	int backup_clipx1, backup_clipy1, backup_clipx2, backup_clipy2;
-	register int x, y, src_offset_x, src_offset_y;
 	double inv[6];
-	gdPointF pt, src_pt;
+	gdAffineArgs args;
 	gdRect bbox;
 	int end_x, end_y;
+	int threads;
+	int status = GD_TRUE;
 	gdInterpolationMethod interpolation_id_bak = src->interpolation_id;
 
 	/* These methods use special implementations */
@@ -2091,59 +2634,28 @@ BGD_DECLARE(int) gdTransformAffineCopy(gdImagePtr dst,
 		return GD_FALSE;
 	}
 
-	src_offset_x =  src_region->x;
-	src_offset_y =  src_region->y;
-
-	if (dst->alphaBlendingFlag) {
-		for (y = bbox.y; y <= end_y; y++) {
-			pt.y = y + 0.5;
-			for (x = bbox.x; x <= end_x; x++) {
-				pt.x = x + 0.5;
-				gdAffineApplyToPointF(&src_pt, &pt, inv);
-				if (floor(src_offset_x + src_pt.x) < c1x
-					|| floor(src_offset_x + src_pt.x) > c2x
-					|| floor(src_offset_y + src_pt.y) < c1y
-					|| floor(src_offset_y + src_pt.y) > c2y) {
-					continue;
-				}
-				gdImageSetPixel(dst, dst_x + x, dst_y + y, getPixelInterpolated(src, (int)(src_offset_x + src_pt.x), (int)(src_offset_y + src_pt.y), 0));
-			}
-		}
-	} else {
-		for (y = bbox.y; y <= end_y; y++) {
-			unsigned char *dst_p = NULL;
-			int *tdst_p = NULL;
-
-			pt.y = y + 0.5;
-			if ((dst_y + y) < 0 || ((dst_y + y) > gdImageSY(dst) -1)) {
-				continue;
-			}
-			if (dst->trueColor) {
-				tdst_p = dst->tpixels[dst_y + y] + dst_x;
-			} else {
-				dst_p = dst->pixels[dst_y + y] + dst_x;
-			}
-
-			for (x = bbox.x; x <= end_x; x++) {
-				pt.x = x + 0.5;
-				gdAffineApplyToPointF(&src_pt, &pt, inv);
-
-				if ((dst_x + x) < 0 || (dst_x + x) > (gdImageSX(dst) - 1)) {
-					break;
-				}
-				if (floor(src_offset_x + src_pt.x) < c1x
-					|| floor(src_offset_x + src_pt.x) > c2x
-					|| floor(src_offset_y + src_pt.y) < c1y
-					|| floor(src_offset_y + src_pt.y) > c2y) {
-					continue;
-				}
-				if (dst->trueColor) {
-					*(tdst_p + dst_x + x) = getPixelInterpolated(src, (int)(src_offset_x + src_pt.x), (int)(src_offset_y + src_pt.y), -1);
-				} else {
-					*(dst_p + dst_x + x) = getPixelRgbInterpolated(dst, getPixelInterpolated(src, (int)(src_offset_x + src_pt.x), (int)(src_offset_y + src_pt.y), -1));
-				}
-			}
-		}
+	args.dst = dst;
+	args.src = src;
+	args.dst_x = dst_x;
+	args.dst_y = dst_y;
+	args.bbox_x = bbox.x;
+	args.bbox_y = bbox.y;
+	args.end_x = end_x;
+	args.src_offset_x = src_region->x;
+	args.src_offset_y = src_region->y;
+	args.c1x = c1x;
+	args.c1y = c1y;
+	args.c2x = c2x;
+	args.c2y = c2y;
+	memcpy(args.inv, inv, sizeof(inv));
+
+	/* rows of palette images get colors allocated in turn, and rows
+	   shared with clones are unshared in turn */
+	threads = dst->trueColor && dst != src ? _gdImageThreads(src) : 1;
+	if (threads > 1 && dst->rowShare && !gdImageUnshare(dst)) {
+		status = GD_FALSE;
+	} else if (end_y >= bbox.y) {
+		status = _gdParallelRows(threads, end_y - bbox.y + 1, gdTransformAffineRows, &args) ? GD_TRUE : GD_FALSE;
 	}
 
 	/* Restore clip if required */
@@ -2153,7 +2665,7 @@ BGD_DECLARE(int) gdTransformAffineCopy(gdImagePtr dst,
 	}
 
 	gdImageSetInterpolationMethod(src, interpolation_id_bak);
-	return GD_TRUE;
+	return status;
 }
 
 /**
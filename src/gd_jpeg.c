@@ -42,6 +42,7 @@
 /* JCE: arrange HAVE_LIBJPEG so that it can be set in gd.h */
 #ifdef HAVE_LIBJPEG
 #include "gdhelpers.h"
+#include "gd_intern.h"
 
 #if defined(_WIN32) && defined(__MINGW32__)
 # define HAVE_BOOLEAN
@@ -550,12 +551,165 @@ BGD_DECLARE(gdImagePtr) gdImageCreateFromJpegCtx(gdIOCtx *infile)
 	return gdImageCreateFromJpegCtxEx(infile, 1);
 }
 
+static gdImagePtr _gdImageCreateFromJpegCtx(gdIOCtx *infile, int ignore_warning,
+                                             gdImagePoolPtr pool, gdImagePtr target,
+                                             int width, int height);
+
 /*
   Function: gdImageCreateFromJpegCtxEx
 
   See <gdImageCreateFromJpeg>.
 */
 BGD_DECLARE(gdImagePtr) gdImageCreateFromJpegCtxEx(gdIOCtx *infile, int ignore_warning)
+{
+	return _gdImageCreateFromJpegCtx(infile, ignore_warning, NULL, NULL, 0, 0);
+}
+
+/*
+  Function: gdImageCreateFromJpegCtxPool
+
+    Reads a JPEG image into an image taken from a pool.
+
+    This works like <gdImageCreateFromJpegCtxEx>, except that the image
+    is obtained with <gdImagePoolGet> rather than created from scratch, so
+    that decoding a series of images of the same size allocates no new
+    pixel memory. The image should be given back with <gdImagePoolPut>
+    once it is no longer needed.
+
+  Parameters:
+
+    infile         - The input context.
+    pool           - The pool.
+    ignore_warning - Whether to ignore warnings of libjpeg.
+
+  Returns:
+
+    The image, or NULL on failure.
+*/
+BGD_DECLARE(gdImagePtr) gdImageCreateFromJpegCtxPool(gdIOCtx *infile, gdImagePoolPtr pool, int ignore_warning)
+{
+	return _gdImageCreateFromJpegCtx(infile, ignore_warning, pool, NULL, 0, 0);
+}
+
+/*
+  Function: gdImageCreateFromJpegCtxInto
+
+    Reads a JPEG image into an existing truecolor image of the same
+    dimensions, replacing all of its pixels and settings.
+
+  Parameters:
+
+    infile         - The input context.
+    im             - The image to read into.
+    ignore_warning - Whether to ignore warnings of libjpeg.
+
+  Returns:
+
+    _im_ on success, NULL on failure, in which case _im_ still belongs to
+    the caller and its contents are undefined.
+*/
+BGD_DECLARE(gdImagePtr) gdImageCreateFromJpegCtxInto(gdIOCtx *infile, gdImagePtr im, int ignore_warning)
+{
+	if (!im) {
+		return NULL;
+	}
+	return _gdImageCreateFromJpegCtx(infile, ignore_warning, NULL, im, 0, 0);
+}
+
+/*
+  Function: gdImageCreateFromJpegCtxScaled
+
+    Reads a JPEG image, scaled to the given size.
+
+    Most of the reduction is done while decoding, which libjpeg can do
+    by 1/2, 1/4 or 1/8 at a fraction of the cost of decoding the full
+    image: the image is decoded at the smallest of these sizes which is
+    not smaller than the requested one, and then scaled the rest of the
+    way with <gdImageScale>. This makes thumbnails of large photographs
+    much faster to obtain than by decoding and scaling them.
+
+    If _width_ or _height_ is 0, it is computed from the other so that
+    the aspect ratio of the image is kept; if both are, the image is
+    read at its size.
+
+  Variants:
+
+    <gdImageCreateFromJpegScaled> reads from a FILE,
+    <gdImageCreateFromJpegPtrScaled> from memory. Both ignore the
+    recoverable warnings of libjpeg.
+
+  Parameters:
+
+    infile         - The input context.
+    width          - The width of the image to return.
+    height         - The height of the image to return.
+    ignore_warning - Whether to ignore warnings of libjpeg.
+
+  Returns:
+
+    The truecolor image, or NULL on failure.
+
+  See also:
+
+    - <gdImageCreateFromFileScaled>
+*/
+BGD_DECLARE(gdImagePtr) gdImageCreateFromJpegCtxScaled(gdIOCtx *infile, int width, int height, int ignore_warning)
+{
+	return _gdImageCreateFromJpegCtx(infile, ignore_warning, NULL, NULL, MAX(width, 0), MAX(height, 0));
+}
+
+/*
+  Function: gdImageCreateFromJpegScaled
+
+  See <gdImageCreateFromJpegCtxScaled>.
+*/
+BGD_DECLARE(gdImagePtr) gdImageCreateFromJpegScaled(FILE *inFile, int width, int height)
+{
+	gdImagePtr im;
+	gdIOCtx *in = gdNewFileCtx(inFile);
+	if (in == NULL) return NULL;
+	im = gdImageCreateFromJpegCtxScaled(in, width, height, 1);
+	in->gd_free(in);
+	return im;
+}
+
+/*
+  Function: gdImageCreateFromJpegPtrScaled
+
+  See <gdImageCreateFromJpegCtxScaled>.
+*/
+BGD_DECLARE(gdImagePtr) gdImageCreateFromJpegPtrScaled(int size, void *data, int width, int height)
+{
+	gdImagePtr im;
+	gdIOCtx *in = gdNewDynamicCtxEx(size, data, 0);
+	if (in == NULL) return NULL;
+	im = gdImageCreateFromJpegCtxScaled(in, width, height, 1);
+	in->gd_free(in);
+	return im;
+}
+
+/* The largest of the denominators 8, 4 and 2 by which libjpeg can scale
+   an image of image_width * image_height while decoding it, without
+   going below width * height; 1 if there is none */
+static int gdJpegScaleDenom(JDIMENSION image_width, JDIMENSION image_height, int width, int height)
+{
+	int denom;
+
+	for (denom = 8; denom > 1; denom /= 2) {
+		if ((image_width + denom - 1) / denom >= (JDIMENSION) width
+		        && (image_height + denom - 1) / denom >= (JDIMENSION) height) {
+			break;
+		}
+	}
+	return denom;
+}
+
+/* Decodes into an image from pool, or into target, or if width or height
+   is set into a new image of that size, see
+   gdImageCreateFromJpegCtxScaled() */
+static gdImagePtr _gdImageCreateFromJpegCtx(gdIOCtx *infile, int ignore_warning,
+                                             gdImagePoolPtr pool, gdImagePtr target,
+                                             int width, int height)
 {
 	struct jpeg_decompress_struct cinfo;
 	struct jpeg_error_mgr jerr;
@@ -592,7 +746,7 @@ BGD_DECLARE(gdImagePtr) gdImageCreateFromJpegCtxEx(gdIOCtx *infile, int ignore_w
 			gdFree(row);
 		}
 		if(im) {
-			gdImageDestroy(im);
+			_gdImagePoolRelease(pool, target, im);
 		}
 		return 0;
 	}
@@ -626,7 +780,15 @@ BGD_DECLARE(gdImagePtr) gdImageCreateFromJpegCtxEx(gdIOCtx *infile, int ignore_w
 		         " gd can handle)\n", cinfo.image_width, INT_MAX);
 	}
 
-	im = gdImageCreateTrueColor((int)cinfo.image_width, (int)cinfo.image_height);
+	/* 2.3.2: shrink on load */
+	if(width > 0 || height > 0) {
+		_gdScaledSize((int)cinfo.image_width, (int)cinfo.image_height, &width, &height);
+		cinfo.scale_num = 1;
+		cinfo.scale_denom = gdJpegScaleDenom(cinfo.image_width, cinfo.image_height, width, height);
+	}
+	jpeg_calc_output_dimensions(&cinfo);
+
+	im = _gdImagePoolAcquire(pool, target, (int)cinfo.output_width, (int)cinfo.output_height, 1, 0);
 	if(im == 0) {
 		gd_error("gd-jpeg error: cannot allocate gdImage struct\n");
 		goto error;
@@ -811,6 +973,9 @@ BGD_DECLARE(gdImagePtr) gdImageCreateFromJpegCtxEx(gdIOCtx *infile, int ignore_w
 
 	jpeg_destroy_decompress(&cinfo);
 	gdFree(row);
+	if(width > 0) {
+		return _gdImageScaleLoaded(im, width, height);
+	}
 	return im;
 
 error:
@@ -820,7 +985,7 @@ error:
 		gdFree(row);
 	}
 	if(im) {
-		gdImageDestroy(im);
+		_gdImagePoolRelease(pool, target, im);
 	}
 
 	return 0;
@@ -1263,4 +1428,51 @@ BGD_DECLARE(gdImagePtr) gdImageCreateFromJpegCtxEx(gdIOCtx *infile, int ignore_w
 	return NULL;
 }
 
+BGD_DECLARE(gdImagePtr) gdImageCreateFromJpegCtxPool(gdIOCtx *infile, gdImagePoolPtr pool, int ignore_warning)
+{
+	(void) infile;
+	(void) pool;
+	(void) ignore_warning;
+	_noJpegError();
+	return NULL;
+}
+
+BGD_DECLARE(gdImagePtr) gdImageCreateFromJpegCtxInto(gdIOCtx *infile, gdImagePtr im, int ignore_warning)
+{
+	(void) infile;
+	(void) im;
+	(void) ignore_warning;
+	_noJpegError();
+	return NULL;
+}
+
+BGD_DECLARE(gdImagePtr) gdImageCreateFromJpegScaled(FILE *inFile, int width, int height)
+{
+	(void) inFile;
+	(void) width;
+	(void) height;
+	_noJpegError();
+	return NULL;
+}
+
+BGD_DECLARE(gdImagePtr) gdImageCreateFromJpegPtrScaled(int size, void *data, int width, int height)
+{
+	(void) size;
+	(void) data;
+	(void) width;
+	(void) height;
+	_noJpegError();
+	return NULL;
+}
+
+BGD_DECLARE(gdImagePtr) gdImageCreateFromJpegCtxScaled(gdIOCtx *infile, int width, int height, int ignore_warning)
+{
+	(void) infile;
+	(void) width;
+	(void) height;
+	(void) ignore_warning;
+	_noJpegError();
+	return NULL;
+}
+
 #endif /* HAVE_LIBJPEG */
@@ -0,0 +1,607 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "gd.h"
+#include "gdhelpers.h"
+
+/**
+ * Title: Memory Management
+ *
+ * All memory libgd allocates for images, I/O buffers and temporary work
+ * areas goes through a small set of internal wrappers. By default these
+ * call the C library allocator, but an application may substitute its
+ * own allocator with <gdSetMemoryMethods>, or bind an arena to the
+ * calling thread with <gdArenaUse>.
+ *
+ * An arena serves allocations from a few large chunks by simply bumping
+ * a pointer. Freeing arena memory is a no-op (except for the most recent
+ * allocation, which is given back), and <gdArenaReset> or
+ * <gdArenaDestroy> release everything the arena handed out at once. This
+ * makes it cheap to run a whole request (decode, transform, encode) and
+ * throw away all of its memory afterwards, and lets an application put
+ * a hard cap on the memory a single request may consume.
+ */
+
+static gdMallocMethod gd_malloc_method = malloc;
+static gdCallocMethod gd_calloc_method = calloc;
+static gdReallocMethod gd_realloc_method = realloc;
+static gdFreeMethod gd_free_method = free;
+
+/* Arena allocations are aligned to, and preceded by a header of, this
+   many bytes. The header stores the size of the allocation. Memory from
+   the allocator has no header; gdFree() passes it on as is. */
+#define GD_ARENA_ALIGN 16
+/* Regular chunk size */
+#define GD_ARENA_CHUNK_SIZE (256 * 1024)
+/* Requests larger than this get a chunk of their own */
+#define GD_ARENA_LARGE (GD_ARENA_CHUNK_SIZE / 4)
+
+#define GD_ARENA_ROUND(n) (((n) + GD_ARENA_ALIGN - 1) & ~(size_t)(GD_ARENA_ALIGN - 1))
+#define GD_ARENA_SIZE(ptr) (*(size_t *)((char *)(ptr) - GD_ARENA_ALIGN))
+
+typedef struct gdArenaChunk {
+	struct gdArenaChunk *next;
+	struct gdArenaStruct *arena;
+	char *start;
+	char *pos;
+	char *end;
+	size_t size;
+} gdArenaChunk;
+
+struct gdArenaStruct {
+	/* all chunks, most recently created first */
+	gdArenaChunk *chunks;
+	/* regular chunk small requests are currently served from */
+	gdArenaChunk *current;
+	/* maximum number of bytes to reserve, 0 for no limit */
+	size_t limit;
+	/* number of bytes currently reserved from the allocator */
+	size_t reserved;
+};
+
+#ifdef GD_THREAD_LOCAL
+/* The arena bound to the calling thread, if any */
+static GD_THREAD_LOCAL gdArenaPtr gd_arena_current = NULL;
+#else
+/* Without thread local storage, binding an arena would bind it to all
+   threads, so there are no arenas */
+# define gd_arena_current ((gdArenaPtr) NULL)
+#endif
+
+/* The chunks of all arenas, sorted by address, so that gdFree() and
+   gdRealloc() can tell arena memory from memory of the allocator, also
+   on another thread or after the arena was unbound. As long as there
+   are none, which gd_arena_chunks_live tells without locking, nothing
+   is looked up. */
+static gdArenaChunk **gd_arena_chunks = NULL;
+static size_t gd_arena_chunks_count = 0;
+static size_t gd_arena_chunks_allocated = 0;
+static volatile long gd_arena_chunks_live = 0;
+gdStaticMutexDeclare(gd_arena_mutex);
+
+/* The index of the first registered chunk above p; the registry must be
+   locked */
+static size_t gdArenaChunkAbove(const char *p)
+{
+	size_t lo = 0, hi = gd_arena_chunks_count;
+
+	while (lo < hi) {
+		const size_t mid = lo + (hi - lo) / 2;
+		if ((const char *)gd_arena_chunks[mid] <= p) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+static int gdArenaRegister(gdArenaChunk *chunk)
+{
+	gdArenaChunk **chunks;
+	size_t i;
+
+	gdStaticMutexLock(gd_arena_mutex);
+	if (gd_arena_chunks_count == gd_arena_chunks_allocated) {
+		const size_t n = gd_arena_chunks_allocated ? 2 * gd_arena_chunks_allocated : 16;
+		chunks = (gdArenaChunk **)gd_realloc_method(gd_arena_chunks, n * sizeof(gdArenaChunk *));
+		if (!chunks) {
+			gdStaticMutexUnlock(gd_arena_mutex);
+			return 0;
+		}
+		gd_arena_chunks = chunks;
+		gd_arena_chunks_allocated = n;
+	}
+	i = gdArenaChunkAbove((const char *)chunk);
+	memmove(gd_arena_chunks + i + 1, gd_arena_chunks + i,
+	        (gd_arena_chunks_count - i) * sizeof(gdArenaChunk *));
+	gd_arena_chunks[i] = chunk;
+	gd_arena_chunks_count++;
+	gdAtomicIncrement(gd_arena_chunks_live);
+	gdStaticMutexUnlock(gd_arena_mutex);
+	return 1;
+}
+
+static void gdArenaUnregister(gdArenaChunk *chunk)
+{
+	size_t i;
+
+	gdStaticMutexLock(gd_arena_mutex);
+	i = gdArenaChunkAbove((const char *)chunk) - 1;
+	memmove(gd_arena_chunks + i, gd_arena_chunks + i + 1,
+	        (gd_arena_chunks_count - i - 1) * sizeof(gdArenaChunk *));
+	gd_arena_chunks_count--;
+	if (gd_arena_chunks_count == 0) {
+		gd_free_method(gd_arena_chunks);
+		gd_arena_chunks = NULL;
+		gd_arena_chunks_allocated = 0;
+	}
+	gdAtomicDecrement(gd_arena_chunks_live);
+	gdStaticMutexUnlock(gd_arena_mutex);
+}
+
+/* The arena chunk holding ptr, NULL for memory of the allocator */
+static gdArenaChunk *gdArenaChunkOf(const void *ptr)
+{
+	const char *p = (const char *)ptr;
+	gdArenaChunk *chunk = NULL;
+	size_t i;
+
+	if (gdAtomicGet(gd_arena_chunks_live) == 0) {
+		return NULL;
+	}
+	gdStaticMutexLock(gd_arena_mutex);
+	i = gdArenaChunkAbove(p);
+	if (i > 0 && p >= gd_arena_chunks[i - 1]->start && p < gd_arena_chunks[i - 1]->end) {
+		chunk = gd_arena_chunks[i - 1];
+	}
+	gdStaticMutexUnlock(gd_arena_mutex);
+	return chunk;
+}
+
+static gdArenaChunk *gdArenaAddChunk(gdArenaPtr arena, size_t need, int zero)
+{
+	gdArenaChunk *chunk;
+	size_t size;
+	char *base;
+
+	if (need > SIZE_MAX - sizeof(gdArenaChunk) - 2 * GD_ARENA_ALIGN) {
+		return NULL;
+	}
+	size = sizeof(gdArenaChunk) + GD_ARENA_ALIGN + need;
+	if (need <= GD_ARENA_LARGE && size < GD_ARENA_CHUNK_SIZE) {
+		size = GD_ARENA_CHUNK_SIZE;
+	}
+	if (arena->limit) {
+		if (arena->reserved >= arena->limit) {
+			return NULL;
+		}
+		if (size > arena->limit - arena->reserved) {
+			/* shrink a regular chunk to what is left, if that suffices */
+			size = arena->limit - arena->reserved;
+			if (size < sizeof(gdArenaChunk) + GD_ARENA_ALIGN + need) {
+				return NULL;
+			}
+		}
+	}
+
+	/* Fresh memory from calloc() is already cleared, usually without
+	   touching the pages, so large zeroed requests ask for it here. */
+	base = zero ? gd_calloc_method(1, size) : gd_malloc_method(size);
+	if (!base) {
+		return NULL;
+	}
+	chunk = (gdArenaChunk *)base;
+	chunk->arena = arena;
+	chunk->start = (char *)GD_ARENA_ROUND((uintptr_t)(base + sizeof(gdArenaChunk)));
+	chunk->pos = chunk->start;
+	chunk->end = base + size;
+	chunk->size = size;
+	if (!gdArenaRegister(chunk)) {
+		gd_free_method(base);
+		return NULL;
+	}
+	chunk->next = arena->chunks;
+	arena->chunks = chunk;
+	arena->reserved += size;
+	return chunk;
+}
+
+static void *gdArenaAlloc(gdArenaPtr arena, size_t size, int zero)
+{
+	gdArenaChunk *chunk = arena->current;
+	size_t need;
+	char *p;
+
+	if (size > SIZE_MAX - 2 * GD_ARENA_ALIGN) {
+		return NULL;
+	}
+	need = GD_ARENA_ALIGN + GD_ARENA_ROUND(size);
+
+	if (!chunk || need > (size_t)(chunk->end - chunk->pos)) {
+		chunk = gdArenaAddChunk(arena, need, zero && need > GD_ARENA_LARGE);
+		if (!chunk) {
+			return NULL;
+		}
+		if (need <= GD_ARENA_LARGE) {
+			arena->current = chunk;
+		} else {
+			/* a chunk of its own, already cleared if need be */
+			zero = 0;
+		}
+	}
+	if (zero) {
+		memset(chunk->pos + GD_ARENA_ALIGN, 0, size);
+	}
+
+	p = chunk->pos;
+	*(size_t *)p = size;
+	chunk->pos += need;
+	return p + GD_ARENA_ALIGN;
+}
+
+/* Gives back the most recent allocation of the current chunk, or a
+   large allocation that got a chunk of its own. */
+static void gdArenaRelease(gdArenaPtr arena, gdArenaChunk *chunk, void *ptr)
+{
+	char *p = (char *)ptr - GD_ARENA_ALIGN;
+	const size_t need = GD_ARENA_ALIGN + GD_ARENA_ROUND(GD_ARENA_SIZE(ptr));
+	gdArenaChunk **link;
+
+	if (chunk == arena->current) {
+		if (p + need == chunk->pos) {
+			chunk->pos = p;
+		}
+		return;
+	}
+	if (p != chunk->start || need <= GD_ARENA_LARGE) {
+		return;
+	}
+
+	for (link = &arena->chunks; *link != chunk; link = &(*link)->next);
+	*link = chunk->next;
+	arena->reserved -= chunk->size;
+	gdArenaUnregister(chunk);
+	gd_free_method(chunk);
+}
+
+static void gdArenaFreeChunks(gdArenaChunk *chunk, gdArenaChunk *keep)
+{
+	while (chunk) {
+		gdArenaChunk *next = chunk->next;
+		if (chunk != keep) {
+			gdArenaUnregister(chunk);
+			gd_free_method(chunk);
+		}
+		chunk = next;
+	}
+}
+
+void * gdCalloc (size_t nmemb, size_t size)
+{
+	if (size && nmemb > SIZE_MAX / size) {
+		return NULL;
+	}
+	if (gd_arena_current) {
+		return gdArenaAlloc(gd_arena_current, nmemb * size, 1);
+	}
+	return gd_calloc_method (nmemb, size);
+}
+
+void *
+gdMalloc (size_t size)
+{
+	if (gd_arena_current) {
+		return gdArenaAlloc(gd_arena_current, size, 0);
+	}
+	return gd_malloc_method (size);
+}
+
+void *
+gdRealloc (void *ptr, size_t size)
+{
+	gdArenaChunk *chunk;
+	size_t old;
+	void *newPtr;
+
+	if (!ptr) {
+		return gdMalloc (size);
+	}
+	chunk = gdArenaChunkOf(ptr);
+	if (!chunk) {
+		/* memory of the allocator stays there */
+		return gd_realloc_method (ptr, size);
+	}
+
+	old = GD_ARENA_SIZE(ptr);
+	/* grow or shrink the most recent allocation in place */
+	if (gd_arena_current && chunk == gd_arena_current->current
+	        && (char *)ptr + GD_ARENA_ROUND(old) == chunk->pos
+	        && size <= (size_t)(chunk->end - (char *)ptr)
+	        && GD_ARENA_ALIGN + GD_ARENA_ROUND(size) <= GD_ARENA_LARGE) {
+		GD_ARENA_SIZE(ptr) = size;
+		chunk->pos = (char *)ptr + GD_ARENA_ROUND(size);
+		return ptr;
+	}
+	newPtr = gdMalloc (size);
+	if (!newPtr) {
+		return NULL;
+	}
+	memcpy(newPtr, ptr, old < size ? old : size);
+	gdFree(ptr);
+	return newPtr;
+}
+
+void *
+gdReallocEx (void *ptr, size_t size)
+{
+	void *newPtr = gdRealloc (ptr, size);
+	if (!newPtr && ptr)
+		gdFree(ptr);
+	return newPtr;
+}
+
+/* The arena ptr was allocated from, NULL for the allocator */
+gdArenaPtr
+gdArenaOf (const void *ptr)
+{
+	const gdArenaChunk *chunk = gdArenaChunkOf(ptr);
+
+	return chunk ? chunk->arena : NULL;
+}
+
+/*
+  Function: gdFree
+
+    Frees memory that has been allocated by libgd functions.
+
+	Unless more specialized functions exists (for instance, <gdImageDestroy>),
+	all memory that has been allocated by public libgd functions has to be
+	freed by calling <gdFree>, and not by free(3), because libgd internally
+	doesn't use alloc(3) and friends but rather its own allocation functions,
+	which are, however, not publicly available.
+
+	Memory that has been allocated from an arena is not returned to the
+	system until the arena is reset or destroyed.
+
+  Parameters:
+
+	ptr - Pointer to the memory space to free. If it is NULL, no operation is
+		  performed.
+
+  Returns:
+
+	Nothing.
+*/
+BGD_DECLARE(void) gdFree (void *ptr)
+{
+	gdArenaChunk *chunk;
+
+	if (!ptr) {
+		return;
+	}
+	chunk = gdArenaChunkOf(ptr);
+	if (chunk) {
+		/* only the thread using the arena gives memory back to it */
+		if (chunk->arena == gd_arena_current) {
+			gdArenaRelease(gd_arena_current, chunk, ptr);
+		}
+		return;
+	}
+	gd_free_method (ptr);
+}
+
+/*
+  Function: gdSetMemoryMethods
+
+    Replaces the allocator libgd uses for all of its memory.
+
+	The methods must be installed before libgd allocates anything (or after
+	everything allocated so far has been freed), and must be safe to call
+	from every thread libgd is used on. Memory returned by the gdImage*Ptr
+	functions has to be released with <gdFree> as usual, which then calls
+	_free_method_.
+
+  Parameters:
+
+	malloc_method  - Replacement for malloc(3)
+	calloc_method  - Replacement for calloc(3)
+	realloc_method - Replacement for realloc(3)
+	free_method    - Replacement for free(3)
+
+	Passing NULL for any of them selects the C library function.
+
+  See also:
+
+	<gdClearMemoryMethods>
+*/
+BGD_DECLARE(void) gdSetMemoryMethods (gdMallocMethod malloc_method,
+                                      gdCallocMethod calloc_method,
+                                      gdReallocMethod realloc_method,
+                                      gdFreeMethod free_method)
+{
+	gd_malloc_method = malloc_method ? malloc_method : malloc;
+	gd_calloc_method = calloc_method ? calloc_method : calloc;
+	gd_realloc_method = realloc_method ? realloc_method : realloc;
+	gd_free_method = free_method ? free_method : free;
+}
+
+/*
+  Function: gdClearMemoryMethods
+
+    Restores the C library allocator.
+
+  See also:
+
+	<gdSetMemoryMethods>
+*/
+BGD_DECLARE(void) gdClearMemoryMethods (void)
+{
+	gdSetMemoryMethods (NULL, NULL, NULL, NULL);
+}
+
+/*
+  Function: gdArenaCreate
+
+    Creates a new arena.
+
+	The arena obtains its memory in chunks from the allocator set by
+	<gdSetMemoryMethods>. Nothing is allocated from it until it is bound to
+	a thread with <gdArenaUse>.
+
+  Parameters:
+
+	limit - The maximum number of bytes the arena may reserve, or 0 for
+			no limit. Once the limit is reached, allocations fail and the
+			libgd function in progress reports an error as if the system
+			had run out of memory.
+
+  Returns:
+
+	The new arena, or NULL on failure. Arenas are not available where
+	the compiler lacks thread local storage; there NULL is returned
+	always.
+*/
+BGD_DECLARE(gdArenaPtr) gdArenaCreate (size_t limit)
+{
+#ifdef GD_THREAD_LOCAL
+	gdArenaPtr arena = (gdArenaPtr) gd_malloc_method(sizeof(struct gdArenaStruct));
+	if (!arena) {
+		return NULL;
+	}
+	arena->chunks = NULL;
+	arena->current = NULL;
+	arena->limit = limit;
+	arena->reserved = 0;
+	return arena;
+#else
+	(void) limit;
+	return NULL;
+#endif
+}
+
+/*
+  Function: gdArenaDestroy
+
+    Releases an arena and all memory allocated from it.
+
+	Any image or buffer allocated from the arena becomes invalid; it must
+	neither be used nor passed to <gdImageDestroy> or <gdFree> anymore. If
+	the arena is bound to the calling thread, it is unbound.
+
+  Parameters:
+
+	arena - The arena. If it is NULL, no operation is performed.
+*/
+BGD_DECLARE(void) gdArenaDestroy (gdArenaPtr arena)
+{
+	if (!arena) {
+		return;
+	}
+#ifdef GD_THREAD_LOCAL
+	if (gd_arena_current == arena) {
+		gd_arena_current = NULL;
+	}
+#endif
+
+	gdArenaFreeChunks(arena->chunks, NULL);
+	gd_free_method(arena);
+}
+
+/*
+  Function: gdArenaReset
+
+    Releases all memory allocated from an arena, keeping the arena itself
+    alive for the next request.
+
+	One regular chunk is kept for reuse; everything else is handed back to
+	the allocator. The same restrictions as for <gdArenaDestroy> apply to
+	images and buffers allocated from the arena.
+
+  Parameters:
+
+	arena - The arena.
+*/
+BGD_DECLARE(void) gdArenaReset (gdArenaPtr arena)
+{
+	gdArenaChunk *chunks, *keep;
+
+	if (!arena) {
+		return;
+	}
+
+	chunks = arena->chunks;
+	keep = arena->current;
+	arena->chunks = keep;
+	/* without a regular chunk, e.g. after only large allocations, all
+	   chunks go */
+	gdArenaFreeChunks(chunks, keep);
+	if (keep) {
+		keep->next = NULL;
+		keep->pos = keep->start;
+	}
+	arena->reserved = keep ? keep->size : 0;
+}
+
+/*
+  Function: gdArenaUse
+
+    Binds an arena to the calling thread.
+
+	While an arena is bound, every allocation libgd makes on this thread is
+	served from it, including the image itself, its pixels, and the buffers
+	returned by the gdImage*Ptr functions. An arena must not be bound to more
+	than one thread at a time.
+
+	Memory libgd obtained before the arena was bound may still be freed as
+	usual, and arena memory may be passed to <gdFree> or <gdImageDestroy>
+	at any time before the arena is reset or destroyed.
+
+  Parameters:
+
+	arena - The arena to bind, or NULL to unbind the current one.
+
+  Returns:
+
+	The arena that was previously bound to the calling thread, if any, so
+	that nested scopes can restore it.
+
+  Example:
+	(start code)
+	gdArenaPtr arena = gdArenaCreate(64 * 1024 * 1024);
+	gdArenaPtr old = gdArenaUse(arena);
+	gdImagePtr im = gdImageCreateFromPngPtr(size, data);
+	void *out = im ? gdImageJpegPtr(im, &outSize, 85) : NULL;
+	// ... send out ...
+	gdArenaUse(old);
+	gdArenaDestroy(arena);
+	(end code)
+*/
+BGD_DECLARE(gdArenaPtr) gdArenaUse (gdArenaPtr arena)
+{
+#ifdef GD_THREAD_LOCAL
+	gdArenaPtr old = gd_arena_current;
+
+	gd_arena_current = arena;
+	return old;
+#else
+	(void) arena;
+	return NULL;
+#endif
+}
+
+/*
+  Function: gdArenaGetUsage
+
+    Returns the number of bytes an arena currently reserves from the
+    allocator, i.e. the value that is checked against its limit.
+*/
+BGD_DECLARE(size_t) gdArenaGetUsage (gdArenaPtr arena)
+{
+	return arena ? arena->reserved : 0;
+}
@@ -0,0 +1,639 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <math.h>
+#include <string.h>
+
+#include "gd.h"
+#include "gdhelpers.h"
+#include "gd_intern.h"
+
+/* Searching the palette of an image.
+
+   For the closest color, the RGBA space is divided into cells of 32
+   values on each axis, 8 x 8 x 8 x 4 = 2048 cells in all (the alpha axis
+   only has 128 values). For every cell, the palette entries which may be
+   the closest one to some color in it are listed, the first time a color
+   of the cell is looked up: these are the entries whose smallest
+   distance to the cell does not exceed the second smallest of the
+   largest distances of all entries to it. The true closest entry is
+   always among them, also if any single entry is excluded from the
+   search, so the lists serve gdImageColorResolveAlpha(), which never
+   picks the transparent color, too. A search only looks at the entries
+   listed for its cell, in palette order, and thus finds exactly what a
+   scan of the whole palette finds.
+
+   Exact colors are looked up in a hash table mapping each color to the
+   first entry of that color. Allocating and deallocating colors update
+   it in place, so that building a palette color by color takes constant
+   time per color.
+
+   Any other change of the palette makes all of this stale, by bumping
+   the generation of the index, which is all gdImagePaletteChanged()
+   does. Code setting the members of gdImage directly has to call it,
+   as the searches only compare generations and never look at the
+   palette to find out whether it changed. The exact color search still
+   checks the entry it finds against the palette, and rebuilds its table
+   if that does not have the color anymore, so that it never returns an
+   entry of another color. */
+
+#define GD_CELL_SHIFT 5
+#define GD_CELL_SIZE (1 << GD_CELL_SHIFT)
+#define GD_CELLS_RGB (256 >> GD_CELL_SHIFT)
+#define GD_CELLS_ALPHA ((gdAlphaMax + 1) >> GD_CELL_SHIFT)
+#define GD_CELLS (GD_CELLS_RGB * GD_CELLS_RGB * GD_CELLS_RGB * GD_CELLS_ALPHA)
+
+/* at most half full */
+#define GD_EXACT_BITS 9
+#define GD_EXACT_SLOTS (1 << GD_EXACT_BITS)
+
+typedef struct {
+	unsigned int generation;
+	int count;
+	/* the candidates, in palette order */
+	unsigned char *entries;
+} gdPaletteCell;
+
+typedef struct {
+	float H, W, B;
+} HWBType;
+
+struct gdPaletteIndexStruct {
+	/* the lists of the cells, the HWB values and the exact color table of
+	   another generation are stale */
+	unsigned int generation;
+	/* GD_CELLS cells, allocated on first use */
+	gdPaletteCell *cells;
+	unsigned int hwbGeneration;
+	HWBType hwb[gdMaxColors];
+	/* the colors of the entries, packed like truecolor values, and the
+	   first entry of each; keys of -1 mark empty slots. openSlots counts
+	   the open entries below colorsTotal. */
+	unsigned int exactGeneration;
+	int exactKeys[GD_EXACT_SLOTS];
+	short exactEntries[GD_EXACT_SLOTS];
+	int openSlots;
+};
+
+/* This code is taken from http://www.acm.org/jgt/papers/SmithLyons96/hwb_rgb.html, an article
+ * on colour conversion to/from RBG and HWB colour systems.
+ * It has been modified to return the converted value as a * parameter.
+ */
+
+#define RETURN_HWB(h, w, b) {HWB->H = h; HWB->W = w; HWB->B = b; return HWB;}
+#define RETURN_RGB(r, g, b) {RGB->R = r; RGB->G = g; RGB->B = b; return RGB;}
+#define HWB_UNDEFINED -1
+#define SETUP_RGB(s, r, g, b) {s.R = r/255.0; s.G = g/255.0; s.B = b/255.0;}
+
+/*
+ * Theoretically, hue 0 (pure red) is identical to hue 6 in these transforms. Pure
+ * red always maps to 6 in this implementation. Therefore UNDEFINED can be
+ * defined as 0 in situations where only unsigned numbers are desired.
+ */
+typedef struct {
+	float R, G, B;
+}
+RGBType;
+
+static HWBType *
+RGB_to_HWB (RGBType RGB, HWBType * HWB)
+{
+
+	/*
+	 * RGB are each on [0, 1]. W and B are returned on [0, 1] and H is
+	 * returned on [0, 6]. Exception: H is returned UNDEFINED if W == 1 - B.
+	 */
+
+	float R = RGB.R, G = RGB.G, B = RGB.B, w, v, b, f;
+	int i;
+
+	w = MIN3 (R, G, B);
+	v = MAX3 (R, G, B);
+	b = 1 - v;
+	if (v == w)
+		RETURN_HWB (HWB_UNDEFINED, w, b);
+	f = (R == w) ? G - B : ((G == w) ? B - R : R - G);
+	i = (R == w) ? 3 : ((G == w) ? 5 : 1);
+	RETURN_HWB (i - f / (v - w), w, b);
+
+}
+
+static void
+RGB_to_HWB_int (int r, int g, int b, HWBType * HWB)
+{
+	RGBType RGB;
+
+	SETUP_RGB (RGB, r, g, b);
+	RGB_to_HWB (RGB, HWB);
+}
+
+static float
+HWB_Diff (const HWBType * HWB1, const HWBType * HWB2)
+{
+	float diff;
+
+	/*
+	 * I made this bit up; it seems to produce OK results, and it is certainly
+	 * more visually correct than the current RGB metric. (PJW)
+	 */
+
+	if ((HWB1->H == HWB_UNDEFINED) || (HWB2->H == HWB_UNDEFINED)) {
+		diff = 0;			/* Undefined hues always match... */
+	} else {
+		diff = fabs (HWB1->H - HWB2->H);
+		if (diff > 3) {
+			diff = 6 - diff;	/* Remember, it's a colour circle */
+		}
+	}
+
+	diff =
+	    diff * diff + (HWB1->W - HWB2->W) * (HWB1->W - HWB2->W) + (HWB1->B -
+	            HWB2->B) * (HWB1->B -
+	                       HWB2->B);
+
+	return diff;
+}
+
+#if 0
+/*
+ * This is not actually used, but is here for completeness, in case someone wants to
+ * use the HWB stuff for anything else...
+ */
+static RGBType *
+HWB_to_RGB (HWBType HWB, RGBType * RGB)
+{
+
+	/*
+	 * H is given on [0, 6] or UNDEFINED. W and B are given on [0, 1].
+	 * RGB are each returned on [0, 1].
+	 */
+
+	float h = HWB.H, w = HWB.W, b = HWB.B, v, n, f;
+	int i;
+
+	v = 1 - b;
+	if (h == HWB_UNDEFINED)
+		RETURN_RGB (v, v, v);
+	i = floor (h);
+	f = h - i;
+	if (i & 1)
+		f = 1 - f;			/* if i is odd */
+	n = w + f * (v - w);		/* linear interpolation between w and v */
+	switch (i) {
+	case 6:
+	case 0:
+		RETURN_RGB (v, n, w);
+	case 1:
+		RETURN_RGB (n, v, w);
+	case 2:
+		RETURN_RGB (w, v, n);
+	case 3:
+		RETURN_RGB (w, n, v);
+	case 4:
+		RETURN_RGB (n, w, v);
+	case 5:
+		RETURN_RGB (v, w, n);
+	}
+
+	return RGB;
+
+}
+#endif
+
+static struct gdPaletteIndexStruct *gdPaletteIndexGet (gdImagePtr im)
+{
+	if (!im->paletteIndex) {
+		im->paletteIndex = (struct gdPaletteIndexStruct *) gdCalloc(1, sizeof(struct gdPaletteIndexStruct));
+		if (im->paletteIndex) {
+			im->paletteIndex->generation = 1;
+		}
+	}
+	return im->paletteIndex;
+}
+
+/* Makes everything derived from the palette stale */
+static void gdPaletteIndexBump (struct gdPaletteIndexStruct *index)
+{
+	int i;
+
+	index->generation++;
+	if (index->generation == 0) {
+		/* wrapped around, make sure nothing stale looks current */
+		if (index->cells) {
+			for (i = 0; i < GD_CELLS; i++) {
+				index->cells[i].generation = 0;
+			}
+		}
+		index->hwbGeneration = 0;
+		index->exactGeneration = 0;
+		index->generation = 1;
+	}
+}
+
+/* The smallest and largest squared distance of v to lo..lo + GD_CELL_SIZE - 1 */
+static void gdCellDistance (long v, long lo, long *dmin, long *dmax)
+{
+	const long hi = lo + GD_CELL_SIZE - 1;
+	long d;
+
+	d = v < lo ? lo - v : (v > hi ? v - hi : 0);
+	*dmin += d * d;
+	d = MAX(labs(v - lo), labs(v - hi));
+	*dmax += d * d;
+}
+
+static int gdPaletteCellBuild (gdImagePtr im, gdPaletteCell *cell, int r, int g, int b, int a)
+{
+	long dmin[gdMaxColors], dmax;
+	long best = -1, second = -1;
+	unsigned char entries[gdMaxColors];
+	int i, count = 0;
+
+	for (i = 0; i < im->colorsTotal; i++) {
+		if (im->open[i]) {
+			continue;
+		}
+		dmin[i] = 0;
+		dmax = 0;
+		gdCellDistance(im->red[i], r, &dmin[i], &dmax);
+		gdCellDistance(im->green[i], g, &dmin[i], &dmax);
+		gdCellDistance(im->blue[i], b, &dmin[i], &dmax);
+		gdCellDistance(im->alpha[i], a, &dmin[i], &dmax);
+		if (best < 0 || dmax < best) {
+			second = best;
+			best = dmax;
+		} else if (second < 0 || dmax < second) {
+			second = dmax;
+		}
+	}
+	if (second < 0) {
+		second = best;
+	}
+	for (i = 0; i < im->colorsTotal; i++) {
+		if (!im->open[i] && dmin[i] <= second) {
+			entries[count++] = (unsigned char) i;
+		}
+	}
+
+	if (cell->entries) {
+		gdFree(cell->entries);
+	}
+	cell->entries = NULL;
+	if (count) {
+		cell->entries = (unsigned char *) gdMalloc(count);
+		if (!cell->entries) {
+			return 0;
+		}
+		memcpy(cell->entries, entries, count);
+	}
+	cell->count = count;
+	cell->generation = im->paletteIndex->generation;
+	return 1;
+}
+
+/* The candidates for the color, or NULL if the whole palette has to be
+   scanned */
+static gdPaletteCell *gdPaletteCellGet (gdImagePtr im, int r, int g, int b, int a)
+{
+	struct gdPaletteIndexStruct *index;
+	gdPaletteCell *cell;
+
+	if (r < 0 || r > 255 || g < 0 || g > 255 || b < 0 || b > 255
+	        || a < 0 || a > gdAlphaMax) {
+		return NULL;
+	}
+	index = gdPaletteIndexGet(im);
+	if (!index) {
+		return NULL;
+	}
+	if (!index->cells) {
+		index->cells = (gdPaletteCell *) gdCalloc(GD_CELLS, sizeof(gdPaletteCell));
+		if (!index->cells) {
+			return NULL;
+		}
+	}
+	r >>= GD_CELL_SHIFT;
+	g >>= GD_CELL_SHIFT;
+	b >>= GD_CELL_SHIFT;
+	a >>= GD_CELL_SHIFT;
+	cell = &index->cells[((r * GD_CELLS_RGB + g) * GD_CELLS_RGB + b) * GD_CELLS_ALPHA + a];
+	if (cell->generation != index->generation
+	        && !gdPaletteCellBuild(im, cell, r << GD_CELL_SHIFT, g << GD_CELL_SHIFT,
+	                               b << GD_CELL_SHIFT, a << GD_CELL_SHIFT)) {
+		return NULL;
+	}
+	return cell;
+}
+
+/* Finds the closest color of the palette of im, ignoring the entry
+   'exclude'. Only colors closer than 'limit' are considered, unless it
+   is negative. Returns -1 if there is none. Of several equally close
+   entries, the first one is returned. */
+int _gdPaletteClosest (gdImagePtr im, int r, int g, int b, int a, int exclude, long limit)
+{
+	gdPaletteCell *cell = gdPaletteCellGet(im, r, g, b, a);
+	int i, j, n, ct = -1;
+	long rd, gd, bd, ad, dist, mindist = limit;
+
+	n = cell ? cell->count : im->colorsTotal;
+	for (j = 0; j < n; j++) {
+		i = cell ? cell->entries[j] : j;
+		if (im->open[i] || i == exclude) {
+			continue;
+		}
+		rd = (long) (im->red[i] - r);
+		gd = (long) (im->green[i] - g);
+		bd = (long) (im->blue[i] - b);
+		ad = (long) (im->alpha[i] - a);
+		dist = rd * rd + gd * gd + bd * bd + ad * ad;
+		if (mindist < 0 || dist < mindist) {
+			mindist = dist;
+			ct = i;
+		}
+	}
+	return ct;
+}
+
+/* Finds the color of the palette of im closest to r, g, b in the HWB
+   color space, see gdImageColorClosestHWB() */
+int _gdPaletteClosestHWB (gdImagePtr im, int r, int g, int b)
+{
+	struct gdPaletteIndexStruct *index = gdPaletteIndexGet(im);
+	HWBType query, entry;
+	const HWBType *hwb;
+	int i, ct = -1;
+	int first = 1;
+	float mindist = 0;
+
+	if (index && index->hwbGeneration != index->generation) {
+		for (i = 0; i < im->colorsTotal; i++) {
+			RGB_to_HWB_int(im->red[i], im->green[i], im->blue[i], &index->hwb[i]);
+		}
+		index->hwbGeneration = index->generation;
+	}
+	RGB_to_HWB_int(r, g, b, &query);
+	for (i = 0; (i < (im->colorsTotal)); i++) {
+		float dist;
+		if (im->open[i]) {
+			continue;
+		}
+		if (index) {
+			hwb = &index->hwb[i];
+		} else {
+			RGB_to_HWB_int(im->red[i], im->green[i], im->blue[i], &entry);
+			hwb = &entry;
+		}
+		dist = HWB_Diff (hwb, &query);
+		if (first || (dist < mindist)) {
+			mindist = dist;
+			ct = i;
+			first = 0;
+		}
+	}
+	return ct;
+}
+
+/* The key of a color in the exact color table, -1 for colors which
+   can't be packed */
+static int gdExactKey (int r, int g, int b, int a)
+{
+	if (r < 0 || r > 255 || g < 0 || g > 255 || b < 0 || b > 255
+	        || a < 0 || a > gdAlphaMax) {
+		return -1;
+	}
+	return gdTrueColorAlpha(r, g, b, a);
+}
+
+static unsigned int gdExactHome (int key)
+{
+	return ((unsigned int) key * 2654435761U) >> (32 - GD_EXACT_BITS);
+}
+
+/* The slot holding key, or the empty slot where it belongs */
+static unsigned int gdExactFind (const struct gdPaletteIndexStruct *index, int key)
+{
+	unsigned int slot = gdExactHome(key);
+
+	while (index->exactKeys[slot] != -1 && index->exactKeys[slot] != key) {
+		slot = (slot + 1) & (GD_EXACT_SLOTS - 1);
+	}
+	return slot;
+}
+
+/* Empties a slot, moving entries after it back so that they can still
+   be found */
+static void gdExactRemove (struct gdPaletteIndexStruct *index, unsigned int slot)
+{
+	unsigned int next = slot, home;
+
+	for (;;) {
+		next = (next + 1) & (GD_EXACT_SLOTS - 1);
+		if (index->exactKeys[next] == -1) {
+			break;
+		}
+		home = gdExactHome(index->exactKeys[next]);
+		/* it may move unless its home lies cyclically in (slot, next] */
+		if (slot < next ? (home <= slot || home > next) : (home <= slot && home > next)) {
+			index->exactKeys[slot] = index->exactKeys[next];
+			index->exactEntries[slot] = index->exactEntries[next];
+			slot = next;
+		}
+	}
+	index->exactKeys[slot] = -1;
+}
+
+/* Adds entry i, unless an earlier entry has the same color */
+static void gdExactAdd (gdImagePtr im, struct gdPaletteIndexStruct *index, int i)
+{
+	const int key = gdExactKey(im->red[i], im->green[i], im->blue[i], im->alpha[i]);
+	unsigned int slot;
+
+	if (key == -1) {
+		return;
+	}
+	slot = gdExactFind(index, key);
+	if (index->exactKeys[slot] == -1) {
+		index->exactKeys[slot] = key;
+		index->exactEntries[slot] = (short) i;
+	} else if (index->exactEntries[slot] > i) {
+		index->exactEntries[slot] = (short) i;
+	}
+}
+
+/* The index with a current exact color table, NULL if out of memory */
+static struct gdPaletteIndexStruct *gdPaletteExactGet (gdImagePtr im)
+{
+	struct gdPaletteIndexStruct *index = gdPaletteIndexGet(im);
+	int i;
+
+	if (!index || index->exactGeneration == index->generation) {
+		return index;
+	}
+	for (i = 0; i < GD_EXACT_SLOTS; i++) {
+		index->exactKeys[i] = -1;
+	}
+	index->openSlots = 0;
+	for (i = 0; i < im->colorsTotal; i++) {
+		if (im->open[i]) {
+			index->openSlots++;
+		} else {
+			gdExactAdd(im, index, i);
+		}
+	}
+	index->exactGeneration = index->generation;
+	return index;
+}
+
+/* Whether entry i of the palette of im has exactly the given color */
+static int gdPaletteIsExact (gdImagePtr im, int i, int r, int g, int b, int a)
+{
+	return i >= 0 && i < im->colorsTotal && !im->open[i] && im->red[i] == r
+	       && im->green[i] == g && im->blue[i] == b && im->alpha[i] == a;
+}
+
+/* Finds the first entry of the palette of im with exactly the given
+   color, -1 if there is none */
+int _gdPaletteExact (gdImagePtr im, int r, int g, int b, int a)
+{
+	const int key = gdExactKey(r, g, b, a);
+	struct gdPaletteIndexStruct *index;
+	unsigned int slot;
+	int i;
+
+	index = key != -1 ? gdPaletteExactGet(im) : NULL;
+	if (!index) {
+		for (i = 0; (i < (im->colorsTotal)); i++) {
+			if (gdPaletteIsExact(im, i, r, g, b, a)) {
+				return i;
+			}
+		}
+		return -1;
+	}
+	slot = gdExactFind(index, key);
+	i = index->exactKeys[slot] == key ? index->exactEntries[slot] : -1;
+	if (gdPaletteIsExact(im, i, r, g, b, a)) {
+		return i;
+	}
+	if (i == -1) {
+		return -1;
+	}
+	/* the palette was changed directly, without gdImagePaletteChanged() */
+	gdPaletteIndexBump(index);
+	index = gdPaletteExactGet(im);
+	slot = gdExactFind(index, key);
+	return index->exactKeys[slot] == key ? index->exactEntries[slot] : -1;
+}
+
+/* Whether there may be open entries below colorsTotal */
+int _gdPaletteHasOpen (gdImagePtr im)
+{
+	if (!gdPaletteIndexGet(im)) {
+		return 1;
+	}
+	return gdPaletteExactGet(im)->openSlots > 0;
+}
+
+/* To be called after the color of entry i was allocated; reused tells
+   whether the entry was an open one below colorsTotal before */
+void _gdPaletteAllocated (gdImagePtr im, int i, int reused)
+{
+	struct gdPaletteIndexStruct *index = im->paletteIndex;
+	int current;
+
+	if (!index) {
+		return;
+	}
+	current = index->exactGeneration == index->generation;
+	if (current) {
+		gdExactAdd(im, index, i);
+		if (reused) {
+			index->openSlots--;
+		}
+	}
+	gdPaletteIndexBump(index);
+	if (current) {
+		index->exactGeneration = index->generation;
+	}
+}
+
+/* To be called after entry i was deallocated */
+void _gdPaletteDeallocated (gdImagePtr im, int i)
+{
+	struct gdPaletteIndexStruct *index = im->paletteIndex;
+	int current, key, j;
+	unsigned int slot;
+
+	if (!index) {
+		return;
+	}
+	current = index->exactGeneration == index->generation;
+	if (current && i < im->colorsTotal) {
+		key = gdExactKey(im->red[i], im->green[i], im->blue[i], im->alpha[i]);
+		if (key != -1) {
+			slot = gdExactFind(index, key);
+			if (index->exactKeys[slot] == key && index->exactEntries[slot] == i) {
+				/* fall back to a later entry of the same color */
+				for (j = i + 1; j < im->colorsTotal; j++) {
+					if (!im->open[j] && im->red[j] == im->red[i] && im->green[j] == im->green[i]
+					        && im->blue[j] == im->blue[i] && im->alpha[j] == im->alpha[i]) {
+						break;
+					}
+				}
+				if (j < im->colorsTotal) {
+					index->exactEntries[slot] = (short) j;
+				} else {
+					gdExactRemove(index, slot);
+				}
+			}
+		}
+		index->openSlots++;
+	}
+	gdPaletteIndexBump(index);
+	if (current) {
+		index->exactGeneration = index->generation;
+	}
+}
+
+/**
+ * Function: gdImagePaletteChanged
+ *
+ * Tells gd that the palette of an image was changed directly
+ *
+ * The closest and exact color functions, like <gdImageColorClosestAlpha>, keep
+ * lookup structures over the palette of an image, which all functions
+ * of gd changing the palette keep up to date. Code setting the members
+ * _red_, _green_, _blue_, _alpha_, _open_ or _colorsTotal_ of a palette
+ * image itself has to call this function afterwards, before any of
+ * these functions is used on the image again; it marks the structures
+ * as stale, so that they are rebuilt on the next search.
+ *
+ * Parameters:
+ *   im - The image.
+ */
+BGD_DECLARE(void) gdImagePaletteChanged (gdImagePtr im)
+{
+	if (im->paletteIndex) {
+		gdPaletteIndexBump(im->paletteIndex);
+	}
+}
+
+/* Frees the lookup structures of the palette of im */
+void _gdImagePaletteIndexFree (gdImagePtr im)
+{
+	int i;
+
+	if (!im->paletteIndex) {
+		return;
+	}
+	if (im->paletteIndex->cells) {
+		for (i = 0; i < GD_CELLS; i++) {
+			if (im->paletteIndex->cells[i].entries) {
+				gdFree(im->paletteIndex->cells[i].entries);
+			}
+		}
+		gdFree(im->paletteIndex->cells);
+	}
+	gdFree(im->paletteIndex);
+	im->paletteIndex = NULL;
+}
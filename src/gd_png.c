@@ -13,6 +13,7 @@
 #ifdef HAVE_LIBPNG
 
 #include "gdhelpers.h"
+#include "gd_intern.h"
 #include "png.h"		/* includes zlib.h and setjmp.h */
 
 #define TRUE 1
@@ -79,6 +80,36 @@ gdPngErrorHandler (png_structp png_ptr, png_const_charp msg)
 }
 #endif
 
+#if defined(PNG_USER_MEM_SUPPORTED) && PNG_LIBPNG_VER >= 10400
+/* libpng's own working memory goes through gdMalloc()/gdFree() as well,
+   so that it honours gdSetMemoryMethods() and arenas. */
+static png_voidp
+gdPngMalloc (png_structp png_ptr, png_alloc_size_t size)
+{
+	(void)png_ptr;
+	return gdMalloc (size);
+}
+
+static void
+gdPngFree (png_structp png_ptr, png_voidp ptr)
+{
+	(void)png_ptr;
+	gdFree (ptr);
+}
+
+# define gdPngCreateReadStruct(error_ptr, error_fn) \
+	png_create_read_struct_2 (PNG_LIBPNG_VER_STRING, error_ptr, error_fn, NULL, \
+	                          NULL, gdPngMalloc, gdPngFree)
+# define gdPngCreateWriteStruct(error_ptr, error_fn) \
+	png_create_write_struct_2 (PNG_LIBPNG_VER_STRING, error_ptr, error_fn, NULL, \
+	                           NULL, gdPngMalloc, gdPngFree)
+#else
+# define gdPngCreateReadStruct(error_ptr, error_fn) \
+	png_create_read_struct (PNG_LIBPNG_VER_STRING, error_ptr, error_fn, NULL)
+# define gdPngCreateWriteStruct(error_ptr, error_fn) \
+	png_create_write_struct (PNG_LIBPNG_VER_STRING, error_ptr, error_fn, NULL)
+#endif
+
 static void
 gdPngReadData (png_structp png_ptr, png_bytep data, png_size_t length)
 {
@@ -193,12 +224,118 @@ BGD_DECLARE(gdImagePtr) gdImageCreateFromPngPtr (int size, void *data)
  * "PNG: The Definitive Guide" (http://www.libpng.org/pub/png/book/).
  */
 
+static gdImagePtr _gdImageCreateFromPngCtx (gdIOCtx * infile, gdImagePoolPtr pool, gdImagePtr target);
+
+/* Converts one decoded row to gd pixels */
+static void
+gdPngConvertRow (gdImagePtr im, int color_type, png_bytep row, int h, png_uint_32 width)
+{
+	png_uint_32 w;
+	int boffset = 0;
+
+	switch (color_type) {
+	case PNG_COLOR_TYPE_RGB:
+		for (w = 0; w < width; w++) {
+			register png_byte r = row[boffset++];
+			register png_byte g = row[boffset++];
+			register png_byte b = row[boffset++];
+			im->tpixels[h][w] = gdTrueColor (r, g, b);
+		}
+		break;
+
+	case PNG_COLOR_TYPE_GRAY_ALPHA:
+	case PNG_COLOR_TYPE_RGB_ALPHA:
+		for (w = 0; w < width; w++) {
+			register png_byte r = row[boffset++];
+			register png_byte g = row[boffset++];
+			register png_byte b = row[boffset++];
+
+			/* gd has only 7 bits of alpha channel resolution, and
+			 * 127 is transparent, 0 opaque. A moment of convenience,
+			 *  a lifetime of compatibility.
+			 */
+
+			register png_byte a = gdAlphaMax - (row[boffset++] >> 1);
+			im->tpixels[h][w] = gdTrueColorAlpha(r, g, b, a);
+		}
+		break;
+	default:
+		if (!im->trueColor) {
+			/* Palette image, or something coerced to be one */
+			for (w = 0; w < width; ++w) {
+				register png_byte idx = row[w];
+				im->pixels[h][w] = idx;
+				im->open[idx] = 0;
+			}
+		}
+	}
+}
+
 /*
   Function: gdImageCreateFromPngCtx
 
   See <gdImageCreateFromPng>.
 */
 BGD_DECLARE(gdImagePtr) gdImageCreateFromPngCtx (gdIOCtx * infile)
+{
+	return _gdImageCreateFromPngCtx (infile, NULL, NULL);
+}
+
+/*
+  Function: gdImageCreateFromPngCtxPool
+
+    Reads a PNG image into an image taken from a pool.
+
+    This works like <gdImageCreateFromPngCtx>, except that the image is
+    obtained with <gdImagePoolGet> rather than created from scratch, so
+    that decoding a series of images of the same size allocates no new
+    pixel memory. The image should be given back with <gdImagePoolPut>
+    once it is no longer needed.
+
+  Parameters:
+
+    infile - The input context.
+    pool   - The pool.
+
+  Returns:
+
+    The image, or NULL on failure.
+*/
+BGD_DECLARE(gdImagePtr) gdImageCreateFromPngCtxPool (gdIOCtx * infile, gdImagePoolPtr pool)
+{
+	return _gdImageCreateFromPngCtx (infile, pool, NULL);
+}
+
+/*
+  Function: gdImageCreateFromPngCtxInto
+
+    Reads a PNG image into an existing image.
+
+    The image has to have the same dimensions as the PNG, and has to be a
+    truecolor image for RGB, RGBA and gray+alpha PNGs and a palette image
+    otherwise (i.e. the type <gdImageCreateFromPngCtx> would create). All
+    of its pixels, its palette and its settings are replaced.
+
+  Parameters:
+
+    infile - The input context.
+    im     - The image to read into.
+
+  Returns:
+
+    _im_ on success, NULL on failure, in which case _im_ still belongs to
+    the caller and its contents are undefined.
+*/
+BGD_DECLARE(gdImagePtr) gdImageCreateFromPngCtxInto (gdIOCtx * infile, gdImagePtr im)
+{
+	if (!im) {
+		return NULL;
+	}
+	return _gdImageCreateFromPngCtx (infile, NULL, im);
+}
+
+static gdImagePtr
+_gdImageCreateFromPngCtx (gdIOCtx * infile, gdImagePoolPtr pool, gdImagePtr target)
 {
 	png_byte sig[8];
 #ifdef PNG_SETJMP_SUPPORTED
@@ -206,7 +343,7 @@ BGD_DECLARE(gdImagePtr) gdImageCreateFromPngCtx (gdIOCtx * infile)
 #endif
 	png_structp png_ptr;
 	png_infop info_ptr;
-	png_uint_32 width, height, rowbytes, w, h, res_x, res_y;
+	png_uint_32 width, height, rowbytes, rows, h, res_x, res_y;
 	int bit_depth, color_type, interlace_type, unit_type;
 	int num_palette = 0, num_trans;
 	png_colorp palette;
@@ -235,9 +372,9 @@ BGD_DECLARE(gdImagePtr) gdImageCreateFromPngCtx (gdIOCtx * infile)
 	}
 
 #ifdef PNG_SETJMP_SUPPORTED
-	png_ptr = png_create_read_struct (PNG_LIBPNG_VER_STRING, &jbw, gdPngErrorHandler, NULL);
+	png_ptr = gdPngCreateReadStruct (&jbw, gdPngErrorHandler);
 #else
-	png_ptr = png_create_read_struct (PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	png_ptr = gdPngCreateReadStruct (NULL, NULL);
 #endif
 	if (png_ptr == NULL) {
 		gd_error("gd-png error: cannot allocate libpng main struct\n");
@@ -278,9 +415,9 @@ BGD_DECLARE(gdImagePtr) gdImageCreateFromPngCtx (gdIOCtx * infile)
 	png_get_IHDR (png_ptr, info_ptr, &width, &height, &bit_depth, &color_type, &interlace_type, NULL, NULL);
 	if ((color_type == PNG_COLOR_TYPE_RGB) || (color_type == PNG_COLOR_TYPE_RGB_ALPHA)
 	        || color_type == PNG_COLOR_TYPE_GRAY_ALPHA) {
-		im = gdImageCreateTrueColor ((int) width, (int) height);
+		im = _gdImagePoolAcquire (pool, target, (int) width, (int) height, 1, 0);
 	} else {
-		im = gdImageCreate ((int) width, (int) height);
+		im = _gdImagePoolAcquire (pool, target, (int) width, (int) height, 0, 0);
 	}
 	if (im == NULL) {
 		gd_error("gd-png error: cannot allocate gdImage struct\n");
@@ -411,19 +548,21 @@ BGD_DECLARE(gdImagePtr) gdImageCreateFromPngCtx (gdIOCtx * infile)
 
 	png_read_update_info (png_ptr, info_ptr);
 
-	/* allocate space for the PNG image data */
+	/* allocate space for the PNG image data; 2.3.2: non-interlaced
+	 * images are read row by row through a single row buffer */
 	rowbytes = png_get_rowbytes (png_ptr, info_ptr);
-	if (overflow2(rowbytes, height))
+	rows = interlace_type == PNG_INTERLACE_NONE ? 1 : height;
+	if (overflow2(rowbytes, rows))
 		goto error;
-	image_data = (png_bytep) gdMalloc (rowbytes * height);
+	image_data = (png_bytep) gdMalloc (rowbytes * rows);
 	if (!image_data) {
 		gd_error("gd-png error: cannot allocate image data\n");
 		goto error;
 	}
-	if (overflow2(height, sizeof (png_bytep)))
+	if (overflow2(rows, sizeof (png_bytep)))
 		goto error;
 
-	row_pointers = (png_bytepp) gdMalloc (height * sizeof (png_bytep));
+	row_pointers = (png_bytepp) gdMalloc (rows * sizeof (png_bytep));
 	if (!row_pointers) {
 		gd_error("gd-png error: cannot allocate row pointers\n");
 		goto error;
@@ -441,13 +580,10 @@ BGD_DECLARE(gdImagePtr) gdImageCreateFromPngCtx (gdIOCtx * infile)
 #endif
 
 	/* set the individual row_pointers to point at the correct offsets */
-	for (h = 0; h < height; ++h) {
+	for (h = 0; h < rows; ++h) {
 		row_pointers[h] = image_data + h * rowbytes;
 	}
 
-	png_read_image (png_ptr, row_pointers);	/* read whole image... */
-	png_read_end (png_ptr, NULL);	/* ...done! */
-
 	if (!im->trueColor) {
 		im->colorsTotal = num_palette;
 		/* load the palette and mark all entries "open" (unused) for now */
@@ -467,50 +603,21 @@ BGD_DECLARE(gdImagePtr) gdImageCreateFromPngCtx (gdIOCtx * infile)
 	im->transparent = transparent;
 	im->interlace = (interlace_type == PNG_INTERLACE_ADAM7);
 
-	/* can't nuke structs until done with palette */
-	png_destroy_read_struct (&png_ptr, &info_ptr, NULL);
-	switch (color_type) {
-	case PNG_COLOR_TYPE_RGB:
-		for (h = 0; h < height; h++) {
-			int boffset = 0;
-			for (w = 0; w < width; w++) {
-				register png_byte r = row_pointers[h][boffset++];
-				register png_byte g = row_pointers[h][boffset++];
-				register png_byte b = row_pointers[h][boffset++];
-				im->tpixels[h][w] = gdTrueColor (r, g, b);
-			}
+	if (rows == 1) {
+		for (h = 0; h < height; ++h) {
+			png_read_row (png_ptr, row_pointers[0], NULL);
+			gdPngConvertRow (im, color_type, row_pointers[0], h, width);
 		}
-		break;
+		png_read_end (png_ptr, NULL);
+		png_destroy_read_struct (&png_ptr, &info_ptr, NULL);
+	} else {
+		png_read_image (png_ptr, row_pointers);	/* read whole image... */
+		png_read_end (png_ptr, NULL);	/* ...done! */
 
-	case PNG_COLOR_TYPE_GRAY_ALPHA:
-	case PNG_COLOR_TYPE_RGB_ALPHA:
+		/* can't nuke structs until done with palette */
+		png_destroy_read_struct (&png_ptr, &info_ptr, NULL);
 		for (h = 0; h < height; h++) {
-			int boffset = 0;
-			for (w = 0; w < width; w++) {
-				register png_byte r = row_pointers[h][boffset++];
-				register png_byte g = row_pointers[h][boffset++];
-				register png_byte b = row_pointers[h][boffset++];
-
-				/* gd has only 7 bits of alpha channel resolution, and
-				 * 127 is transparent, 0 opaque. A moment of convenience,
-				 *  a lifetime of compatibility.
-				 */
-
-				register png_byte a = gdAlphaMax - (row_pointers[h][boffset++] >> 1);
-				im->tpixels[h][w] = gdTrueColorAlpha(r, g, b, a);
-			}
-		}
-		break;
-	default:
-		if (!im->trueColor) {
-			/* Palette image, or something coerced to be one */
-			for (h = 0; h < height; ++h) {
-				for (w = 0; w < width; ++w) {
-					register png_byte idx = row_pointers[h][w];
-					im->pixels[h][w] = idx;
-					open[idx] = 0;
-				}
-			}
+			gdPngConvertRow (im, color_type, row_pointers[h], h, width);
 		}
 	}
 #ifdef DEBUG
@@ -539,7 +646,7 @@ BGD_DECLARE(gdImagePtr) gdImageCreateFromPngCtx (gdIOCtx * infile)
  error:
 	png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
 	if (im) {
-		gdImageDestroy(im);
+		_gdImagePoolRelease(pool, target, im);
 		im = NULL;
 	}
 	goto done;
@@ -784,11 +891,9 @@ static int _gdImagePngCtxEx(gdImagePtr im, gdIOCtx * outfile, int level)
 	if (width == 0 || height ==0) return 1;
 
 #ifdef PNG_SETJMP_SUPPORTED
-	png_ptr = png_create_write_struct (PNG_LIBPNG_VER_STRING,
-	                                   &jbw, gdPngErrorHandler,
-	                                   NULL);
+	png_ptr = gdPngCreateWriteStruct (&jbw, gdPngErrorHandler);
 #else
-	png_ptr = png_create_write_struct (PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	png_ptr = gdPngCreateWriteStruct (NULL, NULL);
 #endif
 	if (png_ptr == NULL) {
 		gd_error("gd-png error: cannot allocate libpng main struct\n");
@@ -1112,6 +1217,22 @@ BGD_DECLARE(gdImagePtr) gdImageCreateFromPngCtx (gdIOCtx * infile)
 	return NULL;
 }
 
+BGD_DECLARE(gdImagePtr) gdImageCreateFromPngCtxPool (gdIOCtx * infile, gdImagePoolPtr pool)
+{
+	(void) infile;
+	(void) pool;
+	_noPngError();
+	return NULL;
+}
+
+BGD_DECLARE(gdImagePtr) gdImageCreateFromPngCtxInto (gdIOCtx * infile, gdImagePtr im)
+{
+	(void) infile;
+	(void) im;
+	_noPngError();
+	return NULL;
+}
+
 BGD_DECLARE(void) gdImagePngEx (gdImagePtr im, FILE * outFile, int level)
 {
 	_noPngError();
@@ -0,0 +1,232 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+
+#include "gd.h"
+#include "gd_errors.h"
+#include "gdhelpers.h"
+#include "gd_intern.h"
+
+/**
+ * Title: Image Pools
+ *
+ * An image pool keeps destroyed images around so that their pixel memory
+ * can be handed out again for the next image of the same size and type.
+ * Applications processing many images of the same dimensions, such as the
+ * frames of a video or thumbnails of a fixed size, thus avoid allocating
+ * and faulting in fresh pixel memory for every image.
+ *
+ * Images are taken from a pool with <gdImagePoolGet> (or by the pooled
+ * decoders, e.g. <gdImageCreateFromPngCtxPool>) and given back with
+ * <gdImagePoolPut>. A pool may be shared by several threads.
+ */
+
+struct gdImagePoolStruct {
+	/* idle images, least recently returned first */
+	gdImagePtr *images;
+	int count;
+	int max;
+	gdMutexDeclare(mutex);
+};
+
+/*
+  Function: gdImagePoolCreate
+
+    Creates an image pool.
+
+  Parameters:
+
+    max - The maximum number of idle images the pool keeps. Images given
+          back to a full pool evict the least recently returned one.
+
+  Returns:
+
+    The new pool, or NULL on failure.
+*/
+BGD_DECLARE(gdImagePoolPtr) gdImagePoolCreate (int max)
+{
+	gdImagePoolPtr pool;
+
+	if (max < 1 || overflow2(max, sizeof (gdImagePtr))) {
+		return NULL;
+	}
+	pool = (gdImagePoolPtr) gdMalloc (sizeof (struct gdImagePoolStruct));
+	if (!pool) {
+		return NULL;
+	}
+	pool->images = (gdImagePtr *) gdMalloc (max * sizeof (gdImagePtr));
+	if (!pool->images) {
+		gdFree (pool);
+		return NULL;
+	}
+	pool->count = 0;
+	pool->max = max;
+	gdMutexSetup (pool->mutex);
+	return pool;
+}
+
+/*
+  Function: gdImagePoolDestroy
+
+    Destroys an image pool and all idle images in it.
+
+    Images currently taken from the pool are not affected; they have to be
+    destroyed with <gdImageDestroy> then.
+
+  Parameters:
+
+    pool - The pool. If it is NULL, no operation is performed.
+*/
+BGD_DECLARE(void) gdImagePoolDestroy (gdImagePoolPtr pool)
+{
+	int i;
+
+	if (!pool) {
+		return;
+	}
+	for (i = 0; i < pool->count; i++) {
+		gdImageDestroy (pool->images[i]);
+	}
+	gdMutexShutdown (pool->mutex);
+	gdFree (pool->images);
+	gdFree (pool);
+}
+
+/* Takes the most recently returned idle image of the given size and type
+   out of the pool, if there is one. */
+static gdImagePtr gdImagePoolTake (gdImagePoolPtr pool, int sx, int sy, int trueColor)
+{
+	gdImagePtr im = NULL;
+	int i;
+
+	gdMutexLock (pool->mutex);
+	for (i = pool->count - 1; i >= 0; i--) {
+		gdImagePtr candidate = pool->images[i];
+		if (candidate->sx == sx && candidate->sy == sy
+		        && (candidate->trueColor != 0) == (trueColor != 0)) {
+			im = candidate;
+			pool->count--;
+			for (; i < pool->count; i++) {
+				pool->images[i] = pool->images[i + 1];
+			}
+			break;
+		}
+	}
+	gdMutexUnlock (pool->mutex);
+	return im;
+}
+
+/*
+  Function: gdImagePoolGet
+
+    Gets an image from a pool.
+
+    The image is in the same state as one just created by <gdImageCreate>
+    or <gdImageCreateTrueColor>: all pixels are cleared, the palette is
+    empty, and all settings have their default values. If the pool holds no
+    idle image of the requested size and type, a new one is created.
+
+  Parameters:
+
+    pool      - The pool. If it is NULL, a new image is created.
+    sx        - The image width.
+    sy        - The image height.
+    trueColor - Whether to get a truecolor or a palette image.
+
+  Returns:
+
+    The image, or NULL on failure. It should be given back with
+    <gdImagePoolPut>, but may also be destroyed by <gdImageDestroy>.
+*/
+BGD_DECLARE(gdImagePtr) gdImagePoolGet (gdImagePoolPtr pool, int sx, int sy, int trueColor)
+{
+	return _gdImagePoolAcquire (pool, NULL, sx, sy, trueColor, 1);
+}
+
+/*
+  Function: gdImagePoolPut
+
+    Gives an image back to a pool.
+
+    The image must not be used by the caller anymore. Images wrapping a
+    caller owned buffer (see <gdImageCreateTrueColorFromBuffer>) or sharing
+    their pixels with clones (see <gdImageCloneShared>) are not kept, but
+    destroyed right away.
+
+  Parameters:
+
+    pool - The pool. If it is NULL, the image is destroyed.
+    im   - The image. It does not need to have been taken from this pool.
+           If it is NULL, no operation is performed.
+*/
+BGD_DECLARE(void) gdImagePoolPut (gdImagePoolPtr pool, gdImagePtr im)
+{
+	gdImagePtr evicted = NULL;
+
+	if (!im) {
+		return;
+	}
+	if (!pool || im->pixelsBorrowed || im->tpixelsBorrowed || im->rowShare) {
+		gdImageDestroy (im);
+		return;
+	}
+
+	gdMutexLock (pool->mutex);
+	if (pool->count == pool->max) {
+		int i;
+		evicted = pool->images[0];
+		for (i = 1; i < pool->count; i++) {
+			pool->images[i - 1] = pool->images[i];
+		}
+		pool->count--;
+	}
+	pool->images[pool->count++] = im;
+	gdMutexUnlock (pool->mutex);
+
+	if (evicted) {
+		gdImageDestroy (evicted);
+	}
+}
+
+/* Gets the image a decoder writes into: the caller supplied 'target'
+   (which has to match the size and type), an image from 'pool', or a new
+   one. The pixels are left as they are unless 'clear' is set. */
+gdImagePtr _gdImagePoolAcquire (gdImagePoolPtr pool, gdImagePtr target,
+                                int sx, int sy, int trueColor, int clear)
+{
+	gdImagePtr im;
+
+	if (target) {
+		if (target->sx != sx || target->sy != sy
+		        || (target->trueColor != 0) != (trueColor != 0)) {
+			gd_error("gd: target image is %dx%d %s, need %dx%d %s\n",
+			         target->sx, target->sy,
+			         target->trueColor ? "truecolor" : "palette",
+			         sx, sy, trueColor ? "truecolor" : "palette");
+			return NULL;
+		}
+		return _gdImageRecycle (target, clear) ? target : NULL;
+	}
+	if (pool) {
+		im = gdImagePoolTake (pool, sx, sy, trueColor);
+		if (im) {
+			if (_gdImageRecycle (im, clear)) {
+				return im;
+			}
+			gdImageDestroy (im);
+		}
+	}
+	return trueColor ? gdImageCreateTrueColor (sx, sy) : gdImageCreate (sx, sy);
+}
+
+/* Disposes of an image obtained by _gdImagePoolAcquire() after a failure.
+   A caller supplied target stays with the caller. */
+void _gdImagePoolRelease (gdImagePoolPtr pool, gdImagePtr target, gdImagePtr im)
+{
+	if (!im || im == target) {
+		return;
+	}
+	gdImagePoolPut (pool, im);
+}
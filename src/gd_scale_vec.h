@@ -0,0 +1,121 @@
+/* Vectorized resampling kernels, included by gd_interpolation.c once per
+   instruction set after gd_vec.h (see there).
+
+   They compute exactly what gdScaleRowC() and gdScaleColC() compute: the
+   pixels are widened to 16 bits and multiplied with the fixed point
+   weights two taps at a time, each sum of two products going to the 32
+   bit lane of its channel, then rounded, shifted and saturated back to
+   bytes. The weights have more bits than a short holds, so each one is
+   split into its upper bits, which are signed, and its lowest
+   GD_SCALE_LOW_BITS, which are not; the sums of both are combined at the
+   end. The weights keep the full sums below 2^31 (see
+   GD_SCALE_WEIGHT_SUM), and with them the sums of the parts. */
+
+#define GD_SCALE_LOW_BITS (GD_SCALE_WEIGHT_BITS - 14)
+
+/* Two taps of weight a and b, as pairs of shorts */
+#define GD_SCALE_PAIR(a, b) VEC_SET1((int) ((unsigned int) (unsigned short) (a) \
+                                            | (unsigned int) (unsigned short) (b) << 16))
+/* The upper and the lower bits of the weights a and b, as pairs */
+#define GD_SCALE_PAIR_HI(a, b) GD_SCALE_PAIR((a) >> GD_SCALE_LOW_BITS, (b) >> GD_SCALE_LOW_BITS)
+#define GD_SCALE_PAIR_LO(a, b) GD_SCALE_PAIR((a) & ((1 << GD_SCALE_LOW_BITS) - 1), \
+                                             (b) & ((1 << GD_SCALE_LOW_BITS) - 1))
+
+/* The sum of the products with the upper bits and the rounded sum of the
+   products with the lower bits */
+#define GD_SCALE_SUM(hi, lo) VEC_ADD(VEC_SLL((hi), GD_SCALE_LOW_BITS), (lo))
+
+/* Rounds the channels of acc, which are in the order of the bytes of the
+   pixels, clamps them and packs them back into pixels */
+static VEC_TARGET veci VEC_FN(gdScalePack) (veci acc0, veci acc1, veci acc2, veci acc3)
+{
+	const veci alphaMax = VEC_SET1(0x7FFFFFFF);
+	veci lo, hi;
+
+	lo = VEC_PACKS32(VEC_SRA(acc0, GD_SCALE_WEIGHT_BITS), VEC_SRA(acc1, GD_SCALE_WEIGHT_BITS));
+	hi = VEC_PACKS32(VEC_SRA(acc2, GD_SCALE_WEIGHT_BITS), VEC_SRA(acc3, GD_SCALE_WEIGHT_BITS));
+	return VEC_MIN8U(VEC_PACKUS16(lo, hi), alphaMax);
+}
+
+/* One pixel per iteration, with its source pixels in the first lane */
+static VEC_TARGET void VEC_FN(gdScaleRow) (int *dst, const int *src, unsigned int dst_len,
+                                           const ContributionType *contrib)
+{
+	const veci zero = VEC_SET1(0);
+	const veci round = VEC_SET1(1 << (GD_SCALE_WEIGHT_BITS - 1));
+	unsigned int x;
+
+	for (x = 0; x < dst_len; x++) {
+		const int *p = src + contrib[x].Left;
+		const int *w = contrib[x].Weights;
+		const int n = contrib[x].Right - contrib[x].Left + 1;
+		veci accHi = zero, accLo = round, px, acc;
+		int k;
+
+		for (k = 0; k + 1 < n; k += 2) {
+			px = VEC_UNPACKLO8(VEC_UNPACKLO8(VEC_LOAD1(p[k]), VEC_LOAD1(p[k + 1])), zero);
+			accHi = VEC_ADD(accHi, VEC_MADD16(px, GD_SCALE_PAIR_HI(w[k], w[k + 1])));
+			accLo = VEC_ADD(accLo, VEC_MADD16(px, GD_SCALE_PAIR_LO(w[k], w[k + 1])));
+		}
+		if (k < n) {
+			px = VEC_UNPACKLO8(VEC_UNPACKLO8(VEC_LOAD1(p[k]), zero), zero);
+			accHi = VEC_ADD(accHi, VEC_MADD16(px, GD_SCALE_PAIR_HI(w[k], 0)));
+			accLo = VEC_ADD(accLo, VEC_MADD16(px, GD_SCALE_PAIR_LO(w[k], 0)));
+		}
+		acc = GD_SCALE_SUM(accHi, accLo);
+		dst[x] = VEC_GET0(VEC_FN(gdScalePack) (acc, acc, acc, acc));
+	}
+}
+
+/* VEC_WIDTH pixels per iteration, down the n rows */
+static VEC_TARGET void VEC_FN(gdScaleCol) (int *dst, int * const *rows, const int *w,
+                                           int n, int len)
+{
+	const veci zero = VEC_SET1(0);
+	const veci round = VEC_SET1(1 << (GD_SCALE_WEIGHT_BITS - 1));
+	int x, k;
+
+	for (x = 0; x + VEC_WIDTH <= len; x += VEC_WIDTH) {
+		veci hi0 = zero, hi1 = zero, hi2 = zero, hi3 = zero;
+		veci lo0 = round, lo1 = round, lo2 = round, lo3 = round;
+		veci pairHi, pairLo, a, b, lo, hi, px;
+
+		for (k = 0; k < n; k += 2) {
+			a = VEC_LOAD(rows[k] + x);
+			if (k + 1 < n) {
+				b = VEC_LOAD(rows[k + 1] + x);
+				pairHi = GD_SCALE_PAIR_HI(w[k], w[k + 1]);
+				pairLo = GD_SCALE_PAIR_LO(w[k], w[k + 1]);
+			} else {
+				b = zero;
+				pairHi = GD_SCALE_PAIR_HI(w[k], 0);
+				pairLo = GD_SCALE_PAIR_LO(w[k], 0);
+			}
+			lo = VEC_UNPACKLO8(a, b);
+			hi = VEC_UNPACKHI8(a, b);
+			px = VEC_UNPACKLO8(lo, zero);
+			hi0 = VEC_ADD(hi0, VEC_MADD16(px, pairHi));
+			lo0 = VEC_ADD(lo0, VEC_MADD16(px, pairLo));
+			px = VEC_UNPACKHI8(lo, zero);
+			hi1 = VEC_ADD(hi1, VEC_MADD16(px, pairHi));
+			lo1 = VEC_ADD(lo1, VEC_MADD16(px, pairLo));
+			px = VEC_UNPACKLO8(hi, zero);
+			hi2 = VEC_ADD(hi2, VEC_MADD16(px, pairHi));
+			lo2 = VEC_ADD(lo2, VEC_MADD16(px, pairLo));
+			px = VEC_UNPACKHI8(hi, zero);
+			hi3 = VEC_ADD(hi3, VEC_MADD16(px, pairHi));
+			lo3 = VEC_ADD(lo3, VEC_MADD16(px, pairLo));
+		}
+		VEC_STORE(dst + x, VEC_FN(gdScalePack) (GD_SCALE_SUM(hi0, lo0), GD_SCALE_SUM(hi1, lo1),
+		                                        GD_SCALE_SUM(hi2, lo2), GD_SCALE_SUM(hi3, lo3)));
+	}
+	for (; x < len; x++) {
+		dst[x] = gdScaleColPixel(rows, w, n, x);
+	}
+}
+
+#undef GD_SCALE_SUM
+#undef GD_SCALE_PAIR_LO
+#undef GD_SCALE_PAIR_HI
+#undef GD_SCALE_PAIR
+#undef GD_SCALE_LOW_BITS
@@ -0,0 +1,284 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "gd.h"
+#include "gdhelpers.h"
+#include "gd_intern.h"
+
+/**
+ * Title: Worker Threads
+ *
+ * <gdImageScale>, <gdImageRotateInterpolated> and <gdTransformAffineCopy>
+ * compute every row of their result independently of the others. They
+ * can split the rows between several threads, which pays off for large
+ * images. This is off by default; <gdSetThreadCount> enables it for all
+ * images, <gdImageSetThreadCount> for the operations reading from one
+ * image.
+ *
+ * Each thread gets a fixed range of rows, computed exactly as in a single
+ * thread, so the results do not depend on the number of threads. The
+ * threads are kept in a pool shared by all threads of the application;
+ * while one operation uses the pool, others run in the thread calling
+ * them. Setting the number of threads back to 1 ends the threads of the
+ * pool.
+ */
+
+#define GD_THREADS_MAX 64
+
+/* condition variables going with the mutexes of gdStaticMutexDeclare() */
+#if defined(CPP_SHARP)
+#elif defined(_WIN32)
+# define GD_THREADS_POOL 1
+# define gdCondDeclare(x) static CONDITION_VARIABLE x = CONDITION_VARIABLE_INIT
+# define gdCondWait(x, m) SleepConditionVariableSRW(&x, &m, INFINITE, 0)
+# define gdCondBroadcast(x) WakeAllConditionVariable(&x)
+#elif defined(HAVE_PTHREAD)
+# define GD_THREADS_POOL 1
+# define gdCondDeclare(x) static pthread_cond_t x = PTHREAD_COND_INITIALIZER
+# define gdCondWait(x, m) pthread_cond_wait(&x, &m)
+# define gdCondBroadcast(x) pthread_cond_broadcast(&x)
+#endif
+
+/* set by gdSetThreadCount() and read by any thread, atomically */
+static volatile long gd_threads = 1;
+
+#ifdef GD_THREADS_POOL
+
+gdStaticMutexDeclare(gd_threads_mutex);
+/* signals a new job or the stop to the workers, and the end of a job or
+   of a worker to the threads waiting for it */
+gdCondDeclare(gd_threads_work);
+gdCondDeclare(gd_threads_done);
+/* the workers started, and of those the ones still running */
+#ifdef _WIN32
+static HANDLE gd_threads_handles[GD_THREADS_MAX];
+#else
+static pthread_t gd_threads_handles[GD_THREADS_MAX];
+#endif
+static int gd_threads_workers = 0;
+static int gd_threads_running = 0;
+/* set while the workers are being stopped; one thread at a time stops
+   them */
+static int gd_threads_stop = 0;
+gdStaticMutexDeclare(gd_threads_stop_mutex);
+
+/* the job being run, split into parts of which the next one to run is
+   next, and of which done are finished */
+static int gd_job_active = 0;
+static gdRowsFunc gd_job_fn;
+static void *gd_job_arg;
+static int gd_job_rows;
+static int gd_job_parts = 0;
+static int gd_job_next = 0;
+static int gd_job_done = 0;
+static int gd_job_failed;
+
+/* Runs the parts of the current job until none is left to start; the
+   pool must be locked */
+static void gdThreadsRunParts(void)
+{
+	while (gd_job_next < gd_job_parts) {
+		const int part = gd_job_next++;
+		const int start = (int) ((long long) gd_job_rows * part / gd_job_parts);
+		const int end = (int) ((long long) gd_job_rows * (part + 1) / gd_job_parts);
+		int ok;
+
+		gdStaticMutexUnlock(gd_threads_mutex);
+		ok = gd_job_fn(gd_job_arg, start, end);
+		gdStaticMutexLock(gd_threads_mutex);
+		if (!ok) {
+			gd_job_failed = 1;
+		}
+		if (++gd_job_done == gd_job_parts) {
+			gdCondBroadcast(gd_threads_done);
+		}
+	}
+}
+
+#ifdef _WIN32
+static DWORD WINAPI gdThreadsWorker(LPVOID unused)
+#else
+static void *gdThreadsWorker(void *unused)
+#endif
+{
+	(void) unused;
+	gdStaticMutexLock(gd_threads_mutex);
+	for (;;) {
+		while (!gd_threads_stop && gd_job_next >= gd_job_parts) {
+			gdCondWait(gd_threads_work, gd_threads_mutex);
+		}
+		if (gd_threads_stop) {
+			break;
+		}
+		gdThreadsRunParts();
+	}
+	gd_threads_running--;
+	gdCondBroadcast(gd_threads_done);
+	gdStaticMutexUnlock(gd_threads_mutex);
+	return 0;
+}
+
+/* Starts workers until there are n; the pool must be locked */
+static void gdThreadsStart(int n)
+{
+	if (gd_threads_stop) {
+		return;
+	}
+	while (gd_threads_workers < n) {
+#ifdef _WIN32
+		HANDLE thread = CreateThread(NULL, 0, gdThreadsWorker, NULL, 0, NULL);
+
+		if (thread == NULL) {
+			return;
+		}
+#else
+		pthread_t thread;
+
+		if (pthread_create(&thread, NULL, gdThreadsWorker, NULL) != 0) {
+			return;
+		}
+#endif
+		gd_threads_handles[gd_threads_workers++] = thread;
+		gd_threads_running++;
+	}
+}
+
+/* Ends all workers and waits for them. A job in progress is finished by
+   the thread which started it. */
+static void gdThreadsStopAll(void)
+{
+	int i, n;
+
+	gdStaticMutexLock(gd_threads_stop_mutex);
+	gdStaticMutexLock(gd_threads_mutex);
+	gd_threads_stop = 1;
+	gdCondBroadcast(gd_threads_work);
+	while (gd_threads_running > 0) {
+		gdCondWait(gd_threads_done, gd_threads_mutex);
+	}
+	n = gd_threads_workers;
+	gd_threads_workers = 0;
+	gd_threads_stop = 0;
+	gdStaticMutexUnlock(gd_threads_mutex);
+
+	for (i = 0; i < n; i++) {
+#ifdef _WIN32
+		WaitForSingleObject(gd_threads_handles[i], INFINITE);
+		CloseHandle(gd_threads_handles[i]);
+#else
+		pthread_join(gd_threads_handles[i], NULL);
+#endif
+	}
+	gdStaticMutexUnlock(gd_threads_stop_mutex);
+}
+
+#endif /* GD_THREADS_POOL */
+
+/* The number of threads for the operations reading from im */
+int _gdImageThreads(gdImagePtr im)
+{
+	return im->threads > 0 ? im->threads : (int) gdAtomicGet(gd_threads);
+}
+
+/* Runs fn over the rows 0 to n - 1, split into up to threads consecutive
+   ranges which are run in parallel. Returns 0 if fn failed for any range. */
+int _gdParallelRows(int threads, int n, gdRowsFunc fn, void *arg)
+{
+#ifdef GD_THREADS_POOL
+	int failed;
+
+	threads = MIN(MIN(threads, n), GD_THREADS_MAX);
+	if (threads <= 1) {
+		return n <= 0 || fn(arg, 0, n);
+	}
+
+	gdStaticMutexLock(gd_threads_mutex);
+	if (gd_job_active) {
+		gdStaticMutexUnlock(gd_threads_mutex);
+		return fn(arg, 0, n);
+	}
+	gd_job_active = 1;
+	/* the calling thread runs parts as well, so the job also finishes
+	   if not all workers could be started */
+	gdThreadsStart(threads - 1);
+	gd_job_fn = fn;
+	gd_job_arg = arg;
+	gd_job_rows = n;
+	gd_job_parts = threads;
+	gd_job_next = 0;
+	gd_job_done = 0;
+	gd_job_failed = 0;
+	gdCondBroadcast(gd_threads_work);
+
+	gdThreadsRunParts();
+	while (gd_job_done < gd_job_parts) {
+		gdCondWait(gd_threads_done, gd_threads_mutex);
+	}
+	failed = gd_job_failed;
+	gd_job_active = 0;
+	gdStaticMutexUnlock(gd_threads_mutex);
+	return !failed;
+#else
+	(void) threads;
+	return n <= 0 || fn(arg, 0, n);
+#endif
+}
+
+/**
+ * Function: gdSetThreadCount
+ *
+ * Sets the number of threads operations on images use by default
+ *
+ * The threads are started when first needed. Setting the number back to
+ * 1 ends them and waits for them, for instance before libgd is unloaded;
+ * images with a number of their own set by <gdImageSetThreadCount> start
+ * them again. Without thread support, operations always run in the
+ * calling thread.
+ *
+ * Parameters:
+ *   threads - The number of threads, at most 64. 1, the default, runs
+ *             operations in the calling thread only.
+ *
+ * See also:
+ *   - <gdImageSetThreadCount>
+ */
+BGD_DECLARE(void) gdSetThreadCount(int threads)
+{
+	threads = CLAMP(threads, 1, GD_THREADS_MAX);
+	gdAtomicSet(gd_threads, threads);
+#ifdef GD_THREADS_POOL
+	if (threads == 1) {
+		gdThreadsStopAll();
+	}
+#endif
+}
+
+/**
+ * Function: gdGetThreadCount
+ *
+ * Returns the number of threads set by <gdSetThreadCount>
+ */
+BGD_DECLARE(int) gdGetThreadCount(void)
+{
+	return (int) gdAtomicGet(gd_threads);
+}
+
+/**
+ * Function: gdImageSetThreadCount
+ *
+ * Sets the number of threads for the operations reading from an image
+ *
+ * These are <gdImageScale>, <gdImageRotateInterpolated> and
+ * <gdTransformAffineCopy> with the image as source. The setting is
+ * copied by <gdImageClone>.
+ *
+ * Parameters:
+ *   im      - The image.
+ *   threads - The number of threads, at most 64. 0, the default, uses the
+ *             number set by <gdSetThreadCount>.
+ */
+BGD_DECLARE(void) gdImageSetThreadCount(gdImagePtr im, int threads)
+{
+	im->threads = CLAMP(threads, 0, GD_THREADS_MAX);
+}
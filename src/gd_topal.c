@@ -47,6 +47,7 @@
 #include <string.h>
 #include "gd.h"
 #include "gdhelpers.h"
+#include "gd_intern.h"
 
 #ifdef HAVE_LIBIMAGEQUANT
 #include <libimagequant.h>
@@ -1513,14 +1514,9 @@ static void convert_gdpixel_to_rgba(liq_color output_row[], int y, int width, vo
 
 static void free_truecolor_image_data(gdImagePtr oim)
 {
-	int i;
 	oim->trueColor = 0;
 	/* Junk the truecolor pixels */
-	for (i = 0; i < oim->sy; i++) {
-		gdFree (oim->tpixels[i]);
-	}
-	gdFree (oim->tpixels);
-	oim->tpixels = 0;
+	_gdImageFreeRows (oim, 1);
 }
 
 #ifdef HAVE_LIBIMAGEQUANT
@@ -1574,17 +1570,10 @@ static int gdImageTrueColorToPaletteBody (gdImagePtr oim, int dither, int colors
 		colorsWanted = maxColors;
 	}
 	if (!cimP) {
-		nim->pixels = gdCalloc (sizeof (unsigned char *), oim->sy);
-		if (!nim->pixels) {
+		if (!_gdImageAllocRows (nim, 0)) {
 			/* No can do */
 			goto outOfMemory;
 		}
-		for (i = 0; (i < nim->sy); i++) {
-			nim->pixels[i] = (unsigned char *) gdCalloc (sizeof (unsigned char), oim->sx);
-			if (!nim->pixels[i]) {
-				goto outOfMemory;
-			}
-		}
 	}
 
 
@@ -1763,15 +1752,7 @@ outOfMemory:
 	if (oim->trueColor) {
 		if (!cimP) {
 			/* On failure only */
-			if (nim->pixels) {
-				for (i = 0; i < nim->sy; i++) {
-					if (nim->pixels[i]) {
-						gdFree (nim->pixels[i]);
-					}
-				}
-				gdFree (nim->pixels);
-			}
-			nim->pixels = NULL;
+			_gdImageFreeRows (nim, 0);
 		} else {
 			gdImageDestroy(nim);
 			*cimP = 0;
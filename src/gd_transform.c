@@ -8,6 +8,7 @@
 #endif /* HAVE_CONFIG_H */
 
 #include "gd.h"
+#include "gd_intern.h"
 
 /**
  * Function: gdImageFlipVertical
@@ -27,6 +28,9 @@ BGD_DECLARE(void) gdImageFlipVertical(gdImagePtr im)
 {
 	register int x, y;
 
+	if (!gdImageUnshare(im)) {
+		return;
+	}
 	if (im->trueColor) {
 		for (y = 0; y < im->sy / 2; y++) {
 			int *row_dst = im->tpixels[y];
@@ -70,6 +74,9 @@ BGD_DECLARE(void) gdImageFlipHorizontal(gdImagePtr im)
 
 	int x, y;
 
+	if (!gdImageUnshare(im)) {
+		return;
+	}
 	if (im->trueColor) {
 		int *px1, *px2, tmp;
 
@@ -0,0 +1,200 @@
+/* Internal header: thin wrappers around the SIMD intrinsics used by the
+   vectorized kernels of libgd.
+
+   A kernel file includes this header once per instruction set, with
+   GD_VEC_SSE2, GD_VEC_AVX2 or GD_VEC_NEON defined, followed by the
+   kernels written in terms of the VEC_* macros below. Those work on
+   VEC_WIDTH lanes of 32 bit integers (veci) or floats (vecf), except for
+   the *8 and *16 variants treating a veci as bytes or shorts, with the
+   packing ones narrowing from the given size, and VEC_ANY() telling
+   whether any bit of a veci is set. Like their SSE2 counterparts, the
+   unpacking and packing macros work on each 128 bit half of an AVX2
+   vector separately; VEC_LOAD1() and VEC_GET0() set and get the first
+   lane. Functions are to be declared VEC_TARGET and named with VEC_FN()
+   so that the versions for several instruction sets can live in one
+   file.
+
+   Which instruction sets the compiler supports is told by the
+   GD_VEC_HAVE_* macros; whether the CPU running the code supports them
+   by _gdCpuFeatures(). */
+
+#ifndef GD_VEC_H
+#define GD_VEC_H
+
+/* SSE2 is part of x86-64, so it needs no runtime check. AVX2 is only
+   built with compilers that allow enabling it per function. The NEON
+   kernels need vdivq_f32(), which is only part of AArch64. */
+#if defined(__x86_64__) || defined(_M_X64)
+# define GD_VEC_HAVE_SSE2 1
+# include <emmintrin.h>
+# if (defined(__GNUC__) && __GNUC__ >= 5) || (defined(__clang__) && __clang_major__ >= 4)
+#  define GD_VEC_HAVE_AVX2 1
+#  include <immintrin.h>
+# endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+# define GD_VEC_HAVE_NEON 1
+# include <arm_neon.h>
+#endif
+
+#endif /* GD_VEC_H */
+
+#undef VEC_WIDTH
+#undef VEC_TARGET
+#undef VEC_FN
+#undef veci
+#undef vecf
+#undef VEC_LOAD
+#undef VEC_STORE
+#undef VEC_SET1
+#undef VEC_SET1F
+#undef VEC_SET1_8
+#undef VEC_AND
+#undef VEC_OR
+#undef VEC_XOR
+#undef VEC_ANY
+#undef VEC_ADD
+#undef VEC_SUB
+#undef VEC_SRL
+#undef VEC_SLL
+#undef VEC_EQ
+#undef VEC_GT
+#undef VEC_EQ8
+#undef VEC_SELECT
+#undef VEC_TOF
+#undef VEC_TOI
+#undef VEC_ADDF
+#undef VEC_SUBF
+#undef VEC_MULF
+#undef VEC_DIVF
+#undef VEC_LOAD1
+#undef VEC_GET0
+#undef VEC_SRA
+#undef VEC_UNPACKLO8
+#undef VEC_UNPACKHI8
+#undef VEC_MADD16
+#undef VEC_PACKS32
+#undef VEC_PACKUS16
+#undef VEC_MIN8U
+
+#if defined(GD_VEC_AVX2)
+
+# define VEC_WIDTH 8
+# define VEC_TARGET __attribute__((target("avx2")))
+# define VEC_FN(name) name##Avx2
+# define veci __m256i
+# define vecf __m256
+# define VEC_LOAD(p) _mm256_loadu_si256((const __m256i *) (p))
+# define VEC_STORE(p, v) _mm256_storeu_si256((__m256i *) (p), (v))
+# define VEC_SET1(x) _mm256_set1_epi32(x)
+# define VEC_SET1F(x) _mm256_set1_ps(x)
+# define VEC_SET1_8(x) _mm256_set1_epi8(x)
+# define VEC_AND(a, b) _mm256_and_si256((a), (b))
+# define VEC_OR(a, b) _mm256_or_si256((a), (b))
+# define VEC_XOR(a, b) _mm256_xor_si256((a), (b))
+# define VEC_ANY(v) (!_mm256_testz_si256((v), (v)))
+# define VEC_ADD(a, b) _mm256_add_epi32((a), (b))
+# define VEC_SUB(a, b) _mm256_sub_epi32((a), (b))
+# define VEC_SRL(v, n) _mm256_srli_epi32((v), (n))
+# define VEC_SLL(v, n) _mm256_slli_epi32((v), (n))
+# define VEC_EQ(a, b) _mm256_cmpeq_epi32((a), (b))
+# define VEC_GT(a, b) _mm256_cmpgt_epi32((a), (b))
+# define VEC_EQ8(a, b) _mm256_cmpeq_epi8((a), (b))
+# define VEC_SELECT(m, a, b) _mm256_blendv_epi8((b), (a), (m))
+# define VEC_TOF(v) _mm256_cvtepi32_ps(v)
+# define VEC_TOI(v) _mm256_cvttps_epi32(v)
+# define VEC_ADDF(a, b) _mm256_add_ps((a), (b))
+# define VEC_SUBF(a, b) _mm256_sub_ps((a), (b))
+# define VEC_MULF(a, b) _mm256_mul_ps((a), (b))
+# define VEC_DIVF(a, b) _mm256_div_ps((a), (b))
+# define VEC_LOAD1(x) _mm256_castsi128_si256(_mm_cvtsi32_si128(x))
+# define VEC_GET0(v) _mm_cvtsi128_si32(_mm256_castsi256_si128(v))
+# define VEC_SRA(v, n) _mm256_srai_epi32((v), (n))
+# define VEC_UNPACKLO8(a, b) _mm256_unpacklo_epi8((a), (b))
+# define VEC_UNPACKHI8(a, b) _mm256_unpackhi_epi8((a), (b))
+# define VEC_MADD16(a, b) _mm256_madd_epi16((a), (b))
+# define VEC_PACKS32(a, b) _mm256_packs_epi32((a), (b))
+# define VEC_PACKUS16(a, b) _mm256_packus_epi16((a), (b))
+# define VEC_MIN8U(a, b) _mm256_min_epu8((a), (b))
+
+#elif defined(GD_VEC_SSE2)
+
+# define VEC_WIDTH 4
+# define VEC_TARGET
+# define VEC_FN(name) name##Sse2
+# define veci __m128i
+# define vecf __m128
+# define VEC_LOAD(p) _mm_loadu_si128((const __m128i *) (p))
+# define VEC_STORE(p, v) _mm_storeu_si128((__m128i *) (p), (v))
+# define VEC_SET1(x) _mm_set1_epi32(x)
+# define VEC_SET1F(x) _mm_set1_ps(x)
+# define VEC_SET1_8(x) _mm_set1_epi8(x)
+# define VEC_AND(a, b) _mm_and_si128((a), (b))
+# define VEC_OR(a, b) _mm_or_si128((a), (b))
+# define VEC_XOR(a, b) _mm_xor_si128((a), (b))
+# define VEC_ANY(v) (_mm_movemask_epi8(_mm_cmpeq_epi8((v), _mm_setzero_si128())) != 0xFFFF)
+# define VEC_ADD(a, b) _mm_add_epi32((a), (b))
+# define VEC_SUB(a, b) _mm_sub_epi32((a), (b))
+# define VEC_SRL(v, n) _mm_srli_epi32((v), (n))
+# define VEC_SLL(v, n) _mm_slli_epi32((v), (n))
+# define VEC_EQ(a, b) _mm_cmpeq_epi32((a), (b))
+# define VEC_GT(a, b) _mm_cmpgt_epi32((a), (b))
+# define VEC_EQ8(a, b) _mm_cmpeq_epi8((a), (b))
+# define VEC_SELECT(m, a, b) _mm_or_si128(_mm_and_si128((m), (a)), _mm_andnot_si128((m), (b)))
+# define VEC_TOF(v) _mm_cvtepi32_ps(v)
+# define VEC_TOI(v) _mm_cvttps_epi32(v)
+# define VEC_ADDF(a, b) _mm_add_ps((a), (b))
+# define VEC_SUBF(a, b) _mm_sub_ps((a), (b))
+# define VEC_MULF(a, b) _mm_mul_ps((a), (b))
+# define VEC_DIVF(a, b) _mm_div_ps((a), (b))
+# define VEC_LOAD1(x) _mm_cvtsi32_si128(x)
+# define VEC_GET0(v) _mm_cvtsi128_si32(v)
+# define VEC_SRA(v, n) _mm_srai_epi32((v), (n))
+# define VEC_UNPACKLO8(a, b) _mm_unpacklo_epi8((a), (b))
+# define VEC_UNPACKHI8(a, b) _mm_unpackhi_epi8((a), (b))
+# define VEC_MADD16(a, b) _mm_madd_epi16((a), (b))
+# define VEC_PACKS32(a, b) _mm_packs_epi32((a), (b))
+# define VEC_PACKUS16(a, b) _mm_packus_epi16((a), (b))
+# define VEC_MIN8U(a, b) _mm_min_epu8((a), (b))
+
+#elif defined(GD_VEC_NEON)
+
+# define VEC_WIDTH 4
+# define VEC_TARGET
+# define VEC_FN(name) name##Neon
+# define veci int32x4_t
+# define vecf float32x4_t
+# define VEC_LOAD(p) vld1q_s32((const int32_t *) (p))
+# define VEC_STORE(p, v) vst1q_s32((int32_t *) (p), (v))
+# define VEC_SET1(x) vdupq_n_s32(x)
+# define VEC_SET1F(x) vdupq_n_f32(x)
+# define VEC_SET1_8(x) vreinterpretq_s32_u8(vdupq_n_u8(x))
+# define VEC_AND(a, b) vandq_s32((a), (b))
+# define VEC_OR(a, b) vorrq_s32((a), (b))
+# define VEC_XOR(a, b) veorq_s32((a), (b))
+# define VEC_ANY(v) (vmaxvq_u32(vreinterpretq_u32_s32(v)) != 0)
+# define VEC_ADD(a, b) vaddq_s32((a), (b))
+# define VEC_SUB(a, b) vsubq_s32((a), (b))
+# define VEC_SRL(v, n) vreinterpretq_s32_u32(vshrq_n_u32(vreinterpretq_u32_s32(v), (n)))
+# define VEC_SLL(v, n) vshlq_n_s32((v), (n))
+# define VEC_EQ(a, b) vreinterpretq_s32_u32(vceqq_s32((a), (b)))
+# define VEC_GT(a, b) vreinterpretq_s32_u32(vcgtq_s32((a), (b)))
+# define VEC_EQ8(a, b) vreinterpretq_s32_u8(vceqq_u8(vreinterpretq_u8_s32(a), vreinterpretq_u8_s32(b)))
+# define VEC_SELECT(m, a, b) vbslq_s32(vreinterpretq_u32_s32(m), (a), (b))
+# define VEC_TOF(v) vcvtq_f32_s32(v)
+# define VEC_TOI(v) vcvtq_s32_f32(v)
+# define VEC_ADDF(a, b) vaddq_f32((a), (b))
+# define VEC_SUBF(a, b) vsubq_f32((a), (b))
+# define VEC_MULF(a, b) vmulq_f32((a), (b))
+# define VEC_DIVF(a, b) vdivq_f32((a), (b))
+# define VEC_LOAD1(x) vsetq_lane_s32((x), vdupq_n_s32(0), 0)
+# define VEC_GET0(v) vgetq_lane_s32((v), 0)
+# define VEC_SRA(v, n) vshrq_n_s32((v), (n))
+# define VEC_UNPACKLO8(a, b) vreinterpretq_s32_u8(vzip1q_u8(vreinterpretq_u8_s32(a), vreinterpretq_u8_s32(b)))
+# define VEC_UNPACKHI8(a, b) vreinterpretq_s32_u8(vzip2q_u8(vreinterpretq_u8_s32(a), vreinterpretq_u8_s32(b)))
+# define VEC_MADD16(a, b) vpaddq_s32(vmull_s16(vget_low_s16(vreinterpretq_s16_s32(a)), vget_low_s16(vreinterpretq_s16_s32(b))), \
+                                    vmull_high_s16(vreinterpretq_s16_s32(a), vreinterpretq_s16_s32(b)))
+# define VEC_PACKS32(a, b) vreinterpretq_s32_s16(vcombine_s16(vqmovn_s32(a), vqmovn_s32(b)))
+# define VEC_PACKUS16(a, b) vreinterpretq_s32_u8(vcombine_u8(vqmovun_s16(vreinterpretq_s16_s32(a)), vqmovun_s16(vreinterpretq_s16_s32(b))))
+# define VEC_MIN8U(a, b) vreinterpretq_s32_u8(vminq_u8(vreinterpretq_u8_s32(a), vreinterpretq_u8_s32(b)))
+
+#endif
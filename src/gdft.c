@@ -595,7 +595,7 @@ fontFetch (char **error, void *key)
 	if (*error || !a->fontpath || !a->fontpath[0]) {
 		gdFree(a->fontlist);
 		if (a->fontpath)
-			free(a->fontpath);
+			gdFree(a->fontpath);
 		gdFree(a);
 
 		if (!*error)
@@ -617,7 +617,7 @@ fontFetch (char **error, void *key)
 
 	if (err) {
 		gdFree (a->fontlist);
-		free(a->fontpath);
+		gdFree(a->fontpath);
 		gdFree(a);
 		*error = "Could not read font";
 		return NULL;
@@ -722,6 +722,29 @@ tweenColorRelease (void *element)
 	gdFree ((char *) element);
 }
 
+/* Blends the len glyph pixels in span onto row y of im, starting at x;
+   the same as gdAlphaBlend() for each pixel, except that fully
+   transparent pixels of the image simply take the glyph color */
+static int
+gdft_blend_span (gdImage * im, int y, int x, int *span, int len)
+{
+	int *tpixel;
+	int i;
+
+	if (!gdImageRowWritable (im, y))
+		return 0;
+	tpixel = &im->tpixels[y][x];
+	for (i = 0; i < len; i++) {
+		if (gdTrueColorGetAlpha (tpixel[i]) == gdAlphaTransparent) {
+			tpixel[i] = span[i];
+			/* leaves the pixel as it is */
+			span[i] = gdAlphaTransparent << 24;
+		}
+	}
+	_gdAlphaBlendSpan (tpixel, span, len);
+	return 1;
+}
+
 /* draw_bitmap - transfers glyph bitmap to GD image */
 static char *
 gdft_draw_bitmap (gdCache_head_t * tc_cache, gdImage * im, int fg,
@@ -740,6 +763,15 @@ gdft_draw_bitmap (gdCache_head_t * tc_cache, gdImage * im, int fg,
 	tc_key.im = im;
 	/* Truecolor version; does not require the cache */
 	if (im->trueColor) {
+		/* runs of glyph pixels to be alpha blended are collected in span
+		   and blended in one go; without it, each pixel is blended on its
+		   own */
+		int *span = NULL;
+		int spanX = 0, spanLen = 0;
+
+		if (fg >= 0 && im->alphaBlendingFlag && bitmap.width > 0) {
+			span = (int *) gdMalloc (sizeof (int) * bitmap.width);
+		}
 		for (row = 0; row < bitmap.rows; row++) {
 			pc = row * bitmap.pitch;
 			pcr = pc;
@@ -765,10 +797,22 @@ gdft_draw_bitmap (gdCache_head_t * tc_cache, gdImage * im, int fg,
 					             pcr]) & (1 << (~col & 0x07))) ?
 					    gdAlphaTransparent : gdAlphaOpaque;
 				} else {
+					gdFree (span);
 					return "Unsupported ft_pixel_mode";
 				}
-				if (level == 0)  /* if background */
+				x = pen_x + col;
+				/* 2.0.16: clip to clipping rectangle, Matt McNabb */
+				if (level == 0 || (x > im->cx2) || (x < im->cx1)) {
+					/* background or out of bounds, ends the run */
+					if (spanLen) {
+						if (!gdft_blend_span (im, y, spanX, span, spanLen)) {
+							gdFree (span);
+							return "Problem allocating memory";
+						}
+						spanLen = 0;
+					}
 					continue;
+				}
 
 				if ((fg >= 0) && (im->trueColor)) {
 					/* Consider alpha in the foreground color itself to be an
@@ -780,12 +824,15 @@ gdft_draw_bitmap (gdCache_head_t * tc_cache, gdImage * im, int fg,
 					             gdTrueColorGetAlpha (fg)) / gdAlphaMax;
 				}
 				level = gdAlphaMax - level;   /* inverting to get alpha */
-				x = pen_x + col;
-				/* clip if out of bounds */
-				/* 2.0.16: clip to clipping rectangle, Matt McNabb */
-				if ((x > im->cx2) || (x < im->cx1))
+				if (span) {
+					if (!spanLen)
+						spanX = x;
+					span[spanLen++] = (level << 24) + (fg & 0xFFFFFF);
 					continue;
+				}
 				/* get pixel location in gd buffer */
+				if (!gdImageRowWritable (im, y))
+					return "Problem allocating memory";
 				tpixel = &im->tpixels[y][x];
 				if (fg < 0) {
 					if (level < (gdAlphaMax / 2)) {
@@ -805,7 +852,15 @@ gdft_draw_bitmap (gdCache_head_t * tc_cache, gdImage * im, int fg,
 					}
 				}
 			}
+			if (spanLen) {
+				if (!gdft_blend_span (im, y, spanX, span, spanLen)) {
+					gdFree (span);
+					return "Problem allocating memory";
+				}
+				spanLen = 0;
+			}
 		}
+		gdFree (span);
 		return (char *) NULL;
 	}
 	/* Non-truecolor case, restored to its more or less original form */
@@ -850,6 +905,8 @@ gdft_draw_bitmap (gdCache_head_t * tc_cache, gdImage * im, int fg,
 			if (x > im->cx2 || x < im->cx1)
 				continue;
 			/* get pixel location in gd buffer */
+			if (!gdImageRowWritable (im, y))
+				return "Problem allocating memory";
 			pixel = &im->pixels[y][x];
 			if (tc_key.pixel == GD_NUMCOLORS) {
 				/* use fg color directly. gd 2.0.2: watch out for
@@ -944,6 +1001,8 @@ BGD_DECLARE(char *) gdImageStringFT (gdImage * im, int *brect, int fg, const cha
  */
 BGD_DECLARE(int) gdFontCacheSetup (void)
 {
+	gdArenaPtr arena;
+
 	if (fontCache) {
 		/* Already set up */
 		return 0;
@@ -953,7 +1012,10 @@ BGD_DECLARE(int) gdFontCacheSetup (void)
 		gdMutexShutdown (gdFontCacheMutex);
 		return -1;
 	}
+	/* 2.3.2: the cache outlives an arena bound to this thread */
+	arena = gdArenaUse (NULL);
 	fontCache = gdCacheCreate (FONTCACHESIZE, fontTest, fontFetch, fontRelease);
+	gdArenaUse (arena);
 	if (!fontCache) {
 		return -2;
 	}
@@ -1108,6 +1170,7 @@ BGD_DECLARE(char *) gdImageStringFTEx (gdImage * im, int *brect, int fg, const c
 	int  i, ch;
 	font_t *font;
 	fontkey_t fontkey;
+	gdArenaPtr arena;
 	const char *next;
 	char *tmpstr = 0;
 	uint32_t *text;
@@ -1160,7 +1223,10 @@ BGD_DECLARE(char *) gdImageStringFTEx (gdImage * im, int *brect, int fg, const c
 	else
 		fontkey.flags = 0;
 	fontkey.library = &library;
+	/* fonts loaded into the cache outlive an arena as well */
+	arena = gdArenaUse (NULL);
 	font = (font_t *) gdCacheGet (fontCache, &fontkey);
+	gdArenaUse (arena);
 	if (!font) {
 		gdCacheDelete (tc_cache);
 		gdMutexUnlock (gdFontCacheMutex);
@@ -19,13 +19,17 @@ extern "C" {
 	/* These functions wrap memory management. gdFree is
 		in gd.h, where callers can utilize it to correctly
 		free memory allocated by these functions with the
-		right version of free(). */
+		right version of free(). They live in gd_memory.c
+		and honour gdSetMemoryMethods() and gdArenaUse(). */
 	void *gdCalloc (size_t nmemb, size_t size);
 	void *gdMalloc (size_t size);
 	void *gdRealloc (void *ptr, size_t size);
 	/* The extended version of gdReallocEx will free *ptr if the
 	 * realloc fails */
 	void *gdReallocEx (void *ptr, size_t size);
+	/* 2.3.2: the arena memory from these functions was allocated from,
+		NULL if it came from the allocator. */
+	struct gdArenaStruct *gdArenaOf (const void *ptr);
 
 	/* Returns nonzero if multiplying the two quantities will
 		result in integer overflow. Also returns nonzero if
@@ -64,6 +68,56 @@ extern "C" {
 # define gdMutexUnlock(x)
 #endif /* _WIN32 || HAVE_PTHREAD */
 
+	/* 2.3.2: mutexes with static storage, initialized at compile time so
+		that they need no setup which several threads could race for. */
+#if defined(CPP_SHARP)
+# define gdStaticMutexDeclare(x)
+# define gdStaticMutexLock(x)
+# define gdStaticMutexUnlock(x)
+#elif defined(_WIN32)
+# define gdStaticMutexDeclare(x) static SRWLOCK x = SRWLOCK_INIT
+# define gdStaticMutexLock(x) AcquireSRWLockExclusive(&x)
+# define gdStaticMutexUnlock(x) ReleaseSRWLockExclusive(&x)
+#elif defined(HAVE_PTHREAD)
+# define gdStaticMutexDeclare(x) static pthread_mutex_t x = PTHREAD_MUTEX_INITIALIZER
+# define gdStaticMutexLock(x) pthread_mutex_lock(&x)
+# define gdStaticMutexUnlock(x) pthread_mutex_unlock(&x)
+#else
+# define gdStaticMutexDeclare(x)
+# define gdStaticMutexLock(x)
+# define gdStaticMutexUnlock(x)
+#endif /* _WIN32 || HAVE_PTHREAD */
+
+	/* 2.3.2: thread local storage for per-thread state. Without compiler
+		support it is left undefined, and the features needing it are
+		disabled. */
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+# define GD_THREAD_LOCAL _Thread_local
+#elif defined(_MSC_VER)
+# define GD_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__) || defined(__clang__) || defined(__SUNPRO_C)
+# define GD_THREAD_LOCAL __thread
+#endif
+
+	/* 2.3.2: atomic counters, e.g. reference counts of data shared between images
+		that may be used by different threads. */
+#if defined(_WIN32)
+# define gdAtomicIncrement(x) InterlockedIncrement(&(x))
+# define gdAtomicDecrement(x) InterlockedDecrement(&(x))
+# define gdAtomicGet(x) InterlockedCompareExchange(&(x), 0, 0)
+# define gdAtomicSet(x, v) InterlockedExchange(&(x), (v))
+#elif defined(__GNUC__) || defined(__clang__)
+# define gdAtomicIncrement(x) __sync_add_and_fetch(&(x), 1)
+# define gdAtomicDecrement(x) __sync_sub_and_fetch(&(x), 1)
+# define gdAtomicGet(x) __sync_fetch_and_add(&(x), 0)
+# define gdAtomicSet(x, v) __sync_lock_test_and_set(&(x), (v))
+#else
+# define gdAtomicIncrement(x) (++(x))
+# define gdAtomicDecrement(x) (--(x))
+# define gdAtomicGet(x) (x)
+# define gdAtomicSet(x, v) ((x) = (v))
+#endif
+
 #define DPCM2DPI(dpcm) (unsigned int)((dpcm)*2.54 + 0.5)
 #define DPM2DPI(dpm)   (unsigned int)((dpm)*0.0254 + 0.5)
 #define DPI2DPCM(dpi)  (unsigned int)((dpi)/2.54 + 0.5)
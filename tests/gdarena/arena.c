@@ -0,0 +1,59 @@
+/**
+ * Images and output buffers allocated while an arena is bound come out of
+ * the arena; its limit is enforced, and its memory may be released with
+ * gdFree()/gdImageDestroy() whether or not it is still bound.
+ */
+
+
+#include "gd.h"
+#include "gdtest.h"
+
+
+int main()
+{
+	gdArenaPtr arena, old;
+	gdImagePtr im, im2;
+	void *data;
+	int size;
+
+	arena = gdArenaCreate(0);
+	gdTestAssert(arena != NULL);
+	gdTestAssert(gdArenaGetUsage(arena) == 0);
+
+	old = gdArenaUse(arena);
+	gdTestAssert(old == NULL);
+
+	im = gdImageCreateTrueColor(300, 200);
+	gdTestAssert(im != NULL);
+	gdTestAssert(gdArenaGetUsage(arena) >= 300 * 200 * 4);
+	gdImageFilledRectangle(im, 10, 10, 100, 100, 0xff0000);
+
+	data = gdImageGifPtr(im, &size);
+	gdTestAssert(data != NULL);
+	im2 = gdImageCreateFromGifPtr(size, data);
+	gdTestAssert(im2 != NULL);
+	gdTestAssert(gdImageGetPixel(im2, 50, 50) != gdImageGetPixel(im2, 150, 150));
+	gdFree(data);
+	gdImageDestroy(im2);
+
+	/* released after the arena has been unbound */
+	gdTestAssert(gdArenaUse(NULL) == arena);
+	gdImageDestroy(im);
+
+	gdArenaReset(arena);
+	gdTestAssert(gdArenaGetUsage(arena) <= 256 * 1024);
+	gdArenaDestroy(arena);
+
+	/* a limit makes allocations beyond it fail */
+	arena = gdArenaCreate(1024 * 1024);
+	gdArenaUse(arena);
+	im = gdImageCreateTrueColor(1000, 1000);
+	gdTestAssert(im == NULL);
+	im = gdImageCreateTrueColor(100, 100);
+	gdTestAssert(im != NULL);
+	gdTestAssert(gdArenaGetUsage(arena) <= 1024 * 1024);
+	gdArenaUse(NULL);
+	gdArenaDestroy(arena);
+
+	return gdNumFailures();
+}
@@ -0,0 +1,46 @@
+/**
+ * Cloning an image (sharing its pixels) while an arena is bound puts the clone into the
+ * arena, but what the original keeps for sharing its rows stays where
+ * the original lives, so that the original survives resetting the
+ * arena.
+ */
+
+
+#include "gd.h"
+#include "gdtest.h"
+
+
+int main()
+{
+	gdImagePtr im, clone;
+	gdArenaPtr arena, old;
+	int i;
+
+	im = gdImageCreateTrueColor(64, 64);
+	gdTestAssert(im != NULL);
+	gdImageFilledRectangle(im, 0, 0, 63, 63, 0x102030);
+
+	arena = gdArenaCreate(0);
+	if (arena == NULL) {
+		/* no thread local storage */
+		gdImageDestroy(im);
+		return 0;
+	}
+	for (i = 0; i < 3; i++) {
+		old = gdArenaUse(arena);
+		clone = gdImageCloneShared(im);
+		gdTestAssert(clone != NULL);
+		gdImageSetPixel(clone, 1, 1, 0xffffff);
+		/* it refers to storage outside of the arena */
+		gdImageDestroy(clone);
+		gdArenaUse(old);
+		gdArenaReset(arena);
+
+		gdImageSetPixel(im, i, 2, 0x405060);
+		gdTestAssert(gdImageGetPixel(im, 1, 1) == 0x102030);
+	}
+	gdArenaDestroy(arena);
+
+	gdImageDestroy(im);
+	return gdNumFailures();
+}
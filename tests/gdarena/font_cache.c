@@ -0,0 +1,38 @@
+/**
+ * The font cache outlives an arena bound while drawing text, so it must
+ * not be allocated from it.
+ */
+
+
+#include <stdlib.h>
+#include "gd.h"
+#include "gdtest.h"
+
+
+int main()
+{
+	gdArenaPtr arena;
+	gdImagePtr im;
+	char *path, *error;
+
+	path = gdTestFilePath("freetype/DejaVuSans.ttf");
+	arena = gdArenaCreate(0);
+	gdArenaUse(arena);
+	im = gdImageCreateTrueColor(100, 50);
+	gdTestAssert(im != NULL);
+	error = gdImageStringFT(im, NULL, 0xffffff, path, 12, 0, 5, 30, "arena");
+	gdTestAssertMsg(error == NULL, "%s\n", error);
+	gdImageDestroy(im);
+	gdArenaUse(NULL);
+	gdArenaDestroy(arena);
+
+	/* the cache is still intact */
+	im = gdImageCreateTrueColor(100, 50);
+	error = gdImageStringFT(im, NULL, 0xffffff, path, 12, 0, 5, 30, "heap");
+	gdTestAssertMsg(error == NULL, "%s\n", error);
+	gdImageDestroy(im);
+	gdFontCacheShutdown();
+	free(path);
+
+	return gdNumFailures();
+}
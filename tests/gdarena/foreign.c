@@ -0,0 +1,37 @@
+/**
+ * Memory the caller hands over to libgd, here the buffer of a dynamic
+ * context which libgd may grow and free, becomes memory of libgd, so
+ * that what comes back can be released with gdFree().
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include "gd.h"
+#include "gdtest.h"
+
+
+int main()
+{
+	gdIOCtxPtr ctx;
+	char *data, *out;
+	char more[1000];
+	int size;
+
+	data = malloc(4);
+	gdTestAssert(data != NULL);
+	memcpy(data, "abcd", 4);
+	memset(more, 'x', sizeof(more));
+
+	ctx = gdNewDynamicCtx(4, data);
+	gdTestAssert(ctx != NULL);
+	ctx->seek(ctx, 4);
+	gdTestAssert(ctx->putBuf(ctx, more, sizeof(more)) == sizeof(more));
+	out = gdDPExtractData(ctx, &size);
+	gdTestAssert(out != NULL && size == 1004);
+	gdTestAssert(memcmp(out, "abcd", 4) == 0 && out[1003] == 'x');
+	gdFree(out);
+	ctx->gd_free(ctx);
+
+	return gdNumFailures();
+}
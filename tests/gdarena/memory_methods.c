@@ -0,0 +1,62 @@
+/**
+ * All allocations go through the methods set with gdSetMemoryMethods().
+ */
+
+
+#include <stdlib.h>
+#include "gd.h"
+#include "gdtest.h"
+
+
+static int allocated = 0;
+
+static void *countingMalloc(size_t size)
+{
+	allocated++;
+	return malloc(size);
+}
+
+static void *countingCalloc(size_t nmemb, size_t size)
+{
+	allocated++;
+	return calloc(nmemb, size);
+}
+
+static void *countingRealloc(void *ptr, size_t size)
+{
+	if (!ptr) {
+		allocated++;
+	}
+	return realloc(ptr, size);
+}
+
+static void countingFree(void *ptr)
+{
+	if (ptr) {
+		allocated--;
+	}
+	free(ptr);
+}
+
+int main()
+{
+	gdImagePtr im;
+	void *data;
+	int size;
+
+	gdSetMemoryMethods(countingMalloc, countingCalloc, countingRealloc, countingFree);
+
+	im = gdImageCreate(64, 64);
+	gdTestAssert(im != NULL);
+	gdTestAssert(allocated > 0);
+	gdImageColorAllocate(im, 255, 255, 255);
+	data = gdImageGifPtr(im, &size);
+	gdTestAssert(data != NULL);
+	gdFree(data);
+	gdImageDestroy(im);
+	gdTestAssertMsg(allocated == 0, "%d allocations leaked\n", allocated);
+
+	gdClearMemoryMethods();
+
+	return gdNumFailures();
+}
@@ -0,0 +1,79 @@
+/**
+ * Shared clones share the pixel rows of the original until either is
+ * written to; plain clones never do
+ */
+
+
+#include "gd.h"
+#include "gdtest.h"
+
+
+int main()
+{
+    gdImagePtr im, clone, clone2, copy, pal, palClone;
+    int c;
+
+    im = gdImageCreateTrueColor(64, 32);
+    gdImageFilledRectangle(im, 0, 0, 63, 31, 0x112233);
+
+    /* a plain clone has pixels of its own right away */
+    copy = gdImageClone(im);
+    gdTestAssert(copy != NULL);
+    gdTestAssert(copy->rowShare == NULL && im->rowShare == NULL);
+    gdTestAssert(gdImageGetStride(copy) > 0);
+    im->tpixels[1][1] = 0x445566;
+    gdTestAssert(gdImageGetPixel(copy, 1, 1) == 0x112233);
+    im->tpixels[1][1] = 0x112233;
+    gdImageDestroy(copy);
+
+    clone = gdImageCloneShared(im);
+    gdTestAssert(clone != NULL);
+    gdTestAssert(clone->tpixels[5] == im->tpixels[5]);
+    gdTestAssert(gdImageGetStride(clone) == 0);
+
+    /* writing to the clone copies only the row written to */
+    gdImageSetPixel(clone, 3, 5, 0xff0000);
+    gdTestAssert(clone->tpixels[5] != im->tpixels[5]);
+    gdTestAssert(clone->tpixels[6] == im->tpixels[6]);
+    gdTestAssert(gdImageGetPixel(clone, 3, 5) == 0xff0000);
+    gdTestAssert(gdImageGetPixel(clone, 4, 5) == 0x112233);
+    gdTestAssert(gdImageGetPixel(im, 3, 5) == 0x112233);
+
+    /* and so does writing to the original */
+    gdImageLine(im, 0, 10, 63, 10, 0x00ff00);
+    gdTestAssert(gdImageGetPixel(im, 20, 10) == 0x00ff00);
+    gdTestAssert(gdImageGetPixel(clone, 20, 10) == 0x112233);
+
+    /* a clone of a clone */
+    clone2 = gdImageCloneShared(clone);
+    gdTestAssert(clone2 != NULL);
+    gdTestAssert(gdImageGetPixel(clone2, 3, 5) == 0xff0000);
+    gdImageFlipVertical(clone2);
+    gdTestAssert(gdImageGetPixel(clone2, 3, 26) == 0xff0000);
+    gdTestAssert(gdImageGetPixel(clone, 3, 26) == 0x112233);
+    gdTestAssert(clone2->rowShare == NULL);
+
+    /* destroying the original leaves the clones intact */
+    gdImageDestroy(im);
+    gdTestAssert(gdImageGetPixel(clone, 20, 10) == 0x112233);
+    gdTestAssert(gdImageUnshare(clone));
+    gdTestAssert(clone->rowShare == NULL);
+    gdTestAssert(gdImageGetPixel(clone, 3, 5) == 0xff0000);
+    gdImageDestroy(clone);
+    gdImageDestroy(clone2);
+
+    pal = gdImageCreate(16, 16);
+    gdImageColorAllocate(pal, 255, 255, 255);
+    c = gdImageColorAllocate(pal, 0, 0, 255);
+    palClone = gdImageCloneShared(pal);
+    gdTestAssert(palClone != NULL);
+    gdTestAssert(palClone->pixels[0] == pal->pixels[0]);
+    gdImageSetPixel(palClone, 8, 8, c);
+    gdTestAssert(gdImageGetPixel(palClone, 8, 8) == c);
+    gdTestAssert(gdImageGetPixel(pal, 8, 8) == 0);
+    gdImageDestroy(palClone);
+    gdTestAssert(gdImageGetPixel(pal, 8, 8) == 0);
+    gdImageDestroy(pal);
+
+    return gdNumFailures();
+}
@@ -0,0 +1,81 @@
+/**
+ * The closest color searches use lookup structures over the palette;
+ * they must give what a scan of the whole palette gives, also after the
+ * palette is changed.
+ */
+
+
+#include "gd.h"
+#include "gdtest.h"
+
+
+/* what gdImageColorClosestAlpha() used to do */
+static int closest(gdImagePtr im, int r, int g, int b, int a, int exclude)
+{
+    long dist, mindist = 0;
+    int i, ct = -1;
+
+    for (i = 0; i < im->colorsTotal; i++) {
+        long rd = im->red[i] - r, gd = im->green[i] - g;
+        long bd = im->blue[i] - b, ad = im->alpha[i] - a;
+
+        if (im->open[i] || i == exclude) {
+            continue;
+        }
+        dist = rd * rd + gd * gd + bd * bd + ad * ad;
+        if (ct == -1 || dist < mindist) {
+            mindist = dist;
+            ct = i;
+        }
+    }
+    return ct;
+}
+
+static void check(gdImagePtr im)
+{
+    int i, r, g, b, a;
+
+    for (i = 0; i < 5000; i++) {
+        r = gdTestRandomInt(300) - 20;
+        g = gdTestRandomInt(256);
+        b = gdTestRandomInt(256);
+        a = gdTestRandomInt(128);
+        gdTestAssert(gdImageColorClosestAlpha(im, r, g, b, a) == closest(im, r, g, b, a, -1));
+        if (im->colorsTotal == gdMaxColors) {
+            gdTestAssert(gdImageColorResolveAlpha(im, r, g, b, a)
+                         == closest(im, r, g, b, a, im->transparent));
+        }
+    }
+}
+
+int main()
+{
+    gdImagePtr im;
+    int i;
+
+    im = gdImageCreate(1, 1);
+    for (i = 0; i < 60; i++) {
+        /* clustered colors, with duplicates to check ties */
+        gdImageColorAllocateAlpha(im, 64 + gdTestRandomInt(8) * 16, gdTestRandomInt(4) * 60, 200,
+                                  gdTestRandomInt(3) * 60);
+    }
+    check(im);
+
+    gdImageColorDeallocate(im, 7);
+    gdImageColorDeallocate(im, 30);
+    gdImageColorTransparent(im, 12);
+    check(im);
+
+    while (gdImageColorAllocateAlpha(im, gdTestRandomInt(256), gdTestRandomInt(256),
+                                     gdTestRandomInt(256), gdTestRandomInt(128)) != -1);
+    gdTestAssert(im->colorsTotal == gdMaxColors);
+    check(im);
+
+    im->red[100] = 3;
+    im->green[100] = 250;
+    gdImagePaletteChanged(im);
+    check(im);
+
+    gdImageDestroy(im);
+    return gdNumFailures();
+}
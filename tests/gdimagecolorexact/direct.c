@@ -0,0 +1,54 @@
+/**
+ * Changing the palette by setting the members of gdImage, like PHP's
+ * imagecolorset() does, and calling gdImagePaletteChanged() afterwards
+ * must not leave the color searches with stale answers. The exact
+ * search never returns an entry of another color, even without it.
+ */
+
+
+#include "gd.h"
+#include "gdtest.h"
+
+
+int main()
+{
+    gdImagePtr im;
+    int b, i;
+
+    im = gdImageCreate(1, 1);
+    for (i = 0; i < 8; i++) {
+        gdImageColorAllocate(im, 200, i, 0);
+    }
+    b = gdImageColorAllocate(im, 200, 200, 200);
+
+    /* build the lookup structures */
+    gdTestAssert(gdImageColorExact(im, 200, 200, 200) == b);
+    gdTestAssert(gdImageColorExact(im, 0, 0, 255) == -1);
+    gdTestAssert(gdImageColorClosest(im, 200, 200, 190) == b);
+
+    im->red[b] = 0;
+    im->green[b] = 0;
+    im->blue[b] = 255;
+
+    /* the old color is not found anymore, even without being announced */
+    gdTestAssert(gdImageColorExact(im, 200, 200, 200) == -1);
+
+    gdImagePaletteChanged(im);
+    gdTestAssert(gdImageColorExact(im, 0, 0, 255) == b);
+    gdTestAssert(gdImageColorExact(im, 200, 200, 200) == -1);
+    gdTestAssert(gdImageColorClosest(im, 200, 200, 190) == 7);
+    gdTestAssert(gdImageColorClosest(im, 0, 0, 250) == b);
+    gdTestAssert(gdImageColorResolve(im, 0, 0, 255) == b);
+    gdTestAssert(im->colorsTotal == 9);
+
+    /* an entry opened directly is reused */
+    im->open[3] = 1;
+    gdImagePaletteChanged(im);
+    gdTestAssert(gdImageColorExact(im, 200, 3, 0) == -1);
+    gdTestAssert(gdImageColorAllocate(im, 1, 2, 3) == 3);
+    gdTestAssert(gdImageColorExact(im, 1, 2, 3) == 3);
+    gdTestAssert(im->colorsTotal == 9);
+
+    gdImageDestroy(im);
+    return gdNumFailures();
+}
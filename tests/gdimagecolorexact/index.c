@@ -0,0 +1,84 @@
+/**
+ * The exact color searches use a lookup table over the palette, which
+ * allocating and deallocating colors keep up to date; they must give
+ * what a scan of the whole palette gives.
+ */
+
+
+#include "gd.h"
+#include "gdtest.h"
+
+
+/* what gdImageColorExactAlpha() used to do, ignoring the entry exclude */
+static int exact(gdImagePtr im, int r, int g, int b, int a, int exclude)
+{
+    int i;
+
+    for (i = 0; i < im->colorsTotal; i++) {
+        if (!im->open[i] && i != exclude && im->red[i] == r && im->green[i] == g
+                && im->blue[i] == b && im->alpha[i] == a) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* few colors, so that there are duplicates */
+static void color(int *r, int *g, int *b, int *a)
+{
+    *r = gdTestRandomInt(4) * 80;
+    *g = gdTestRandomInt(4) * 80;
+    *b = gdTestRandomInt(2) * 255;
+    *a = gdTestRandomInt(2) * 127;
+}
+
+int main()
+{
+    gdImagePtr im;
+    int i, n, r, g, b, a, expected, open;
+
+    im = gdImageCreate(1, 1);
+    for (n = 0; n < 20000; n++) {
+        color(&r, &g, &b, &a);
+        switch (gdTestRandomInt(5)) {
+        case 0:
+            gdImageColorAllocateAlpha(im, r, g, b, a);
+            break;
+        case 1:
+            gdImageColorDeallocate(im, gdTestRandomInt(im->colorsTotal + 1));
+            break;
+        case 2:
+            expected = exact(im, r, g, b, a, im->transparent);
+            if (expected == -1) {
+                open = -1;
+                for (i = im->colorsTotal - 1; i >= 0 && open == -1; i--) {
+                    if (im->open[i]) {
+                        open = i;
+                    }
+                }
+                expected = open != -1 ? open : im->colorsTotal;
+            }
+            if (expected < gdMaxColors) {
+                gdTestAssert(gdImageColorResolveAlpha(im, r, g, b, a) == expected);
+            }
+            break;
+        case 3:
+            if (gdTestRandomInt(20) == 0) {
+                gdImageColorTransparent(im, gdTestRandomInt(im->colorsTotal + 1));
+            }
+            break;
+        default:
+            gdTestAssert(gdImageColorExactAlpha(im, r, g, b, a) == exact(im, r, g, b, a, -1));
+            break;
+        }
+        if (im->colorsTotal == gdMaxColors) {
+            for (i = 0; i < gdMaxColors; i += 2) {
+                gdImageColorDeallocate(im, i);
+            }
+        }
+    }
+    gdTestAssert(gdImageColorExactAlpha(im, 300, 0, 0, 0) == -1);
+
+    gdImageDestroy(im);
+    return gdNumFailures();
+}
@@ -0,0 +1,104 @@
+/**
+ * gdImageCompareDiff() and the color comparison of gdImageCompare() must
+ * agree with comparing the images pixel by pixel.
+ */
+
+
+#include "gd.h"
+#include "gdtest.h"
+
+
+static int rgb(gdImagePtr im, int x, int y)
+{
+    int c = gdImageGetPixel(im, x, y);
+
+    return (gdImageRed(im, c) << 16) | (gdImageGreen(im, c) << 8) | gdImageBlue(im, c);
+}
+
+static void check(gdImagePtr im1, gdImagePtr im2)
+{
+    int x, y, count = 0, x1 = 1 << 30, y1 = 1 << 30, x2 = -1, y2 = -1;
+    gdRect bounds;
+
+    for (y = 0; y < gdImageSY(im1) && y < gdImageSY(im2); y++) {
+        for (x = 0; x < gdImageSX(im1) && x < gdImageSX(im2); x++) {
+            if (rgb(im1, x, y) != rgb(im2, x, y)) {
+                count++;
+                x1 = x < x1 ? x : x1;
+                x2 = x > x2 ? x : x2;
+                y1 = y < y1 ? y : y1;
+                y2 = y;
+            }
+        }
+    }
+    gdTestAssert(gdImageCompareDiff(im1, im2, &bounds) == count);
+    gdTestAssert(!(gdImageCompare(im1, im2) & GD_CMP_COLOR) == !count);
+    if (count) {
+        gdTestAssert(bounds.x == x1 && bounds.y == y1);
+        gdTestAssert(bounds.width == x2 - x1 + 1 && bounds.height == y2 - y1 + 1);
+    } else {
+        gdTestAssert(bounds.x == 0 && bounds.y == 0 && bounds.width == 0 && bounds.height == 0);
+    }
+}
+
+static gdImagePtr create(int trueColor, int sx, int sy)
+{
+    gdImagePtr im;
+    int i;
+
+    if (trueColor) {
+        im = gdImageCreateTrueColor(sx, sy);
+        gdImageAlphaBlending(im, 0);
+    } else {
+        im = gdImageCreate(sx, sy);
+        for (i = 0; i < 8; i++) {
+            gdImageColorAllocateAlpha(im, i & 1 ? 255 : 0, i & 2 ? 255 : 0, i & 4 ? 255 : 0, 0);
+        }
+        /* the same color as 0, but more transparent */
+        gdImageColorAllocateAlpha(im, 0, 0, 0, 100);
+    }
+    return im;
+}
+
+static void set(gdImagePtr im, int x, int y, int i)
+{
+    if (gdImageTrueColor(im)) {
+        gdImageSetPixel(im, x, y, i < 8 ? gdTrueColor(i & 1 ? 255 : 0, i & 2 ? 255 : 0, i & 4 ? 255 : 0)
+                        : gdTrueColorAlpha(0, 0, 0, 100));
+    } else {
+        gdImageSetPixel(im, x, y, i);
+    }
+}
+
+int main()
+{
+    gdImagePtr im1, im2;
+    int t, i, n;
+
+    for (t = 0; t < 4; t++) {
+        im1 = create(t & 1, 601, 37);
+        im2 = create(t & 2, 601 - t, 37);
+        check(im1, im2);
+
+        /* alpha doesn't count */
+        set(im1, 5, 5, 8);
+        check(im1, im2);
+
+        for (n = 0; n < 6; n++) {
+            for (i = gdTestRandomInt(4); i > 0; i--) {
+                set(gdTestRandomInt(2) ? im1 : im2, gdTestRandomInt(601), gdTestRandomInt(37),
+                    gdTestRandomInt(9));
+            }
+            check(im1, im2);
+        }
+        gdImageFilledRectangle(im1, 0, 0, 600, 36, 0);
+        gdImageFilledRectangle(im2, 0, 0, 600, 36, 0);
+        set(im2, 599 - t, 36, 3);
+        check(im1, im2);
+
+        gdImageDestroy(im1);
+        gdImageDestroy(im2);
+    }
+
+    return gdNumFailures();
+}
@@ -0,0 +1,170 @@
+/**
+ * Copying from palette images, which is done a row at a time, must give
+ * the same result as drawing each pixel with gdImageSetPixel(), and must
+ * allocate the colors of a palette destination in the same order.
+ */
+
+
+#include "gd.h"
+#include "gdtest.h"
+
+
+static gdImagePtr randomPaletteImage(int sx, int sy, int colors)
+{
+    gdImagePtr im = gdImageCreate(sx, sy);
+    int x, y, i;
+
+    for (i = 0; i < colors; i++) {
+        gdImageColorAllocateAlpha(im, gdTestRandomInt(256), gdTestRandomInt(256), gdTestRandomInt(256),
+                                  gdTestRandomInt(128));
+    }
+    for (y = 0; y < sy; y++) {
+        for (x = 0; x < sx; x++) {
+            im->pixels[y][x] = gdTestRandomInt(colors);
+        }
+    }
+    return im;
+}
+
+static gdImagePtr randomTrueColorImage(int sx, int sy)
+{
+    gdImagePtr im = gdImageCreateTrueColor(sx, sy);
+    int x, y;
+
+    for (y = 0; y < sy; y++) {
+        for (x = 0; x < sx; x++) {
+            im->tpixels[y][x] = gdTestRandom();
+        }
+    }
+    return im;
+}
+
+/* what gdImageCopy() does a pixel at a time */
+static void copyPixels(gdImagePtr dst, gdImagePtr src, int dstX, int dstY,
+                       int srcX, int srcY, int w, int h)
+{
+    int colorMap[gdMaxColors];
+    int x, y, i;
+
+    for (i = 0; i < gdMaxColors; i++) {
+        colorMap[i] = -1;
+    }
+    for (y = 0; y < h; y++) {
+        for (x = 0; x < w; x++) {
+            int c = gdImageGetPixel(src, srcX + x, srcY + y);
+            if (c == src->transparent) {
+                continue;
+            }
+            if (dst->trueColor) {
+                gdImageSetPixel(dst, dstX + x, dstY + y,
+                                gdTrueColorAlpha(src->red[c], src->green[c], src->blue[c], src->alpha[c]));
+            } else {
+                if (colorMap[c] == -1) {
+                    colorMap[c] = gdImageColorResolveAlpha(dst, src->red[c], src->green[c],
+                                                           src->blue[c], src->alpha[c]);
+                }
+                gdImageSetPixel(dst, dstX + x, dstY + y, colorMap[c]);
+            }
+        }
+    }
+}
+
+static void copyBoth(gdImagePtr a, gdImagePtr b, gdImagePtr src, int dstX, int dstY,
+                     int srcX, int srcY, int w, int h)
+{
+    gdImageCopy(a, src, dstX, dstY, srcX, srcY, w, h);
+    copyPixels(b, src, dstX, dstY, srcX, srcY, w, h);
+}
+
+static int samePalette(gdImagePtr a, gdImagePtr b)
+{
+    int i;
+
+    if (a->colorsTotal != b->colorsTotal) {
+        return 0;
+    }
+    for (i = 0; i < a->colorsTotal; i++) {
+        if (a->red[i] != b->red[i] || a->green[i] != b->green[i]
+                || a->blue[i] != b->blue[i] || a->alpha[i] != b->alpha[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int samePixels(gdImagePtr a, gdImagePtr b)
+{
+    int x, y;
+
+    for (y = 0; y < a->sy; y++) {
+        for (x = 0; x < a->sx; x++) {
+            if (a->pixels[y][x] != b->pixels[y][x]) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+int main()
+{
+    /* -1 for the palette of the source */
+    static const int paletteSizes[] = {-1, 0, 20, 256};
+    gdImagePtr src, a, b;
+    int effect, transparent, i;
+
+    src = randomPaletteImage(40, 30, 50);
+    for (transparent = 0; transparent < 2; transparent++) {
+        gdImageColorTransparent(src, transparent ? 7 : -1);
+
+        /* to truecolor, with each effect */
+        for (effect = gdEffectReplace; effect <= gdEffectMultiply; effect++) {
+            a = randomTrueColorImage(50, 20);
+            b = gdImageClone(a);
+            gdImageAlphaBlending(a, effect);
+            gdImageAlphaBlending(b, effect);
+            gdImageSetClip(a, 3, 2, 44, 17);
+            gdImageSetClip(b, 3, 2, 44, 17);
+
+            /* partly outside of the destination and its clipping rectangle */
+            copyBoth(a, b, src, -5, 10, 2, 3, 36, 25);
+            copyBoth(a, b, src, 30, -4, 0, 0, 40, 30);
+            gdImageSetClip(a, 0, 0, 49, 19);
+            gdImageSetClip(b, 0, 0, 49, 19);
+            gdTestAssertMsg(gdAssertImageEquals(a, b),
+                            "truecolor, effect %d, transparent %d\n", effect, transparent);
+
+            gdImageDestroy(a);
+            gdImageDestroy(b);
+        }
+
+        /* to palette images with the palette of the source, no colors,
+           a few colors and a full palette */
+        for (i = 0; i < 4; i++) {
+            const int colors = paletteSizes[i];
+            if (colors < 0) {
+                int c;
+                a = gdImageCreate(50, 20);
+                for (c = 0; c < src->colorsTotal; c++) {
+                    gdImageColorAllocateAlpha(a, src->red[c], src->green[c], src->blue[c], src->alpha[c]);
+                }
+            } else {
+                a = colors ? randomPaletteImage(50, 20, colors) : gdImageCreate(50, 20);
+            }
+            b = gdImageClone(a);
+            gdImageSetClip(a, 3, 2, 44, 17);
+            gdImageSetClip(b, 3, 2, 44, 17);
+
+            copyBoth(a, b, src, -5, 10, 2, 3, 36, 25);
+            copyBoth(a, b, src, 30, -4, 0, 0, 40, 30);
+            gdTestAssertMsg(samePalette(a, b) && samePixels(a, b),
+                            "palette, %d colors, transparent %d\n", colors, transparent);
+
+            gdImageDestroy(a);
+            gdImageDestroy(b);
+        }
+    }
+    gdImageDestroy(src);
+
+    return gdNumFailures();
+}
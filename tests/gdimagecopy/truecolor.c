@@ -0,0 +1,73 @@
+/**
+ * Copying between truecolor images, which is done a span at a time, must
+ * give the same result as drawing each pixel with gdImageSetPixel().
+ */
+
+
+#include "gd.h"
+#include "gdtest.h"
+
+
+static gdImagePtr randomImage(int sx, int sy)
+{
+    gdImagePtr im = gdImageCreateTrueColor(sx, sy);
+    int x, y;
+
+    for (y = 0; y < sy; y++) {
+        for (x = 0; x < sx; x++) {
+            /* every fourth pixel is the transparent color */
+            im->tpixels[y][x] = gdTestRandomInt(4) ? gdTestRandom() : 0x123456;
+        }
+    }
+    return im;
+}
+
+static void copyPixels(gdImagePtr dst, gdImagePtr src, int dstX, int dstY,
+                       int srcX, int srcY, int w, int h)
+{
+    int x, y;
+
+    for (y = 0; y < h; y++) {
+        for (x = 0; x < w; x++) {
+            int c = gdImageGetTrueColorPixel(src, srcX + x, srcY + y);
+            if (c != src->transparent) {
+                gdImageSetPixel(dst, dstX + x, dstY + y, c);
+            }
+        }
+    }
+}
+
+int main()
+{
+    gdImagePtr src, a, b;
+    int effect, transparent;
+
+    src = randomImage(40, 30);
+    for (transparent = 0; transparent < 2; transparent++) {
+        gdImageColorTransparent(src, transparent ? 0x123456 : -1);
+        for (effect = gdEffectReplace; effect <= gdEffectMultiply; effect++) {
+            a = randomImage(50, 20);
+            b = gdImageClone(a);
+            gdImageAlphaBlending(a, effect);
+            gdImageAlphaBlending(b, effect);
+            gdImageSetClip(a, 3, 2, 44, 17);
+            gdImageSetClip(b, 3, 2, 44, 17);
+
+            /* partly outside of the destination and its clipping rectangle */
+            gdImageCopy(a, src, -5, 10, 2, 3, 36, 25);
+            copyPixels(b, src, -5, 10, 2, 3, 36, 25);
+            gdImageCopy(a, src, 30, -4, 0, 0, 40, 30);
+            copyPixels(b, src, 30, -4, 0, 0, 40, 30);
+            gdImageSetClip(a, 0, 0, 49, 19);
+            gdImageSetClip(b, 0, 0, 49, 19);
+            gdTestAssertMsg(gdAssertImageEquals(a, b),
+                            "effect %d, transparent %d\n", effect, transparent);
+
+            gdImageDestroy(a);
+            gdImageDestroy(b);
+        }
+    }
+    gdImageDestroy(src);
+
+    return gdNumFailures();
+}
@@ -0,0 +1,80 @@
+/**
+ * Merging truecolor images, which is done a span at a time, must give the
+ * same result as merging each pixel on its own.
+ */
+
+
+#include "gd.h"
+#include "gdtest.h"
+
+
+static gdImagePtr randomImage(int sx, int sy)
+{
+    gdImagePtr im = gdImageCreateTrueColor(sx, sy);
+    int x, y;
+
+    for (y = 0; y < sy; y++) {
+        for (x = 0; x < sx; x++) {
+            /* every fourth pixel is the transparent color */
+            im->tpixels[y][x] = gdTestRandomInt(4) ? gdTestRandom() : 0x123456;
+        }
+    }
+    return im;
+}
+
+static void mergePixels(gdImagePtr dst, gdImagePtr src, int dstX, int dstY,
+                        int srcX, int srcY, int w, int h, int pct)
+{
+    int x, y;
+
+    for (y = 0; y < h; y++) {
+        for (x = 0; x < w; x++) {
+            int c = gdImageGetPixel(src, srcX + x, srcY + y);
+            int dc, r, g, b;
+            if (c == gdImageGetTransparent(src)) {
+                continue;
+            }
+            dc = gdImageGetPixel(dst, dstX + x, dstY + y);
+            r = gdImageRed(src, c) * (pct / 100.0) + gdImageRed(dst, dc) * ((100 - pct) / 100.0);
+            g = gdImageGreen(src, c) * (pct / 100.0) + gdImageGreen(dst, dc) * ((100 - pct) / 100.0);
+            b = gdImageBlue(src, c) * (pct / 100.0) + gdImageBlue(dst, dc) * ((100 - pct) / 100.0);
+            gdImageSetPixel(dst, dstX + x, dstY + y, gdImageColorResolve(dst, r, g, b));
+        }
+    }
+}
+
+int main()
+{
+    static const int pcts[] = {0, 30, 50, 77, 100};
+    gdImagePtr src, a, b;
+    int effect, i;
+
+    src = randomImage(40, 30);
+    gdImageColorTransparent(src, 0x123456);
+    for (effect = gdEffectReplace; effect <= gdEffectMultiply; effect++) {
+        for (i = 0; i < (int) (sizeof(pcts) / sizeof(pcts[0])); i++) {
+            a = randomImage(50, 20);
+            b = gdImageClone(a);
+            gdImageAlphaBlending(a, effect);
+            gdImageAlphaBlending(b, effect);
+            gdImageSetClip(a, 3, 2, 44, 17);
+            gdImageSetClip(b, 3, 2, 44, 17);
+
+            /* partly outside of the destination and its clipping rectangle */
+            gdImageCopyMerge(a, src, -5, 10, 2, 3, 36, 25, pcts[i]);
+            mergePixels(b, src, -5, 10, 2, 3, 36, 25, pcts[i]);
+            gdImageCopyMerge(a, src, 30, -4, 0, 0, 40, 30, pcts[i]);
+            mergePixels(b, src, 30, -4, 0, 0, 40, 30, pcts[i]);
+            gdImageSetClip(a, 0, 0, 49, 19);
+            gdImageSetClip(b, 0, 0, 49, 19);
+            gdTestAssertMsg(gdAssertImageEquals(a, b),
+                            "effect %d, pct %d\n", effect, pcts[i]);
+
+            gdImageDestroy(a);
+            gdImageDestroy(b);
+        }
+    }
+    gdImageDestroy(src);
+
+    return gdNumFailures();
+}
@@ -0,0 +1,145 @@
+/**
+ * gdImageCopyResampled() must give each destination pixel the average of
+ * the source pixels it covers, weighted by their coverage and, for the
+ * colors, by their opacity; up to rounding, as it was computed in
+ * floating point before. With alpha blending enabled, the result is
+ * blended onto the destination.
+ */
+
+
+#include "gd.h"
+#include "gdtest.h"
+
+
+/* the coverage of source pixel i by destination pixel d */
+static double coverage(int d, int i, int dstLen, int srcLen)
+{
+    const double lo = (double) d * srcLen / dstLen;
+    const double hi = (double) (d + 1) * srcLen / dstLen;
+    const double start = lo > i ? lo : i;
+    const double end = hi < i + 1 ? hi : i + 1;
+
+    return end > start ? end - start : 0.0;
+}
+
+static void resamplePixels(gdImagePtr dst, gdImagePtr src, int dstX, int dstY, int srcX, int srcY,
+                           int dstW, int dstH, int srcW, int srcH)
+{
+    int x, y, i, j;
+
+    for (y = 0; y < dstH; y++) {
+        for (x = 0; x < dstW; x++) {
+            double sum = 0.0, alpha = 0.0, opacity = 0.0, red = 0.0, green = 0.0, blue = 0.0;
+            int c;
+
+            for (j = 0; j < srcH; j++) {
+                for (i = 0; i < srcW; i++) {
+                    const double w = coverage(x, i, dstW, srcW) * coverage(y, j, dstH, srcH);
+                    const int p = gdImageGetTrueColorPixel(src, srcX + i, srcY + j);
+                    const double o = w * (gdAlphaMax - gdTrueColorGetAlpha(p));
+
+                    sum += w;
+                    alpha += w * gdTrueColorGetAlpha(p);
+                    opacity += o;
+                    red += o * gdTrueColorGetRed(p);
+                    green += o * gdTrueColorGetGreen(p);
+                    blue += o * gdTrueColorGetBlue(p);
+                }
+            }
+            if (opacity > 0.0) {
+                c = gdTrueColorAlpha((int) (red / opacity + 0.5), (int) (green / opacity + 0.5),
+                                     (int) (blue / opacity + 0.5), (int) (alpha / sum + 0.5));
+            } else {
+                c = gdTrueColorAlpha(0, 0, 0, gdAlphaTransparent);
+            }
+            gdImageSetPixel(dst, dstX + x, dstY + y, c);
+        }
+    }
+}
+
+/* whether the channels of the images differ by at most one */
+static int roughlyEqual(gdImagePtr a, gdImagePtr b)
+{
+    int x, y, shift;
+
+    for (y = 0; y < gdImageSY(a); y++) {
+        for (x = 0; x < gdImageSX(a); x++) {
+            const int p = gdImageTrueColorPixel(a, x, y);
+            const int q = gdImageTrueColorPixel(b, x, y);
+            for (shift = 0; shift < 32; shift += 8) {
+                const int d = ((p >> shift) & 0xff) - ((q >> shift) & 0xff);
+                if (d < -1 || d > 1) {
+                    return 0;
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+int main()
+{
+    /* srcW, srcH, dstW, dstH */
+    static const int sizes[][4] = {
+        {37, 29, 10, 8}, {7, 5, 23, 16}, {30, 20, 17, 31}, {12, 12, 12, 12}
+    };
+    gdImagePtr tc, pal, a, b;
+    int i, k, x, y;
+
+    tc = gdImageCreateTrueColor(40, 30);
+    pal = gdImageCreate(40, 30);
+    for (i = 0; i < 64; i++) {
+        gdImageColorAllocateAlpha(pal, gdTestRandomInt(256), gdTestRandomInt(256), gdTestRandomInt(256),
+                                  gdTestRandomInt(128));
+    }
+    gdImageColorTransparent(pal, 5);
+    for (y = 0; y < 30; y++) {
+        for (x = 0; x < 40; x++) {
+            /* a fully transparent corner, and opaque and random alpha elsewhere */
+            const int alpha = x < 8 && y < 8 ? gdAlphaTransparent : (x % 3 ? gdTestRandomInt(128) : 0);
+            tc->tpixels[y][x] = gdTrueColorAlpha(gdTestRandomInt(256), gdTestRandomInt(256),
+                                                 gdTestRandomInt(256), alpha);
+            pal->pixels[y][x] = gdTestRandomInt(64);
+        }
+    }
+
+    for (k = 0; k < 2; k++) {
+        gdImagePtr src = k ? pal : tc;
+        for (i = 0; i < 4; i++) {
+            const int *s = sizes[i];
+            gdImagePtr blended, expected;
+
+            a = gdImageCreateTrueColor(40, 40);
+            gdImageFilledRectangle(a, 0, 0, 39, 39, gdTrueColorAlpha(20, 40, 60, 50));
+            blended = gdImageClone(a);
+            expected = gdImageClone(a);
+            b = gdImageClone(a);
+            gdImageAlphaBlending(a, 0);
+            gdImageAlphaBlending(b, 0);
+            gdImageSetClip(a, 2, 3, 30, 35);
+            gdImageSetClip(b, 2, 3, 30, 35);
+            gdImageSetClip(blended, 2, 3, 30, 35);
+            gdImageSetClip(expected, 2, 3, 30, 35);
+
+            gdImageCopyResampled(a, src, 1, 4, 40 - s[0], 1, s[2], s[3], s[0], s[1]);
+            resamplePixels(b, src, 1, 4, 40 - s[0], 1, s[2], s[3], s[0], s[1]);
+            gdTestAssertMsg(roughlyEqual(a, b), "%s source, %dx%d to %dx%d\n",
+                            k ? "palette" : "truecolor", s[0], s[1], s[2], s[3]);
+
+            gdImageCopyResampled(blended, src, 1, 4, 40 - s[0], 1, s[2], s[3], s[0], s[1]);
+            gdImageSetClip(a, 0, 0, 39, 39);
+            gdImageCopy(expected, a, 1, 4, 1, 4, s[2], s[3]);
+            gdTestAssertMsg(gdAssertImageEquals(expected, blended), "%s source blended, %dx%d to %dx%d\n",
+                            k ? "palette" : "truecolor", s[0], s[1], s[2], s[3]);
+
+            gdImageDestroy(a);
+            gdImageDestroy(b);
+            gdImageDestroy(blended);
+            gdImageDestroy(expected);
+        }
+    }
+    gdImageDestroy(tc);
+    gdImageDestroy(pal);
+
+    return gdNumFailures();
+}
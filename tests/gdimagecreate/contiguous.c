@@ -0,0 +1,44 @@
+/**
+ * Newly created images store their pixel rows in one contiguous block,
+ * and gdImageGetStride() reports the distance between the rows.
+ */
+
+#include "gd.h"
+#include "gdtest.h"
+
+
+static void check_rows(void **rows, int sy, int stride)
+{
+	int y;
+
+	gdTestAssert(stride > 0);
+	gdTestAssert(((size_t) rows[0] & 4095) == 0);
+	for (y = 1; y < sy; y++) {
+		gdTestAssert((char *) rows[y] - (char *) rows[y - 1] == stride);
+	}
+}
+
+int main()
+{
+	gdImagePtr im;
+
+	im = gdImageCreateTrueColor(123, 45);
+	gdTestAssert(gdImageGetStride(im) >= 123 * (int) sizeof(int));
+	check_rows((void **) im->tpixels, 45, gdImageGetStride(im));
+	gdImageSetPixel(im, 122, 44, 0x123456);
+	gdTestAssert(gdImageGetPixel(im, 122, 44) == 0x123456);
+	gdImageDestroy(im);
+
+	im = gdImageCreate(77, 33);
+	gdTestAssert(gdImageGetStride(im) >= 77);
+	check_rows((void **) im->pixels, 33, gdImageGetStride(im));
+
+	/* the converted image is contiguous as well */
+	gdImageColorAllocate(im, 255, 0, 0);
+	gdTestAssert(gdImagePaletteToTrueColor(im));
+	check_rows((void **) im->tpixels, 33, gdImageGetStride(im));
+	gdTestAssert(gdImageGetPixel(im, 10, 10) == 0xff0000);
+	gdImageDestroy(im);
+
+	return gdNumFailures();
+}
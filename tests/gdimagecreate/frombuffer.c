@@ -0,0 +1,63 @@
+/**
+ * Images created from a caller owned buffer read and write that buffer
+ * directly, and leave it alone when destroyed.
+ */
+
+
+#include <stdlib.h>
+#include "gd.h"
+#include "gdtest.h"
+
+
+#define W 50
+#define H 20
+#define PITCH 64
+
+int main()
+{
+	int *frame;
+	unsigned char *indexes;
+	gdImagePtr im;
+
+	frame = calloc(PITCH * H, sizeof(int));
+	frame[3 * PITCH + 7] = 0x123456;
+
+	/* invalid strides */
+	gdTestAssert(gdImageCreateTrueColorFromBuffer(W, H, frame, W * sizeof(int) - 4) == NULL);
+	gdTestAssert(gdImageCreateTrueColorFromBuffer(W, H, frame, W * sizeof(int) + 2) == NULL);
+	gdTestAssert(gdImageCreateTrueColorFromBuffer(W, H, NULL, W * sizeof(int)) == NULL);
+
+	im = gdImageCreateTrueColorFromBuffer(W, H, frame, PITCH * sizeof(int));
+	gdTestAssert(im != NULL);
+	gdTestAssert(gdImageTrueColor(im));
+	gdTestAssert(gdImageGetStride(im) == PITCH * sizeof(int));
+	gdTestAssert(gdImageGetPixel(im, 7, 3) == 0x123456);
+
+	gdImageSetPixel(im, W - 1, H - 1, 0xabcdef);
+	gdTestAssert(frame[(H - 1) * PITCH + W - 1] == 0xabcdef);
+	gdImageFilledRectangle(im, 0, 10, W - 1, 10, 0x00ff00);
+	gdTestAssert(frame[10 * PITCH] == 0x00ff00);
+	gdTestAssert(frame[10 * PITCH + W] == 0);
+
+	gdImageDestroy(im);
+	gdTestAssert(frame[3 * PITCH + 7] == 0x123456);
+	free(frame);
+
+	indexes = calloc(PITCH, H);
+	im = gdImageCreateFromBuffer(W, H, indexes, PITCH);
+	gdTestAssert(im != NULL);
+	gdTestAssert(!gdImageTrueColor(im));
+	gdImageColorAllocate(im, 0, 0, 0);
+	gdImageColorAllocate(im, 255, 255, 255);
+	gdImageLine(im, 0, 5, W - 1, 5, 1);
+	gdTestAssert(indexes[5 * PITCH] == 1 && indexes[5 * PITCH + W - 1] == 1);
+	gdTestAssert(indexes[5 * PITCH + W] == 0);
+
+	/* converting replaces the storage, the buffer stays the caller's */
+	gdTestAssert(gdImagePaletteToTrueColor(im));
+	gdTestAssert(gdImageGetPixel(im, 0, 5) == 0xffffff);
+	gdImageDestroy(im);
+	free(indexes);
+
+	return gdNumFailures();
+}
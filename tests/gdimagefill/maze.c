@@ -0,0 +1,86 @@
+/**
+ * gdImageFill() must fill regions of any shape completely, without
+ * leaking out of the region or the clipping rectangle. The maze below
+ * is a single corridor winding through the whole image.
+ */
+
+
+#include "gd.h"
+#include "gdtest.h"
+
+
+#define W 601
+#define H 400
+
+/* walls in every odd column, open alternately at the top and the bottom */
+static void drawMaze(gdImagePtr im, int wall)
+{
+    int x;
+
+    for (x = 1; x < W; x += 2) {
+        if (x / 2 % 2) {
+            gdImageLine(im, x, 1, x, H - 1, wall);
+        } else {
+            gdImageLine(im, x, 0, x, H - 2, wall);
+        }
+    }
+}
+
+/* whether all pixels inside of (x1, y1) - (x2, y2) that are not wall are c,
+   and all others are outside */
+static int filled(gdImagePtr im, int wall, int c, int outside, int x1, int y1, int x2, int y2)
+{
+    int x, y;
+
+    for (y = 0; y < H; y++) {
+        for (x = 0; x < W; x++) {
+            const int p = gdImageGetPixel(im, x, y);
+            const int expected = x >= x1 && x <= x2 && y >= y1 && y <= y2 ? c : outside;
+            if (p != wall && p != expected) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+int main()
+{
+    gdImagePtr im, tile;
+    int wall, c, red, blue;
+
+    /* the whole maze */
+    im = gdImageCreateTrueColor(W, H);
+    wall = gdTrueColor(255, 255, 255);
+    c = gdTrueColor(255, 0, 0);
+    drawMaze(im, wall);
+    gdImageFill(im, W - 1, H - 1, c);
+    gdTestAssert(filled(im, wall, c, c, 0, 0, W - 1, H - 1));
+
+    /* only the part inside of the clipping rectangle connected to the start */
+    gdImageSetClip(im, 10, 0, W - 1, H - 1);
+    gdImageFill(im, W - 1, H - 1, 0);
+    gdImageSetClip(im, 0, 0, W - 1, H - 1);
+    gdTestAssert(filled(im, wall, 0, c, 10, 0, W - 1, H - 1));
+    gdImageDestroy(im);
+
+    /* with a tile having the color being replaced */
+    im = gdImageCreate(W, H);
+    gdImageColorAllocate(im, 0, 0, 0);
+    wall = gdImageColorAllocate(im, 255, 255, 255);
+    drawMaze(im, wall);
+    tile = gdImageCreate(2, 1);
+    red = gdImageColorAllocate(tile, 255, 0, 0);
+    blue = gdImageColorAllocate(tile, 0, 0, 0);
+    gdImageSetPixel(tile, 0, 0, red);
+    gdImageSetPixel(tile, 1, 0, blue);
+    gdImageSetTile(im, tile);
+    gdImageFill(im, 0, 0, gdTiled);
+    red = gdImageColorExact(im, 255, 0, 0);
+    gdTestAssert(red >= 0 && gdImageGetPixel(im, 0, H - 1) == red
+                 && gdImageGetPixel(im, W - 1, H - 1) == red && gdImageGetPixel(im, W - 3, 0) == red);
+    gdImageDestroy(im);
+    gdImageDestroy(tile);
+
+    return gdNumFailures();
+}
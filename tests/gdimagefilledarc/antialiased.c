@@ -0,0 +1,78 @@
+/**
+ * gdImageFilledEllipseAA() and gdImageFilledArcAA() must cover the area of
+ * the shape, with the pixel values adding up to it.
+ */
+
+
+#include <math.h>
+#include "gd.h"
+#include "gdtest.h"
+
+
+/* the area covered, drawing white onto opaque black */
+static double coveredArea(gdImagePtr im)
+{
+    double area = 0.0;
+    int x, y;
+
+    for (y = 0; y < gdImageSY(im); y++) {
+        for (x = 0; x < gdImageSX(im); x++) {
+            area += gdImageRed(im, gdImageTrueColorPixel(im, x, y)) / 255.0;
+        }
+    }
+    return area;
+}
+
+static gdImagePtr blackImage(void)
+{
+    gdImagePtr im = gdImageCreateTrueColor(100, 80);
+    gdImageAlphaBlending(im, 0);
+    return im;
+}
+
+int main()
+{
+    const double pi = 3.14159265358979323846;
+    const int white = gdTrueColor(255, 255, 255);
+    gdImagePtr im, full;
+    double area;
+
+    im = blackImage();
+    gdImageFilledEllipseAA(im, 50.3, 40, 81, 53.5, white);
+    area = coveredArea(im);
+    gdTestAssertMsg(fabs(area - pi * 81 * 53.5 / 4) < 1, "ellipse area %f\n", area);
+    gdTestAssert(gdImageRed(im, gdImageTrueColorPixel(im, 50, 40)) == 255);
+    gdTestAssert(gdImageRed(im, gdImageTrueColorPixel(im, 5, 5)) == 0);
+
+    /* an arc from an angle to itself is the whole ellipse */
+    full = blackImage();
+    gdImageFilledArcAA(full, 50.3, 40, 81, 53.5, 30, 390, white, gdPie);
+    gdTestAssert(gdAssertImageEquals(im, full));
+    gdImageDestroy(im);
+    gdImageDestroy(full);
+
+    /* a quarter from the rightmost point clockwise to the bottom one */
+    im = blackImage();
+    gdImageFilledArcAA(im, 50, 40, 60, 50, 0, 90, white, gdPie);
+    area = coveredArea(im);
+    gdTestAssertMsg(fabs(area - pi * 60 * 50 / 16) < 1, "pie area %f\n", area);
+    gdTestAssert(gdImageRed(im, gdImageTrueColorPixel(im, 60, 50)) == 255);
+    gdTestAssert(gdImageRed(im, gdImageTrueColorPixel(im, 40, 30)) == 0);
+    gdImageDestroy(im);
+
+    /* the chord fills the triangle of the center and the end points */
+    im = blackImage();
+    gdImageFilledArcAA(im, 50, 40, 60, 50, -90, 0, white, gdChord);
+    area = coveredArea(im);
+    gdTestAssertMsg(fabs(area - 30 * 25 / 2.0) < 0.5, "chord area %f\n", area);
+    gdTestAssert(gdImageRed(im, gdImageTrueColorPixel(im, 55, 35)) == 255);
+    gdImageDestroy(im);
+
+    /* nothing is drawn without filling */
+    im = blackImage();
+    gdImageFilledArcAA(im, 50, 40, 60, 50, 0, 90, white, gdNoFill);
+    gdTestAssert(coveredArea(im) == 0.0);
+    gdImageDestroy(im);
+
+    return gdNumFailures();
+}
@@ -0,0 +1,135 @@
+/**
+ * gdImageFilledPolygonAA() must draw each pixel with the fraction of it
+ * covered by a simple polygon, as far as sampling it can tell, also when
+ * the polygon is partly outside of the clipping rectangle.
+ */
+
+
+#include <stdlib.h>
+#include <math.h>
+#include "gd.h"
+#include "gdtest.h"
+
+
+/* the winding number of the polygon around (x, y) */
+static int winding(const gdPointF *p, int n, double x, double y)
+{
+    int i, w = 0;
+
+    for (i = 0; i < n; i++) {
+        const gdPointF *a = &p[i ? i - 1 : n - 1];
+        const gdPointF *b = &p[i];
+        if ((a->y <= y) != (b->y <= y)) {
+            const double cx = a->x + (y - a->y) * (b->x - a->x) / (b->y - a->y);
+            if (cx > x) {
+                w += a->y < b->y ? 1 : -1;
+            }
+        }
+    }
+    return w;
+}
+
+/* the coverage of pixel (x, y) by the polygon, from 32x32 samples */
+static double sampledCoverage(const gdPointF *p, int n, int x, int y)
+{
+    int i, j, inside = 0;
+
+    for (j = 0; j < 32; j++) {
+        for (i = 0; i < 32; i++) {
+            if (winding(p, n, x - 0.5 + (i + 0.5) / 32, y - 0.5 + (j + 0.5) / 32)) {
+                inside++;
+            }
+        }
+    }
+    return inside / 1024.0;
+}
+
+/* an opaque black image the polygons are drawn onto in white, so that
+   the red channel of a pixel is its coverage */
+static gdImagePtr blackImage(int sx, int sy)
+{
+    gdImagePtr im = gdImageCreateTrueColor(sx, sy);
+    gdImageAlphaBlending(im, 0);
+    return im;
+}
+
+int main()
+{
+    const int white = gdTrueColor(255, 255, 255);
+    gdPointF square[4] = {{0, 0}, {10, 0}, {10, 10}, {0, 10}};
+    gdImagePtr im, clipped, pal, expected;
+    int i, k, x, y;
+
+    /* the pixel centers are on the outline */
+    im = blackImage(20, 20);
+    gdImageFilledPolygonAA(im, square, 4, white);
+    gdTestAssert(gdImageRed(im, gdImageTrueColorPixel(im, 5, 5)) == 255);
+    gdTestAssert(gdImageRed(im, gdImageTrueColorPixel(im, 0, 5)) == 128);
+    gdTestAssert(gdImageRed(im, gdImageTrueColorPixel(im, 10, 0)) == 64);
+    gdTestAssert(gdImageRed(im, gdImageTrueColorPixel(im, 11, 5)) == 0);
+    gdImageDestroy(im);
+
+    /* palette images get the pixels at least half covered */
+    pal = gdImageCreate(20, 20);
+    expected = gdImageCreate(20, 20);
+    gdImageColorAllocate(pal, 0, 0, 0);
+    gdImageColorAllocate(expected, 0, 0, 0);
+    gdImageFilledPolygonAA(pal, square, 4, gdImageColorAllocate(pal, 255, 255, 255));
+    gdImageFilledRectangle(expected, 0, 0, 10, 10, gdImageColorAllocate(expected, 255, 255, 255));
+    /* the corners are a quarter covered */
+    gdImageSetPixel(expected, 0, 0, 0);
+    gdImageSetPixel(expected, 10, 0, 0);
+    gdImageSetPixel(expected, 0, 10, 0);
+    gdImageSetPixel(expected, 10, 10, 0);
+    gdTestAssert(gdAssertImageEquals(expected, pal));
+    gdImageDestroy(pal);
+    gdImageDestroy(expected);
+
+    /* with alpha blending, the opacity of the color is scaled by the
+       coverage */
+    im = gdImageCreateTrueColor(20, 20);
+    gdImageFilledRectangle(im, 0, 0, 19, 19, gdTrueColor(10, 200, 30));
+    gdImageFilledPolygonAA(im, square, 4, gdTrueColorAlpha(250, 20, 100, 30));
+    gdTestAssert(gdImageTrueColorPixel(im, 5, 5) ==
+                 gdAlphaBlend(gdTrueColor(10, 200, 30), gdTrueColorAlpha(250, 20, 100, 30)));
+    gdTestAssert(gdImageTrueColorPixel(im, 0, 5) ==
+                 gdAlphaBlend(gdTrueColor(10, 200, 30), gdTrueColorAlpha(250, 20, 100, 78)));
+    gdImageDestroy(im);
+
+    /* random polygons reaching out of the image, with the vertices at
+       increasing angles around a point, so that they are simple */
+    for (k = 0; k < 10; k++) {
+        gdPointF p[12];
+        int n = 3 + k, worst = 0;
+
+        for (i = 0; i < n; i++) {
+            const double angle = (i + gdTestRandomInt(100) / 100.0) * 2 * 3.14159265358979323846 / n;
+            const double r = 5 + gdTestRandomInt(2500) / 100.0;
+            p[i].x = 20 + r * cos(angle);
+            p[i].y = 15 + r * sin(angle);
+        }
+        im = blackImage(40, 30);
+        clipped = blackImage(40, 30);
+        gdImageSetClip(clipped, 3, 4, 25, 20);
+        gdImageFilledPolygonAA(im, p, n, white);
+        gdImageFilledPolygonAA(clipped, p, n, white);
+
+        for (y = 0; y < 30; y++) {
+            for (x = 0; x < 40; x++) {
+                const int got = gdImageRed(im, gdImageTrueColorPixel(im, x, y));
+                const int d = abs(got - (int) (sampledCoverage(p, n, x, y) * 255 + 0.5));
+                const int inClip = x >= 3 && x <= 25 && y >= 4 && y <= 20;
+
+                worst = d > worst ? d : worst;
+                gdTestAssertMsg(gdImageTrueColorPixel(clipped, x, y) ==
+                                (inClip ? gdImageTrueColorPixel(im, x, y) : 0),
+                                "polygon %d clipped differs at %d,%d\n", k, x, y);
+            }
+        }
+        gdTestAssertMsg(worst <= 12, "polygon %d off by %d\n", k, worst);
+        gdImageDestroy(im);
+        gdImageDestroy(clipped);
+    }
+
+    return gdNumFailures();
+}
@@ -0,0 +1,29 @@
+/**
+ * gdImageSetClip() accepts a clipping rectangle with x1 > x2, which
+ * clips everything away; filling a polygon then draws nothing.
+ */
+
+
+#include "gd.h"
+#include "gdtest.h"
+
+
+int main()
+{
+	gdPoint points[] = {{5, 2}, {45, 4}, {25, 18}};
+	gdImagePtr im, expected;
+	int red;
+
+	im = gdImageCreate(50, 20);
+	gdImageColorAllocate(im, 255, 255, 255);
+	red = gdImageColorAllocate(im, 255, 0, 0);
+	expected = gdImageClone(im);
+
+	gdImageSetClip(im, 30, 0, 10, 19);
+	gdImageFilledPolygon(im, points, 3, red);
+	gdAssertImageEquals(expected, im);
+
+	gdImageDestroy(expected);
+	gdImageDestroy(im);
+	return gdNumFailures();
+}
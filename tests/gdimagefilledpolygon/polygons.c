@@ -0,0 +1,55 @@
+/**
+ * gdImageFilledPolygons() fills its polygons together with the even-odd
+ * rule: separate polygons come out as with gdImageFilledPolygon(), and
+ * polygons inside of others make holes.
+ */
+
+
+#include "gd.h"
+#include "gdtest.h"
+
+
+int main()
+{
+    gdPoint points[] = {
+        /* a triangle */
+        {5, 5}, {60, 12}, {20, 70},
+        /* a square with a diamond shaped hole */
+        {80, 10}, {150, 10}, {150, 80}, {80, 80},
+        {115, 20}, {140, 45}, {115, 70}, {90, 45},
+        /* a single point, which draws nothing */
+        {10, 90}
+    };
+    int counts[] = {3, 4, 4, 1};
+    gdImagePtr a, b, hole;
+    int red, x, y;
+
+    a = gdImageCreate(160, 100);
+    gdImageColorAllocate(a, 255, 255, 255);
+    red = gdImageColorAllocate(a, 255, 0, 0);
+    b = gdImageClone(a);
+    hole = gdImageClone(a);
+
+    gdImageFilledPolygons(a, points, counts, 4, red);
+
+    gdImageFilledPolygon(b, points, 3, red);
+    gdImageFilledPolygon(b, points + 3, 4, red);
+    /* the hole leaves the pixels on its outline, as those are where
+       runs of the square end */
+    gdImageFilledPolygon(hole, points + 7, 4, 1);
+    for (y = 0; y < 100; y++) {
+        for (x = 1; x < 159; x++) {
+            if (gdImageGetPixel(hole, x - 1, y) && gdImageGetPixel(hole, x + 1, y)) {
+                gdImageSetPixel(b, x, y, 0);
+            }
+        }
+    }
+
+    gdTestAssert(gdAssertImageEquals(b, a));
+
+    gdImageDestroy(a);
+    gdImageDestroy(b);
+    gdImageDestroy(hole);
+
+    return gdNumFailures();
+}
@@ -0,0 +1,64 @@
+/**
+ * Filled rectangles are filled a row at a time for plain colors; they
+ * must give the same results as setting each pixel, for all effects,
+ * with clipping and for widths that are no multiple of the vector size.
+ */
+
+
+#include "gd.h"
+#include "gdtest.h"
+
+
+static int effects[] = {
+    gdEffectReplace, gdEffectAlphaBlend, gdEffectNormal,
+    gdEffectOverlay, gdEffectMultiply
+};
+
+static int colors[] = {
+    0x00ff8040, 0x30ff8040, 0x7fff8040
+};
+
+int main()
+{
+    gdImagePtr a, b;
+    int e, c, x, y;
+
+    for (e = 0; e < (int) (sizeof(effects) / sizeof(effects[0])); e++) {
+        for (c = 0; c < (int) (sizeof(colors) / sizeof(colors[0])); c++) {
+            a = gdImageCreateTrueColor(41, 23);
+            b = gdImageCreateTrueColor(41, 23);
+            for (y = 0; y < 23; y++) {
+                for (x = 0; x < 41; x++) {
+                    gdImageSetPixel(a, x, y, gdTrueColorAlpha(x * 6, y * 11, 90, (x + y) % 128));
+                    gdImageSetPixel(b, x, y, gdTrueColorAlpha(x * 6, y * 11, 90, (x + y) % 128));
+                }
+            }
+            gdImageAlphaBlending(a, effects[e]);
+            gdImageAlphaBlending(b, effects[e]);
+            gdImageSetClip(a, 1, 2, 38, 20);
+            gdImageSetClip(b, 1, 2, 38, 20);
+
+            gdImageFilledRectangle(a, 39, -4, -3, 17, colors[c]);
+            for (y = -4; y <= 17; y++) {
+                for (x = -3; x <= 39; x++) {
+                    gdImageSetPixel(b, x, y, colors[c]);
+                }
+            }
+            gdTestAssert(gdAssertImageEquals(a, b));
+            gdImageDestroy(a);
+            gdImageDestroy(b);
+        }
+    }
+
+    a = gdImageCreate(41, 23);
+    gdImageColorAllocate(a, 0, 0, 0);
+    gdImageColorAllocate(a, 255, 0, 0);
+    gdImageFilledRectangle(a, 3, 4, 60, 10, 1);
+    gdTestAssert(gdImageGetPixel(a, 2, 4) == 0);
+    gdTestAssert(gdImageGetPixel(a, 3, 4) == 1);
+    gdTestAssert(gdImageGetPixel(a, 40, 10) == 1);
+    gdTestAssert(gdImageGetPixel(a, 40, 11) == 0);
+    gdImageDestroy(a);
+
+    return gdNumFailures();
+}
@@ -0,0 +1,47 @@
+/**
+ * gdImageFillToBorder() must fill regions of any shape completely, however
+ * many runs of pixels they consist of. The maze below is a single corridor
+ * winding through the whole image.
+ */
+
+
+#include "gd.h"
+#include "gdtest.h"
+
+
+#define W 601
+#define H 400
+
+int main()
+{
+    gdImagePtr im;
+    int border, c, x, y, ok = 1;
+
+    im = gdImageCreate(W, H);
+    gdImageColorAllocate(im, 0, 0, 0);
+    border = gdImageColorAllocate(im, 255, 255, 255);
+    c = gdImageColorAllocate(im, 255, 0, 0);
+
+    /* walls in every odd column, open alternately at the top and the bottom */
+    for (x = 1; x < W; x += 2) {
+        if (x / 2 % 2) {
+            gdImageLine(im, x, 1, x, H - 1, border);
+        } else {
+            gdImageLine(im, x, 0, x, H - 2, border);
+        }
+    }
+    gdImageFillToBorder(im, 0, 0, border, c);
+
+    for (y = 0; y < H; y++) {
+        for (x = 0; x < W; x++) {
+            const int p = gdImageGetPixel(im, x, y);
+            if (p != border && p != c) {
+                ok = 0;
+            }
+        }
+    }
+    gdTestAssert(ok);
+    gdImageDestroy(im);
+
+    return gdNumFailures();
+}
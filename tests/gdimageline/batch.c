@@ -0,0 +1,92 @@
+/**
+ * The batch drawing functions must draw the same as the respective
+ * number of single calls, for plain and special colors.
+ */
+
+
+#include "gd.h"
+#include "gdtest.h"
+
+
+#define N 200
+
+static int effects[] = {
+    gdEffectReplace, gdEffectAlphaBlend, gdEffectOverlay, gdEffectMultiply
+};
+
+static void draw(gdImagePtr a, gdImagePtr b, int color)
+{
+    gdPoint p[2 * N];
+    gdRect r[N];
+    int i;
+
+    for (i = 0; i < 2 * N; i++) {
+        p[i].x = gdTestRandomInt(140) - 20;
+        p[i].y = gdTestRandomInt(120) - 20;
+    }
+    for (i = 0; i < N; i++) {
+        r[i].x = gdTestRandomInt(140) - 20;
+        r[i].y = gdTestRandomInt(120) - 20;
+        r[i].width = gdTestRandomInt(30) - 2;
+        r[i].height = gdTestRandomInt(30) - 2;
+    }
+
+    gdImageLines(a, p, N, color);
+    for (i = 0; i < N; i++) {
+        gdImageLine(b, p[2 * i].x, p[2 * i].y, p[2 * i + 1].x, p[2 * i + 1].y, color);
+    }
+
+    gdImageFilledRectangles(a, r, N, color);
+    for (i = 0; i < N; i++) {
+        if (r[i].width > 0 && r[i].height > 0) {
+            gdImageFilledRectangle(b, r[i].x, r[i].y, r[i].x + r[i].width - 1,
+                                   r[i].y + r[i].height - 1, color);
+        }
+    }
+
+    gdImageFilledEllipses(a, p, N, 9, 6, color);
+    for (i = 0; i < N; i++) {
+        gdImageFilledEllipse(b, p[i].x, p[i].y, 9, 6, color);
+    }
+}
+
+int main()
+{
+    gdImagePtr a, b;
+    int style[3];
+    int e;
+
+    for (e = 0; e < (int) (sizeof(effects) / sizeof(effects[0])); e++) {
+        a = gdImageCreateTrueColor(100, 80);
+        b = gdImageCreateTrueColor(100, 80);
+        gdImageAlphaBlending(a, effects[e]);
+        gdImageAlphaBlending(b, effects[e]);
+        gdImageSetClip(a, 5, 3, 90, 70);
+        gdImageSetClip(b, 5, 3, 90, 70);
+        draw(a, b, 0x30ff8040);
+        gdTestAssert(gdAssertImageEquals(a, b));
+        gdImageDestroy(a);
+        gdImageDestroy(b);
+    }
+
+    a = gdImageCreate(100, 80);
+    b = gdImageCreate(100, 80);
+    gdImageColorAllocate(a, 0, 0, 0);
+    gdImageColorAllocate(b, 0, 0, 0);
+    gdImageColorAllocate(a, 255, 0, 0);
+    gdImageColorAllocate(b, 255, 0, 0);
+    draw(a, b, 1);
+    gdTestAssert(gdAssertImageEquals(a, b));
+
+    style[0] = 1;
+    style[1] = gdTransparent;
+    style[2] = 0;
+    gdImageSetStyle(a, style, 3);
+    gdImageSetStyle(b, style, 3);
+    draw(a, b, gdStyled);
+    gdTestAssert(gdAssertImageEquals(a, b));
+    gdImageDestroy(a);
+    gdImageDestroy(b);
+
+    return gdNumFailures();
+}
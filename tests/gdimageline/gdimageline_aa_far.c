@@ -0,0 +1,32 @@
+/**
+ * Anti-aliased lines with end points far outside of the image must be
+ * clipped without overflowing, and must only touch pixels within the
+ * clipping rectangle.
+ */
+
+
+#include "gd.h"
+#include "gdtest.h"
+
+
+int main()
+{
+	gdImagePtr im;
+
+	im = gdImageCreateTrueColor(59, 6);
+	gdImageSetAntiAliased(im, gdTrueColorAlpha(255, 255, 255, 0));
+
+	/* mostly vertical */
+	gdImageLine(im, 41, 2000000000, 27, -2000000000, gdAntiAliased);
+	gdImageLine(im, -2000000000, 2000000000, 2000000000, -1999999999, gdAntiAliased);
+	/* mostly horizontal */
+	gdImageLine(im, 2000000000, 41, -2000000000, 27, gdAntiAliased);
+	gdImageLine(im, -2000000000, -1999999999, 2000000000, 2000000000, gdAntiAliased);
+
+	gdImageSetClip(im, 10, 1, 40, 4);
+	gdImageLine(im, 41, 2000000000, 27, -2000000000, gdAntiAliased);
+	gdImageLine(im, 2000000000, 3, -2000000000, 2, gdAntiAliased);
+
+	gdImageDestroy(im);
+	return gdNumFailures();
+}
@@ -0,0 +1,45 @@
+/**
+ * gdImageSetClip() accepts a clipping rectangle with x1 > x2, which
+ * clips everything away; drawing lines, filled ellipses and rectangles,
+ * one at a time or in batches, then draws nothing.
+ */
+
+
+#include "gd.h"
+#include "gdtest.h"
+
+
+static void draw(gdImagePtr im, int color)
+{
+	gdPoint c[] = {{20, 10}, {35, 8}};
+	gdRect r[] = {{5, 2, 30, 10}, {12, 0, 5, 20}};
+
+	gdImageLine(im, 0, 5, 49, 7, color);
+	gdImageLine(im, 3, 0, 45, 19, color);
+	gdImageFilledEllipse(im, 25, 10, 30, 12, color);
+	gdImageFilledEllipses(im, c, 2, 20, 10, color);
+	gdImageFilledRectangle(im, 5, 5, 40, 15, color);
+	gdImageFilledRectangles(im, r, 2, color);
+}
+
+int main()
+{
+	gdImagePtr im, expected;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		if (i) {
+			im = gdImageCreateTrueColor(50, 20);
+		} else {
+			im = gdImageCreate(50, 20);
+			gdImageColorAllocate(im, 255, 255, 255);
+		}
+		expected = gdImageClone(im);
+		gdImageSetClip(im, 30, 0, 10, 19);
+		draw(im, gdImageColorAllocate(im, 255, 0, 0));
+		gdAssertImageEquals(expected, im);
+		gdImageDestroy(expected);
+		gdImageDestroy(im);
+	}
+	return gdNumFailures();
+}
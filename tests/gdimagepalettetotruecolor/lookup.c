@@ -0,0 +1,46 @@
+/**
+ * gdImagePaletteToTrueColor() converts all pixels through the palette,
+ * making the transparent color fully transparent, for any width.
+ */
+
+
+#include "gd.h"
+#include "gdtest.h"
+
+
+int main()
+{
+    gdImagePtr im;
+    int i, x, y, c, expected;
+    int red[gdMaxColors], green[gdMaxColors], blue[gdMaxColors], alpha[gdMaxColors];
+
+    im = gdImageCreate(37, 5);
+    for (i = 0; i < gdMaxColors; i++) {
+        red[i] = i;
+        green[i] = 255 - i;
+        blue[i] = (i * 7) & 255;
+        alpha[i] = i & 127;
+        gdImageColorAllocateAlpha(im, red[i], green[i], blue[i], alpha[i]);
+    }
+    gdImageColorTransparent(im, 200);
+    for (y = 0; y < 5; y++) {
+        for (x = 0; x < 37; x++) {
+            gdImageSetPixel(im, x, y, (x * 11 + y * 37) & 255);
+        }
+    }
+
+    gdTestAssert(gdImagePaletteToTrueColor(im));
+    gdTestAssert(gdImageTrueColor(im));
+    for (y = 0; y < 5; y++) {
+        for (x = 0; x < 37; x++) {
+            c = (x * 11 + y * 37) & 255;
+            expected = c == 200 ? gdTrueColorAlpha(0, 0, 0, gdAlphaTransparent)
+                       : gdTrueColorAlpha(red[c], green[c], blue[c], alpha[c]);
+            gdTestAssert(gdImageGetPixel(im, x, y) == expected);
+        }
+    }
+    gdTestAssert(gdImageGetTransparent(im) == gdTrueColorAlpha(red[200], green[200], blue[200], gdAlphaTransparent));
+
+    gdImageDestroy(im);
+    return gdNumFailures();
+}
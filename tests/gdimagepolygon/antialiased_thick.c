@@ -0,0 +1,69 @@
+/**
+ * Thick anti-aliased outlines are drawn as one stroke: each pixel is
+ * blended once, with its coverage by the stroke, also where the segments
+ * are joined or the outline crosses itself.
+ */
+
+
+#include "gd.h"
+#include "gdtest.h"
+
+
+int main()
+{
+    gdPoint zigzag[6] = {{10, 10}, {90, 20}, {20, 40}, {85, 70}, {15, 65}, {50, 50}};
+    gdPoint square[4] = {{20, 20}, {60, 20}, {60, 60}, {20, 60}};
+    const int translucent = gdTrueColorAlpha(0, 0, 0, 64);
+    gdImagePtr im;
+    int x, y, full, lightest;
+
+    /* a thick horizontal line covers its width, and half a pixel beyond
+       its end points */
+    im = gdImageCreateTrueColor(40, 20);
+    gdImageFilledRectangle(im, 0, 0, 39, 19, 0xFFFFFF);
+    gdImageSetThickness(im, 4);
+    gdImageSetAntiAliased(im, 0x000000);
+    gdImageLine(im, 10, 10, 30, 10, gdAntiAliased);
+    gdTestAssert(gdImageTrueColorPixel(im, 10, 9) == 0x000000);
+    gdTestAssert(gdImageTrueColorPixel(im, 30, 11) == 0x000000);
+    gdTestAssert(gdImageTrueColorPixel(im, 20, 7) == 0xFFFFFF);
+    gdTestAssert(gdImageTrueColorPixel(im, 9, 10) == 0xFFFFFF);
+    gdTestAssert(gdImageRed(im, gdImageTrueColorPixel(im, 20, 8)) > 100 &&
+                 gdImageRed(im, gdImageTrueColorPixel(im, 20, 8)) < 156);
+    gdImageDestroy(im);
+
+    /* with a translucent color, no pixel gets darker than the color
+       blended once, and the inside of the stroke gets exactly that */
+    im = gdImageCreateTrueColor(100, 80);
+    gdImageFilledRectangle(im, 0, 0, 99, 79, 0xFFFFFF);
+    full = gdAlphaBlend(0xFFFFFF, translucent);
+    gdImageSetThickness(im, 6);
+    gdImageSetAntiAliased(im, translucent);
+    gdImageOpenPolygon(im, zigzag, 6, gdAntiAliased);
+    lightest = 255;
+    for (y = 0; y < 80; y++) {
+        for (x = 0; x < 100; x++) {
+            const int red = gdImageRed(im, gdImageTrueColorPixel(im, x, y));
+            lightest = red < lightest ? red : lightest;
+        }
+    }
+    gdTestAssertMsg(lightest == gdTrueColorGetRed(full), "darkest red %d\n", lightest);
+    gdTestAssert(gdImageTrueColorPixel(im, 90, 20) == full);
+    gdTestAssert(gdImageTrueColorPixel(im, 20, 40) == full);
+    gdImageDestroy(im);
+
+    /* closed outlines have rounded outer corners, and full inner ones */
+    im = gdImageCreateTrueColor(80, 80);
+    gdImageFilledRectangle(im, 0, 0, 79, 79, 0xFFFFFF);
+    gdImageSetThickness(im, 8);
+    gdImageSetAntiAliased(im, 0x000000);
+    gdImagePolygon(im, square, 4, gdAntiAliased);
+    gdTestAssert(gdImageTrueColorPixel(im, 23, 23) == 0x000000);
+    gdTestAssert(gdImageTrueColorPixel(im, 25, 25) == 0xFFFFFF);
+    gdTestAssert(gdImageTrueColorPixel(im, 40, 17) == 0x000000);
+    gdTestAssert(gdImageTrueColorPixel(im, 16, 16) == 0xFFFFFF);
+    gdTestAssert(gdImageTrueColorPixel(im, 64, 64) == 0xFFFFFF);
+    gdImageDestroy(im);
+
+    return gdNumFailures();
+}
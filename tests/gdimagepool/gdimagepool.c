@@ -0,0 +1,57 @@
+/**
+ * Images given back to a pool are handed out again for the same size and
+ * type, in the state of a freshly created image.
+ */
+
+
+#include "gd.h"
+#include "gdtest.h"
+
+
+int main()
+{
+	gdImagePoolPtr pool;
+	gdImagePtr im, im2, im3;
+	int **rows;
+
+	pool = gdImagePoolCreate(2);
+	gdTestAssert(pool != NULL);
+
+	im = gdImagePoolGet(pool, 40, 30, 1);
+	gdTestAssert(im != NULL && gdImageTrueColor(im));
+	gdImageFilledRectangle(im, 0, 0, 39, 29, 0x336699);
+	gdImageAlphaBlending(im, 0);
+	gdImageSetClip(im, 5, 5, 10, 10);
+	rows = im->tpixels;
+	gdImagePoolPut(pool, im);
+
+	im = gdImagePoolGet(pool, 40, 30, 1);
+	gdTestAssert(im->tpixels == rows);
+	gdTestAssert(gdImageGetPixel(im, 20, 20) == 0);
+	gdTestAssert(im->alphaBlendingFlag == 1);
+	gdTestAssert(im->cx1 == 0 && im->cy1 == 0 && im->cx2 == 39 && im->cy2 == 29);
+
+	/* different type or size: a new image */
+	im2 = gdImagePoolGet(pool, 40, 30, 0);
+	gdTestAssert(im2 != NULL && !gdImageTrueColor(im2));
+	gdTestAssert(im2->colorsTotal == 0);
+	im3 = gdImagePoolGet(pool, 41, 30, 1);
+	gdTestAssert(im3 != NULL && im3->tpixels != rows);
+
+	/* the third image evicts the least recently returned one */
+	gdImagePoolPut(pool, im);
+	gdImagePoolPut(pool, im2);
+	gdImagePoolPut(pool, im3);
+	im = gdImagePoolGet(pool, 41, 30, 1);
+	gdTestAssert(im == im3);
+	gdImageDestroy(im);
+
+	gdImagePoolDestroy(pool);
+
+	/* without a pool, images are created and destroyed */
+	im = gdImagePoolGet(NULL, 10, 10, 1);
+	gdTestAssert(im != NULL);
+	gdImagePoolPut(NULL, im);
+
+	return gdNumFailures();
+}
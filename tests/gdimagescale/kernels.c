@@ -0,0 +1,76 @@
+/**
+ * The two pass scaling uses vectorized kernels for whole blocks of
+ * pixels and scalar code for the rest; both must give the same results,
+ * and scaling rows must give what scaling the columns of the transposed
+ * image gives.
+ */
+
+
+#include "gd.h"
+#include "gdtest.h"
+
+
+static gdImagePtr transpose(gdImagePtr im)
+{
+    gdImagePtr res = gdImageCreateTrueColor(im->sy, im->sx);
+    int x, y;
+
+    for (y = 0; y < im->sy; y++) {
+        for (x = 0; x < im->sx; x++) {
+            res->tpixels[x][y] = im->tpixels[y][x];
+        }
+    }
+    return res;
+}
+
+int main()
+{
+    gdImagePtr src, t, dst, col, part;
+    gdRect r = {0, 0, 1, 23};
+    int x, y, i;
+    const int cols[] = {0, 7, 8, 22, 36};
+
+    /* neither width is a multiple of the vector widths */
+    src = gdImageCreateTrueColor(37, 23);
+    for (y = 0; y < 23; y++) {
+        for (x = 0; x < 37; x++) {
+            src->tpixels[y][x] = gdTrueColorAlpha(gdTestRandomInt(256), gdTestRandomInt(256),
+                                                  gdTestRandomInt(256), gdTestRandomInt(128));
+        }
+    }
+    gdImageSetInterpolationMethod(src, GD_CATMULLROM);
+
+    /* columns on their own only go through the scalar code */
+    dst = gdImageScale(src, 37, 10);
+    for (i = 0; i < 5; i++) {
+        r.x = cols[i];
+        part = gdImageCrop(src, &r);
+        gdImageSetInterpolationMethod(part, GD_CATMULLROM);
+        col = gdImageScale(part, 1, 10);
+        for (y = 0; y < 10; y++) {
+            gdTestAssert(col->tpixels[y][0] == dst->tpixels[y][cols[i]]);
+        }
+        gdImageDestroy(col);
+        gdImageDestroy(part);
+    }
+    gdImageDestroy(dst);
+
+    /* an odd and an even number of taps */
+    for (i = 0; i < 2; i++) {
+        const int len = i ? 9 : 61;
+
+        dst = gdImageScale(src, len, 23);
+        t = transpose(src);
+        gdImageSetInterpolationMethod(t, GD_CATMULLROM);
+        col = gdImageScale(t, 23, len);
+        gdImageDestroy(t);
+        t = transpose(col);
+        gdAssertImageEquals(dst, t);
+        gdImageDestroy(t);
+        gdImageDestroy(col);
+        gdImageDestroy(dst);
+    }
+
+    gdImageDestroy(src);
+    return gdNumFailures();
+}
@@ -0,0 +1,55 @@
+/**
+ * Scaling a palette image with a generic filter must give what scaling
+ * its truecolor conversion gives, and leave the source a palette image.
+ */
+
+
+#include "gd.h"
+#include "gdtest.h"
+
+
+static void check(gdImagePtr pal, gdImagePtr tc, int width, int height)
+{
+    gdImagePtr scaled_pal, scaled_tc;
+
+    scaled_pal = gdImageScale(pal, width, height);
+    scaled_tc = gdImageScale(tc, width, height);
+    if (!gdTestAssert(scaled_pal != NULL && scaled_tc != NULL)) {
+        return;
+    }
+    gdTestAssert(!gdImageTrueColor(pal));
+    gdAssertImageEquals(scaled_tc, scaled_pal);
+    gdImageDestroy(scaled_pal);
+    gdImageDestroy(scaled_tc);
+}
+
+int main()
+{
+    gdImagePtr pal, tc;
+    int i, x, y;
+
+    pal = gdImageCreate(50, 40);
+    for (i = 0; i < 16; i++) {
+        gdImageColorAllocateAlpha(pal, i * 16, 255 - i * 16, (i * 90) & 255, i * 8);
+    }
+    gdImageColorTransparent(pal, 5);
+    for (y = 0; y < 40; y++) {
+        for (x = 0; x < 50; x++) {
+            gdImageSetPixel(pal, x, y, (x / 3 + y / 5) & 15);
+        }
+    }
+    gdImageSetInterpolationMethod(pal, GD_MITCHELL);
+
+    tc = gdImageClone(pal);
+    gdImageColorTransparent(tc, 5);
+    gdImagePaletteToTrueColor(tc);
+    gdImageSetInterpolationMethod(tc, GD_MITCHELL);
+
+    check(pal, tc, 23, 71);
+    check(pal, tc, 50, 17);
+    check(pal, tc, 90, 40);
+
+    gdImageDestroy(pal);
+    gdImageDestroy(tc);
+    return gdNumFailures();
+}
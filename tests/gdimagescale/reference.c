@@ -0,0 +1,493 @@
+/**
+ * The two pass scaling computes with fixed point weights; for every
+ * filter, each pass must give each channel within one of what computing
+ * with the double weights of the filter gives.
+ *
+ * Both passes round. Where the first one hits an exact tie, which the
+ * double weights break either way, filters with negative lobes may add
+ * up the differences of neighboring pixels, so after both passes they
+ * are only within two.
+ */
+
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gd.h"
+#include "gdtest.h"
+
+#ifndef M_PI
+# define M_PI 3.14159265358979323846
+#endif
+
+
+/* The filters, as in gd_interpolation.c */
+
+static double bessel_j1(const double x)
+{
+    static const double
+    Pone[] = {
+        0.581199354001606143928050809e+21,
+        -0.6672106568924916298020941484e+20,
+        0.2316433580634002297931815435e+19,
+        -0.3588817569910106050743641413e+17,
+        0.2908795263834775409737601689e+15,
+        -0.1322983480332126453125473247e+13,
+        0.3413234182301700539091292655e+10,
+        -0.4695753530642995859767162166e+7,
+        0.270112271089232341485679099e+4
+    },
+    Qone[] = {
+        0.11623987080032122878585294e+22,
+        0.1185770712190320999837113348e+20,
+        0.6092061398917521746105196863e+17,
+        0.2081661221307607351240184229e+15,
+        0.5243710262167649715406728642e+12,
+        0.1013863514358673989967045588e+10,
+        0.1501793594998585505921097578e+7,
+        0.1606931573481487801970916749e+4,
+        0.1e+1
+    };
+    double p = Pone[8], q = Qone[8];
+    long i;
+
+    for (i = 7; i >= 0; i--) {
+        p = p*x*x+Pone[i];
+        q = q*x*x+Qone[i];
+    }
+    return p/q;
+}
+
+static double bessel_p1(const double x)
+{
+    static const double
+    Pone[] = {
+        0.352246649133679798341724373e+5,
+        0.62758845247161281269005675e+5,
+        0.313539631109159574238669888e+5,
+        0.49854832060594338434500455e+4,
+        0.2111529182853962382105718e+3,
+        0.12571716929145341558495e+1
+    },
+    Qone[] = {
+        0.352246649133679798068390431e+5,
+        0.626943469593560511888833731e+5,
+        0.312404063819041039923015703e+5,
+        0.4930396490181088979386097e+4,
+        0.2030775189134759322293574e+3,
+        0.1e+1
+    };
+    double p = Pone[5], q = Qone[5];
+    long i;
+
+    for (i = 4; i >= 0; i--) {
+        p = p*(8.0/x)*(8.0/x)+Pone[i];
+        q = q*(8.0/x)*(8.0/x)+Qone[i];
+    }
+    return p/q;
+}
+
+static double bessel_q1(const double x)
+{
+    static const double
+    Pone[] = {
+        0.3511751914303552822533318e+3,
+        0.7210391804904475039280863e+3,
+        0.4259873011654442389886993e+3,
+        0.831898957673850827325226e+2,
+        0.45681716295512267064405e+1,
+        0.3532840052740123642735e-1
+    },
+    Qone[] = {
+        0.74917374171809127714519505e+4,
+        0.154141773392650970499848051e+5,
+        0.91522317015169922705904727e+4,
+        0.18111867005523513506724158e+4,
+        0.1038187585462133728776636e+3,
+        0.1e+1
+    };
+    double p = Pone[5], q = Qone[5];
+    long i;
+
+    for (i = 4; i >= 0; i--) {
+        p = p*(8.0/x)*(8.0/x)+Pone[i];
+        q = q*(8.0/x)*(8.0/x)+Qone[i];
+    }
+    return p/q;
+}
+
+static double bessel_order1(double x)
+{
+    double p, q;
+
+    if (x == 0.0)
+        return 0.0f;
+    p = x;
+    if (x < 0.0)
+        x = -x;
+    if (x < 8.0)
+        return p*bessel_j1(x);
+    q = (double)sqrt(2.0f/(M_PI*x))*(double)(bessel_p1(x)*(1.0f/sqrt(2.0f)*(sin(x)-cos(x)))-8.0f/x*bessel_q1(x)*
+        (-1.0f/sqrt(2.0f)*(sin(x)+cos(x))));
+    if (p < 0.0f)
+        q = -q;
+    return q;
+}
+
+static double filter_bessel(const double x)
+{
+    if (x == 0.0f)
+        return (double)(M_PI/4.0f);
+    return bessel_order1((double)M_PI*x)/(2.0f*x);
+}
+
+static double filter_bell(const double x1)
+{
+    const double x = x1 < 0.0 ? -x1 : x1;
+
+    if (x < 0.5) return 0.75 - x*x;
+    if (x < 1.5) return 0.5 * pow(x - 1.5, 2.0);
+    return 0.0;
+}
+
+static double filter_blackman(const double x)
+{
+    return 0.42f+0.5f*(double)cos(M_PI*x)+0.08f*(double)cos(2.0f*M_PI*x);
+}
+
+static double filter_box(double x)
+{
+    if (x < -0.5f)
+        return 0.0f;
+    if (x < 0.5f)
+        return 1.0f;
+    return 0.0f;
+}
+
+static double filter_bspline(const double x)
+{
+    double a, b, c, d;
+    const double xm1 = x - 1.0f;
+    const double xp1 = x + 1.0f;
+    const double xp2 = x + 2.0f;
+
+    if (x > 2.0f)
+        return 0.0f;
+    if (xp2 <= 0.0f) a = 0.0f; else a = xp2*xp2*xp2;
+    if (xp1 <= 0.0f) b = 0.0f; else b = xp1*xp1*xp1;
+    if (x <= 0) c = 0.0f; else c = x*x*x;
+    if (xm1 <= 0.0f) d = 0.0f; else d = xm1*xm1*xm1;
+    return 0.16666666666666666667f * (a - (4.0f * b) + (6.0f * c) - (4.0f * d));
+}
+
+static double filter_catmullrom(const double x)
+{
+    if (x < -2.0)
+        return 0.0f;
+    if (x < -1.0)
+        return 0.5f*(4.0f+x*(8.0f+x*(5.0f+x)));
+    if (x < 0.0)
+        return 0.5f*(2.0f+x*x*(-5.0f-3.0f*x));
+    if (x < 1.0)
+        return 0.5f*(2.0f+x*x*(-5.0f+3.0f*x));
+    if (x < 2.0)
+        return 0.5f*(4.0f+x*(-8.0f+x*(5.0f-x)));
+    return 0.0f;
+}
+
+static double filter_gaussian(const double x)
+{
+    return (double)(exp(-2.0f * x * x) * 0.79788456080287f);
+}
+
+static double filter_generalized_cubic(const double t)
+{
+    const double a = -0.5f;
+    const double abs_t = fabs(t);
+    const double abs_t_sq = abs_t * abs_t;
+
+    if (abs_t < 1) return (a + 2) * abs_t_sq * abs_t - (a + 3) * abs_t_sq + 1;
+    if (abs_t < 2) return a * abs_t_sq * abs_t - 5 * a * abs_t_sq + 8 * a * abs_t - 4 * a;
+    return 0;
+}
+
+static double filter_hermite(const double x1)
+{
+    const double x = x1 < 0.0 ? -x1 : x1;
+
+    if (x < 1.0) return (2.0 * x - 3) * x * x + 1.0;
+    return 0.0;
+}
+
+static double filter_hamming(const double x)
+{
+    if (x < -1.0f)
+        return 0.0f;
+    if (x < 0.0f)
+        return 0.92f*(-2.0f*x-3.0f)*x*x+1.0f;
+    if (x < 1.0f)
+        return 0.92f*(2.0f*x-3.0f)*x*x+1.0f;
+    return 0.0f;
+}
+
+static double filter_hanning(const double x)
+{
+    return 0.5 + 0.5 * cos(M_PI * x);
+}
+
+static double filter_mitchell(const double x)
+{
+    const double B = 1.0f/3.0f, C = 1.0f/3.0f;
+    const double P0 = (6.0f - 2.0f * B) / 6.0f;
+    const double P2 = (-18.0f + 12.0f * B + 6.0f * C) / 6.0f;
+    const double P3 = (12.0f - 9.0f * B - 6.0f * C) / 6.0f;
+    const double Q0 = (8.0f * B + 24.0f * C) / 6.0f;
+    const double Q1 = (-12.0f * B - 48.0f * C) / 6.0f;
+    const double Q2 = (6.0f * B + 30.0f * C) / 6.0f;
+    const double Q3 = (-1.0f * B - 6.0f * C) / 6.0f;
+
+    if (x < -2.0)
+        return 0.0f;
+    if (x < -1.0)
+        return Q0-x*(Q1-x*(Q2-x*Q3));
+    if (x < 0.0f)
+        return P0+x*x*(P2-x*P3);
+    if (x < 1.0f)
+        return P0+x*x*(P2+x*P3);
+    if (x < 2.0f)
+        return Q0+x*(Q1+x*(Q2+x*Q3));
+    return 0.0f;
+}
+
+static double filter_power(const double x)
+{
+    if (fabs(x) > 1) return 0.0f;
+    return 1.0f - (double)fabs(pow(x, 2.0f));
+}
+
+static double filter_quadratic(const double x1)
+{
+    const double x = x1 < 0.0 ? -x1 : x1;
+
+    if (x <= 0.5) return -2.0 * x * x + 1;
+    if (x <= 1.5) return x * x - 2.5 * x + 1.5;
+    return 0.0;
+}
+
+static double filter_sinc(const double x)
+{
+    if (x == 0.0) return 1.0;
+    return sin(M_PI * x) / (M_PI * x);
+}
+
+static double filter_triangle(const double x1)
+{
+    const double x = x1 < 0.0 ? -x1 : x1;
+
+    if (x < 1.0) return 1.0 - x;
+    return 0.0;
+}
+
+typedef double (*filter_fn)(double);
+
+static const struct {
+    gdInterpolationMethod id;
+    filter_fn filter;
+    const char *name;
+    int negative; /* has negative weights */
+} filters[] = {
+    {GD_BELL, filter_bell, "bell", 0},
+    {GD_BESSEL, filter_bessel, "bessel", 1},
+    {GD_BLACKMAN, filter_blackman, "blackman", 0},
+    {GD_BOX, filter_box, "box", 0},
+    {GD_BSPLINE, filter_bspline, "bspline", 0},
+    {GD_CATMULLROM, filter_catmullrom, "catmullrom", 1},
+    {GD_GAUSSIAN, filter_gaussian, "gaussian", 0},
+    {GD_GENERALIZED_CUBIC, filter_generalized_cubic, "generalized cubic", 1},
+    {GD_HERMITE, filter_hermite, "hermite", 0},
+    {GD_HAMMING, filter_hamming, "hamming", 0},
+    {GD_HANNING, filter_hanning, "hanning", 0},
+    {GD_MITCHELL, filter_mitchell, "mitchell", 1},
+    {GD_POWER, filter_power, "power", 0},
+    {GD_QUADRATIC, filter_quadratic, "quadratic", 1},
+    {GD_SINC, filter_sinc, "sinc", 1},
+    {GD_TRIANGLE, filter_triangle, "triangle", 0}
+};
+
+
+/* The channel as the double path rounds and clamps it */
+static int clamp_channel(double v, int max)
+{
+    const int r = (int)floor(v + 0.5);
+
+    return r < 0 ? 0 : (r > max ? max : r);
+}
+
+/* Scales the src_len pixels of src to the dst_len pixels of dst, the
+   way the two pass scaling does with double weights */
+static void scale_line(int *dst, unsigned int dst_len,
+                       const int *src, unsigned int src_len, filter_fn filter)
+{
+    const double scale = (double)dst_len / (double)src_len;
+    const double scale_f = scale < 1.0 ? scale : 1.0;
+    const double width = scale < 1.0 ? 0.5f / scale : 0.5f;
+    const int windows_size = 2 * (int)ceil(width) + 1;
+    unsigned int u;
+
+    for (u = 0; u < dst_len; u++) {
+        const double center = (double)u / scale;
+        int left = (int)floor(center - width);
+        int right = (int)ceil(center + width);
+        double *w = malloc(windows_size * sizeof(double));
+        double total = 0.0, r = 0, g = 0, b = 0, a = 0;
+        int i;
+
+        left = left < 0 ? 0 : left;
+        right = right > (int)src_len - 1 ? (int)src_len - 1 : right;
+        if (right - left + 1 > windows_size) {
+            if (left < (int)src_len) {
+                left++;
+            } else {
+                right--;
+            }
+        }
+        for (i = left; i <= right; i++) {
+            total += (w[i - left] = scale_f * filter(scale_f * (center - (double)i)));
+        }
+        for (i = left; i <= right; i++) {
+            const int px = src[i];
+            const double wi = total > 0.0 ? w[i - left] / total : w[i - left];
+
+            r += wi * gdTrueColorGetRed(px);
+            g += wi * gdTrueColorGetGreen(px);
+            b += wi * gdTrueColorGetBlue(px);
+            a += wi * gdTrueColorGetAlpha(px);
+        }
+        dst[u] = gdTrueColorAlpha(clamp_channel(r, 0xFF), clamp_channel(g, 0xFF),
+                                  clamp_channel(b, 0xFF), clamp_channel(a, 0x7F));
+        free(w);
+    }
+}
+
+static gdImagePtr scale_reference(gdImagePtr src, int width, int height, filter_fn filter)
+{
+    gdImagePtr tmp, dst;
+    int x, y;
+
+    /* a pass is left out if the size stays the same */
+    tmp = gdImageCreateTrueColor(width, src->sy);
+    for (y = 0; y < src->sy; y++) {
+        if (width == src->sx) {
+            memcpy(tmp->tpixels[y], src->tpixels[y], width * sizeof(int));
+        } else {
+            scale_line(tmp->tpixels[y], width, src->tpixels[y], src->sx, filter);
+        }
+    }
+    if (height == src->sy) {
+        return tmp;
+    }
+    dst = gdImageCreateTrueColor(width, height);
+    for (x = 0; x < width; x++) {
+        int col[256], res[256];
+
+        for (y = 0; y < src->sy; y++) {
+            col[y] = tmp->tpixels[y][x];
+        }
+        scale_line(res, height, col, src->sy, filter);
+        for (y = 0; y < height; y++) {
+            dst->tpixels[y][x] = res[y];
+        }
+    }
+    gdImageDestroy(tmp);
+    return dst;
+}
+
+static int channel_diff(int p, int q)
+{
+    int d, max = 0;
+
+    d = abs(gdTrueColorGetRed(p) - gdTrueColorGetRed(q));
+    max = d > max ? d : max;
+    d = abs(gdTrueColorGetGreen(p) - gdTrueColorGetGreen(q));
+    max = d > max ? d : max;
+    d = abs(gdTrueColorGetBlue(p) - gdTrueColorGetBlue(q));
+    max = d > max ? d : max;
+    d = abs(gdTrueColorGetAlpha(p) - gdTrueColorGetAlpha(q));
+    return d > max ? d : max;
+}
+
+/* Checks that no channel of src scaled with filter f is more than max
+   off the double path */
+static void check(gdImagePtr src, unsigned int f, int width, int height, int max)
+{
+    gdImagePtr dst, ref;
+    int x, y, worst = 0;
+
+    gdImageSetInterpolationMethod(src, filters[f].id);
+    dst = gdImageScale(src, width, height);
+    if (!gdTestAssertMsg(dst != NULL, "%s to %dx%d failed\n", filters[f].name, width, height)) {
+        return;
+    }
+    ref = scale_reference(src, width, height, filters[f].filter);
+    for (y = 0; y < dst->sy; y++) {
+        for (x = 0; x < dst->sx; x++) {
+            const int d = channel_diff(dst->tpixels[y][x], ref->tpixels[y][x]);
+            worst = d > worst ? d : worst;
+        }
+    }
+    gdTestAssertMsg(worst <= max, "%s to %dx%d is off by %d\n",
+                    filters[f].name, width, height, worst);
+    gdImageDestroy(ref);
+    gdImageDestroy(dst);
+}
+
+static gdImagePtr random_image(int width, int height)
+{
+    gdImagePtr im = gdImageCreateTrueColor(width, height);
+    int x, y;
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            im->tpixels[y][x] = gdTrueColorAlpha(gdTestRandomInt(256), gdTestRandomInt(256),
+                                                 gdTestRandomInt(256), gdTestRandomInt(128));
+        }
+    }
+    return im;
+}
+
+int main()
+{
+    /* down and up, by odd and by whole factors */
+    static const int widths[] = {3, 23, 60, 122, 183, 201};
+    static const int heights[] = {2, 17, 46, 94, 141, 200};
+    static const int sizes[][2] = {
+        {23, 17}, {150, 100}, {9, 200}, {201, 6}, {122, 94}, {183, 141}
+    };
+    /* hundreds of taps */
+    static const int narrow[] = {2, 7, 30};
+    gdImagePtr src, wide;
+    unsigned int f, s;
+
+    src = random_image(61, 47);
+    wide = random_image(1999, 4);
+
+    for (f = 0; f < sizeof(filters) / sizeof(filters[0]); f++) {
+        /* one pass */
+        for (s = 0; s < sizeof(widths) / sizeof(widths[0]); s++) {
+            check(src, f, widths[s], src->sy, 1);
+            check(src, f, src->sx, heights[s], 1);
+        }
+        for (s = 0; s < sizeof(narrow) / sizeof(narrow[0]); s++) {
+            check(wide, f, narrow[s], wide->sy, 1);
+        }
+        /* both */
+        for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            check(src, f, sizes[s][0], sizes[s][1], filters[f].negative ? 2 : 1);
+        }
+    }
+
+    gdImageDestroy(wide);
+    gdImageDestroy(src);
+    return gdNumFailures();
+}
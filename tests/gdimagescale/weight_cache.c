@@ -0,0 +1,80 @@
+/**
+ * The weight tables of the two pass scaling are cached; cached tables
+ * must give the same results as fresh ones, also after the arena which
+ * was bound when they were computed is gone, and flat areas must stay
+ * flat with every method.
+ */
+
+
+#include "gd.h"
+#include "gdtest.h"
+
+
+static gdImagePtr scale(gdImagePtr src)
+{
+    gdImagePtr dst = gdImageScale(src, 31, 77);
+
+    gdTestAssert(dst != NULL);
+    return dst;
+}
+
+int main()
+{
+    gdImagePtr src, first, again;
+    gdArenaPtr arena, old;
+    int method, x, y;
+
+    src = gdImageCreateTrueColor(60, 40);
+    for (y = 0; y < 40; y++) {
+        for (x = 0; x < 60; x++) {
+            gdImageSetPixel(src, x, y, gdTrueColorAlpha(x * 4, y * 6, (x * y) & 255, (x + y) & 127));
+        }
+    }
+    gdImageSetInterpolationMethod(src, GD_CATMULLROM);
+
+    /* computed while an arena is bound */
+    arena = gdArenaCreate(0);
+    old = gdArenaUse(arena);
+    first = scale(src);
+    gdImageDestroy(first);
+    gdArenaUse(old);
+    gdArenaDestroy(arena);
+
+    first = scale(src);
+    again = scale(src);
+    gdAssertImageEquals(first, again);
+    gdImageDestroy(again);
+
+    gdScaleCacheSetSize(0);
+    again = scale(src);
+    gdAssertImageEquals(first, again);
+    gdImageDestroy(again);
+    gdImageDestroy(first);
+    gdScaleCacheSetSize(16);
+
+    gdImageAlphaBlending(src, 0);
+    gdImageFilledRectangle(src, 0, 0, 59, 39, gdTrueColorAlpha(201, 7, 255, 60));
+    for (method = GD_BELL; method <= GD_TRIANGLE; method++) {
+        if (method == GD_BICUBIC || method == GD_BICUBIC_FIXED || method == GD_BILINEAR_FIXED
+                || method == GD_LINEAR || method == GD_NEAREST_NEIGHBOUR || method == GD_WEIGHTED4) {
+            continue;
+        }
+        gdImageSetInterpolationMethod(src, method);
+        first = scale(src);
+        for (y = 0; y < 77; y++) {
+            for (x = 0; x < 31; x++) {
+                if (gdImageGetPixel(first, x, y) != gdTrueColorAlpha(201, 7, 255, 60)) {
+                    gdTestErrorMsg("method %d: %x at %d,%d\n", method, gdImageGetPixel(first, x, y), x, y);
+                    gdTestAssert(0);
+                    x = 31;
+                    y = 77;
+                }
+            }
+        }
+        gdImageDestroy(first);
+    }
+
+    gdImageDestroy(src);
+    gdScaleCacheSetSize(0);
+    return gdNumFailures();
+}
@@ -0,0 +1,52 @@
+/**
+ * Scaling in both directions keeps only a window of the horizontally
+ * scaled rows; it must give what scaling horizontally, then vertically
+ * gives, for up- and downscaling and palette sources.
+ */
+
+
+#include "gd.h"
+#include "gdtest.h"
+
+
+static void check(gdImagePtr src, int width, int height)
+{
+    gdImagePtr both, tmp, twice;
+
+    both = gdImageScale(src, width, height);
+    tmp = gdImageScale(src, width, gdImageSY(src));
+    gdImageSetInterpolationMethod(tmp, gdImageGetInterpolationMethod(src));
+    twice = gdImageScale(tmp, width, height);
+    gdTestAssert(both != NULL && twice != NULL);
+    gdAssertImageEquals(twice, both);
+    gdImageDestroy(twice);
+    gdImageDestroy(tmp);
+    gdImageDestroy(both);
+}
+
+int main()
+{
+    gdImagePtr src, pal;
+    int x, y;
+
+    src = gdImageCreateTrueColor(90, 70);
+    for (y = 0; y < 70; y++) {
+        for (x = 0; x < 90; x++) {
+            gdImageSetPixel(src, x, y, gdTrueColorAlpha(x * 2, y * 3, (x * y) & 255, (x ^ y) & 127));
+        }
+    }
+    gdImageSetInterpolationMethod(src, GD_CATMULLROM);
+    check(src, 31, 9);
+    check(src, 143, 201);
+    check(src, 13, 150);
+    check(src, 1, 1);
+
+    pal = gdImageCreatePaletteFromTrueColor(src, 0, 100);
+    gdTestAssert(pal != NULL);
+    gdImageSetInterpolationMethod(pal, GD_HERMITE);
+    check(pal, 50, 23);
+
+    gdImageDestroy(pal);
+    gdImageDestroy(src);
+    return gdNumFailures();
+}
@@ -0,0 +1,66 @@
+/**
+ * Blending spans must give exactly the same results as the per pixel
+ * functions, for all combinations of alpha values.
+ */
+
+
+#include "gd.h"
+#include "gdtest.h"
+
+
+#define N 67 /* not a multiple of any vector width */
+
+static int randomColor(int alpha)
+{
+    return (alpha << 24) | (gdTestRandom() & 0xFFFFFF);
+}
+
+int main()
+{
+    static int src[N], dst[N];
+    gdImagePtr im;
+    int effect, sa, da, i, failed;
+
+    im = gdImageCreateTrueColor(N, 1);
+    for (effect = gdEffectReplace; effect <= gdEffectMultiply; effect++) {
+        gdImageAlphaBlending(im, effect);
+        failed = 0;
+        for (sa = 0; sa <= gdAlphaMax && !failed; sa++) {
+            for (da = 0; da <= gdAlphaMax && !failed; da++) {
+                for (i = 0; i < N; i++) {
+                    /* mix in some neighbouring alpha values */
+                    src[i] = randomColor(i % 7 ? sa : (sa + i) % (gdAlphaMax + 1));
+                    dst[i] = randomColor(i % 5 ? da : (da + i) % (gdAlphaMax + 1));
+                }
+                gdImagePutSpan(im, 0, 0, N, dst);
+                gdImageBlendSpan(im, 0, 0, N, src);
+                for (i = 0; i < N; i++) {
+                    int expected;
+                    switch (effect) {
+                    case gdEffectOverlay:
+                        expected = gdLayerOverlay(dst[i], src[i]);
+                        break;
+                    case gdEffectMultiply:
+                        expected = gdLayerMultiply(dst[i], src[i]);
+                        break;
+                    case gdEffectReplace:
+                        expected = src[i];
+                        break;
+                    default:
+                        expected = gdAlphaBlend(dst[i], src[i]);
+                        break;
+                    }
+                    if (im->tpixels[0][i] != expected) {
+                        gdTestErrorMsg("effect %d: %08x onto %08x gives %08x, expected %08x\n",
+                                       effect, src[i], dst[i], im->tpixels[0][i], expected);
+                        failed = 1;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    gdImageDestroy(im);
+
+    return gdNumFailures();
+}
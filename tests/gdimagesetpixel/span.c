@@ -0,0 +1,88 @@
+/**
+ * The span functions must give the same results as their per pixel
+ * counterparts, and clip the same way.
+ */
+
+
+#include "gd.h"
+#include "gdtest.h"
+
+
+#define W 37
+
+static int effects[] = {
+    gdEffectReplace, gdEffectAlphaBlend, gdEffectNormal,
+    gdEffectOverlay, gdEffectMultiply
+};
+
+int main()
+{
+    gdImagePtr a, b, pal;
+    int src[W + 10], row[W + 10];
+    int e, i, n;
+
+    for (i = 0; i < W + 10; i++) {
+        src[i] = gdTestRandom();
+    }
+
+    for (e = 0; e < (int) (sizeof(effects) / sizeof(effects[0])); e++) {
+        a = gdImageCreateTrueColor(W, 4);
+        b = gdImageCreateTrueColor(W, 4);
+        gdImageFilledRectangle(a, 0, 0, W - 1, 3, 0x40805060);
+        gdImageFilledRectangle(b, 0, 0, W - 1, 3, 0x40805060);
+        gdImageAlphaBlending(a, effects[e]);
+        gdImageAlphaBlending(b, effects[e]);
+
+        /* starts left of the image and ends right of it */
+        n = gdImageBlendSpan(a, -5, 2, W + 10, src);
+        gdTestAssert(n == W);
+        for (i = 0; i < W + 10; i++) {
+            gdImageSetPixel(b, i - 5, 2, src[i]);
+        }
+        gdTestAssert(gdAssertImageEquals(a, b));
+        gdImageDestroy(a);
+        gdImageDestroy(b);
+    }
+
+    /* put, get and clipping */
+    a = gdImageCreateTrueColor(W, 4);
+    gdImageSetClip(a, 2, 0, 9, 3);
+    n = gdImagePutSpan(a, 0, 1, W, src);
+    gdTestAssert(n == 8);
+    gdTestAssert(gdImageGetPixel(a, 1, 1) == 0);
+    gdTestAssert(gdImageGetPixel(a, 10, 1) == 0);
+    gdImageSetClip(a, 0, 0, W - 1, 3);
+    for (i = 0; i < W + 10; i++) {
+        row[i] = -1;
+    }
+    n = gdImageGetSpan(a, -3, 1, W + 10, row);
+    gdTestAssert(n == W);
+    gdTestAssert(row[0] == -1 && row[2] == -1);
+    gdTestAssert(row[3 + 1] == 0);
+    for (i = 2; i <= 9; i++) {
+        gdTestAssert(row[3 + i] == src[i]);
+    }
+    gdTestAssert(row[W + 3] == -1);
+    gdTestAssert(gdImagePutSpan(a, 0, 4, W, src) == 0);
+    gdTestAssert(gdImageGetSpan(a, W, 0, 5, row) == 0);
+    gdImageDestroy(a);
+
+    /* palette images */
+    pal = gdImageCreate(W, 2);
+    gdImageColorAllocate(pal, 0, 0, 0);
+    for (i = 0; i < W; i++) {
+        row[i] = i < 20 ? 0x00ff0000 : 0x000000ff;
+    }
+    n = gdImageBlendSpan(pal, 0, 1, W, row);
+    gdTestAssert(n == W);
+    gdTestAssert(pal->colorsTotal == 3);
+    gdImageGetTrueColorSpan(pal, 0, 1, W, src);
+    for (i = 0; i < W; i++) {
+        gdTestAssert(src[i] == row[i]);
+    }
+    gdImageGetSpan(pal, 18, 1, 4, src);
+    gdTestAssert(src[0] == 1 && src[1] == 1 && src[2] == 2 && src[3] == 2);
+    gdImageDestroy(pal);
+
+    return gdNumFailures();
+}
@@ -0,0 +1,90 @@
+/**
+ * Scaling, rotating and transforming split the rows of the result
+ * between threads if asked to; the results must be the same as with one
+ * thread, for the global and the per image setting.
+ */
+
+
+#include "gd.h"
+#include "gdtest.h"
+
+
+typedef gdImagePtr (*op)(gdImagePtr src);
+
+static gdImagePtr scale(gdImagePtr src)
+{
+    return gdImageScale(src, 157, 61);
+}
+
+static gdImagePtr rotate(gdImagePtr src)
+{
+    return gdImageRotateInterpolated(src, 33.0f, 0x7F000000);
+}
+
+static gdImagePtr transform(gdImagePtr src)
+{
+    gdImagePtr dst = gdImageCreateTrueColor(120, 120);
+    gdRect area = {0, 0, 0, 0};
+    double affine[6];
+
+    area.width = src->sx;
+    area.height = src->sy;
+    gdAffineRotate(affine, 20.0);
+    gdImageAlphaBlending(dst, 0);
+    gdTransformAffineCopy(dst, 5, 0, src, &area, affine);
+    return dst;
+}
+
+static void check(gdImagePtr src, op fn)
+{
+    gdImagePtr single, multi;
+
+    gdSetThreadCount(1);
+    gdImageSetThreadCount(src, 0);
+    single = fn(src);
+    gdTestAssert(single != NULL);
+
+    gdSetThreadCount(4);
+    multi = fn(src);
+    gdAssertImageEquals(single, multi);
+    gdImageDestroy(multi);
+
+    gdSetThreadCount(1);
+    gdImageSetThreadCount(src, 7);
+    multi = fn(src);
+    gdAssertImageEquals(single, multi);
+    gdImageDestroy(multi);
+
+    gdImageDestroy(single);
+}
+
+int main()
+{
+    gdImagePtr tc, pal;
+    int x, y;
+
+    tc = gdImageCreateTrueColor(97, 83);
+    for (y = 0; y < 83; y++) {
+        for (x = 0; x < 97; x++) {
+            gdImageSetPixel(tc, x, y, gdTrueColorAlpha(x * 2, y * 3, (x * y) & 255, (x + y) & 127));
+        }
+    }
+    pal = gdImageCreatePaletteFromTrueColor(tc, 0, 64);
+    gdTestAssert(pal != NULL);
+
+    gdImageSetInterpolationMethod(tc, GD_CATMULLROM);
+    gdImageSetInterpolationMethod(pal, GD_MITCHELL);
+    check(tc, scale);
+    check(pal, scale);
+    check(tc, rotate);
+    check(tc, transform);
+
+    gdSetThreadCount(100);
+    gdTestAssert(gdGetThreadCount() == 64);
+    gdSetThreadCount(1);
+    gdTestAssert(gdGetThreadCount() == 1);
+
+    gdImageDestroy(pal);
+    gdImageDestroy(tc);
+    return gdNumFailures();
+}
@@ -510,6 +510,25 @@ unsigned int gdMaxPixelDiff(gdImagePtr a, gdImagePtr b)
     return diff;
 }
 
+static unsigned int randomSeed = 1;
+
+/* a linear congruential generator, of which only the high bits are used */
+static unsigned int gdTestRandomNext(void)
+{
+	randomSeed = randomSeed * 1103515245 + 12345;
+	return randomSeed;
+}
+
+int gdTestRandom(void)
+{
+	return (int) ((gdTestRandomNext() >> 1) & 0x7fffffff);
+}
+
+int gdTestRandomInt(int n)
+{
+	return (int) ((gdTestRandomNext() >> 8) % (unsigned int) n);
+}
+
 int gdTestImageCompareToImage(const char* file, unsigned int line, const char* message,
                               gdImagePtr expected, gdImagePtr actual)
 {
@@ -54,6 +54,12 @@ int gdTestImageCompareToFile(const char* file, unsigned int line, const char* me
 
 unsigned int gdMaxPixelDiff(gdImagePtr a, gdImagePtr b);
 
+/* Pseudo random numbers, the same sequence in every run of a test:
+   gdTestRandom() returns the next one, from 0 to 0x7fffffff, and
+   gdTestRandomInt() the next one from 0 to n - 1. */
+int gdTestRandom(void);
+int gdTestRandomInt(int n);
+
 int _gdTestAssert(const char* file, unsigned int line, int condition);
 
 int _gdTestAssertMsg(const char* file, unsigned int line, int condition, const char* message, ...);
@@ -0,0 +1,54 @@
+/**
+ * Decoding into pooled or existing images gives the same result as
+ * decoding into a new image.
+ */
+
+
+#include "gd.h"
+#include "gdtest.h"
+
+
+int main()
+{
+	gdImagePoolPtr pool;
+	gdImagePtr src, expected, im;
+	gdIOCtxPtr ctx;
+	void *data;
+	int size;
+
+	src = gdImageCreateTrueColor(64, 48);
+	gdImageFilledRectangle(src, 0, 0, 63, 47, 0x204080);
+	gdImageFilledEllipse(src, 32, 24, 40, 30, 0xf0c010);
+	data = gdImageJpegPtr(src, &size, 90);
+	gdImageDestroy(src);
+	expected = gdImageCreateFromJpegPtr(size, data);
+	gdTestAssert(expected != NULL);
+
+	pool = gdImagePoolCreate(1);
+	gdImagePoolPut(pool, gdImagePoolGet(pool, 64, 48, 1));
+	ctx = gdNewDynamicCtxEx(size, data, 0);
+	im = gdImageCreateFromJpegCtxPool(ctx, pool, 1);
+	ctx->gd_free(ctx);
+	gdTestAssert(im != NULL);
+	gdTestAssert(gdAssertImageEquals(expected, im));
+
+	ctx = gdNewDynamicCtxEx(size, data, 0);
+	gdImageFilledRectangle(im, 0, 0, 10, 10, 0);
+	gdTestAssert(gdImageCreateFromJpegCtxInto(ctx, im, 1) == im);
+	ctx->gd_free(ctx);
+	gdTestAssert(gdAssertImageEquals(expected, im));
+	gdImagePoolPut(pool, im);
+
+	/* palette images can't hold a JPEG */
+	im = gdImageCreate(64, 48);
+	ctx = gdNewDynamicCtxEx(size, data, 0);
+	gdTestAssert(gdImageCreateFromJpegCtxInto(ctx, im, 1) == NULL);
+	ctx->gd_free(ctx);
+	gdImageDestroy(im);
+
+	gdImagePoolDestroy(pool);
+	gdImageDestroy(expected);
+	gdFree(data);
+
+	return gdNumFailures();
+}
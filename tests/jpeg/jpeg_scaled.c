@@ -0,0 +1,80 @@
+/**
+ * Decoding a JPEG at a requested size reduces it while decoding and
+ * scales it the rest of the way; the result has the requested size and
+ * looks like decoding and scaling the whole image. A missing width or
+ * height keeps the aspect ratio.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "gd.h"
+#include "gdtest.h"
+
+
+static gdImagePtr decode(void *data, int size, int width, int height)
+{
+	gdImagePtr im = gdImageCreateFromJpegPtrScaled(size, data, width, height);
+
+	gdTestAssert(im != NULL);
+	return im;
+}
+
+int main()
+{
+	gdImagePtr src, full, im, expected;
+	void *data;
+	char *file;
+	FILE *fp;
+	int size, x, y;
+
+	src = gdImageCreateTrueColor(400, 300);
+	for (y = 0; y < 300; y++) {
+		for (x = 0; x < 400; x++) {
+			gdImageSetPixel(src, x, y, gdTrueColor(x * 255 / 399, y * 255 / 299, 128));
+		}
+	}
+	data = gdImageJpegPtr(src, &size, 95);
+	gdImageDestroy(src);
+	gdTestAssert(data != NULL);
+	full = gdImageCreateFromJpegPtr(size, data);
+	gdTestAssert(full != NULL);
+
+	/* reduced by 1/2 while decoding, close to scaling the full image */
+	im = decode(data, size, 150, 0);
+	gdTestAssert(gdImageSX(im) == 150 && gdImageSY(im) == 113);
+	gdImageSetInterpolationMethod(full, GD_TRIANGLE);
+	expected = gdImageScale(full, 150, 113);
+	gdTestAssert(gdMaxPixelDiff(expected, im) <= 8);
+	gdImageDestroy(expected);
+	gdImageDestroy(im);
+
+	/* exactly 1/8 */
+	im = decode(data, size, 50, 0);
+	gdTestAssert(gdImageSX(im) == 50 && gdImageSY(im) == 38);
+	gdTestAssert(gdImageGetInterpolationMethod(im) == GD_BILINEAR_FIXED);
+	gdImageDestroy(im);
+
+	/* enlarged, and at the original size */
+	im = decode(data, size, 800, 600);
+	gdTestAssert(gdImageSX(im) == 800 && gdImageSY(im) == 600);
+	gdImageDestroy(im);
+	im = decode(data, size, 0, 0);
+	gdAssertImageEquals(full, im);
+	gdImageDestroy(im);
+
+	file = gdTestTempFile("jpeg_scaled.jpg");
+	fp = fopen(file, "wb");
+	gdTestAssert(fp != NULL);
+	fwrite(data, 1, size, fp);
+	fclose(fp);
+	im = gdImageCreateFromFileScaled(file, 40, 30);
+	gdTestAssert(im != NULL && gdImageSX(im) == 40 && gdImageSY(im) == 30);
+	gdImageDestroy(im);
+	remove(file);
+	free(file);
+
+	gdImageDestroy(full);
+	gdFree(data);
+	return gdNumFailures();
+}
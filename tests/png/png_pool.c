@@ -0,0 +1,76 @@
+/**
+ * Decoding into pooled or existing images gives the same result as
+ * decoding into a new image, for interlaced images as well.
+ */
+
+
+#include "gd.h"
+#include "gdtest.h"
+
+
+static void check(gdImagePtr src, int trueColor)
+{
+	gdImagePoolPtr pool;
+	gdImagePtr expected, im, other;
+	gdIOCtxPtr ctx;
+	void *data;
+	int size;
+
+	data = gdImagePngPtr(src, &size);
+	expected = gdImageCreateFromPngPtr(size, data);
+	gdTestAssert(expected != NULL && gdImageTrueColor(expected) == trueColor);
+
+	pool = gdImagePoolCreate(1);
+	gdImagePoolPut(pool, gdImagePoolGet(pool, gdImageSX(src), gdImageSY(src), trueColor));
+	ctx = gdNewDynamicCtxEx(size, data, 0);
+	im = gdImageCreateFromPngCtxPool(ctx, pool);
+	ctx->gd_free(ctx);
+	gdTestAssert(im != NULL);
+	gdTestAssert(gdAssertImageEquals(expected, im));
+	gdTestAssert(im->interlace == expected->interlace);
+
+	/* into an image of the right kind */
+	ctx = gdNewDynamicCtxEx(size, data, 0);
+	gdImageFilledRectangle(im, 0, 0, 10, 10, 1);
+	gdTestAssert(gdImageCreateFromPngCtxInto(ctx, im) == im);
+	ctx->gd_free(ctx);
+	gdTestAssert(gdAssertImageEquals(expected, im));
+	gdImagePoolPut(pool, im);
+
+	/* and the wrong one */
+	other = gdImageCreateTrueColor(gdImageSX(src) + 1, gdImageSY(src));
+	ctx = gdNewDynamicCtxEx(size, data, 0);
+	gdTestAssert(gdImageCreateFromPngCtxInto(ctx, other) == NULL);
+	ctx->gd_free(ctx);
+	gdImageDestroy(other);
+
+	gdImagePoolDestroy(pool);
+	gdImageDestroy(expected);
+	gdFree(data);
+}
+
+int main()
+{
+	gdImagePtr src;
+
+	src = gdImageCreateTrueColor(60, 40);
+	gdImageSaveAlpha(src, 1);
+	gdImageAlphaBlending(src, 0);
+	gdImageFilledRectangle(src, 0, 0, 59, 39, gdTrueColorAlpha(10, 200, 30, 40));
+	gdImageFilledEllipse(src, 30, 20, 40, 30, gdTrueColorAlpha(250, 0, 90, 0));
+	check(src, 1);
+	gdImageInterlace(src, 1);
+	check(src, 1);
+	gdImageDestroy(src);
+
+	src = gdImageCreate(33, 17);
+	gdImageColorAllocate(src, 255, 255, 255);
+	gdImageColorAllocate(src, 0, 0, 255);
+	gdImageLine(src, 0, 0, 32, 16, 1);
+	check(src, 0);
+	gdImageInterlace(src, 1);
+	check(src, 0);
+	gdImageDestroy(src);
+
+	return gdNumFailures();
+}